@@ -5,6 +5,8 @@
 #include <GLFW/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <sstream> 
@@ -16,10 +18,22 @@
 //Local files
 #include "Timer.h"
 #include "Model.h"
+#include "ModelLibrary.h"
+#include "AssetLoader.h"
+#include "SceneGraph.h"
+#include "RenderQueue.h"
 #include "Camera.h"
 #include "SkinnedMesh.h"
+#include "AnimationScheduler.h"
 #include "ShaderLoader.h"
+#include "GLState.h"
 #include "TextureLoader.h"
+#include "TextureCache.h"
+#include "TextureCooker.h"
+#include "AllocationCounter.h"
+#include "FrameTimeHistogram.h"
+#include "UploadManager.h"
+#include "VirtualTexture.h"
 
 //namespaces
 using std::string;
@@ -5,7 +5,8 @@ in vec3 Normal;
 in vec3 Vertex; 
 in mat3 TBN;
 
-//Texture sampler
+//Texture sampler - diffuse maps are sRGB textures, so they sample as linear colour and every term below is
+//lighting in linear space.  The framebuffer is sRGB too, encoding FragColour on the way out
 uniform sampler2D texture_diffuse1;
 
 //Camera location
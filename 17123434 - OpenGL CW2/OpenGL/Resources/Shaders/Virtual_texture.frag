@@ -0,0 +1,56 @@
+#version 330 core
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+// Virtual texture - see VirtualTexture.h
+uniform sampler2D	tileCache;
+uniform sampler2D	pageTable;
+uniform vec4		virtualSize;	// width, height, levels, tile size
+uniform vec4		cacheLayout;	// padded tile size, border, 1 / cache width, 1 / cache height
+uniform float		lodBias;
+
+// Directional light, as the basic shader
+uniform vec4		lightDirection;
+uniform vec4		lightDiffuseColour;
+
+out vec4 FragColour;
+
+// the level TileFeedback::mipLevel() picks
+int virtualLevel(vec2 uv)
+{
+	vec2 dx = dFdx(uv * virtualSize.xy);
+	vec2 dy = dFdy(uv * virtualSize.xy);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + lodBias;
+	return clamp(int(floor(lod)), 0, int(virtualSize.z) - 1);
+}
+
+vec4 sampleVirtual(vec2 uv)
+{
+	// level first, from the unclamped coordinates, so the derivatives aren't flattened at the edges
+	int level = virtualLevel(uv);
+	uv = clamp(uv, vec2(0.0), vec2(1.0) - 0.5 / virtualSize.xy);
+
+	ivec2 tiles = max(ivec2(virtualSize.xy / virtualSize.w) >> level, ivec2(1));
+	vec4 entry = floor(texelFetch(pageTable, ivec2(uv * vec2(tiles)), level) * 255.0 + 0.5);
+
+	// nothing resident yet: grey, in linear light like the tiles it stands in for
+	if (entry.a == 0.0)
+		return vec4(0.5, 0.5, 0.5, 1.0);
+
+	// the resident tile may be an ancestor, so the position within it is worked out at its level
+	vec2 texel = uv * virtualSize.xy / exp2(entry.b);
+	vec2 inTile = texel - floor(texel / virtualSize.w) * virtualSize.w;
+	vec2 cacheTexel = entry.rg * cacheLayout.x + cacheLayout.y + inTile;
+
+	return textureLod(tileCache, cacheTexel * cacheLayout.zw, 0.0);
+}
+
+void main()
+{
+	float li = clamp(dot(normalize(lightDirection.xyz), normalize(Normal)), 0.0, 1.0);
+
+	// some ambient, so the side facing away from the light isn't black
+	FragColour = sampleVirtual(TexCoord) * (0.3 + 0.7 * li * lightDiffuseColour);
+	FragColour.a = 1.0;
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+// Shared by Virtual_texture.frag and Virtual_texture_feedback.frag
+layout (location = 0) in vec3 vertexPos;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texCoord;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 TexCoord;
+out vec3 Normal;
+
+void main()
+{
+	TexCoord = texCoord;
+	Normal = mat3(transpose(inverse(model))) * normal;
+
+	gl_Position = projection * view * model * vec4(vertexPos, 1.0f);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+in vec2 TexCoord;
+
+// Virtual texture - see VirtualTexture.h.  Only the size and bias are used here
+uniform vec4		virtualSize;	// width, height, levels, tile size
+uniform float		lodBias;
+
+out vec4 FragColour;
+
+// the level TileFeedback::mipLevel() picks
+int virtualLevel(vec2 uv)
+{
+	vec2 dx = dFdx(uv * virtualSize.xy);
+	vec2 dy = dFdy(uv * virtualSize.xy);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + lodBias;
+	return clamp(int(floor(lod)), 0, int(virtualSize.z) - 1);
+}
+
+// writes the tile the main pass will sample, encoded as TileFeedback::encode()
+void main()
+{
+	int level = virtualLevel(TexCoord);
+	vec2 uv = clamp(TexCoord, vec2(0.0), vec2(1.0) - 0.5 / virtualSize.xy);
+
+	ivec2 tiles = max(ivec2(virtualSize.xy / virtualSize.w) >> level, ivec2(1));
+	ivec2 tile = min(ivec2(uv * vec2(tiles)), tiles - 1);
+
+	FragColour = vec4(float(tile.x & 255), float(tile.y & 255), float(((tile.x >> 8) & 15) | (((tile.y >> 8) & 15) << 4)), float(level + 1)) / 255.0;
+}
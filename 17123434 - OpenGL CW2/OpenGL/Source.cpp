@@ -28,6 +28,7 @@ struct Light {
 	glm::vec4 position;
 	glm::vec4 colour;
 
+	// amb and col are linear light, the space the shaders light in
 	Light(glm::vec4 amb, glm::vec4 pos, glm::vec4 col) : ambient(amb), position(pos), colour(col) {}
 };
 
@@ -55,52 +56,187 @@ glm::vec4 dark_blue(0.0, 0.0, 0.7, 1.0);
 #pragma endregion
 
 #pragma region Material Related Stuff
-enum Materials { WOOD, BRASS, GRASS, LEATHER, NONE };
+enum Materials { WOOD, BRASS, GRASS, LEATHER, NONE, NUM_MATERIALS };
+
+struct MaterialData
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	float exponent;
+};
+
+// Material values, indexed by Materials, in linear light.  The instanced shader gets the whole table and each instance
+// picks its entry
+const MaterialData materialTable[NUM_MATERIALS] = {
+	{ glm::vec4(0.32, 0.22, 0.07, 1.0), glm::vec4(1.0, 1.0, 1.0, 1.0), glm::vec4(0.7, 0.6, 0.6, 1.0), 2.0f },							// WOOD
+	{ glm::vec4(0.32, 0.22, 0.07, 1.0), glm::vec4(0.78, 0.36, 0.22, 1.0), glm::vec4(0.992157, 0.941176, 0.507043, 1.0), 120.89743616f },	// BRASS
+	{ glm::vec4(0.1, 0.1, 0.1, 1.0), glm::vec4(1.0, 1.0, 1.0, 1.0), glm::vec4(0.1, 0.1, 0.1, 1.0), 1.0f },								// GRASS
+	{ glm::vec4(0.1, 0.1, 0.1, 1.0), glm::vec4(1.0, 1.0, 1.0, 1.0), glm::vec4(0.1, 0.1, 0.1, 1.0), 50.0f },								// LEATHER
+	{ glm::vec4(1.0, 1.0, 1.0, 1.0), glm::vec4(1.0, 0.0, 0.0, 1.0), glm::vec4(1.0, 1.0, 1.0, 1.0), 1.0f }								// NONE
+};
 
 struct MaterialUniforms
 {
-	GLuint ambient;
-	GLuint diffuse;
-	GLuint specular;
-	GLuint exponent;
+	UniformID ambient;
+	UniformID diffuse;
+	UniformID specular;
+	UniformID exponent;
 };
 
 MaterialUniforms matU;
+MaterialUniforms instancedMatU;
+
+void useMaterial(Materials, ShaderProgram&, const MaterialUniforms&);
+void useMaterialTable(ShaderProgram&, const MaterialUniforms&);
+
+// Camera and lighting uniforms set on every shader that draws the scene
+struct SceneUniforms
+{
+	UniformID lightAmbArr;
+	UniformID lightPosArr;
+	UniformID lightColArr;
+	UniformID lightAttenuation;
+	UniformID eyePos;
+	UniformID view;
+	UniformID projection;
+	UniformID lightDirection;
+	UniformID lightDiffuse;
+};
 
-void useMaterial(Materials, MaterialUniforms);
+SceneUniforms findSceneUniforms(const ShaderProgram&);
 #pragma endregion
 
 #pragma region Model Functions
 
-// Default variables for easy access
-glm::mat4 defaultTranslate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.0, 0.0f));
-glm::mat4 defaultRotate = glm::rotate(glm::mat4(1.0f), glm::radians(0.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-glm::mat4 defaultScale = glm::scale(glm::mat4(1.0f), glm::vec3(1.0, 1.0, 1.0f));
+// Every model is loaded once into the library and shared by the objects that reference it.
+ModelLibrary models;
+
+// Transform hierarchy for everything in the scene.  World matrices are cached and only rebuilt when a node moves.
+SceneGraph scene;
+
+// Model matrix uniform, looked up once after the shader is built
+UniformID modelU = ShaderProgram::NO_UNIFORM;
 
 // This struct holds information about the model to be rendered.
 // Use this to render an object instead of rendering it directly from the model.
+// The model is referenced through a handle and the transform through a scene node, so objects are cheap to copy.
 struct Object {
-	Model model;
+	ModelHandle model;
 	Materials material;
-	glm::mat4 translation;
-	glm::mat4 rotation;
-	glm::mat4 scale;
+	SceneNode node;
+
+	Object(ModelHandle m, Materials mat, SceneNode n) :
+		model(m), material(mat), node(n) {}
+
+	// Queue a draw packet for each of the model's meshes, keyed by its distance from the eye
+	void Submit(RenderQueue& queue, ShaderProgram& shader, const glm::vec3& eyePos) const {
+		const glm::mat4& world = scene.worldTransform(node);
+		float depth = glm::length(glm::vec3(world[3]) - eyePos) / (float)camera_settings.farPlane;
+
+		const Model& m = models.get(model);
+		for (unsigned int i = 0; i < m.meshes.size(); i++)
+			queue.submit(&shader, material, m.meshes[i], world, depth);
+	}
+};
+
+// Copies of one model drawn with a single instanced draw per mesh.  The instance data is rebuilt from the
+// scene graph every frame, so instances can move like any other object.
+struct InstancedObjects {
+	ModelHandle model;
+	vector<SceneNode> nodes;
+	vector<Materials> materials;
+	vector<InstanceData> instances;	// staging copy, sized once in add()
+	InstanceBuffer buffer;
+
+	explicit InstancedObjects(ModelHandle m) : model(m) {}
+
+	void add(Materials material, SceneNode node) {
+		nodes.push_back(node);
+		materials.push_back(material);
+		instances.resize(nodes.size());
+	}
 
-	Object(Model m, Materials mat, glm::mat4 t = defaultTranslate, glm::mat4 r = defaultRotate, glm::mat4 s = defaultScale) :
-		model(m), material(mat), translation(t), rotation(r), scale(s) {}
+	void Render(ShaderProgram& shader) {
+		for (size_t i = 0; i < nodes.size(); i++) {
+			instances[i].transform = scene.worldTransform(nodes[i]);
+			instances[i].material = materials[i];
+		}
+
+		buffer.upload(instances.data(), (unsigned int)instances.size());
+		models.get(model).drawInstanced(shader, buffer);
+	}
+};
+
+// A flat square of ground around the stadium, drawn with the virtual texture given by --virtual-texture.  Its texture
+// coordinates run 0 to 1 across the whole square, so one huge image covers it without repeating
+struct Terrain {
+	GLuint vertexArray = 0;
+	GLuint vertexBuffer = 0;
+
+	// halfSize either side of the origin at height y, facing up
+	void create(float halfSize, float y) {
+		// position, normal, texture coordinates, as a triangle strip
+		const GLfloat vertices[] = {
+			-halfSize, y, halfSize,		0.0f, 1.0f, 0.0f,	0.0f, 0.0f,
+			halfSize, y, halfSize,		0.0f, 1.0f, 0.0f,	1.0f, 0.0f,
+			-halfSize, y, -halfSize,	0.0f, 1.0f, 0.0f,	0.0f, 1.0f,
+			halfSize, y, -halfSize,		0.0f, 1.0f, 0.0f,	1.0f, 1.0f
+		};
+
+		glGenVertexArrays(1, &vertexArray);
+		GLState::bindVertexArray(vertexArray);
+		glGenBuffers(1, &vertexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void*)(3 * sizeof(GLfloat)));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void*)(6 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void draw() const {
+		GLState::bindVertexArray(vertexArray);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
 
-	// New translation, rotation and scale are passed as paramaters for hierarchical purposes.
-	void Render(GLuint shader, glm::mat4 t = defaultTranslate, glm::mat4 r = defaultRotate, glm::mat4 s = defaultScale) {
-		glm::mat4 myModelMat = translation * rotation * scale * t * r * s;
-		useMaterial(material, matU);
-		glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(myModelMat));
-		model.draw(shader); //Draw the plane
+	void release() {
+		GLState::forgetVertexArray(vertexArray);
+		glDeleteVertexArrays(1, &vertexArray);
+		glDeleteBuffers(1, &vertexBuffer);
+		vertexArray = vertexBuffer = 0;
 	}
 };
 
+// Draws render queue packets, setting the CW2 material uniforms when the material changes
+class SceneBackend : public GLRenderBackend {
+public:
+	void setMaterial(const DrawPacket& packet) override {
+		useMaterial((Materials)packet.material, *packet.program, matU);
+	}
+};
+
+// Objects are queued each frame and drawn sorted by program, material, textures and VAO to minimise state changes
+RenderQueue renderQueue;
+SceneBackend sceneBackend;
+
 // Function Prototypes
-void RenderObject(Object object, GLuint shader, glm::mat4 t = defaultTranslate, glm::mat4 r = defaultRotate, glm::mat4 s = defaultScale);
-void RenderObject(Object objects[], int numOfItems, GLuint shader, glm::mat4 t = defaultTranslate, glm::mat4 r = defaultRotate, glm::mat4 s = defaultScale);
+void SubmitObject(const Object& object, ShaderProgram& shader, const glm::vec3& eyePos);
+void SubmitObject(const Object objects[], int numOfItems, ShaderProgram& shader, const glm::vec3& eyePos);
+void benchmarkModelDraw(const char *name, const Model& model, ShaderProgram& shader, int iterations);
+int benchmarkDraw();
+int checkRenderQueue();
+int benchmarkTextureDecode();
+int benchmarkAnimation(int argc, char *argv[]);
+int reportAnimationCompression(int argc, char *argv[]);
+void benchmarkAnimationBlending(const Skeleton& skeleton, const vector<AnimationClip>& clips, const vector<AnimationClip>& borrowedClips);
+int cookTextures();
+int checkCubeMaps();
+int checkVirtualTexture();
+int checkAnimation();
 
 #pragma endregion
 
@@ -124,14 +260,79 @@ float lightPosX = 0.0;
 float lightPosZ = -6.5;
 #pragma endregion
 
-int main()
+int main(int argc, char *argv[])
 {
+	// Run that times the CPU cost of submitting the stadium models, through the raw program and through the ShaderProgram
+	// binding tables, in a hidden window
+	if (argc > 1 && string(argv[1]) == "--benchmark-draw")
+		return benchmarkDraw();
+
+	// Headless check that a sorted render queue makes the fewest state changes, recorded by a mock backend
+	if (argc > 1 && string(argv[1]) == "--check-render-queue")
+		return checkRenderQueue();
+
+	// Headless run that times decoding the bundled textures, without creating a window
+	if (argc > 1 && string(argv[1]) == "--benchmark-textures")
+		return benchmarkTextureDecode();
+
+	// Headless run that times sampling and compressing the skinned models' animations: --benchmark-animation
+	// [model ...], by default the wave character
+	if (argc > 1 && string(argv[1]) == "--benchmark-animation")
+		return benchmarkAnimation(argc - 2, argv + 2);
+
+	// Headless run that compresses the skinned models' animations as SkinnedMesh does and reports their sizes and errors:
+	// --report-animation-compression [model ...], by default the wave characters
+	if (argc > 1 && string(argv[1]) == "--report-animation-compression")
+		return reportAnimationCompression(argc - 2, argv + 2);
+
+	// Headless run that block compresses the bundled textures into .dds files ahead of time and reports their quality.
+	// Fails if any texture comes out below its format's quality floor
+	if (argc > 1 && string(argv[1]) == "--cook-textures")
+		return cookTextures();
+
+	// Headless check of the cube map decoders on generated images.  Run it from a build with AddressSanitizer to check
+	// those paths for leaks and overruns
+	if (argc > 1 && string(argv[1]) == "--check-cube-maps")
+		return checkCubeMaps();
+
+	// Headless check of virtual texture tile selection, eviction and the page table, on made up feedback
+	if (argc > 1 && string(argv[1]) == "--check-virtual-texture")
+		return checkVirtualTexture();
+
+	// Headless check of baked animation clips against the aiScene's own keys, on a skeleton and animations built in code
+	if (argc > 1 && string(argv[1]) == "--check-animation")
+		return checkAnimation();
+
+	// --blocking-uploads copies each model to the GPU in one go as it's installed, for comparing frame times with the
+	// streamed uploads
+	bool blockingUploads = false;
+	for (int i = 1; i < argc; i++)
+		if (string(argv[i]) == "--blocking-uploads")
+			blockingUploads = true;
+
+	// --blocking-load waits for every model to be imported and installed before the first frame, as loading did before
+	// it moved to worker threads, for comparing the startup times printed with those of the asynchronous load.  Compare
+	// second runs, once the models have been cooked
+	bool blockingLoad = false;
+	for (int i = 1; i < argc; i++)
+		if (string(argv[i]) == "--blocking-load")
+			blockingLoad = true;
+
+	// --virtual-texture <image> lays the image over the ground around the stadium as a virtual texture, so only the
+	// tiles in view are kept in video memory.  The image's sides must be powers of two.  It's cooked into tiles on
+	// first use, which for a very large image takes a while
+	string virtualTexturePath;
+	for (int i = 1; i + 1 < argc; i++)
+		if (string(argv[i]) == "--virtual-texture")
+			virtualTexturePath = argv[i + 1];
+
 	// glfw: initialize and configure
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
 
 	// glfw window creation
@@ -164,11 +365,12 @@ int main()
 	glfwSwapInterval(1);		// glfw enable swap interval to match screen v-sync
 	glEnable(GL_DEPTH_TEST);	//Enables depth testing
 	glEnable(GL_CULL_FACE);		//Enables face culling
+	glEnable(GL_FRAMEBUFFER_SRGB);	//Shaders work in linear light; writes to the window are encoded as sRGB
 	glFrontFace(GL_CCW);		//Specifies which winding order if front facing
 
 	// ======================================= SHADER =======================================
 
-	GLuint basicShader;
+	ShaderProgram basicShader;
 
 	// build and compile our shader program
 	GLSL_ERROR glsl_err = ShaderLoader::createShaderProgram(
@@ -176,45 +378,110 @@ int main()
 		string("Resources\\Shaders\\Basic_shader.frag"),
 		&basicShader);
 
+	// same lighting as the basic shader, but the model matrix and material come from instance attributes
+	ShaderProgram instancedShader;
+
+	glsl_err = ShaderLoader::createShaderProgram(
+		string("Resources\\Shaders\\Basic_shader_instanced.vert"),
+		string("Resources\\Shaders\\Basic_shader_instanced.frag"),
+		&instancedShader);
+
+	// the ground's virtual texture is sampled through its page table, and the feedback pass writes the tiles it needs
+	ShaderProgram virtualTextureShader, virtualFeedbackShader;
+
+	if (!virtualTexturePath.empty()) {
+		glsl_err = ShaderLoader::createShaderProgram(
+			string("Resources\\Shaders\\Virtual_texture.vert"),
+			string("Resources\\Shaders\\Virtual_texture.frag"),
+			&virtualTextureShader);
+
+		glsl_err = ShaderLoader::createShaderProgram(
+			string("Resources\\Shaders\\Virtual_texture.vert"),
+			string("Resources\\Shaders\\Virtual_texture_feedback.frag"),
+			&virtualFeedbackShader);
+	}
+
 	// ======================================= OBJECTS =======================================
 
-	Model turf("Resources\\Models\\Turf\\turfWithMat.obj");												// Load the model
-	glm::mat4 turfScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(5, 5, 5));							// Set up translation/rotation/scale
-	Object turfObj(turf, GRASS, defaultTranslate, defaultRotate, turfScaleMat);							// Initialize the object
+	// Static objects get a single node holding their full placement.  Moving objects get a child node
+	// whose local transform is updated every frame - only those nodes are recomputed by scene.update().
+
+	// Models are imported on worker threads and uploaded a few per frame, so the scene starts rendering straight away.
+	// The first run imports through Assimp and cooks each model, later runs load the cooked files
+	// Their vertices and textures are streamed in through staging memory, a few MB per frame, so a large model is
+	// spread over several frames instead of stalling one
+	double modelLoadStart = glfwGetTime();
+	UploadManager uploads;
+	AssetLoader loader(models, blockingUploads ? nullptr : &uploads);
 
-	Model stands("Resources\\Models\\Stands\\Stands.obj");												// Load the model
+	ModelHandle turf = loader.loadModel("Resources\\Models\\Turf\\turfWithMat.obj");						// Load the model
+	ModelHandle stands = loader.loadModel("Resources\\Models\\Stands\\Stands.obj");							// Load the model
+	glm::mat4 stadiumScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(0.5, 0.5, 0.5));					// Set up stadium scale
+	glm::mat4 turfScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(5, 5, 5));							// Set up translation/rotation/scale
 	glm::mat4 standsTranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(0.0, -2.5, 0.0));			// Set up translation/rotation/scale
 	glm::mat4 standsScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(9.2, 10, 10));						//
-	Object standsObj(stands, WOOD, standsTranslationMat, defaultRotate, standsScaleMat);				// Initialize the object
+	SceneNode turfNode = scene.createNode(turfScaleMat * stadiumScaleMat);
+	SceneNode standsNode = scene.createNode(standsTranslationMat * standsScaleMat * stadiumScaleMat);
+	Object stadium[] = { Object(turf, GRASS, turfNode), Object(stands, WOOD, standsNode) };				// Initialize the objects
 
-	glm::mat4 stadiumScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(0.5, 0.5, 0.5));					// Set up translation/rotation/scale
-	Object stadium[] = { turfObj, standsObj };															// Initialize the object
-	
-	Model character("Resources\\Models\\Character\\Player_OpenGL.obj");									// Load the model
+	ModelHandle character = loader.loadModel("Resources\\Models\\Character\\Player_OpenGL.obj");			// Load the model
 	glm::mat4 characterScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(0.5, 0.5, 0.5));					// Set up scale
-	Object characterObj(character, NONE, defaultTranslate, defaultRotate, characterScaleMat);			// Initialize the object
+	SceneNode characterNode = scene.createNode(characterScaleMat);
+	SceneNode characterPoseNode = scene.createNode(glm::mat4(1.0), characterNode);						// Player movement/rotation
+	Object characterObj(character, NONE, characterPoseNode);											// Initialize the object
 
-	Model chest("Resources\\Models\\Chest\\Chest.obj");													// Load the model
+	ModelHandle chest = loader.loadModel("Resources\\Models\\Chest\\Chest.obj");							// Load the model
 	glm::mat4 chestTranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(0.0, -9.5, -8.2));			// Set up translation
 	glm::mat4 chestScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(10.0, 10.0, 10.0));					// Set up scale
-	Object chestObj(chest, WOOD, chestTranslationMat, defaultRotate, chestScaleMat);					// Initialize the object
+	Object chestObj(chest, WOOD, scene.createNode(chestTranslationMat * chestScaleMat));				// Initialize the object
 
-	Model quaffle("Resources\\Models\\Balls\\Quaffle_V2.obj");											// Load the model
+	ModelHandle quaffle = loader.loadModel("Resources\\Models\\Balls\\Quaffle_V2.obj");					// Load the model
 	glm::mat4 quaffleTranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(0.0, -0.1, -8.0));		// Set up translation
 	glm::mat4 quaffleScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(10.0, 10.0, 10.0));				// Set up scale
-	Object quaffleObj(quaffle, LEATHER, quaffleTranslationMat, defaultRotate, quaffleScaleMat);			// Initialize the object
+	SceneNode quaffleNode = scene.createNode(quaffleTranslationMat * quaffleScaleMat);
+	SceneNode quaffleSpinNode = scene.createNode(glm::mat4(1.0), quaffleNode);							// Ball spin
+	Object quaffleObj(quaffle, LEATHER, quaffleSpinNode);												// Initialize the object
 
-	Model bludger("Resources\\Models\\Balls\\Bludger.obj");												// Load the model
+	ModelHandle bludger = loader.loadModel("Resources\\Models\\Balls\\Bludger.obj");						// Load the model
+	models.setPlaceholder(bludger);																		// Drawn until each model arrives
 	glm::mat4 bludger1TranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(2.0, 0.0, -20.0));		// Set up translation
 	glm::mat4 bludger2TranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(-2.0, 0.0, -20.0));		// Set up translation
 	glm::mat4 bludgerScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(0.4, 0.4, 0.4));					// Set up scale
-	Object bludgerObj(bludger, BRASS, defaultTranslate, defaultRotate, bludgerScaleMat);				// Initialize the object
+	SceneNode bludger1SpinNode = scene.createNode(glm::mat4(1.0), scene.createNode(bludgerScaleMat * bludger1TranslationMat));
+	SceneNode bludger2SpinNode = scene.createNode(glm::mat4(1.0), scene.createNode(bludgerScaleMat * bludger2TranslationMat));
+	InstancedObjects bludgers(bludger);																	// Initialize the instances
+	bludgers.add(BRASS, bludger1SpinNode);
+	bludgers.add(BRASS, bludger2SpinNode);
 
-	Model hoops("Resources\\Models\\Hoops\\Hoops.obj");													// Load the model
+	ModelHandle hoops = loader.loadModel("Resources\\Models\\Hoops\\Hoops.obj");							// Load the model
 	glm::mat4 hoopsScaleMat = glm::scale(glm::mat4(1.0), glm::vec3(1.0, 1.0, 1.0));						// Set up scale
 	glm::mat4 hoops1TranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(17.0, -2.0, 0.0));		// Set up translation
 	glm::mat4 hoops2TranslationMat = glm::translate(glm::mat4(1.0), glm::vec3(-17.0, -2.0, 0.0));		// Set up translation
-	Object hoopsObj(hoops, BRASS, defaultTranslate, defaultRotate, hoopsScaleMat);						// Initialize the object
+	InstancedObjects hoopsObjs(hoops);																	// Initialize the instances
+	hoopsObjs.add(BRASS, scene.createNode(hoopsScaleMat * hoops1TranslationMat));
+	hoopsObjs.add(BRASS, scene.createNode(hoopsScaleMat * hoops2TranslationMat));
+
+	// 32 MB of tiles, however large the image
+	VirtualTexture virtualTexture;
+	Terrain terrain;
+	if (!virtualTexturePath.empty()) {
+		if (virtualTexture.create(virtualTexturePath, IMAGE_COLOUR, 32 * 1024 * 1024, camera_settings.screenWidth, camera_settings.screenHeight)) {
+			const VirtualTextureInfo& info = virtualTexture.info();
+			cout << "Virtual texture " << virtualTexturePath << ": " << info.width << "x" << info.height << ", " << info.levels
+				<< " levels of " << info.tileSize << " pixel tiles, " << virtualTexture.stats().slots << " cache slots" << endl;
+			terrain.create(60.0f, -2.6f);
+		}
+		else
+			cout << "Failed to load virtual texture " << virtualTexturePath << endl;
+	}
+
+	// OpenGL time per frame given to creating imported models, and the data staged for them per frame
+	const double modelUploadBudget = 4.0;
+	const size_t uploadBudgetBytes = 4 * 1024 * 1024;
+
+	// frame times while the models arrive and afterwards.  The first two frames include startup, so aren't counted
+	FrameTimeHistogram loadingFrames, loadedFrames;
+	unsigned int frameCount = 0;
 
 	// ======================================= LIGHTS =======================================
 
@@ -230,29 +497,68 @@ int main()
 	GLfloat mat_specularExp = 32.0;						// Shiny surface
 
 	//======================================= BASIC SHADER UNIFORM LOCATION =======================================
-	// Get unifom locations in shader
-	GLuint lightAmbArr = glGetUniformLocation(basicShader, "lightAmbArray");
-	GLuint lightPosArr = glGetUniformLocation(basicShader, "lightPosArray");
-	GLuint lightColArr = glGetUniformLocation(basicShader, "lightColArray");
-	GLuint lightTypeArr = glGetUniformLocation(basicShader, "lightTypeArray");
-	GLuint uLightAttenuation = glGetUniformLocation(basicShader, "lightAttenuation");
-	GLuint uEyePos = glGetUniformLocation(basicShader, "eyePos");
-
-	// Get material unifom locations in shader
-	matU.ambient = glGetUniformLocation(basicShader, "matAmbient");
-	matU.diffuse = glGetUniformLocation(basicShader, "matDiffuse");
-	matU.specular = glGetUniformLocation(basicShader, "matSpecularColour");
-	matU.exponent = glGetUniformLocation(basicShader, "matSpecularExponent");
+	// Get unifom IDs in shaders
+	SceneUniforms basicU = findSceneUniforms(basicShader);
+	SceneUniforms instancedU = findSceneUniforms(instancedShader);
+	modelU = basicShader.uniform("model");
+
+	// Get material unifom IDs in shaders
+	matU.ambient = basicShader.uniform("matAmbient");
+	matU.diffuse = basicShader.uniform("matDiffuse");
+	matU.specular = basicShader.uniform("matSpecularColour");
+	matU.exponent = basicShader.uniform("matSpecularExponent");
+
+	instancedMatU.ambient = instancedShader.uniform("matAmbientArray");
+	instancedMatU.diffuse = instancedShader.uniform("matDiffuseArray");
+	instancedMatU.specular = instancedShader.uniform("matSpecularColourArray");
+	instancedMatU.exponent = instancedShader.uniform("matSpecularExponentArray");
+
+	SceneUniforms virtualTextureU = findSceneUniforms(virtualTextureShader);
+	UniformID virtualTextureModelU = virtualTextureShader.uniform("model");
+	VirtualTextureUniforms virtualTextureVTU = VirtualTexture::findUniforms(virtualTextureShader);
+	UniformID feedbackModelU = virtualFeedbackShader.uniform("model");
+	UniformID feedbackViewU = virtualFeedbackShader.uniform("view");
+	UniformID feedbackProjectionU = virtualFeedbackShader.uniform("projection");
+	VirtualTextureUniforms feedbackVTU = VirtualTexture::findUniforms(virtualFeedbackShader);
+
+	if (blockingLoad) {
+		loader.finish();
+		cout << "Models loaded in " << (glfwGetTime() - modelLoadStart) * 1000.0 << " ms (blocking load)" << endl;
+	}
+
+	cout << "Rendering started after " << (glfwGetTime() - modelLoadStart) * 1000.0 << " ms" << endl;
 
 	// render loop
 	while (!glfwWindowShouldClose(window))
 	{
+		// Count heap allocations, uniform uploads and state changes made this frame, including installing models,
+		// requesting tiles and streaming uploads
+		AllocationCounter::beginFrame();
+		basicShader.resetFrameStats();
+		instancedShader.resetFrameStats();
+		GLState::resetFrameStats();
+
+		// Install any models that finished importing.  Once the last one is in, report the load time
+		if (loader.pending() > 0 && loader.update(modelUploadBudget) > 0 && loader.pending() == 0) {
+			cout << "Models loaded in " << (glfwGetTime() - modelLoadStart) * 1000.0 << " ms" << endl;
+			loadingFrames.print(cout, blockingUploads ? "Frame times while loading (blocking uploads)" : "Frame times while loading (streamed uploads)");
+		}
+		// Queue the tiles the last feedback asked for ahead of the uploads
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		virtualTexture.resize(framebufferWidth, framebufferHeight);
+		virtualTexture.update(uploads);
+		uploads.update(uploadBudgetBytes);
+
 		// input
 		processInput(window);
 		timer.tick();
 
+		if (++frameCount > 2)
+			(loader.pending() > 0 ? loadingFrames : loadedFrames).record(timer.getDeltaTimeSeconds() * 1000.0);
+
 		// render
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClearColor(0.01f, 0.01f, 0.01f, 1.0f);	// 0.1 once encoded as sRGB
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		glm::mat4 model = glm::mat4(1.0);
@@ -262,52 +568,47 @@ int main()
 		glm::mat4 scale = glm::scale(glm::mat4(1.0), glm::vec3(0.01, 0.01, 0.01));
 		glm::mat4 rotation = glm::rotate(glm::mat4(1.0), glm::radians(12.0f), glm::vec3(0.0, 1.0, 0.0));
 
-		glUseProgram(basicShader); //Use the Basic shader
-
 		Light l4(superWeakAmbient, glm::vec4(lightPosX, 2.0, lightPosZ, 1.0), white);
 
 		glm::vec4 light_ambients[] = { l1.ambient, l2.ambient, l3.ambient, l4.ambient };
 		glm::vec4 light_positions[] = { l1.position, l2.position, l3.position, l4.position };
 		glm::vec4 light_colours[] = { l1.colour, l2.colour, l3.colour, l4.colour };
 
-		float lightSize = sizeof(light_colours) / sizeof(*light_colours);
+		int lightSize = sizeof(light_colours) / sizeof(*light_colours);
 
-		//Pass the uniform data to Basic shader///////////////////////////////////
-		//Pass the light data
-		glUniform4fv(lightColArr, lightSize, (GLfloat*)&light_colours);
-		glUniform4fv(lightAmbArr, lightSize, (GLfloat*)&light_ambients);
-		glUniform4fv(lightPosArr, lightSize, (GLfloat*)&light_positions);
-		glUniform3fv(uLightAttenuation, 1, (GLfloat*)&attenuation);
-		glUniform3fv(uEyePos, 1, (GLfloat*)&eyePos);
+		// Pass the light and camera data to a shader
+		auto setSceneUniforms = [&](ShaderProgram& shader, const SceneUniforms& u) {
+			shader.use();
+			shader.setVec4Array(u.lightColArr, light_colours, lightSize);
+			shader.setVec4Array(u.lightAmbArr, light_ambients, lightSize);
+			shader.setVec4Array(u.lightPosArr, light_positions, lightSize);
+			shader.setVec3(u.lightAttenuation, glm::make_vec3(attenuation));
+			shader.setVec3(u.eyePos, eyePos);
 
-		//Pass material data
-		glUniform4fv(matU.ambient, 1, (GLfloat*)&mat_amb_diff);
-		glUniform4fv(matU.diffuse, 1, (GLfloat*)&mat_amb_diff);
-		glUniform4fv(matU.specular, 1, (GLfloat*)&mat_specularCol);
-		glUniform1f(matU.exponent, mat_specularExp);
+			shader.setMat4(u.view, view);
+			shader.setMat4(u.projection, projection);
 
-		glUniformMatrix4fv(glGetUniformLocation(basicShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(basicShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		glUniformMatrix4fv(glGetUniformLocation(basicShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
+			shader.setVec4(u.lightDirection, glm::vec4(1.0f, 1.0f, 0.5f, 0.0f));
+			shader.setVec4(u.lightDiffuse, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+		};
 
-		GLint lightDirectionLoc = glGetUniformLocation(basicShader, "lightDirection");
-		GLint lightDiffuseLoc = glGetUniformLocation(basicShader, "lightDiffuseColour");
-		glUniform4f(lightDirectionLoc, 1.0f, 1.0f, 0.5f, 0.0f);
-		glUniform4f(lightDiffuseLoc, 1.0f, 1.0f, 1.0f, 1.0f);
+		//Pass the uniform data to Basic shader///////////////////////////////////
+		setSceneUniforms(basicShader, basicU); //Use the Basic shader
 
-		// Render the Stadium
-		RenderObject(stadium, 2, basicShader, defaultTranslate, defaultRotate, stadiumScaleMat);
+		//Pass material data
+		basicShader.setVec4(matU.ambient, glm::make_vec4(mat_amb_diff));
+		basicShader.setVec4(matU.diffuse, glm::make_vec4(mat_amb_diff));
+		basicShader.setVec4(matU.specular, glm::make_vec4(mat_specularCol));
+		basicShader.setFloat(matU.exponent, mat_specularExp);
 
+		basicShader.setMat4(modelU, model);
 
-		RenderObject(chestObj, basicShader);
-		RenderObject(hoopsObj, basicShader, hoops1TranslationMat);
-		RenderObject(hoopsObj, basicShader, hoops2TranslationMat);
-		
+		// Update the moving nodes, then rebuild the world matrices that changed
 		ballsRotY += 1.0;
 		glm::mat4 ballsRotMat = glm::rotate(glm::mat4(1.0), glm::radians(ballsRotY), glm::vec3(0.0, 1.0, 0.0));
-		RenderObject(quaffleObj, basicShader, defaultTranslate, ballsRotMat);
-		RenderObject(bludgerObj, basicShader, bludger1TranslationMat, ballsRotMat);
-		RenderObject(bludgerObj, basicShader, bludger2TranslationMat, ballsRotMat);
+		scene.setLocalTransform(quaffleSpinNode, ballsRotMat);
+		scene.setLocalTransform(bludger1SpinNode, ballsRotMat);
+		scene.setLocalTransform(bludger2SpinNode, ballsRotMat);
 
 		glm::vec3 playerMovPos = glm::vec3(playerMovX * playerSpeed, playerMovY * playerSpeed, playerMovZ * playerSpeed);
 		glm::mat4 playerMovMat = glm::translate(glm::mat4(1.0), playerMovPos);
@@ -315,8 +616,46 @@ int main()
 		glm::mat4 playerRotMatY = glm::rotate(glm::mat4(1.0), glm::radians(playerRotY), glm::vec3(0.0, 1.0, 0.0));
 		glm::mat4 playerRotMatZ = glm::rotate(glm::mat4(1.0), glm::radians(playerRotZ), glm::vec3(0.0, 0.0, 1.0));
 		glm::mat4 playerRotMat = playerRotMatX * playerRotMatY * playerRotMatZ;
-		// Render the player
-		RenderObject(characterObj, basicShader, playerMovMat, playerRotMat);
+		scene.setLocalTransform(characterPoseNode, playerMovMat * playerRotMat);
+
+		scene.update();
+
+		// Draw the ground into the virtual texture's feedback target, which is read back for a later frame's update()
+		if (virtualTexture.beginFeedback()) {
+			virtualFeedbackShader.use();
+			virtualFeedbackShader.setMat4(feedbackModelU, glm::mat4(1.0));
+			virtualFeedbackShader.setMat4(feedbackViewU, view);
+			virtualFeedbackShader.setMat4(feedbackProjectionU, projection);
+			virtualTexture.apply(virtualFeedbackShader, feedbackVTU, true);
+			terrain.draw();
+			virtualTexture.endFeedback(framebufferWidth, framebufferHeight);
+		}
+
+		// Queue the Stadium
+		SubmitObject(stadium, 2, basicShader, eyePos);
+
+		SubmitObject(chestObj, basicShader, eyePos);
+		SubmitObject(quaffleObj, basicShader, eyePos);
+
+		// Queue the player
+		SubmitObject(characterObj, basicShader, eyePos);
+
+		// Draw everything in state order
+		renderQueue.flush(sceneBackend);
+
+		// Render the repeated models, one instanced draw per mesh
+		setSceneUniforms(instancedShader, instancedU);
+		useMaterialTable(instancedShader, instancedMatU);
+		bludgers.Render(instancedShader);
+		hoopsObjs.Render(instancedShader);
+
+		// Then the ground, with whatever tiles are resident
+		if (virtualTexture.isCreated()) {
+			setSceneUniforms(virtualTextureShader, virtualTextureU);
+			virtualTextureShader.setMat4(virtualTextureModelU, glm::mat4(1.0));
+			virtualTexture.apply(virtualTextureShader, virtualTextureVTU, false);
+			terrain.draw();
+		}
 
 		if (camera.getState() == FOLLOWING)
 			camera.followPosition(glm::vec3(playerMovX, playerMovY, playerMovZ), glm::vec3(5.0, 2.0, 0.0), glm::vec2(180.0, -20.0));
@@ -327,7 +666,33 @@ int main()
 		// Display info every second
 		infoDisplayTimer += timer.getDeltaTimeSeconds();
 		if (infoDisplayTimer >= 1.0f) {
-			cout << "Time: " << (int)t << "; FPS: " << (int)(1.0 / timer.getDeltaTimeSeconds()) << ";" << endl;
+			size_t frameAllocations = AllocationCounter::frameAllocations();
+			UniformStats uniformStats = basicShader.frameStats();
+			uniformStats.uploads += instancedShader.frameStats().uploads;
+			uniformStats.skipped += instancedShader.frameStats().skipped;
+			GLStateStats stateStats = GLState::frameStats();
+			cout << "Time: " << (int)t << "; FPS: " << (int)(1.0 / timer.getDeltaTimeSeconds()) << "; Allocations this frame: " << frameAllocations
+				<< "; Transforms updated: " << scene.lastUpdateCount() << "/" << scene.size()
+				<< "; Uniform uploads: " << uniformStats.uploads << " (" << uniformStats.skipped << " skipped)"
+				<< "; State changes: " << stateStats.issued << " (" << stateStats.elided << " elided)" << endl;
+			const RenderQueueStats& queueStats = renderQueue.lastFlushStats();
+			cout << "    Draw packets: " << queueStats.packets << "; Program changes: " << queueStats.programChanges
+				<< "; Material changes: " << queueStats.materialChanges << "; Texture changes: " << queueStats.textureChanges
+				<< "; VAO changes: " << queueStats.vertexArrayChanges << ";" << endl;
+			TextureCacheStats textureStats = TextureCache::stats();
+			cout << "    Textures resident: " << textureStats.residentTextures << " (" << textureStats.residentBytes / (1024 * 1024) << " MB)"
+				<< "; Cache hits: " << textureStats.hits << "; Misses: " << textureStats.misses << "; Evictions: " << textureStats.evictions << ";" << endl;
+			const UploadStats& uploadStats = uploads.lastUpdateStats();
+			cout << "    Uploads pending: " << uploads.pending() << " (" << uploads.pendingBytes() / 1024 << " KB)"
+				<< "; Staged last frame: " << uploadStats.stagedBytes / 1024 << " KB in " << uploadStats.chunks << " chunks"
+				<< (uploadStats.ringFull ? " (ring full)" : "")
+				<< (uploadStats.directBytes > 0 ? "; Uploaded directly: " + std::to_string(uploadStats.directBytes / 1024) + " KB" : "")
+				<< (uploads.persistentlyMapped() ? "; Persistent ring;" : "; Mapped per chunk;") << endl;
+			if (virtualTexture.isCreated()) {
+				VirtualTextureStats vtStats = virtualTexture.stats();
+				cout << "    Virtual tiles requested: " << vtStats.requestedTiles << "; Resident: " << vtStats.residentTiles << "/" << vtStats.slots
+					<< "; Loading: " << vtStats.loadingTiles << "; Evictions: " << vtStats.evictions << ";" << endl;
+			}
 			infoDisplayTimer = 0.0f;
 		}
 		
@@ -337,6 +702,19 @@ int main()
 		glfwPollEvents();
 	}
 
+	// Release the models' buffers while the context is still alive, starting with any that haven't arrived yet
+	loader.cancel();
+	bludgers.buffer.release();
+	hoopsObjs.buffer.release();
+	models.clear();
+	uploads.release();
+	virtualTexture.release();
+	if (terrain.vertexArray != 0)
+		terrain.release();
+
+	if (loadedFrames.count() > 0)
+		loadedFrames.print(cout, "Frame times after loading");
+
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	glfwTerminate();
 	return 0;
@@ -344,49 +722,201 @@ int main()
 
 #pragma region Function Implementations
 
-void RenderObject(Object object, GLuint shader, glm::mat4 t, glm::mat4 r, glm::mat4 s ) {
-	object.Render(shader, t, r, s);
+void SubmitObject(const Object& object, ShaderProgram& shader, const glm::vec3& eyePos) {
+	object.Submit(renderQueue, shader, eyePos);
 }
 
-void RenderObject(Object objects[], int numOfItems, GLuint shader, glm::mat4 t, glm::mat4 r, glm::mat4 s) {
+void SubmitObject(const Object objects[], int numOfItems, ShaderProgram& shader, const glm::vec3& eyePos) {
 	for (int i = 0; i < numOfItems; i++) {
-		objects[i].Render(shader, t, r, s);
+		objects[i].Submit(renderQueue, shader, eyePos);
 	}
 }
 
-void useMaterial(Materials chosenMaterial, MaterialUniforms matVar) {
-	switch (chosenMaterial)
-	{
-	case WOOD:
-		glUniform4fv(matVar.ambient, 1, glm::value_ptr(glm::vec3(0.32, 0.22, 0.07)));
-		glUniform4fv(matVar.diffuse, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-		glUniform4fv(matVar.specular, 1, glm::value_ptr(glm::vec3(0.7, 0.6, 0.6)));
-		glUniform1f(matVar.exponent, 2);
-
-	case BRASS:
-		glUniform4fv(matVar.ambient, 1, glm::value_ptr(glm::vec3(0.32, 0.22, 0.07)));
-		glUniform4fv(matVar.diffuse, 1, glm::value_ptr(glm::vec3(0.78, 0.36, 0.22)));
-		glUniform4fv(matVar.specular, 1, glm::value_ptr(glm::vec3(0.992157, 0.941176, 0.507043)));
-		glUniform1f(matVar.exponent, 120.89743616);
-
-	case GRASS:
-		glUniform4fv(matVar.ambient, 1, glm::value_ptr(glm::vec3(0.1, 0.1, 0.1)));
-		glUniform4fv(matVar.diffuse, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-		glUniform4fv(matVar.specular, 1, glm::value_ptr(glm::vec3(0.1, 0.1, 0.1)));
-		glUniform1f(matVar.exponent, 1);
-
-	case LEATHER:
-		glUniform4fv(matVar.ambient, 1, glm::value_ptr(glm::vec3(0.1, 0.1, 0.1)));
-		glUniform4fv(matVar.diffuse, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-		glUniform4fv(matVar.specular, 1, glm::value_ptr(glm::vec3(0.1, 0.1, 0.1)));
-		glUniform1f(matVar.exponent, 50.0);
-
-	case NONE:
-		glUniform4fv(matVar.ambient, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-		glUniform4fv(matVar.diffuse, 1, glm::value_ptr(glm::vec3(1.0, 0.0, 0.0)));
-		glUniform4fv(matVar.specular, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-		glUniform1f(matVar.exponent, 1.0);
+// Times Model::draw on the CPU only - nothing is presented.  Both paths are drawn once first so the meshes' binding
+// tables are already built.
+void benchmarkModelDraw(const char *name, const Model& model, ShaderProgram& shader, int iterations) {
+	typedef std::chrono::high_resolution_clock Clock;
+
+	model.draw(shader.id());
+	model.draw(shader);
+	glFinish();
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+		model.draw(shader.id());
+	double rawTime = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	glFinish();
+
+	// the raw path sets the samplers itself, behind the ShaderProgram's back, so put back the units it assigned
+	shader.invalidateCache();
+	for (UniformID id = 0; id < (UniformID)shader.numUniforms(); id++)
+		if (shader.textureUnit(id) >= 0)
+			shader.setInt(id, shader.textureUnit(id));
+
+	start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+		model.draw(shader);
+	double tableTime = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	glFinish();
+
+	cout << name << " (" << model.meshes.size() << " meshes) Model::draw CPU time: " << rawTime / iterations << "us with program id, "
+		<< tableTime / iterations << "us with ShaderProgram" << endl;
+}
+
+// Submits every combination of 3 programs, 4 materials, 5 texture sets and 2 vertex arrays twice, in a scrambled order,
+// flushes them into a RecordingRenderBackend and checks each state was set once per group and the draws came out in
+// key order.  Returns 0 if everything matched
+int checkRenderQueue() {
+	const unsigned int PROGRAMS = 3, MATERIALS = 4, TEXTURE_SETS = 5, VERTEX_ARRAYS = 2, COPIES = 2;
+
+	vector<DrawPacket> packets;
+	vector<float> depths;
+	for (unsigned int program = 1; program <= PROGRAMS; program++)
+		for (unsigned int material = 0; material < MATERIALS; material++)
+			for (unsigned int textureSet = 1; textureSet <= TEXTURE_SETS; textureSet++)
+				for (unsigned int vertexArray = 1; vertexArray <= VERTEX_ARRAYS; vertexArray++)
+					for (unsigned int copy = 0; copy < COPIES; copy++) {
+						DrawPacket packet = DrawPacket();
+						packet.programID = program;
+						packet.material = material;
+						packet.textureSet = textureSet;
+						packet.vertexArray = vertexArray;
+						packets.push_back(packet);
+						depths.push_back(copy * 0.5f + 0.25f);
+					}
+
+	// a fixed scramble, so the queue has real sorting to do
+	unsigned int seed = 12345;
+	for (size_t i = packets.size() - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		size_t j = (seed >> 8) % (i + 1);
+		std::swap(packets[i], packets[j]);
+		std::swap(depths[i], depths[j]);
+	}
+
+	RenderQueue queue;
+	for (size_t i = 0; i < packets.size(); i++)
+		queue.submit(packets[i], depths[i]);
+
+	RecordingRenderBackend backend;
+	queue.flush(backend);
+	const RenderQueueStats& stats = queue.lastFlushStats();
+
+	bool sorted = true;
+	const vector<RecordingRenderBackend::Call>& calls = backend.calls();
+	SortKey lastKey = 0;
+	for (size_t i = 0; i < calls.size(); i++) {
+		if (calls[i].type != RecordingRenderBackend::DRAW)
+			continue;
+		if (calls[i].packet.key < lastKey)
+			sorted = false;
+		lastKey = calls[i].packet.key;
+	}
+
+	struct Check {
+		const char		*name;
+		unsigned int	recorded, reported, expected;
+	};
+	const Check checks[] = {
+		{ "draws", backend.count(RecordingRenderBackend::DRAW), stats.packets, (unsigned int)packets.size() },
+		{ "program changes", backend.count(RecordingRenderBackend::SET_PROGRAM), stats.programChanges, PROGRAMS },
+		{ "material changes", backend.count(RecordingRenderBackend::SET_MATERIAL), stats.materialChanges, PROGRAMS * MATERIALS },
+		{ "texture changes", backend.count(RecordingRenderBackend::SET_TEXTURES), stats.textureChanges, PROGRAMS * MATERIALS * TEXTURE_SETS },
+		{ "vertex array changes", backend.count(RecordingRenderBackend::SET_VERTEX_ARRAY), stats.vertexArrayChanges,
+			PROGRAMS * MATERIALS * TEXTURE_SETS * VERTEX_ARRAYS },
+	};
+
+	bool passed = sorted;
+	for (const Check& check : checks) {
+		bool ok = check.recorded == check.expected && check.reported == check.expected;
+		passed = passed && ok;
+		cout << check.name << ": " << check.recorded << " recorded, " << check.reported << " reported, " << check.expected
+			<< " expected" << (ok ? "" : " - MISMATCH") << endl;
 	}
+	cout << "draws in key order: " << (sorted ? "yes" : "no") << endl;
+	cout << (passed ? "Render queue check passed" : "Render queue check FAILED") << endl;
+
+	return passed ? 0 : 1;
+}
+
+// Loads the stadium models into a hidden window's context and times drawing them with benchmarkModelDraw
+int benchmarkDraw() {
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* window = glfwCreateWindow(camera_settings.screenWidth, camera_settings.screenHeight, "Draw benchmark", NULL, NULL);
+	if (window == NULL) {
+		cout << "Failed to create GLFW window" << endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		cout << "Failed to initialize GLAD" << endl;
+		glfwTerminate();
+		return -1;
+	}
+
+	ShaderProgram basicShader;
+	ShaderLoader::createShaderProgram(
+		string("Resources\\Shaders\\Basic_shader.vert"),
+		string("Resources\\Shaders\\Basic_shader.frag"),
+		&basicShader);
+
+	ModelHandle turf = models.load("Resources\\Models\\Turf\\turfWithMat.obj");
+	ModelHandle stands = models.load("Resources\\Models\\Stands\\Stands.obj");
+
+	basicShader.use();
+	benchmarkModelDraw("Turf", models.get(turf), basicShader, 1000);
+	benchmarkModelDraw("Stands", models.get(stands), basicShader, 1000);
+
+	models.clear();
+	glfwTerminate();
+	return 0;
+}
+
+void useMaterial(Materials chosenMaterial, ShaderProgram& shader, const MaterialUniforms& matVar) {
+	const MaterialData& material = materialTable[chosenMaterial];
+	shader.setVec4(matVar.ambient, material.ambient);
+	shader.setVec4(matVar.diffuse, material.diffuse);
+	shader.setVec4(matVar.specular, material.specular);
+	shader.setFloat(matVar.exponent, material.exponent);
+}
+
+SceneUniforms findSceneUniforms(const ShaderProgram& shader) {
+	SceneUniforms u;
+	u.lightAmbArr = shader.uniform("lightAmbArray");
+	u.lightPosArr = shader.uniform("lightPosArray");
+	u.lightColArr = shader.uniform("lightColArray");
+	u.lightAttenuation = shader.uniform("lightAttenuation");
+	u.eyePos = shader.uniform("eyePos");
+	u.view = shader.uniform("view");
+	u.projection = shader.uniform("projection");
+	u.lightDirection = shader.uniform("lightDirection");
+	u.lightDiffuse = shader.uniform("lightDiffuseColour");
+	return u;
+}
+
+void useMaterialTable(ShaderProgram& shader, const MaterialUniforms& matVar) {
+	glm::vec4 ambients[NUM_MATERIALS], diffuses[NUM_MATERIALS], speculars[NUM_MATERIALS];
+	GLfloat exponents[NUM_MATERIALS];
+
+	for (int i = 0; i < NUM_MATERIALS; i++) {
+		ambients[i] = materialTable[i].ambient;
+		diffuses[i] = materialTable[i].diffuse;
+		speculars[i] = materialTable[i].specular;
+		exponents[i] = materialTable[i].exponent;
+	}
+
+	shader.setVec4Array(matVar.ambient, ambients, NUM_MATERIALS);
+	shader.setVec4Array(matVar.diffuse, diffuses, NUM_MATERIALS);
+	shader.setVec4Array(matVar.specular, speculars, NUM_MATERIALS);
+	shader.setFloatArray(matVar.exponent, exponents, NUM_MATERIALS);
 }
 
 #pragma endregion
@@ -529,4 +1059,1131 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 	camera.processMouseScroll(yoffset);
 }
 
-#pragma endregion
\ No newline at end of file
+#pragma endregion
+
+// Every texture the models use, and what each holds
+static const char *bundledTextures[] = {
+	"Resources\\Models\\Balls\\Leather_005_baseColor.jpg",
+	"Resources\\Models\\Balls\\Leather_005_height.png",
+	"Resources\\Models\\Balls\\Leather_005_normal.jpg",
+	"Resources\\Models\\Balls\\Leather_006_COLOR.jpg",
+	"Resources\\Models\\Balls\\Leather_006_NORM.jpg",
+	"Resources\\Models\\Balls\\Leather_006_ROUGH.jpg",
+	"Resources\\Models\\Balls\\Metal_Doff.png",
+	"Resources\\Models\\Balls\\Metal_Normal.png",
+	"Resources\\Models\\Balls\\Metal_Spec.png",
+	"Resources\\Models\\Stands\\Wood.jpg",
+	"Resources\\Models\\Character\\Black.png",
+	"Resources\\Models\\Character\\Brown.png",
+	"Resources\\Models\\Character\\Red.png",
+	"Resources\\Models\\Character\\White.png",
+	"Resources\\Models\\Character\\Yellow.png"
+};
+static const ImageContent bundledContents[] = {
+	IMAGE_COLOUR, IMAGE_DATA, IMAGE_NORMAL_MAP, IMAGE_COLOUR, IMAGE_NORMAL_MAP, IMAGE_DATA, IMAGE_COLOUR, IMAGE_NORMAL_MAP, IMAGE_DATA,
+	IMAGE_COLOUR, IMAGE_COLOUR, IMAGE_COLOUR, IMAGE_COLOUR, IMAGE_COLOUR, IMAGE_COLOUR
+};
+static const unsigned int numBundledTextures = sizeof(bundledTextures) / sizeof(*bundledTextures);
+
+// Decodes and mipmaps each bundled texture in turn on this thread, as the texture cooker does, and reports the
+// allocations it took and the process's peak memory.  Run before the batch decode, which holds every image at once
+void benchmarkDecodeMemory() {
+	size_t newCalls = AllocationCounter::totalAllocations();
+
+	for (unsigned int i = 0; i < numBundledTextures; i++) {
+		DecodedImage image;
+		if (!TextureLoader::decodeImage(bundledTextures[i], true, image))
+			continue;
+
+		vector<MipLevel> mips;
+		MipBuilder::build(image.pixels, image.width, image.height, image.channels, bundledContents[i], MIP_KAISER, mips);
+	}
+
+	newCalls = AllocationCounter::totalAllocations() - newCalls;
+	cout << "Decode memory: " << newCalls << " operator new calls; peak RSS " << AllocationCounter::peakResidentBytes() / (1024 * 1024)
+		<< " MB" << endl;
+}
+
+// Decodes the bundled textures one thread at a time and then as a parallel batch, and reports the throughput of each
+int benchmarkTextureDecode() {
+	benchmarkDecodeMemory();
+
+	vector<string> paths(bundledTextures, bundledTextures + numBundledTextures);
+
+	const unsigned int threadCounts[] = { 1, 0 };
+	for (unsigned int i = 0; i < 2; i++) {
+		vector<DecodedImage> images;
+		TextureBatchStats stats;
+		TextureLoader::decodeImages(paths, true, images, threadCounts[i], &stats);
+
+		double megabytes = stats.decodedBytes / (1024.0 * 1024.0);
+		cout << "Decoded " << stats.images - stats.failed << "/" << stats.images << " textures (" << megabytes << " MB) on "
+			<< stats.threads << " thread(s) in " << stats.decodeMilliseconds << " ms: "
+			<< megabytes / (stats.decodeMilliseconds / 1000.0) << " MB/s" << endl;
+	}
+
+	return 0;
+}
+
+// The lowest PSNR, in dB, each block format may give a bundled texture, in BlockFormat order.  A few dB under the worst
+// bundled texture of each: BC1 27.7 (Leather_006_ROUGH, grain finer than a block), BC3 31.4 (Metal_Spec) and BC5 42.1
+// (Leather_005_normal)
+static const double minimumPSNR[] = { 25.0, 28.0, 38.0 };
+
+// Cooks every bundled texture and its mipmaps into a .dds file (the same files Model loads), then decompresses the top
+// level of each on the CPU and prints its format, size and peak signal to noise ratio against the original image.
+// Returns 1 if a texture couldn't be cooked or came out below its format's minimumPSNR
+int cookTextures() {
+	typedef std::chrono::steady_clock Clock;
+
+	bool passed = true;
+	size_t totalDecoded = 0, totalCompressed = 0;
+	double totalMilliseconds = 0.0;
+
+	for (unsigned int i = 0; i < numBundledTextures; i++) {
+		DecodedImage original;
+		CompressedImage compressed;
+
+		Clock::time_point start = Clock::now();
+		bool cooked = TextureCooker::cook(bundledTextures[i], true, bundledContents[i], compressed);
+		double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		if (!cooked || !TextureLoader::decodeImage(bundledTextures[i], true, original)) {
+			cout << bundledTextures[i] << ": couldn't be cooked - FAILED" << endl;
+			passed = false;
+			continue;
+		}
+
+		vector<unsigned char> decompressed;
+		BlockCompressor::decompress(compressed, decompressed);
+
+		// normal maps only keep X and Y, and alpha only matters where the format stores it
+		int compareChannels = compressed.format == BLOCK_BC5 ? 2 : (compressed.format == BLOCK_BC3 ? 4 : 3);
+		double psnr = BlockCompressor::psnr(original.pixels, original.channels, decompressed, original.width, original.height, compareChannels);
+		bool psnrOK = psnr >= minimumPSNR[compressed.format];
+		passed = passed && psnrOK;
+
+		size_t decodedBytes = (size_t)original.width * original.height * original.channels;
+		totalDecoded += decodedBytes;
+		totalCompressed += compressed.blocks.size();
+		totalMilliseconds += milliseconds;
+
+		cout << bundledTextures[i] << ": " << BlockCompressor::formatName(compressed.format) << " " << original.width << "x"
+			<< original.height << " with " << compressed.levels << " levels, " << decodedBytes / 1024 << " KB -> " << compressed.blocks.size() / 1024 << " KB, PSNR "
+			<< psnr << " dB, cooked in " << milliseconds << " ms" << (psnrOK ? "" : " - BELOW THE FLOOR") << endl;
+	}
+
+	cout << "Cooked " << totalDecoded / (1024 * 1024) << " MB of textures into " << totalCompressed / (1024 * 1024)
+		<< " MB in " << totalMilliseconds << " ms" << endl;
+	cout << "Floors: BC1 " << minimumPSNR[BLOCK_BC1] << " dB, BC3 " << minimumPSNR[BLOCK_BC3] << " dB, BC5 " << minimumPSNR[BLOCK_BC5]
+		<< " dB" << endl;
+	cout << (passed ? "Texture cooking passed" : "Texture cooking FAILED") << endl;
+
+	return passed ? 0 : 1;
+}
+
+// Colours for the faces of the generated cube maps, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order, and where each face
+// sits in a horizontal cross
+static const unsigned char cubeCheckColours[6][3] = {
+	{ 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0 }, { 0, 255, 255 }, { 255, 0, 255 }
+};
+static const int crossColumn[6] = { 2, 0, 1, 1, 1, 3 };
+static const int crossRow[6] = { 1, 1, 0, 2, 1, 1 };
+
+static bool writePPM(const string& path, int width, int height, const vector<unsigned char>& rgb) {
+	ofstream file(path, ios::binary);
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)rgb.data(), rgb.size());
+	return (bool)file;
+}
+
+// fills one cell of a cross with a face's colour, marking the cell's top left (or, flipped, bottom right) pixel with
+// the face number in the red channel so orientation can be checked
+static void fillCrossCell(vector<unsigned char>& rgb, int width, int size, int column, int row, int face, bool flipped) {
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++) {
+			unsigned char *pixel = &rgb[((size_t)(row * size + y) * width + column * size + x) * 3];
+			pixel[0] = cubeCheckColours[face][0];
+			pixel[1] = cubeCheckColours[face][1];
+			pixel[2] = cubeCheckColours[face][2];
+		}
+
+	int corner = flipped ? size - 1 : 0;
+	rgb[((size_t)(row * size + corner) * width + column * size + corner) * 3] = (unsigned char)(face * 40);
+}
+
+// true if every face has its colour, opaque, with the marker in its top left
+static bool crossFacesMatch(const CubeMapImage& image, int size) {
+	if (image.size != size)
+		return false;
+
+	for (int face = 0; face < 6; face++) {
+		const vector<unsigned char>& pixels = image.faces[face];
+		if (pixels.size() != (size_t)size * size * 4 || pixels[0] != face * 40)
+			return false;
+
+		const unsigned char *middle = &pixels[((size_t)(size / 2) * size + size / 2) * 4];
+		if (middle[0] != cubeCheckColours[face][0] || middle[1] != cubeCheckColours[face][1] || middle[2] != cubeCheckColours[face][2] ||
+			middle[3] != 255)
+			return false;
+	}
+	return true;
+}
+
+static bool emptyCubeMap(const CubeMapImage& image) {
+	for (int face = 0; face < 6; face++)
+		if (!image.faces[face].empty() || !image.mips[face].empty())
+			return false;
+	return image.size == 0;
+}
+
+// Writes a horizontal cross, a vertical cross (its -Z upside down) and a panorama as PPM files, decodes them with
+// TextureLoader::decodeCubeMap and checks where the faces landed, then checks a missing image, in both the single
+// image and six file forms, leaves the cube map empty.  The generated files are deleted afterwards.  Returns 0 if
+// everything matched
+int checkCubeMaps() {
+	const int size = 64;
+	const string crossPath = "cube_map_check_cross.ppm", verticalPath = "cube_map_check_vertical.ppm";
+	const string panoramaPath = "cube_map_check_panorama.ppm";
+
+	vector<unsigned char> cross((size_t)4 * size * 3 * size * 3, 0);
+	for (int face = 0; face < 6; face++)
+		fillCrossCell(cross, 4 * size, size, crossColumn[face], crossRow[face], face, false);
+
+	// the vertical cross has no column 3, so -Z hangs below +Z, rotated half a turn
+	vector<unsigned char> vertical((size_t)3 * size * 4 * size * 3, 0);
+	for (int face = 0; face < 5; face++)
+		fillCrossCell(vertical, 3 * size, size, crossColumn[face], crossRow[face], face, false);
+	fillCrossCell(vertical, 3 * size, size, 1, 3, 5, true);
+
+	// red is the longitude and green the latitude, so each face's centre says which direction it was sampled from
+	const int panoramaWidth = 1024, panoramaHeight = 512;
+	vector<unsigned char> panorama((size_t)panoramaWidth * panoramaHeight * 3);
+	for (int y = 0; y < panoramaHeight; y++)
+		for (int x = 0; x < panoramaWidth; x++) {
+			unsigned char *pixel = &panorama[((size_t)y * panoramaWidth + x) * 3];
+			pixel[0] = (unsigned char)(x * 255 / (panoramaWidth - 1));
+			pixel[1] = (unsigned char)(y * 255 / (panoramaHeight - 1));
+			pixel[2] = 128;
+		}
+
+	bool passed = writePPM(crossPath, 4 * size, 3 * size, cross) && writePPM(verticalPath, 3 * size, 4 * size, vertical) &&
+		writePPM(panoramaPath, panoramaWidth, panoramaHeight, panorama);
+	if (!passed)
+		cout << "Couldn't write the cube map check images" << endl;
+
+	CubeMapImage image;
+
+	bool crossOK = passed && TextureLoader::decodeCubeMap(crossPath, CUBE_CROSS, image) && crossFacesMatch(image, size);
+	if (crossOK) {
+		TextureLoader::buildMipmaps(image);
+		for (int face = 0; face < 6; face++)
+			crossOK = crossOK && image.mips[face].size() == (size_t)MipBuilder::levelCount(size, size) - 1;
+	}
+	cout << "horizontal cross: " << (crossOK ? "ok" : "MISMATCH") << endl;
+
+	bool verticalOK = passed && TextureLoader::decodeCubeMap(verticalPath, CUBE_CROSS, image) && crossFacesMatch(image, size);
+	cout << "vertical cross: " << (verticalOK ? "ok" : "MISMATCH") << endl;
+
+	// the face centres' longitude and latitude, as fractions of the panorama.  +Y and -Y look at the poles, where
+	// longitude means nothing, and +Z looks along the seam, where it may be either end
+	const float expectedU[6] = { 0.75f, 0.25f, -1.0f, -1.0f, 1.0f, 0.5f };
+	const float expectedV[6] = { 0.5f, 0.5f, 0.0f, 1.0f, 0.5f, 0.5f };
+	bool panoramaOK = passed && TextureLoader::decodeCubeMap(panoramaPath, CUBE_EQUIRECTANGULAR, image) && image.size == panoramaWidth / 4;
+	for (int face = 0; panoramaOK && face < 6; face++) {
+		const unsigned char *centre = &image.faces[face][((size_t)(image.size / 2) * image.size + image.size / 2) * 4];
+		float u = centre[0] / 255.0f, v = centre[1] / 255.0f;
+		bool longitudeOK = expectedU[face] < 0.0f || fabs(u - expectedU[face]) < 0.02f || (face == 4 && u < 0.02f);
+		panoramaOK = longitudeOK && fabs(v - expectedV[face]) < 0.02f;
+	}
+	cout << "panorama: " << (panoramaOK ? "ok" : "MISMATCH") << endl;
+
+	bool missingOK = !TextureLoader::decodeCubeMap("cube_map_check_missing.ppm", CUBE_CROSS, image) && emptyCubeMap(image) &&
+		!TextureLoader::decodeCubeMap("", "cube_map_check_missing", ".ppm", image) && emptyCubeMap(image);
+	cout << "missing image: " << (missingOK ? "ok" : "MISMATCH") << endl;
+
+	std::remove(crossPath.c_str());
+	std::remove(verticalPath.c_str());
+	std::remove(panoramaPath.c_str());
+
+	passed = passed && crossOK && verticalOK && panoramaOK && missingOK;
+	cout << (passed ? "Cube map check passed" : "Cube map check FAILED") << endl;
+
+	return passed ? 0 : 1;
+}
+
+// Appends count feedback pixels asking for a tile
+static void addFeedback(vector<unsigned char>& rgba, unsigned int tile, unsigned int count) {
+	unsigned char pixel[4];
+	TileFeedback::encode(tile, pixel);
+	for (unsigned int i = 0; i < count; i++)
+		rgba.insert(rgba.end(), pixel, pixel + 4);
+}
+
+// true if a tile's page table entry points at the slot, holding a tile of the level given
+static bool pageTableEntryIs(const TileCache& cache, const VirtualTextureInfo& info, unsigned int tile, unsigned int slot, int level) {
+	const unsigned char *entry = cache.pageTableLevel(tileLevel(tile)) + ((size_t)tileY(tile) * info.tilesX(tileLevel(tile)) + tileX(tile)) * 4;
+	return entry[0] == slot % cache.columns() && entry[1] == slot / cache.columns() && entry[2] == level && entry[3] == 255;
+}
+
+// Drives TileFeedback and a four slot TileCache by hand for a 1024 x 1024 texture of 128 pixel tiles (four levels,
+// the last a single tile) and checks the requests come out coarsest first with each tile's pixels added to its
+// ancestors', eviction takes the least recently used tile but never a pinned one, a loading one or one touched this
+// frame, and the page table points each tile at its nearest resident ancestor.  Nothing touches OpenGL.  Returns 0 if
+// everything matched
+int checkVirtualTexture() {
+	VirtualTextureInfo info;
+	info.width = info.height = 1024;
+	info.tileSize = 128;
+	info.border = VirtualTextureFile::DEFAULT_BORDER;
+	info.levels = 4;
+
+	// three level 0 tiles and a level 1 one that shares an ancestor with one of them, then a pixel where nothing was
+	// drawn and one outside the texture, which are both ignored
+	vector<unsigned char> rgba;
+	addFeedback(rgba, tileKey(0, 0, 0), 5);
+	addFeedback(rgba, tileKey(0, 7, 7), 9);
+	addFeedback(rgba, tileKey(0, 1, 0), 3);
+	addFeedback(rgba, tileKey(1, 3, 3), 2);
+	rgba.insert(rgba.end(), 4, 0);
+	addFeedback(rgba, tileKey(0, 8, 0), 1);
+
+	TileFeedback feedback;
+	feedback.analyse(info, rgba.data(), rgba.size() / 4);
+
+	const TileRequest expected[] = {
+		{ tileKey(3, 0, 0), 19 },
+		{ tileKey(2, 1, 1), 11 }, { tileKey(2, 0, 0), 8 },
+		{ tileKey(1, 3, 3), 11 }, { tileKey(1, 0, 0), 8 },
+		{ tileKey(0, 7, 7), 9 }, { tileKey(0, 0, 0), 5 }, { tileKey(0, 1, 0), 3 },
+	};
+	const vector<TileRequest>& requests = feedback.requests();
+	bool feedbackOK = requests.size() == sizeof(expected) / sizeof(*expected);
+	for (size_t i = 0; feedbackOK && i < requests.size(); i++)
+		feedbackOK = requests[i].tile == expected[i].tile && requests[i].pixels == expected[i].pixels;
+	cout << "feedback requests: " << (feedbackOK ? "ok" : "MISMATCH") << endl;
+
+	// a cache with nothing resident has nothing to point at
+	TileCache cache(info, 2, 2);
+	cache.buildPageTable();
+	bool fallbackOK = cache.pageTableLevel(0)[3] == 0 && cache.pageTableLevel(info.levels - 1)[3] == 0;
+
+	// frame 1 fills the four slots: the pinned root and three level 0 tiles, all resident
+	const unsigned int root = tileKey(3, 0, 0), a = tileKey(0, 0, 0), b = tileKey(0, 1, 0), c = tileKey(0, 7, 7);
+	const unsigned int d = tileKey(1, 3, 3), e = tileKey(2, 0, 0), f = tileKey(0, 1, 1), g = tileKey(0, 2, 2);
+	unsigned int rootSlot, slot, dSlot, eSlot;
+	bool evictionOK = cache.reserve(root, rootSlot, true) && cache.reserve(a, slot) && cache.reserve(b, slot) && cache.reserve(c, slot);
+	cache.markResident(root);
+	cache.markResident(a);
+	cache.markResident(b);
+	cache.markResident(c);
+
+	// frame 2 touches a and c, so b goes, and with a and c in use and d loading nothing else can
+	cache.beginFrame();
+	cache.touch(a);
+	cache.touch(c);
+	bool lruOK = cache.reserve(d, dSlot) && !cache.contains(b) && cache.contains(a) && cache.contains(c);
+	bool thisFrameOK = !cache.reserve(e, slot) && cache.stats().refused == 1;
+
+	// frame 3 touches c, so a goes.  Frame 4 touches nothing, and c goes rather than d, which is still loading
+	cache.beginFrame();
+	cache.touch(c);
+	lruOK = lruOK && cache.reserve(e, eSlot) && !cache.contains(a);
+	cache.beginFrame();
+	bool loadingOK = cache.reserve(f, slot) && !cache.contains(c) && cache.contains(d);
+
+	// with every other slot loading, only the pinned root is left, and it stays
+	bool pinnedOK = !cache.reserve(g, slot) && cache.isResident(root);
+	evictionOK = evictionOK && lruOK && thisFrameOK && loadingOK && pinnedOK && cache.stats().evictions == 3;
+	cout << "least recently used eviction: " << (lruOK ? "ok" : "MISMATCH") << endl;
+	cout << "tiles touched this frame kept: " << (thisFrameOK ? "ok" : "MISMATCH") << endl;
+	cout << "loading tiles kept: " << (loadingOK ? "ok" : "MISMATCH") << endl;
+	cout << "pinned tiles kept: " << (pinnedOK ? "ok" : "MISMATCH") << endl;
+
+	// d and e land.  Each tile should sample itself or its nearest resident ancestor: f, still loading, falls back to
+	// e, and a corner nothing covers falls back to the root
+	cache.markResident(d);
+	cache.markResident(e);
+	fallbackOK = fallbackOK && cache.pageTableDirty();
+	cache.buildPageTable();
+	fallbackOK = fallbackOK && !cache.pageTableDirty() &&
+		pageTableEntryIs(cache, info, d, dSlot, 1) && pageTableEntryIs(cache, info, tileKey(0, 7, 7), dSlot, 1) &&
+		pageTableEntryIs(cache, info, tileKey(0, 6, 6), dSlot, 1) && pageTableEntryIs(cache, info, f, eSlot, 2) &&
+		pageTableEntryIs(cache, info, tileKey(1, 1, 0), eSlot, 2) && pageTableEntryIs(cache, info, tileKey(0, 0, 7), rootSlot, 3) &&
+		pageTableEntryIs(cache, info, root, rootSlot, 3);
+	cout << "page table fallback: " << (fallbackOK ? "ok" : "MISMATCH") << endl;
+
+	bool passed = feedbackOK && evictionOK && fallbackOK;
+	cout << (passed ? "Virtual texture check passed" : "Virtual texture check FAILED") << endl;
+
+	return passed ? 0 : 1;
+}
+
+// The skinning matrices SkinnedMesh worked out before animations were baked, straight from the aiScene: each node's
+// channel found by name, the keys either side of the time found with a linear search and interpolated as Assimp does,
+// slerping rotations, and each bone found by name.  Bones are numbered as SkinnedMesh numbered them
+struct ReferenceAnimation {
+	const aiScene				*scene;
+	map<string, unsigned int>	boneMapping;
+	vector<glm::mat4>			boneOffsets;
+	glm::mat4					globalInverse;
+
+	static glm::mat4 toGLM(const aiMatrix4x4& matrix) {
+		return glm::transpose(glm::make_mat4(&matrix.a1));
+	}
+
+	template<typename Key>
+	static unsigned int findKey(const Key *keys, unsigned int count, float time) {
+		for (unsigned int i = 0; i + 1 < count; i++)
+			if (time < (float)keys[i + 1].mTime)
+				return i;
+		return 0;
+	}
+
+	static aiVector3D interpolate(const aiVectorKey *keys, unsigned int count, float time) {
+		if (count == 1)
+			return keys[0].mValue;
+		unsigned int i = findKey(keys, count, time);
+		float factor = (time - (float)keys[i].mTime) / (float)(keys[i + 1].mTime - keys[i].mTime);
+		return keys[i].mValue + factor * (keys[i + 1].mValue - keys[i].mValue);
+	}
+
+	static aiQuaternion interpolate(const aiQuatKey *keys, unsigned int count, float time) {
+		if (count == 1)
+			return keys[0].mValue;
+		unsigned int i = findKey(keys, count, time);
+		float factor = (time - (float)keys[i].mTime) / (float)(keys[i + 1].mTime - keys[i].mTime);
+		aiQuaternion rotation;
+		aiQuaternion::Interpolate(rotation, keys[i].mValue, keys[i + 1].mValue, factor);
+		return rotation.Normalize();
+	}
+
+	explicit ReferenceAnimation(const aiScene *scene) : scene(scene) {
+		for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+			const aiMesh *mesh = scene->mMeshes[i];
+			for (unsigned int j = 0; j < mesh->mNumBones; j++) {
+				if (boneMapping.find(mesh->mBones[j]->mName.data) == boneMapping.end()) {
+					boneMapping[mesh->mBones[j]->mName.data] = (unsigned int)boneOffsets.size();
+					boneOffsets.push_back(toGLM(mesh->mBones[j]->mOffsetMatrix));
+				}
+			}
+		}
+		globalInverse = glm::inverse(toGLM(scene->mRootNode->mTransformation));
+	}
+
+	void readNode(const aiAnimation *animation, float time, const aiNode *node, const glm::mat4& parent, vector<glm::mat4>& palette) const {
+		glm::mat4 local = toGLM(node->mTransformation);
+		for (unsigned int i = 0; i < animation->mNumChannels; i++) {
+			const aiNodeAnim *channel = animation->mChannels[i];
+			if (strcmp(channel->mNodeName.data, node->mName.data) == 0) {
+				// translation * rotation * scale.  Not aiMatrix4x4's constructor, which scales after rotating
+				aiVector3D scaling = interpolate(channel->mScalingKeys, channel->mNumScalingKeys, time);
+				aiQuaternion rotation = interpolate(channel->mRotationKeys, channel->mNumRotationKeys, time);
+				aiVector3D translation = interpolate(channel->mPositionKeys, channel->mNumPositionKeys, time);
+				local = glm::translate(glm::mat4(1.0), glm::vec3(translation.x, translation.y, translation.z)) *
+					toGLM(aiMatrix4x4(rotation.GetMatrix())) * glm::scale(glm::mat4(1.0), glm::vec3(scaling.x, scaling.y, scaling.z));
+				break;
+			}
+		}
+
+		glm::mat4 global = parent * local;
+		map<string, unsigned int>::const_iterator bone = boneMapping.find(node->mName.data);
+		if (bone != boneMapping.end())
+			palette[bone->second] = globalInverse * global * boneOffsets[bone->second];
+
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			readNode(animation, time, node->mChildren[i], global, palette);
+	}
+
+	void evaluate(unsigned int animationNumber, float timeInSeconds, vector<glm::mat4>& palette) const {
+		const aiAnimation *animation = scene->mAnimations[animationNumber];
+		float ticksPerSecond = (float)(animation->mTicksPerSecond != 0.0 ? animation->mTicksPerSecond : 25.0);
+		float time = fmod(timeInSeconds * ticksPerSecond, (float)animation->mDuration);
+
+		palette.assign(boneOffsets.size(), glm::mat4(1.0));
+		readNode(animation, time, scene->mRootNode, glm::mat4(1.0), palette);
+	}
+};
+
+// The skeleton checkAnimation builds, parents first.  Helper is a node with no bone, carrying Leg_R
+static const char *checkNodeNames[] = {
+	"Root", "Hips", "Spine", "Chest", "Neck", "Head", "Arm_L", "Hand_L", "Arm_R", "Hand_R", "Helper", "Leg_R", "Leg_L"
+};
+static const int checkNodeParents[] = { -1, 0, 1, 2, 3, 4, 3, 6, 3, 8, 1, 10, 1 };
+static const unsigned int numCheckNodes = sizeof(checkNodeNames) / sizeof(*checkNodeNames);
+
+// Bones of the two meshes, out of the nodes' order.  Both meshes use Hips, and Ghost has no node
+static const char *checkMeshBones[2][9] = {
+	{ "Hand_R", "Arm_R", "Head", "Neck", "Chest", "Spine", "Hips", "Hand_L", "Arm_L" },
+	{ "Leg_L", "Hips", "Ghost", "Leg_R" }
+};
+static const unsigned int checkMeshBoneCounts[2] = { 9, 4 };
+
+// An animation channel and how many keys each of its tracks has
+struct CheckChannel {
+	const char		*node;
+	unsigned int	positions, rotations, scalings;
+};
+
+// Walk moves the body, with single key tracks, a channel for the helper node, one for a node the skeleton doesn't have
+// and a second for Hips, which only the first counts.  Wave moves the arms, with ticks per second left at 0 for the
+// default
+static const CheckChannel walkChannels[] = {
+	{ "Leg_R", 25, 49, 2 }, { "Tail", 5, 5, 5 }, { "Hips", 13, 25, 1 }, { "Head", 1, 1, 1 }, { "Leg_L", 25, 49, 2 },
+	{ "Helper", 1, 7, 1 }, { "Spine", 2, 17, 1 }, { "Hips", 3, 3, 3 }, { "Arm_L", 1, 33, 3 }, { "Hand_L", 1, 13, 1 }
+};
+static const CheckChannel waveChannels[] = {
+	{ "Hand_R", 1, 61, 1 }, { "Arm_R", 4, 31, 31 }, { "Chest", 1, 9, 1 }, { "Neck", 3, 1, 2 }
+};
+
+// A rotation of angle radians about a fixed axis for each number
+static aiQuaternion checkRotation(unsigned int number, float angle) {
+	aiVector3D axis(sin(number * 1.7f), 1.0f, cos(number * 0.9f));
+	return aiQuaternion(axis.Normalize(), angle);
+}
+
+// keys evenly spaced over duration ticks, wandering around the node's own transform
+static aiNodeAnim *makeCheckChannel(const CheckChannel& spec, unsigned int number, double duration) {
+	aiNodeAnim *channel = new aiNodeAnim();
+	channel->mNodeName.Set(spec.node);
+
+	channel->mNumPositionKeys = spec.positions;
+	channel->mPositionKeys = new aiVectorKey[spec.positions];
+	for (unsigned int k = 0; k < spec.positions; k++) {
+		channel->mPositionKeys[k].mTime = spec.positions > 1 ? duration * k / (spec.positions - 1) : 0.0;
+		channel->mPositionKeys[k].mValue = aiVector3D(0.1f * sin(k * 0.9f + number), 0.5f + 0.1f * cos(k * 0.4f + number), 0.05f * sin(k * 1.3f));
+	}
+
+	channel->mNumRotationKeys = spec.rotations;
+	channel->mRotationKeys = new aiQuatKey[spec.rotations];
+	for (unsigned int k = 0; k < spec.rotations; k++) {
+		channel->mRotationKeys[k].mTime = spec.rotations > 1 ? duration * k / (spec.rotations - 1) : 0.0;
+		channel->mRotationKeys[k].mValue = checkRotation(number, 0.8f * sin(k * 0.5f + number));
+	}
+
+	channel->mNumScalingKeys = spec.scalings;
+	channel->mScalingKeys = new aiVectorKey[spec.scalings];
+	for (unsigned int k = 0; k < spec.scalings; k++) {
+		channel->mScalingKeys[k].mTime = spec.scalings > 1 ? duration * k / (spec.scalings - 1) : 0.0;
+		channel->mScalingKeys[k].mValue = aiVector3D(1.0f + 0.15f * sin(k * 0.7f + number), 1.0f + 0.1f * cos(k * 0.3f), 1.0f);
+	}
+
+	return channel;
+}
+
+static aiAnimation *makeCheckAnimation(const char *name, double duration, double ticksPerSecond, const CheckChannel *specs, unsigned int count) {
+	aiAnimation *animation = new aiAnimation();
+	animation->mName.Set(name);
+	animation->mDuration = duration;
+	animation->mTicksPerSecond = ticksPerSecond;
+	animation->mNumChannels = count;
+	animation->mChannels = new aiNodeAnim*[count];
+	for (unsigned int i = 0; i < count; i++)
+		animation->mChannels[i] = makeCheckChannel(specs[i], i, duration);
+	return animation;
+}
+
+// Fills in the scene checkAnimation poses: checkNodeNames' skeleton, each node turned and moved from its parent and
+// Helper scaled, two meshes using its bones and the walk and wave animations.  The scene owns all of it
+static void buildCheckScene(aiScene& scene) {
+	vector<aiNode*> nodes(numCheckNodes);
+	for (unsigned int i = 0; i < numCheckNodes; i++) {
+		nodes[i] = new aiNode(checkNodeNames[i]);
+		float scale = string(checkNodeNames[i]) == "Helper" ? 2.0f : 1.0f;
+		nodes[i]->mTransformation = aiMatrix4x4(aiVector3D(scale, scale, scale), checkRotation(i, 0.3f * i),
+			aiVector3D(0.05f * i, 0.5f, 0.02f * i));
+	}
+
+	for (unsigned int i = 1; i < numCheckNodes; i++) {
+		aiNode *parent = nodes[checkNodeParents[i]];
+		aiNode **children = new aiNode*[parent->mNumChildren + 1];
+		std::copy(parent->mChildren, parent->mChildren + parent->mNumChildren, children);
+		children[parent->mNumChildren++] = nodes[i];
+		delete[] parent->mChildren;
+		parent->mChildren = children;
+		nodes[i]->mParent = parent;
+	}
+	scene.mRootNode = nodes[0];
+
+	scene.mNumMeshes = 2;
+	scene.mMeshes = new aiMesh*[2];
+	for (unsigned int i = 0; i < 2; i++) {
+		aiMesh *mesh = new aiMesh();
+		mesh->mNumBones = checkMeshBoneCounts[i];
+		mesh->mBones = new aiBone*[mesh->mNumBones];
+		for (unsigned int j = 0; j < mesh->mNumBones; j++) {
+			mesh->mBones[j] = new aiBone();
+			mesh->mBones[j]->mName.Set(checkMeshBones[i][j]);
+			mesh->mBones[j]->mOffsetMatrix = aiMatrix4x4(aiVector3D(1.0f, 1.0f, 1.0f), checkRotation(j + 20, -0.2f * j),
+				aiVector3D(0.0f, -0.5f * j, 0.1f));
+		}
+		scene.mMeshes[i] = mesh;
+	}
+
+	scene.mNumAnimations = 2;
+	scene.mAnimations = new aiAnimation*[2];
+	scene.mAnimations[0] = makeCheckAnimation("Walk", 48.0, 30.0, walkChannels, sizeof(walkChannels) / sizeof(*walkChannels));
+	scene.mAnimations[1] = makeCheckAnimation("Wave", 120.0, 0.0, waveChannels, sizeof(waveChannels) / sizeof(*waveChannels));
+}
+
+// the largest difference between any elements of two runs of matrices, infinite if either has a NaN
+static float paletteDifference(const glm::mat4 *a, const glm::mat4 *b, unsigned int count) {
+	float difference = 0.0f;
+	for (unsigned int i = 0; i < count; i++)
+		for (int column = 0; column < 4; column++)
+			for (int row = 0; row < 4; row++) {
+				float elementDifference = fabs(a[i][column][row] - b[i][column][row]);
+				difference = std::max(difference, std::isnan(elementDifference) ? std::numeric_limits<float>::infinity() : elementDifference);
+			}
+	return difference;
+}
+
+// the largest difference between two poses' translations, rotations (of either sign) and scales
+static float poseDifference(const LocalPose& a, const LocalPose& b) {
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.translations.size(); i++) {
+		float rotation = std::min(glm::length(a.rotations[i] - b.rotations[i]), glm::length(a.rotations[i] + b.rotations[i]));
+		difference = std::max(difference, glm::length(a.translations[i] - b.translations[i]));
+		difference = std::max(difference, rotation);
+		difference = std::max(difference, glm::length(a.scales[i] - b.scales[i]));
+	}
+	return difference;
+}
+
+// true if every element of the matrices is a NaN
+static bool allNaN(const glm::mat4 *matrices, unsigned int count) {
+	for (unsigned int i = 0; i < count; i++)
+		for (int column = 0; column < 4; column++)
+			for (int row = 0; row < 4; row++)
+				if (!std::isnan(matrices[i][column][row]))
+					return false;
+	return true;
+}
+
+// Builds a scene in memory with buildCheckScene, bakes its animations and checks the skeleton numbers its bones as
+// SkinnedMesh did and the baked clips give the same skinning matrices as evaluating the aiScene's keys directly, for
+// 3 s at 60 frames a second with a cursor and at scattered times without.  Then poses a crowd playing them through an
+// AnimationScheduler on four threads and checks every character came out exactly as posing it alone does, and again
+// into one block laid out as BonePaletteBuffer's region for the frame.  Last come blending and cross-fades: the ends
+// of blends, masks and additive layers, blend trees only sampling the clips that show, AnimationPlayer never jumping
+// when a fade starts, even with more fades than it keeps, and the scheduler posing players' trees as they pose alone.
+// Nothing touches OpenGL.  Returns 0 if everything matched
+int checkAnimation() {
+	// as close as float arithmetic done in a different order gets
+	const float PALETTE_TOLERANCE = 1e-4f;
+
+	aiScene scene;
+	buildCheckScene(scene);
+	ReferenceAnimation reference(&scene);
+
+	Skeleton skeleton;
+	skeleton.build(&scene);
+	bool skeletonOK = skeleton.numNodes() == numCheckNodes && skeleton.boneMapping == reference.boneMapping &&
+		skeleton.unplacedBones.size() == 1 && skeleton.unplacedBones[0] == reference.boneMapping["Ghost"];
+	for (unsigned int i = 0; i < skeleton.numNodes(); i++)
+		skeletonOK = skeletonOK && skeleton.parents[i] < (int)i;
+	cout << "skeleton nodes and bones: " << (skeletonOK ? "ok" : "MISMATCH") << endl;
+
+	vector<AnimationClip> clips(scene.mNumAnimations);
+	bool bakeOK = skeletonOK;
+	for (unsigned int i = 0; i < scene.mNumAnimations; i++)
+		bakeOK = bakeOK && AnimationClip::bake(scene.mAnimations[i], skeleton, clips[i]);
+	bakeOK = bakeOK && clips[0].channels.size() == scene.mAnimations[0]->mNumChannels - 2 &&
+		clips[1].channels.size() == scene.mAnimations[1]->mNumChannels && clips[1].ticksPerSecond == 25.0f;
+
+	float bakeDifference = 0.0f;
+	PoseScratch scratch;
+	vector<glm::mat4> palette(skeleton.numBones()), expected;
+	for (unsigned int i = 0; bakeOK && i < clips.size(); i++) {
+		ClipCursor cursor;
+		for (int frame = 0; frame < 180; frame++) {
+			const float times[2] = { frame / 60.0f, fmod(frame * 0.731f, 7.0f) };
+			for (int searched = 0; searched < 2; searched++) {
+				reference.evaluate(i, times[searched], expected);
+				clips[i].evaluate(skeleton, times[searched], scratch, palette.data(), searched ? nullptr : &cursor);
+				bakeDifference = std::max(bakeDifference, paletteDifference(palette.data(), expected.data(), skeleton.numBones()));
+			}
+		}
+	}
+	bakeOK = bakeOK && bakeDifference <= PALETTE_TOLERANCE;
+	cout << "baked clips against the aiScene's keys: " << (bakeOK ? "ok" : "MISMATCH") << " (largest difference " << bakeDifference
+		<< ")" << endl;
+
+	// the crowd starts at scattered times, most with cursors, and plays on for half a second
+	const unsigned int CROWD = 100;
+	AnimationScheduler scheduler(4);
+	vector<AnimationInstance> crowd(CROWD);
+	vector<ClipCursor> cursors(CROWD);
+	vector<vector<glm::mat4>> palettes(CROWD, vector<glm::mat4>(skeleton.numBones()));
+	for (unsigned int i = 0; i < CROWD; i++) {
+		crowd[i].skeleton = &skeleton;
+		crowd[i].clip = &clips[i % clips.size()];
+		crowd[i].cursor = i % 3 ? &cursors[i] : nullptr;
+		crowd[i].palette = palettes[i].data();
+	}
+
+	bool schedulerOK = bakeOK;
+	for (int frame = 0; schedulerOK && frame < 30; frame++) {
+		for (unsigned int i = 0; i < CROWD; i++)
+			crowd[i].time = i * 0.37f + frame / 60.0f;
+		scheduler.evaluate(crowd);
+		schedulerOK = scheduler.stats().instances == CROWD;
+
+		for (unsigned int i = 0; schedulerOK && i < CROWD; i++) {
+			crowd[i].clip->evaluate(skeleton, crowd[i].time, scratch, palette.data());
+			schedulerOK = paletteDifference(palette.data(), palettes[i].data(), skeleton.numBones()) == 0.0f;
+		}
+	}
+	cout << "scheduled crowd against posing each alone: " << (schedulerOK ? "ok" : "MISMATCH") << endl;
+
+	// part of the crowd again, into one block as a frame's palette region is filled: each character's matrices straight
+	// after the last's, where the shader finds them at paletteBase + instance * paletteStride.  The region is mapped
+	// memory that is only ever written, so starting from NaNs every matrix must be written, the bone with no node's as
+	// the identity, and the matrices after the last character left alone
+	const unsigned int REGION_CHARACTERS = 20, GUARD_MATRICES = 4;
+	const unsigned int stride = skeleton.numBones();
+	const unsigned int ghost = skeleton.unplacedBones.empty() ? 0 : skeleton.unplacedBones[0];
+	const glm::vec4 nanColumn(std::numeric_limits<float>::quiet_NaN());
+	vector<glm::mat4> region(REGION_CHARACTERS * stride + GUARD_MATRICES, glm::mat4(nanColumn, nanColumn, nanColumn, nanColumn));
+	vector<AnimationInstance> regionCrowd(crowd.begin(), crowd.begin() + REGION_CHARACTERS);
+	for (unsigned int i = 0; i < REGION_CHARACTERS; i++)
+		regionCrowd[i].palette = &region[i * stride];
+	scheduler.evaluate(regionCrowd);
+
+	bool regionOK = schedulerOK && allNaN(&region[REGION_CHARACTERS * stride], GUARD_MATRICES);
+	for (unsigned int i = 0; regionOK && i < REGION_CHARACTERS; i++)
+		regionOK = paletteDifference(&region[i * stride], palettes[i].data(), stride) == 0.0f && region[i * stride + ghost] == glm::mat4(1.0f);
+	cout << "palettes packed into one write only region: " << (regionOK ? "ok" : "MISMATCH") << endl;
+
+	// the ends of a blend are its poses, a blend through a mask leaves the nodes outside it alone, and a layer added
+	// at its reference, or with no weight, changes nothing
+	const float POSE_TOLERANCE = 1e-5f;
+	LocalPose walk, wave, blended, expectedPose;
+	walk.resize(skeleton.numNodes());
+	wave.resize(skeleton.numNodes());
+	blended.resize(skeleton.numNodes());
+	expectedPose.resize(skeleton.numNodes());
+	clips[0].sample(skeleton, 0.7f, walk);
+	clips[1].sample(skeleton, 1.3f, wave);
+
+	PoseBlend::blend(skeleton, walk, wave, 0.0f, blended);
+	bool blendOK = poseDifference(blended, walk) <= POSE_TOLERANCE;
+	PoseBlend::blend(skeleton, walk, wave, 1.0f, blended);
+	blendOK = blendOK && poseDifference(blended, wave) <= POSE_TOLERANCE;
+
+	BoneMask arm = BoneMask::subtree(skeleton, "Arm_L");
+	expectedPose = walk;
+	for (unsigned int i = 0; i < skeleton.numNodes(); i++) {
+		bool inArm = skeleton.names[i] == "Arm_L" || skeleton.names[i] == "Hand_L";
+		blendOK = blendOK && arm.weights[i] == (inArm ? 1.0f : 0.0f);
+		if (inArm) {
+			expectedPose.translations[i] = wave.translations[i];
+			expectedPose.rotations[i] = wave.rotations[i];
+			expectedPose.scales[i] = wave.scales[i];
+		}
+	}
+	PoseBlend::blend(skeleton, walk, wave, 1.0f, blended, &arm);
+	blendOK = blendOK && poseDifference(blended, expectedPose) <= POSE_TOLERANCE;
+
+	PoseBlend::addLayer(skeleton, walk, wave, wave, 1.0f, blended);
+	blendOK = blendOK && poseDifference(blended, walk) <= POSE_TOLERANCE;
+	PoseBlend::addLayer(skeleton, walk, wave, skeleton.bindPose, 0.0f, blended);
+	blendOK = blendOK && poseDifference(blended, walk) <= POSE_TOLERANCE;
+	cout << "blend ends, masks and additive layers: " << (blendOK ? "ok" : "MISMATCH") << endl;
+
+	// a tree blending the same two poses only samples both while both show
+	BlendScratch blendScratch;
+	BlendTree tree;
+	unsigned int walkNode = tree.addClip(&clips[0]), waveNode = tree.addClip(&clips[1]);
+	unsigned int mix = tree.addBlend(walkNode, waveNode, 0.0f);
+	tree.setTime(walkNode, 0.7f);
+	tree.setTime(waveNode, 1.3f);
+	bool treeOK = poseDifference(tree.evaluate(skeleton, blendScratch), walk) <= POSE_TOLERANCE && tree.sampledClips() == 1;
+	tree.setWeight(mix, 1.0f);
+	treeOK = treeOK && poseDifference(tree.evaluate(skeleton, blendScratch), wave) <= POSE_TOLERANCE && tree.sampledClips() == 1;
+	tree.setWeight(mix, 0.5f);
+	PoseBlend::blend(skeleton, walk, wave, 0.5f, blended);
+	treeOK = treeOK && poseDifference(tree.evaluate(skeleton, blendScratch), blended) <= POSE_TOLERANCE && tree.sampledClips() == 2;
+	cout << "blend trees sample only the clips that show: " << (treeOK ? "ok" : "MISMATCH") << endl;
+
+	// a player cross-fading between walk, wave and the bind pose every 47 frames over 0.3 s.  Starting a fade mustn't
+	// move the pose, and once it finishes the pose is the new clip's, played from when the fade started
+	const AnimationClip *states[3] = { &clips[0], &clips[1], nullptr };
+	const float FRAME_SECONDS = 1.0f / 60.0f;
+	AnimationPlayer player;
+	const AnimationClip *playing = &clips[0];
+	float playingTime = 0.0f, fadeJump = 0.0f, settledDifference = 0.0f;
+	player.play(skeleton, playing, 0.0f);
+	for (int frame = 1; frame < 600; frame++) {
+		if (frame % 47 == 0) {
+			LocalPose before = player.tree().evaluate(skeleton, blendScratch);
+			playing = states[(frame / 47) % 3];
+			player.play(skeleton, playing, 0.3f);
+			playingTime = 0.0f;
+			fadeJump = std::max(fadeJump, poseDifference(player.tree().evaluate(skeleton, blendScratch), before));
+		}
+
+		player.update(FRAME_SECONDS);
+		playingTime += FRAME_SECONDS;
+		const LocalPose& pose = player.tree().evaluate(skeleton, blendScratch);
+		if (!player.fading()) {
+			if (playing)
+				playing->sample(skeleton, playingTime, expectedPose);
+			else
+				expectedPose = skeleton.bindPose;
+			settledDifference = std::max(settledDifference, poseDifference(pose, expectedPose));
+		}
+	}
+	bool fadeOK = fadeJump <= POSE_TOLERANCE && settledDifference <= 1e-4f;
+	cout << "cross-fades start without a jump and settle on the clip: " << (fadeOK ? "ok" : "MISMATCH") << endl;
+
+	// a new 0.5 s fade every 4 frames, far more than MAX_FADES at once, so the oldest keep being frozen into a still
+	// pose.  That mustn't move the pose either, the tree mustn't grow past MAX_FADES, and once the fades stop the last
+	// one finishes
+	AnimationPlayer crowded;
+	unsigned int freezes = 0;
+	bool freezeOK = true;
+	crowded.play(skeleton, &clips[0], 0.0f);
+	for (int frame = 0; frame < 600; frame++) {
+		if (frame % 4 == 0) {
+			LocalPose before = crowded.tree().evaluate(skeleton, blendScratch);
+			if (crowded.tree().size() >= 2 * AnimationPlayer::MAX_FADES - 1)
+				freezes++;
+			crowded.play(skeleton, states[(frame / 4) % 3], 0.5f);
+			freezeOK = freezeOK && poseDifference(crowded.tree().evaluate(skeleton, blendScratch), before) <= POSE_TOLERANCE;
+		}
+		crowded.update(FRAME_SECONDS);
+		freezeOK = freezeOK && crowded.tree().size() <= 2 * AnimationPlayer::MAX_FADES;
+	}
+	for (int frame = 0; frame < 60; frame++)
+		crowded.update(FRAME_SECONDS);
+	freezeOK = freezeOK && freezes > 0 && !crowded.fading();
+	cout << "fades beyond MAX_FADES frozen without a jump: " << (freezeOK ? "ok" : "MISMATCH") << endl;
+
+	// players part way through fades, posed by the scheduler through their trees
+	vector<AnimationPlayer> players(CROWD);
+	vector<AnimationInstance> playerCrowd(CROWD);
+	for (unsigned int i = 0; i < CROWD; i++) {
+		players[i].play(skeleton, states[i % 3], 0.0f);
+		players[i].update(i * 0.1f);
+		players[i].play(skeleton, states[(i + 1) % 3], 0.5f);
+		players[i].update(0.2f);
+		playerCrowd[i].skeleton = &skeleton;
+		playerCrowd[i].tree = &players[i].tree();
+		playerCrowd[i].palette = palettes[i].data();
+	}
+	scheduler.evaluate(playerCrowd);
+
+	bool scheduledTreesOK = true;
+	for (unsigned int i = 0; scheduledTreesOK && i < CROWD; i++) {
+		players[i].tree().evaluate(skeleton, blendScratch, palette.data());
+		scheduledTreesOK = paletteDifference(palette.data(), palettes[i].data(), skeleton.numBones()) == 0.0f;
+	}
+	cout << "scheduled blend trees against evaluating each alone: " << (scheduledTreesOK ? "ok" : "MISMATCH") << endl;
+
+	bool passed = skeletonOK && bakeOK && schedulerOK && regionOK && blendOK && treeOK && fadeOK && freezeOK && scheduledTreesOK;
+	cout << (passed ? "Animation check passed" : "Animation check FAILED") << endl;
+
+	return passed ? 0 : 1;
+}
+
+// A crowd of players, each cross-fading between idle (the bind pose) and the player's animations, changing every two
+// seconds with 0.3 s fades, posed through an AnimationScheduler.  Then the same with a half strength additive layer of
+// the first animation over everything below the first bone.  Reports the cost per frame and the clips sampled per
+// character, which the fades keep to little more than one
+void benchmarkAnimationBlending(const Skeleton& skeleton, const vector<AnimationClip>& clips, const vector<AnimationClip>& borrowedClips) {
+	const unsigned int PLAYERS = 250;
+	const int FRAMES = 300;
+	const int STATE_FRAMES = 120;
+	const float FADE_SECONDS = 0.3f;
+
+	vector<const AnimationClip*> states(1, nullptr);
+	for (const AnimationClip& clip : clips)
+		states.push_back(&clip);
+	for (const AnimationClip& clip : borrowedClips)
+		states.push_back(&clip);
+
+	int firstBoneNode = 0;
+	while (firstBoneNode < (int)skeleton.numNodes() && skeleton.bones[firstBoneNode] < 0)
+		firstBoneNode++;
+	BoneMask layerMask = firstBoneNode < (int)skeleton.numNodes() ? BoneMask::subtree(skeleton, skeleton.names[firstBoneNode].c_str())
+		: BoneMask();
+
+	AnimationScheduler scheduler;
+
+	for (int layered = 0; layered < (clips.empty() || layerMask.weights.empty() ? 1 : 2); layered++) {
+		vector<AnimationPlayer> players(PLAYERS);
+		vector<BlendTree> layers(PLAYERS);
+		vector<AnimationInstance> crowd(PLAYERS);
+		vector<vector<glm::mat4>> palettes(PLAYERS, vector<glm::mat4>(skeleton.numBones()));
+		unsigned int seed = 1;
+
+		for (unsigned int i = 0; i < PLAYERS; i++) {
+			players[i].play(skeleton, states[i % states.size()], 0.0f);
+			crowd[i].skeleton = &skeleton;
+			crowd[i].palette = palettes[i].data();
+		}
+
+		double milliseconds = 0.0;
+		size_t sampledClips = 0;
+		for (int frame = 0; frame < FRAMES; frame++) {
+			for (unsigned int i = 0; i < PLAYERS; i++) {
+				// each player changes state on its own schedule
+				if ((frame + i * 7) % STATE_FRAMES == 0) {
+					seed = seed * 1664525u + 1013904223u;
+					players[i].play(skeleton, states[(seed >> 16) % states.size()], FADE_SECONDS);
+				}
+				players[i].update(1.0f / 60.0f);
+
+				crowd[i].tree = &players[i].tree();
+				if (layered) {
+					// the player's blend with the layer added, rebuilt as the player's tree changes
+					BlendTree& layer = layers[i];
+					layer = players[i].tree();
+					unsigned int base = layer.size() - 1;
+					unsigned int layerClip = layer.addClip(&clips[0]);
+					layer.setTime(layerClip, frame / 60.0f);
+					layer.addAdditive(base, layerClip, &skeleton.bindPose, 0.5f, &layerMask);
+					crowd[i].tree = &layer;
+				}
+			}
+
+			scheduler.evaluate(crowd);
+			milliseconds += scheduler.stats().milliseconds;
+			for (unsigned int i = 0; i < PLAYERS; i++)
+				sampledClips += crowd[i].tree->sampledClips();
+		}
+
+		cout << PLAYERS << " players cross-fading between " << states.size() << " states" << (layered ? " with an additive layer" : "")
+			<< " on " << scheduler.threads() << " thread(s): " << milliseconds / FRAMES << " ms per frame, "
+			<< (double)sampledClips / (PLAYERS * FRAMES) << " clips sampled per player" << endl;
+	}
+}
+
+// The memory an animation's channels and keys take in the aiScene
+static size_t sceneKeyBytes(const aiAnimation *animation) {
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < animation->mNumChannels; i++) {
+		const aiNodeAnim *channel = animation->mChannels[i];
+		bytes += sizeof(aiNodeAnim) + (channel->mNumPositionKeys + channel->mNumScalingKeys) * sizeof(aiVectorKey)
+			+ channel->mNumRotationKeys * sizeof(aiQuatKey);
+	}
+	return bytes;
+}
+
+// Bakes and compresses each of a scene's animations with the default settings, as SkinnedMesh does, and prints the
+// clip's keys and bytes in the aiScene, baked and compressed, and how far compression moved any node.  Returns the
+// clips' total bytes in each form
+static void reportSceneCompression(const aiScene *scene, size_t& sceneBytes, size_t& bakedBytes, size_t& compressedBytes) {
+	Skeleton skeleton;
+	skeleton.build(scene);
+	cout << "  " << skeleton.numNodes() << " nodes, " << skeleton.numBones() << " bones, " << scene->mNumAnimations << " animations" << endl;
+
+	for (unsigned int i = 0; i < scene->mNumAnimations; i++) {
+		AnimationClip clip;
+		if (!AnimationClip::bake(scene->mAnimations[i], skeleton, clip)) {
+			cout << "  \"" << scene->mAnimations[i]->mName.data << "\" moves none of the skeleton's nodes" << endl;
+			continue;
+		}
+
+		size_t bakedChannels = clip.channels.size();
+		ClipCompressionStats stats;
+		clip.compress(skeleton, ClipCompression(), &stats);
+
+		size_t bytes = sceneKeyBytes(scene->mAnimations[i]);
+		sceneBytes += bytes;
+		bakedBytes += stats.originalBytes;
+		compressedBytes += stats.compressedBytes;
+
+		cout << "  \"" << clip.name << "\" " << clip.seconds() << " s, " << bakedChannels << " channels to " << clip.channels.size() << ", "
+			<< stats.originalKeys << " keys to " << stats.compressedKeys << "; " << bytes << " bytes in the aiScene, " << stats.originalBytes << " baked, "
+			<< stats.compressedBytes << " compressed (" << 100.0 * stats.compressedBytes / std::max(stats.originalBytes, (size_t)1)
+			<< "% of baked)" << endl;
+		cout << "    max error: rotation " << stats.maxRotationError << " degrees, translation " << stats.maxTranslationError
+			<< ", bone space " << stats.maxError << " (tolerance " << stats.tolerance << ")" << endl;
+	}
+}
+
+// Imports each model as SkinnedMesh does and reports each of its animations with reportSceneCompression, then the
+// totals.  Returns 1 if a model couldn't be imported
+int reportAnimationCompression(int numPaths, char *paths[]) {
+	vector<string> models(paths, paths + numPaths);
+	if (models.empty()) {
+		models.push_back("Resources\\Models\\Wave Character\\Wave_Player.fbx");
+		models.push_back("Resources\\Models\\Wave Character\\Player_Wave_V2.fbx");
+	}
+
+	bool passed = true;
+	size_t sceneBytes = 0, bakedBytes = 0, compressedBytes = 0;
+
+	for (const string& path : models) {
+		Assimp::Importer importer;
+		const aiScene *scene = importer.ReadFile(path.c_str(), aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals);
+		if (!scene) {
+			cout << path << ": " << importer.GetErrorString() << endl;
+			passed = false;
+			continue;
+		}
+
+		cout << path << ":" << endl;
+		reportSceneCompression(scene, sceneBytes, bakedBytes, compressedBytes);
+	}
+
+	cout << "All animations: " << sceneBytes << " bytes in the aiScenes, " << bakedBytes << " baked, " << compressedBytes << " compressed"
+		<< endl;
+
+	return passed ? 0 : 1;
+}
+
+// Bakes each model's animations and plays every one through for POSES poses at 60 frames a second, sampling with a
+// cursor (as an instance playing forward does) and with a fresh search for each pose, and reports poses per second.
+// Each pose includes the skinning matrices.  Then poses crowds of characters playing the animations through an
+// AnimationScheduler, for a range of crowd sizes and thread counts
+int benchmarkAnimation(int numPaths, char *paths[]) {
+	typedef std::chrono::steady_clock Clock;
+	const int POSES = 20000;
+	const int FRAMES = 200;
+
+	struct Character {
+		Skeleton				skeleton;
+		vector<AnimationClip>	clips;
+	};
+
+	vector<string> models(paths, paths + numPaths);
+	if (models.empty()) {
+		models.push_back("Resources\\Models\\Wave Character\\Wave_Player.fbx");
+		models.push_back("Resources\\Models\\Wave Character\\Player_Wave_V2.fbx");
+	}
+
+	// reserved so the crowd's pointers to the characters stay valid
+	vector<Character> characters;
+	characters.reserve(models.size());
+	// the other models' animations baked onto the first model's skeleton, where they move nodes of the same names
+	vector<AnimationClip> borrowedClips;
+
+	for (const string& path : models) {
+		Assimp::Importer importer;
+		const aiScene *scene = importer.ReadFile(path.c_str(), aiProcess_Triangulate);
+		if (!scene) {
+			cout << path << ": " << importer.GetErrorString() << endl;
+			continue;
+		}
+
+		characters.emplace_back();
+		Skeleton& skeleton = characters.back().skeleton;
+		vector<AnimationClip>& clips = characters.back().clips;
+
+		Clock::time_point start = Clock::now();
+		skeleton.build(scene);
+		clips.resize(scene->mNumAnimations);
+		size_t keys = 0;
+		for (unsigned int i = 0; i < scene->mNumAnimations; i++) {
+			AnimationClip::bake(scene->mAnimations[i], skeleton, clips[i]);
+			keys += clips[i].keyCount();
+		}
+		double bakeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		cout << path << ": " << skeleton.numNodes() << " nodes, " << skeleton.numBones() << " bones, " << clips.size()
+			<< " animations with " << keys << " keys baked in " << bakeMilliseconds << " ms" << endl;
+
+		for (unsigned int i = 0; characters.size() > 1 && i < scene->mNumAnimations; i++) {
+			AnimationClip clip;
+			if (AnimationClip::bake(scene->mAnimations[i], characters.front().skeleton, clip))
+				borrowedClips.push_back(clip);
+		}
+
+		PoseScratch scratch;
+		vector<glm::mat4> palette(skeleton.numBones(), glm::mat4(1.0));
+
+		for (const AnimationClip& clip : clips) {
+			double milliseconds[2];
+			for (int search = 0; search < 2; search++) {
+				ClipCursor cursor;
+				start = Clock::now();
+				for (int i = 0; i < POSES; i++)
+					clip.evaluate(skeleton, i / 60.0f, scratch, palette.data(), search ? nullptr : &cursor);
+				milliseconds[search] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			}
+
+			cout << "  \"" << clip.name << "\" " << clip.seconds() << " s, " << clip.channels.size() << " channels: "
+				<< POSES / (milliseconds[0] / 1000.0) << " poses/s with a cursor, " << POSES / (milliseconds[1] / 1000.0)
+				<< " poses/s searching" << endl;
+		}
+
+		// each clip compressed: its keys' size as the aiScene holds them, baked and compressed, how far compression
+		// moved it and how fast it samples afterwards
+		for (unsigned int i = 0; i < clips.size(); i++) {
+			size_t sceneBytes = sceneKeyBytes(scene->mAnimations[i]);
+
+			AnimationClip compressed = clips[i];
+			ClipCompressionStats stats;
+			start = Clock::now();
+			compressed.compress(skeleton, ClipCompression(), &stats);
+			double compressMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			ClipCursor cursor;
+			start = Clock::now();
+			for (int j = 0; j < POSES; j++)
+				compressed.evaluate(skeleton, j / 60.0f, scratch, palette.data(), &cursor);
+			double sampleMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			cout << "  \"" << compressed.name << "\" compressed in " << compressMilliseconds << " ms: " << stats.originalKeys << " keys to "
+				<< stats.compressedKeys << ", " << sceneBytes << " bytes in the aiScene, " << stats.originalBytes << " baked, "
+				<< stats.compressedBytes << " compressed; max error " << stats.maxError << " (tolerance " << stats.tolerance << "), "
+				<< POSES / (sampleMilliseconds / 1000.0) << " poses/s with a cursor" << endl;
+		}
+	}
+
+	// every animation of every model, for the crowd to play in turn
+	vector<AnimationInstance> animations;
+	for (const Character& character : characters) {
+		for (const AnimationClip& clip : character.clips) {
+			AnimationInstance instance;
+			instance.skeleton = &character.skeleton;
+			instance.clip = &clip;
+			animations.push_back(instance);
+		}
+	}
+	if (animations.empty())
+		return 0;
+
+	const unsigned int crowdSizes[] = { 1, 10, 100, 250, 500, 1000 };
+	unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(hardwareThreads);
+
+	for (unsigned int threads : threadCounts) {
+		AnimationScheduler scheduler(threads);
+
+		for (unsigned int crowdSize : crowdSizes) {
+			// each character starts its animation at a different point, with its own cursor and palette
+			vector<AnimationInstance> crowd(crowdSize);
+			vector<ClipCursor> cursors(crowdSize);
+			vector<vector<glm::mat4>> palettes(crowdSize);
+			for (unsigned int i = 0; i < crowdSize; i++) {
+				crowd[i] = animations[i % animations.size()];
+				crowd[i].cursor = &cursors[i];
+				palettes[i].resize(crowd[i].skeleton->numBones(), glm::mat4(1.0));
+				crowd[i].palette = palettes[i].data();
+			}
+
+			double milliseconds = 0.0;
+			for (int frame = 0; frame < FRAMES; frame++) {
+				for (unsigned int i = 0; i < crowdSize; i++)
+					crowd[i].time = i * 0.37f + frame / 60.0f;
+
+				scheduler.evaluate(crowd);
+				milliseconds += scheduler.stats().milliseconds;
+			}
+
+			cout << crowdSize << " characters on " << threads << " thread(s): " << milliseconds / FRAMES << " ms per frame, "
+				<< crowdSize * FRAMES / (milliseconds / 1000.0) << " poses/s" << endl;
+		}
+	}
+
+	benchmarkAnimationBlending(characters.front().skeleton, characters.front().clips, borrowedClips);
+
+	return 0;
+}
@@ -1,4 +1,5 @@
 #include "AABB.h"
+#include "GLState.h"
 
 
 static float boxPositionArray[] = 
@@ -22,7 +23,7 @@ GLushort elements[] = {
 void AABB::setupVAO()
 {	// Configure VAO/VBO for texture quads
 	glGenVertexArrays(1, &this->VAO);
-	glBindVertexArray(this->VAO);
+	GLState::bindVertexArray(this->VAO);
 
 	glGenBuffers(1, &this->VBO);
 	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
@@ -34,7 +35,7 @@ void AABB::setupVAO()
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 void AABB::setViewProjection(glm::mat4 viewProjection)
@@ -82,7 +83,7 @@ void AABB::render(GLuint lineShader, bool frustum)
 	static GLint mLocation = glGetUniformLocation(lineShader, "model");
 	static GLint vpLocation = glGetUniformLocation(lineShader, "viewProjection");
 
-	glUseProgram(lineShader);
+	GLState::useProgram(lineShader);
 
 	glm::vec4 colour(1.0, 1.0, 1.0, 1.0); //white by default
 
@@ -96,13 +97,10 @@ void AABB::render(GLuint lineShader, bool frustum)
 	glUniformMatrix4fv(mLocation, 1, GL_FALSE, glm::value_ptr(this->modelMatrix));
 	glUniformMatrix4fv(vpLocation, 1, GL_FALSE, glm::value_ptr(this->viewProjectionMatrix));
 
-	glBindVertexArray(this->VAO);
+	GLState::bindVertexArray(this->VAO);
 	glDrawElements(GL_LINE_LOOP, 4, GL_UNSIGNED_SHORT, 0);
 	glDrawElements(GL_LINE_LOOP, 4, GL_UNSIGNED_SHORT, (GLvoid*)(4 * sizeof(GLushort)));
 	glDrawElements(GL_LINES, 8, GL_UNSIGNED_SHORT, (GLvoid*)(8 * sizeof(GLushort)));
-	glBindVertexArray(0);
-
-	glUseProgram(0);
 }
 
 glm::vec3 AABB::getSize()
@@ -0,0 +1,137 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+static std::atomic<size_t> totalCount(0);
+static std::atomic<size_t> frameCount(0);
+static std::atomic<size_t> frameByteCount(0);
+
+
+//
+// Private functions
+//
+
+static void *countedAlloc(size_t size)
+{
+	totalCount.fetch_add(1, std::memory_order_relaxed);
+	frameCount.fetch_add(1, std::memory_order_relaxed);
+	frameByteCount.fetch_add(size, std::memory_order_relaxed);
+
+	// malloc(0) may return NULL, but operator new must return a unique pointer
+	return std::malloc(size ? size : 1);
+}
+
+
+//
+// AllocationCounter
+//
+
+void AllocationCounter::beginFrame()
+{
+	frameCount.store(0, std::memory_order_relaxed);
+	frameByteCount.store(0, std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::frameAllocations()
+{
+	return frameCount.load(std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::frameBytes()
+{
+	return frameByteCount.load(std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::totalAllocations()
+{
+	return totalCount.load(std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::peakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	// kilobytes on Linux
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+
+//
+// Global operator new/delete replacements
+//
+
+void *operator new(size_t size)
+{
+	void *p = countedAlloc(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	void *p = countedAlloc(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+	std::free(p);
+}
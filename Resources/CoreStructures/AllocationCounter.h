@@ -0,0 +1,26 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+// Counts calls to the global operator new (AllocationCounter.cpp replaces the global new/delete operators).
+// Call beginFrame() at the start of each frame and frameAllocations() at the end to check how many heap
+// allocations the frame made - in steady state the render loop should report zero.
+class AllocationCounter {
+
+public:
+	// resets the per-frame counters
+	static void beginFrame();
+
+	// allocations / bytes requested since the last beginFrame()
+	static size_t frameAllocations();
+	static size_t frameBytes();
+
+	// allocations made since the program started
+	static size_t totalAllocations();
+
+	// the most physical memory the process has used (peak working set on Windows, max RSS elsewhere)
+	static size_t peakResidentBytes();
+};
+
+#endif
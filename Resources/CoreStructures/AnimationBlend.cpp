@@ -0,0 +1,407 @@
+//  AnimationBlend.cpp
+
+#include "AnimationBlend.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define ANIMATION_BLEND_SSE2
+#include <emmintrin.h>
+#endif
+
+
+//
+// Private functions
+//
+
+#ifdef ANIMATION_BLEND_SSE2
+
+// the dot product of two quaternions in every lane
+static inline __m128 dot4(__m128 a, __m128 b)
+{
+	__m128 products = _mm_mul_ps(a, b);
+	__m128 pairs = _mm_add_ps(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+#endif
+
+// interpolates linearly from a to b, or to -b if that's nearer (the same rotation, the shorter way round), and
+// renormalises
+static inline glm::quat nlerp(const glm::quat& a, const glm::quat& b, float weight)
+{
+#ifdef ANIMATION_BLEND_SSE2
+	__m128 start = _mm_loadu_ps(&a.x);
+	__m128 end = _mm_loadu_ps(&b.x);
+
+	// flip end by copying the dot product's sign bit into every component
+	end = _mm_xor_ps(end, _mm_and_ps(dot4(start, end), _mm_set1_ps(-0.0f)));
+
+	__m128 q = _mm_add_ps(start, _mm_mul_ps(_mm_sub_ps(end, start), _mm_set1_ps(weight)));
+	q = _mm_div_ps(q, _mm_sqrt_ps(dot4(q, q)));
+
+	glm::quat result;
+	_mm_storeu_ps(&result.x, q);
+	return result;
+#else
+	glm::quat end = glm::dot(a, b) < 0.0f ? -b : b;
+	return glm::normalize(a * (1.0f - weight) + end * weight);
+#endif
+}
+
+// eases a fade in and out, so nothing starts or stops moving suddenly
+static inline float fadeWeight(float elapsed, float fadeSeconds)
+{
+	float t = fadeSeconds > 0.0f ? std::min(elapsed / fadeSeconds, 1.0f) : 1.0f;
+	return t * t * (3.0f - 2.0f * t);
+}
+
+static inline float nodeWeight(float weight, const BoneMask *mask, unsigned int node)
+{
+	return mask ? weight * mask->weights[node] : weight;
+}
+
+static inline void ensureSize(LocalPose& pose, const Skeleton& skeleton)
+{
+	if (pose.translations.size() < skeleton.numNodes())
+		pose.resize(skeleton.numNodes());
+}
+
+
+//
+// BoneMask public method implementation
+//
+
+BoneMask BoneMask::subtree(const Skeleton& skeleton, const char *node, float weight)
+{
+	BoneMask mask;
+	mask.weights.assign(skeleton.numNodes(), 0.0f);
+
+	int root = skeleton.findNode(node);
+	if (root < 0)
+		return mask;
+
+	// nodes are stored depth first, so a subtree follows its root and every node's parent comes before it
+	mask.weights[root] = weight;
+	for (unsigned int i = root + 1; i < skeleton.numNodes(); i++)
+	{
+		int parent = skeleton.parents[i];
+		if (parent < root)
+			break;
+		if (mask.weights[parent] != 0.0f)
+			mask.weights[i] = weight;
+	}
+
+	return mask;
+}
+
+
+//
+// PoseBlend public method implementation
+//
+
+void PoseBlend::blend(const Skeleton& skeleton, const LocalPose& from, const LocalPose& to, float weight, LocalPose& out,
+	const BoneMask *mask)
+{
+	unsigned int count = skeleton.numNodes();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float w = nodeWeight(weight, mask, i);
+		out.translations[i] = from.translations[i] + (to.translations[i] - from.translations[i]) * w;
+		out.scales[i] = from.scales[i] + (to.scales[i] - from.scales[i]) * w;
+		out.rotations[i] = nlerp(from.rotations[i], to.rotations[i], w);
+	}
+}
+
+void PoseBlend::addLayer(const Skeleton& skeleton, const LocalPose& base, const LocalPose& layer, const LocalPose& reference,
+	float weight, LocalPose& out, const BoneMask *mask)
+{
+	const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+
+	unsigned int count = skeleton.numNodes();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float w = nodeWeight(weight, mask, i);
+
+		out.translations[i] = base.translations[i] + (layer.translations[i] - reference.translations[i]) * w;
+
+		// the layer's turn away from the reference, scaled down and applied after the base's own rotation
+		glm::quat difference = glm::conjugate(reference.rotations[i]) * layer.rotations[i];
+		out.rotations[i] = glm::normalize(base.rotations[i] * nlerp(identity, difference, w));
+
+		glm::vec3 ratio = layer.scales[i] / glm::max(reference.scales[i], glm::vec3(1e-6f));
+		out.scales[i] = base.scales[i] * (glm::vec3(1.0f) + (ratio - glm::vec3(1.0f)) * w);
+	}
+}
+
+
+//
+// BlendTree public method implementation
+//
+
+unsigned int BlendTree::addClip(const AnimationClip *clip, float speed)
+{
+	Node node = Node();
+	node.type = BLEND_CLIP;
+	node.clip = clip;
+	node.speed = speed;
+	nodes.push_back(node);
+	return (unsigned int)nodes.size() - 1;
+}
+
+unsigned int BlendTree::addPose(const LocalPose *pose)
+{
+	Node node = Node();
+	node.type = BLEND_POSE;
+	node.pose = pose;
+	nodes.push_back(node);
+	return (unsigned int)nodes.size() - 1;
+}
+
+unsigned int BlendTree::addBlend(unsigned int from, unsigned int to, float weight, const BoneMask *mask)
+{
+	Node node = Node();
+	node.type = BLEND_LERP;
+	node.from = from;
+	node.to = to;
+	node.weight = weight;
+	node.mask = mask;
+	nodes.push_back(node);
+	return (unsigned int)nodes.size() - 1;
+}
+
+unsigned int BlendTree::addAdditive(unsigned int base, unsigned int layer, const LocalPose *reference, float weight, const BoneMask *mask)
+{
+	Node node = Node();
+	node.type = BLEND_ADDITIVE;
+	node.from = base;
+	node.to = layer;
+	node.pose = reference;
+	node.weight = weight;
+	node.mask = mask;
+	nodes.push_back(node);
+	return (unsigned int)nodes.size() - 1;
+}
+
+void BlendTree::setTime(unsigned int index, float time)
+{
+	nodes[index].time = time;
+}
+
+void BlendTree::advance(float deltaSeconds)
+{
+	for (unsigned int i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].type == BLEND_CLIP)
+			nodes[i].time += deltaSeconds * nodes[i].speed;
+	}
+}
+
+const LocalPose& BlendTree::evaluate(const Skeleton& skeleton, BlendScratch& scratch, glm::mat4 *palette)
+{
+	const LocalPose *root = &skeleton.bindPose;
+
+	lastSampledClips = 0;
+
+	if (!nodes.empty())
+		root = &evaluateNode(skeleton, scratch, (unsigned int)nodes.size() - 1);
+
+	if (palette)
+	{
+		if (scratch.globals.size() < skeleton.numNodes())
+			scratch.globals.resize(skeleton.numNodes());
+		skeleton.computePalette(*root, scratch.globals.data(), palette);
+	}
+
+	return *root;
+}
+
+const LocalPose& BlendTree::evaluateNode(const Skeleton& skeleton, BlendScratch& scratch, unsigned int index)
+{
+	unsigned int count = index + 1;
+
+	lastSampledClips = 0;
+
+	// sized before any node's result points into them
+	if (scratch.poses.size() < count)
+		scratch.poses.resize(count);
+	scratch.results.assign(count, nullptr);
+
+	// walk back from the root marking the nodes whose results can be seen
+	needed.assign(count, 0);
+	needed[count - 1] = 1;
+	for (unsigned int i = count; i-- > 0;)
+	{
+		const Node& node = nodes[i];
+		if (!needed[i])
+			continue;
+
+		if (node.type == BLEND_LERP)
+		{
+			if (node.weight > 0.0f || node.mask)
+				needed[node.to] = 1;
+			if (node.weight < 1.0f || node.mask)
+				needed[node.from] = 1;
+		}
+		else if (node.type == BLEND_ADDITIVE)
+		{
+			needed[node.from] = 1;
+			if (node.weight != 0.0f)
+				needed[node.to] = 1;
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!needed[i])
+			continue;
+
+		Node& node = nodes[i];
+		LocalPose& pose = scratch.poses[i];
+
+		switch (node.type)
+		{
+		case BLEND_CLIP:
+			if (!node.clip)
+			{
+				scratch.results[i] = &skeleton.bindPose;
+				break;
+			}
+			ensureSize(pose, skeleton);
+			node.clip->sample(skeleton, node.time, pose, &node.cursor);
+			scratch.results[i] = &pose;
+			lastSampledClips++;
+			break;
+
+		case BLEND_POSE:
+			scratch.results[i] = node.pose ? node.pose : &skeleton.bindPose;
+			break;
+
+		case BLEND_LERP:
+			if (node.weight <= 0.0f && !node.mask)
+				scratch.results[i] = scratch.results[node.from];
+			else if (node.weight >= 1.0f && !node.mask)
+				scratch.results[i] = scratch.results[node.to];
+			else
+			{
+				ensureSize(pose, skeleton);
+				PoseBlend::blend(skeleton, *scratch.results[node.from], *scratch.results[node.to], node.weight, pose, node.mask);
+				scratch.results[i] = &pose;
+			}
+			break;
+
+		case BLEND_ADDITIVE:
+			if (node.weight == 0.0f)
+				scratch.results[i] = scratch.results[node.from];
+			else
+			{
+				ensureSize(pose, skeleton);
+				PoseBlend::addLayer(skeleton, *scratch.results[node.from], *scratch.results[node.to],
+					node.pose ? *node.pose : skeleton.bindPose, node.weight, pose, node.mask);
+				scratch.results[i] = &pose;
+			}
+			break;
+		}
+	}
+
+	return *scratch.results[count - 1];
+}
+
+
+//
+// AnimationPlayer public method implementation
+//
+
+void AnimationPlayer::play(const Skeleton& skeleton, const AnimationClip *clip, float fadeSeconds)
+{
+	// nothing to fade from yet
+	if (sources.empty())
+		fadeSeconds = 0.0f;
+
+	if (fadeSeconds <= 0.0f)
+		sources.clear();
+	else if (sources.size() >= MAX_FADES)
+		freezeOldest(skeleton);
+
+	Source source;
+	source.clip = clip;
+	source.frozen = false;
+	source.fadeSeconds = fadeSeconds;
+	source.elapsed = 0.0f;
+	source.clipNode = source.blendNode = 0;
+
+	// a new clip node, so it starts from the beginning with a fresh cursor
+	rebuild();
+	source.clipNode = blendTree.addClip(clip);
+	if (!sources.empty())
+		source.blendNode = blendTree.addBlend(blendTree.size() - 2, source.clipNode, 0.0f);
+
+	sources.push_back(source);
+}
+
+void AnimationPlayer::update(float deltaSeconds)
+{
+	blendTree.advance(deltaSeconds);
+
+	// a finished fade hides everything under it
+	size_t firstVisible = 0;
+	for (size_t i = 1; i < sources.size(); i++)
+	{
+		sources[i].elapsed += deltaSeconds;
+		float weight = fadeWeight(sources[i].elapsed, sources[i].fadeSeconds);
+		blendTree.setWeight(sources[i].blendNode, weight);
+		if (weight >= 1.0f)
+			firstVisible = i;
+	}
+
+	if (firstVisible > 0)
+	{
+		sources.erase(sources.begin(), sources.begin() + firstVisible);
+		rebuild();
+	}
+}
+
+
+//
+// Private functions
+//
+
+void AnimationPlayer::freezeOldest(const Skeleton& skeleton)
+{
+	// the blend fading the second source in is everything under the third, so the pose on screen doesn't change.  The
+	// result may be frozenPose itself, if the second source hasn't started to show
+	if (!frozenPose)
+		frozenPose.reset(new LocalPose());
+	const LocalPose& blended = blendTree.evaluateNode(skeleton, freezeScratch, sources[1].blendNode);
+	if (&blended != frozenPose.get())
+		*frozenPose = blended;
+
+	sources.erase(sources.begin());
+	sources[0].clip = nullptr;
+	sources[0].frozen = true;
+	rebuild();
+}
+
+void AnimationPlayer::rebuild()
+{
+	BlendTree previous;
+	std::swap(previous, blendTree);
+
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		Source& source = sources[i];
+		unsigned int clipNode;
+		if (source.frozen)
+			clipNode = blendTree.addPose(frozenPose.get());
+		else
+		{
+			clipNode = blendTree.addClip(source.clip);
+			if (source.clipNode < previous.size())
+				blendTree.node(clipNode) = previous.node(source.clipNode);
+		}
+		source.clipNode = clipNode;
+
+		if (i > 0)
+			source.blendNode = blendTree.addBlend(blendTree.size() - 2, clipNode, fadeWeight(source.elapsed, source.fadeSeconds));
+	}
+}
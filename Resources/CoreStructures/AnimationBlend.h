@@ -0,0 +1,151 @@
+//  AnimationBlend.h - Blending local poses: cross-fades, additive layers and per-bone masks, driven by a blend tree
+#ifndef ANIMATION_BLEND_H
+#define ANIMATION_BLEND_H
+
+#include <memory>
+#include <vector>
+
+#include "AnimationClip.h"
+
+// A weight for each node of a skeleton, restricting a blend or layer to part of the body, eg. a wave to one arm
+struct BoneMask {
+
+	std::vector<float>			weights;
+
+	// weight for the named node and everything below it, 0 for the rest.  All 0 if there's no such node
+	static BoneMask subtree(const Skeleton& skeleton, const char *node, float weight = 1.0f);
+};
+
+// Operations on whole poses.  Each works through the node arrays in order with no branches on the data, and the
+// rotations are blended four floats at a time with SSE2 where it's available.  Rotations are nlerped - interpolated
+// linearly along the shorter arc and renormalised - which for the small angles between blended poses is
+// indistinguishable from slerp and much cheaper
+class PoseBlend {
+
+public:
+	// out = from towards to by weight (scaled by the mask's weight for each node, if there is one).  out may be from or to
+	static void blend(const Skeleton& skeleton, const LocalPose& from, const LocalPose& to, float weight, LocalPose& out,
+		const BoneMask *mask = nullptr);
+
+	// out = base with layer's difference from reference added, scaled by weight: translations offset, rotations turned
+	// and scales multiplied.  out may be base
+	static void addLayer(const Skeleton& skeleton, const LocalPose& base, const LocalPose& layer, const LocalPose& reference,
+		float weight, LocalPose& out, const BoneMask *mask = nullptr);
+};
+
+// Working memory for evaluating blend trees, grown to the largest tree and skeleton it's used with.  Each thread
+// evaluating trees needs its own
+struct BlendScratch {
+
+	std::vector<LocalPose>		poses;
+	std::vector<const LocalPose*> results;			// each node's result, in poses or passed through; null if not needed
+	std::vector<glm::mat4>		globals;
+};
+
+// One character's animation: a small tree of clips, fixed poses, blends and additive layers.  Nodes are added leaves
+// first and refer to earlier nodes by index, so the tree is evaluated in one pass in order, and the last node added is
+// the root.  Clip nodes keep their own time and cursor, moved on by advance().
+//
+// A blend showing only one side (weight 0, or 1 without a mask) and a layer with weight 0 don't evaluate the side that
+// can't be seen, and only the nodes the root reaches are evaluated, so a character only pays for the clips it is
+// actually showing.  Blends that pass one side through don't copy it.
+class BlendTree {
+
+public:
+	enum NodeType { BLEND_CLIP, BLEND_POSE, BLEND_LERP, BLEND_ADDITIVE };
+
+	struct Node {
+		NodeType				type;
+		const AnimationClip		*clip;				// BLEND_CLIP
+		float					time;				// seconds into the clip
+		float					speed;
+		ClipCursor				cursor;
+		const LocalPose			*pose;				// BLEND_POSE, and the additive layer's reference
+		unsigned int			from, to;			// BLEND_LERP blends these; BLEND_ADDITIVE adds to onto from
+		float					weight;
+		const BoneMask			*mask;
+	};
+
+	// each returns the new node's index.  Clips, poses, masks and references are only pointed to, so must outlive the tree
+	unsigned int addClip(const AnimationClip *clip, float speed = 1.0f);
+	unsigned int addPose(const LocalPose *pose);
+	unsigned int addBlend(unsigned int from, unsigned int to, float weight = 0.0f, const BoneMask *mask = nullptr);
+	unsigned int addAdditive(unsigned int base, unsigned int layer, const LocalPose *reference, float weight = 1.0f,
+		const BoneMask *mask = nullptr);
+
+	void clear() { nodes.clear(); }
+
+	Node& node(unsigned int index) { return nodes[index]; }
+	const Node& node(unsigned int index) const { return nodes[index]; }
+	unsigned int size() const { return (unsigned int)nodes.size(); }
+
+	void setWeight(unsigned int index, float weight) { nodes[index].weight = weight; }
+	// restarts a clip node at a time in seconds
+	void setTime(unsigned int index, float time);
+
+	// moves every clip node on by deltaSeconds times its speed
+	void advance(float deltaSeconds);
+
+	// the root's pose, which stays in scratch until its next use.  With a palette, also writes the skinning matrices
+	// for skeleton.numBones() bones to it
+	const LocalPose& evaluate(const Skeleton& skeleton, BlendScratch& scratch, glm::mat4 *palette = nullptr);
+	// the pose of one node, evaluating only what it depends on, as if it were the root
+	const LocalPose& evaluateNode(const Skeleton& skeleton, BlendScratch& scratch, unsigned int index);
+
+	// how many clips the last evaluate() sampled
+	unsigned int sampledClips() const { return lastSampledClips; }
+
+private:
+	std::vector<Node>			nodes;
+	std::vector<char>			needed;
+	unsigned int				lastSampledClips = 0;
+};
+
+// Plays one animation at a time on a character, cross-fading into each new one so it never pops.  Starting another
+// fade before the last has finished fades from the blend on screen, so several animations can be sampled at once; at
+// most MAX_FADES.  Beyond that the two that have been fading out longest are collapsed into one still pose, as they
+// are blended at that moment, and the newer fades carry on over it.  Once a fade completes the animations under it
+// are dropped, so a character that isn't fading costs one clip.
+//
+// The blend is a BlendTree, which can be handed to AnimationScheduler as it is.
+class AnimationPlayer {
+
+public:
+	static const unsigned int MAX_FADES = 3;
+
+	// fades to clip, played from its start, over fadeSeconds (0 cuts straight to it).  A null clip fades to the bind pose.
+	// skeleton is the one the tree is evaluated with, needed if the oldest fades have to be collapsed
+	void play(const Skeleton& skeleton, const AnimationClip *clip, float fadeSeconds);
+
+	// moves the animations and fades on
+	void update(float deltaSeconds);
+
+	const AnimationClip *current() const { return sources.empty() ? nullptr : sources.back().clip; }
+	bool fading() const { return sources.size() > 1; }
+
+	BlendTree& tree() { return blendTree; }
+
+private:
+	// an animation being shown, oldest first.  Each fades in over everything before it
+	struct Source {
+		const AnimationClip		*clip;
+		bool					frozen;				// frozenPose rather than clip, only ever the first
+		float					fadeSeconds;
+		float					elapsed;
+		unsigned int			clipNode;			// in blendTree
+		unsigned int			blendNode;			// fading it in, except for the first
+	};
+
+	std::vector<Source>			sources;
+	BlendTree					blendTree;
+	std::unique_ptr<LocalPose>	frozenPose;			// on the heap so the tree's pointer to it survives the player moving
+	BlendScratch				freezeScratch;
+
+	// replaces the two oldest sources with their blend as it is now
+	void freezeOldest(const Skeleton& skeleton);
+
+	// lays the tree out for sources, keeping each clip's time and cursor
+	void rebuild();
+};
+
+#endif
@@ -0,0 +1,805 @@
+//  AnimationClip.cpp
+
+#include "AnimationClip.h"
+
+#include <algorithm>
+#include <cmath>
+#include <assimp/scene.h>
+
+
+//
+// Private functions
+//
+
+static glm::mat4 toGLM(const aiMatrix4x4& matrix)
+{
+	// Assimp is row major and GLM column major
+	return glm::mat4(
+		matrix.a1, matrix.b1, matrix.c1, matrix.d1,
+		matrix.a2, matrix.b2, matrix.c2, matrix.d2,
+		matrix.a3, matrix.b3, matrix.c3, matrix.d3,
+		matrix.a4, matrix.b4, matrix.c4, matrix.d4
+	);
+}
+
+// the key to interpolate from: the last one at or before time, but never the last key, so there's always one after it.
+// Searches forward from start, which must not be past the answer.  Times are floats, or packed into shorts
+template <typename Time>
+static inline unsigned int findKey(const Time *times, unsigned int count, float time, unsigned int start)
+{
+	unsigned int key = start;
+	while (key + 2 < count && time >= times[key + 1])
+		key++;
+	return key;
+}
+
+template <typename Time>
+static inline unsigned int searchKey(const Time *times, unsigned int count, float time)
+{
+	const Time *next = std::upper_bound(times + 1, times + count - 1, time);
+	return (unsigned int)(next - times) - 1;
+}
+
+// how far time is from key to key + 1, clamped so times outside the keys hold the end values
+template <typename Time>
+static inline float keyFactor(const Time *times, unsigned int key, float time)
+{
+	float span = (float)times[key + 1] - (float)times[key];
+	float factor = span > 0.0f ? (time - (float)times[key]) / span : 0.0f;
+	return std::min(std::max(factor, 0.0f), 1.0f);
+}
+
+// finds the key for time in a channel's count keys, through the cursor's entry if there is one
+template <typename Time>
+static inline unsigned int locateKey(const Time *times, unsigned int count, float time, unsigned int *cursorKey)
+{
+	if (!cursorKey)
+		return searchKey(times, count, time);
+
+	*cursorKey = findKey(times, count, time, *cursorKey);
+	return *cursorKey;
+}
+
+// spherical interpolation along the shorter arc, falling back to linear when the rotations are nearly the same, then
+// normalised - as aiQuaternion::Interpolate() followed by Normalize()
+static inline glm::quat interpolate(const glm::quat& start, glm::quat end, float factor)
+{
+	float cosom = glm::dot(start, end);
+	if (cosom < 0.0f)
+	{
+		cosom = -cosom;
+		end = -end;
+	}
+
+	float sclp, sclq;
+	if (1.0f - cosom > 0.0001f)
+	{
+		float omega = std::acos(cosom);
+		float sinom = std::sin(omega);
+		sclp = std::sin((1.0f - factor) * omega) / sinom;
+		sclq = std::sin(factor * omega) / sinom;
+	}
+	else
+	{
+		sclp = 1.0f - factor;
+		sclq = factor;
+	}
+
+	return glm::normalize(start * sclp + end * sclq);
+}
+
+static inline glm::vec3 sampleVector(const std::vector<float>& times, const std::vector<glm::vec3>& values, unsigned int first, unsigned int count,
+	float time, unsigned int *cursorKey)
+{
+	if (count == 1)
+		return values[first];
+
+	unsigned int key = locateKey(&times[first], count, time, cursorKey);
+	float factor = keyFactor(&times[first], key, time);
+	return glm::mix(values[first + key], values[first + key + 1], factor);
+}
+
+
+// linear interpolation along the shorter arc, renormalised: cheaper than interpolate() and, between keys close enough
+// together, within compression's tolerance of it
+static inline glm::quat nlerp(const glm::quat& start, const glm::quat& end, float factor)
+{
+	glm::quat target = glm::dot(start, end) < 0.0f ? -end : end;
+	return glm::normalize(start * (1.0f - factor) + target * factor);
+}
+
+// the smallest three components of a unit quaternion are within this of 0
+static const float PACKED_ROTATION_RANGE = 0.70710678f;
+static const float PACKED_ROTATION_MAX = 32767.0f;
+static const float PACKED_MAX = 65535.0f;
+
+static inline unsigned short packFraction(float fraction, float maximum)
+{
+	return (unsigned short)std::lround(std::min(std::max(fraction, 0.0f), 1.0f) * maximum);
+}
+
+// drops the largest component, which the others give back, and stores the rest in 15 bits each.  Bit 0 of the first two
+// words holds which was dropped
+static inline void packRotation(const glm::quat& rotation, unsigned short *packed)
+{
+	float components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+	unsigned int largest = 0;
+	for (unsigned int i = 1; i < 4; i++)
+	{
+		if (std::fabs(components[i]) > std::fabs(components[largest]))
+			largest = i;
+	}
+
+	// q and -q are the same rotation, so turn it round to make the dropped component positive
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	for (unsigned int i = 0, word = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float fraction = (components[i] * sign + PACKED_ROTATION_RANGE) / (2.0f * PACKED_ROTATION_RANGE);
+		packed[word] = (unsigned short)((packFraction(fraction, PACKED_ROTATION_MAX) << 1) | ((largest >> word) & 1));
+		word++;
+	}
+}
+
+static inline glm::quat unpackRotation(const unsigned short *packed)
+{
+	unsigned int largest = (packed[0] & 1) | ((packed[1] & 1) << 1);
+
+	float components[4];
+	float sumOfSquares = 0.0f;
+	for (unsigned int i = 0, word = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float component = (packed[word] >> 1) * (2.0f * PACKED_ROTATION_RANGE / PACKED_ROTATION_MAX) - PACKED_ROTATION_RANGE;
+		components[i] = component;
+		sumOfSquares += component * component;
+		word++;
+	}
+	components[largest] = std::sqrt(std::max(1.0f - sumOfSquares, 0.0f));
+
+	return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+static inline glm::vec3 unpackVector(const unsigned short *packed, const AnimationClip::TrackRange& range)
+{
+	return range.minimum + glm::vec3(packed[0], packed[1], packed[2]) * range.step;
+}
+
+static inline void packVector(const glm::vec3& value, const AnimationClip::TrackRange& range, unsigned short *packed)
+{
+	for (int i = 0; i < 3; i++)
+		packed[i] = range.step[i] > 0.0f ? packFraction((value[i] - range.minimum[i]) / (range.step[i] * PACKED_MAX), PACKED_MAX) : 0;
+}
+
+static AnimationClip::TrackRange vectorRange(const glm::vec3 *values, unsigned int count)
+{
+	glm::vec3 minimum = values[0], maximum = values[0];
+	for (unsigned int i = 1; i < count; i++)
+	{
+		minimum = glm::min(minimum, values[i]);
+		maximum = glm::max(maximum, values[i]);
+	}
+
+	AnimationClip::TrackRange range;
+	range.minimum = minimum;
+	range.step = (maximum - minimum) / PACKED_MAX;
+	return range;
+}
+
+static inline glm::vec3 samplePackedVector(const unsigned short *times, const unsigned short *values, unsigned int count,
+	const AnimationClip::TrackRange& range, float time, unsigned int *cursorKey)
+{
+	if (count == 1)
+		return unpackVector(values, range);
+
+	unsigned int key = locateKey(times, count, time, cursorKey);
+	float factor = keyFactor(times, key, time);
+	return glm::mix(unpackVector(values + key * 3, range), unpackVector(values + (key + 1) * 3, range), factor);
+}
+
+// how far a bone's origin and points reach along each of its axes move between two local transforms, in the parent's
+// space.  The bone-space error compression works to
+static float transformError(const glm::vec3& translation0, const glm::quat& rotation0, const glm::vec3& scale0,
+	const glm::vec3& translation1, const glm::quat& rotation1, const glm::vec3& scale1, float reach)
+{
+	float error = glm::length(translation0 - translation1);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 point(0.0f);
+		point[axis] = reach;
+		glm::vec3 moved = (translation0 + rotation0 * (scale0 * point)) - (translation1 + rotation1 * (scale1 * point));
+		error = std::max(error, glm::length(moved));
+	}
+	return error;
+}
+
+// Chooses which of a track's count keys compression keeps.  decoded holds each key's value as sampling will see it once
+// packed, and packedTimes its time.  A track that stays within tolerance of its first key keeps just that one, and one
+// that stays within tolerance of the bind pose none.  Otherwise the first and last keys are kept, and each key after
+// that is as far on as lets interpolating the decoded keys reproduce the original at every key and halfway between
+template <typename Value, typename OriginalLerp, typename PackedLerp, typename Error>
+static void reduceKeys(const float *times, const float *packedTimes, const Value *values, const Value *decoded, unsigned int count,
+	const Value& bind, OriginalLerp originalLerp, PackedLerp packedLerp, Error error, float tolerance, std::vector<unsigned int>& kept)
+{
+	kept.clear();
+
+	// whether every original key and halfway point in [first, last] is within tolerance of value
+	auto holds = [&](const Value& value, unsigned int first, unsigned int last) {
+		for (unsigned int i = first; i <= last; i++)
+		{
+			if (error(values[i], value) > tolerance)
+				return false;
+			if (i < last && error(originalLerp(values[i], values[i + 1], 0.5f), value) > tolerance)
+				return false;
+		}
+		return true;
+	};
+
+	if (holds(bind, 0, count - 1))
+		return;
+
+	kept.push_back(0);
+	if (count == 1 || holds(decoded[0], 0, count - 1))
+		return;
+
+	// whether interpolating from decoded key a to decoded key b reproduces the original between them
+	auto bridges = [&](unsigned int a, unsigned int b) {
+		float span = packedTimes[b] - packedTimes[a];
+		for (unsigned int i = a; i < b; i++)
+		{
+			for (int half = 0; half < 2; half++)
+			{
+				if (i == a && half == 0)
+					continue;
+
+				float time = half ? (times[i] + times[i + 1]) * 0.5f : times[i];
+				Value original = half ? originalLerp(values[i], values[i + 1], 0.5f) : values[i];
+				float factor = span > 0.0f ? std::min(std::max((time - packedTimes[a]) / span, 0.0f), 1.0f) : 0.0f;
+				if (error(original, packedLerp(decoded[a], decoded[b], factor)) > tolerance)
+					return false;
+			}
+		}
+		return true;
+	};
+
+	unsigned int anchor = 0;
+	while (anchor < count - 1)
+	{
+		unsigned int next = anchor + 1;
+		while (next + 1 < count && bridges(anchor, next + 1))
+			next++;
+		kept.push_back(next);
+		anchor = next;
+	}
+}
+
+
+//
+// LocalPose public method implementation
+//
+
+void LocalPose::resize(unsigned int numNodes)
+{
+	translations.resize(numNodes);
+	rotations.resize(numNodes);
+	scales.resize(numNodes);
+}
+
+
+//
+// PoseScratch public method implementation
+//
+
+void PoseScratch::reserve(const Skeleton& skeleton)
+{
+	if (pose.translations.size() < skeleton.numNodes())
+		pose.resize(skeleton.numNodes());
+	if (globals.size() < skeleton.numNodes())
+		globals.resize(skeleton.numNodes());
+}
+
+
+//
+// Skeleton public method implementation
+//
+
+void Skeleton::build(const aiScene *scene)
+{
+	names.clear();
+	parents.clear();
+	bones.clear();
+	unplacedBones.clear();
+	boneOffsets.clear();
+	boneMapping.clear();
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+	{
+		const aiMesh *mesh = scene->mMeshes[i];
+		for (unsigned int j = 0; j < mesh->mNumBones; j++)
+		{
+			std::string name(mesh->mBones[j]->mName.data);
+			if (boneMapping.find(name) != boneMapping.end())
+				continue;
+
+			boneMapping[name] = (unsigned int)boneOffsets.size();
+			boneOffsets.push_back(toGLM(mesh->mBones[j]->mOffsetMatrix));
+		}
+	}
+
+	// depth first, children pushed in reverse so they come out in the scene's order
+	std::vector<std::pair<const aiNode*, int>> stack;
+	stack.push_back(std::make_pair((const aiNode*)scene->mRootNode, -1));
+
+	std::vector<glm::vec3> translations, scales;
+	std::vector<glm::quat> rotations;
+
+	while (!stack.empty())
+	{
+		const aiNode *node = stack.back().first;
+		int parent = stack.back().second;
+		stack.pop_back();
+
+		int index = (int)names.size();
+		names.push_back(node->mName.data);
+		parents.push_back(parent);
+
+		std::map<std::string, unsigned int>::const_iterator bone = boneMapping.find(names.back());
+		bones.push_back(bone == boneMapping.end() ? -1 : (int)bone->second);
+
+		aiVector3D scaling, position;
+		aiQuaternion rotation;
+		node->mTransformation.Decompose(scaling, rotation, position);
+		translations.push_back(glm::vec3(position.x, position.y, position.z));
+		rotations.push_back(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z));
+		scales.push_back(glm::vec3(scaling.x, scaling.y, scaling.z));
+
+		for (unsigned int i = node->mNumChildren; i > 0; i--)
+			stack.push_back(std::make_pair((const aiNode*)node->mChildren[i - 1], index));
+	}
+
+	std::vector<bool> placed(boneOffsets.size(), false);
+	for (unsigned int i = 0; i < bones.size(); i++)
+		if (bones[i] >= 0)
+			placed[bones[i]] = true;
+	for (unsigned int i = 0; i < placed.size(); i++)
+		if (!placed[i])
+			unplacedBones.push_back(i);
+
+	bindPose.translations.swap(translations);
+	bindPose.rotations.swap(rotations);
+	bindPose.scales.swap(scales);
+
+	globalInverse = glm::inverse(toGLM(scene->mRootNode->mTransformation));
+}
+
+int Skeleton::findNode(const char *name) const
+{
+	for (unsigned int i = 0; i < names.size(); i++)
+	{
+		if (names[i] == name)
+			return (int)i;
+	}
+	return -1;
+}
+
+void Skeleton::computePalette(const LocalPose& pose, glm::mat4 *globals, glm::mat4 *palette) const
+{
+	unsigned int count = numNodes();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		// translation * rotation * scale, built directly
+		const glm::vec3& scale = pose.scales[i];
+		glm::mat4 local = glm::mat4_cast(pose.rotations[i]);
+		local[0] *= scale.x;
+		local[1] *= scale.y;
+		local[2] *= scale.z;
+		local[3] = glm::vec4(pose.translations[i], 1.0f);
+
+		globals[i] = parents[i] < 0 ? local : globals[parents[i]] * local;
+
+		if (bones[i] >= 0)
+			palette[bones[i]] = globalInverse * globals[i] * boneOffsets[bones[i]];
+	}
+
+	for (unsigned int i = 0; i < unplacedBones.size(); i++)
+		palette[unplacedBones[i]] = glm::mat4(1.0f);
+}
+
+
+//
+// AnimationClip public method implementation
+//
+
+bool AnimationClip::bake(const aiAnimation *animation, const Skeleton& skeleton, AnimationClip& clip)
+{
+	clip = AnimationClip();
+	clip.name = animation->mName.data;
+	clip.duration = (float)animation->mDuration;
+	clip.ticksPerSecond = animation->mTicksPerSecond != 0.0 ? (float)animation->mTicksPerSecond : 25.0f;
+
+	unsigned int translationCount = 0, rotationCount = 0, scaleCount = 0;
+	for (unsigned int i = 0; i < animation->mNumChannels; i++)
+	{
+		translationCount += animation->mChannels[i]->mNumPositionKeys;
+		rotationCount += animation->mChannels[i]->mNumRotationKeys;
+		scaleCount += animation->mChannels[i]->mNumScalingKeys;
+	}
+
+	clip.channels.reserve(animation->mNumChannels);
+	clip.translationTimes.reserve(translationCount);
+	clip.translations.reserve(translationCount);
+	clip.rotationTimes.reserve(rotationCount);
+	clip.rotations.reserve(rotationCount);
+	clip.scaleTimes.reserve(scaleCount);
+	clip.scales.reserve(scaleCount);
+
+	// only the first channel for a node counts, as when Assimp's channels were searched by name
+	std::vector<bool> animated(skeleton.numNodes(), false);
+
+	for (unsigned int i = 0; i < animation->mNumChannels; i++)
+	{
+		const aiNodeAnim *nodeAnim = animation->mChannels[i];
+		int node = skeleton.findNode(nodeAnim->mNodeName.data);
+		if (node < 0 || animated[node])
+			continue;
+		animated[node] = true;
+
+		Channel channel;
+		channel.node = (unsigned int)node;
+
+		channel.firstTranslation = (unsigned int)clip.translationTimes.size();
+		channel.numTranslations = nodeAnim->mNumPositionKeys;
+		for (unsigned int j = 0; j < nodeAnim->mNumPositionKeys; j++)
+		{
+			const aiVectorKey& key = nodeAnim->mPositionKeys[j];
+			clip.translationTimes.push_back((float)key.mTime);
+			clip.translations.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+		}
+
+		channel.firstRotation = (unsigned int)clip.rotationTimes.size();
+		channel.numRotations = nodeAnim->mNumRotationKeys;
+		for (unsigned int j = 0; j < nodeAnim->mNumRotationKeys; j++)
+		{
+			const aiQuatKey& key = nodeAnim->mRotationKeys[j];
+			clip.rotationTimes.push_back((float)key.mTime);
+			clip.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+		}
+
+		channel.firstScale = (unsigned int)clip.scaleTimes.size();
+		channel.numScales = nodeAnim->mNumScalingKeys;
+		for (unsigned int j = 0; j < nodeAnim->mNumScalingKeys; j++)
+		{
+			const aiVectorKey& key = nodeAnim->mScalingKeys[j];
+			clip.scaleTimes.push_back((float)key.mTime);
+			clip.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+		}
+
+		clip.channels.push_back(channel);
+	}
+
+	// the channels in node order, so sampling writes the pose front to back
+	std::sort(clip.channels.begin(), clip.channels.end(), [](const Channel& a, const Channel& b) { return a.node < b.node; });
+
+	return !clip.channels.empty();
+}
+
+void AnimationClip::sample(const Skeleton& skeleton, float timeInSeconds, LocalPose& pose, ClipCursor *cursor) const
+{
+	float time = duration > 0.0f ? std::fmod(timeInSeconds * ticksPerSecond, duration) : 0.0f;
+	if (time < 0.0f)
+		time += duration;
+
+	unsigned int *keys = nullptr;
+	if (cursor)
+	{
+		// a new cursor, or time has gone backwards: search from the first keys again
+		if (cursor->keys.size() != channels.size() * 3 || time < cursor->time)
+			cursor->keys.assign(channels.size() * 3, 0);
+		cursor->time = time;
+		keys = cursor->keys.data();
+	}
+
+	std::copy(skeleton.bindPose.translations.begin(), skeleton.bindPose.translations.end(), pose.translations.begin());
+	std::copy(skeleton.bindPose.rotations.begin(), skeleton.bindPose.rotations.end(), pose.rotations.begin());
+	std::copy(skeleton.bindPose.scales.begin(), skeleton.bindPose.scales.end(), pose.scales.begin());
+
+	if (isCompressed)
+		samplePacked(time, pose, keys);
+	else
+		sampleKeys(time, pose, keys);
+}
+
+void AnimationClip::evaluate(const Skeleton& skeleton, float timeInSeconds, PoseScratch& scratch, glm::mat4 *palette, ClipCursor *cursor) const
+{
+	scratch.reserve(skeleton);
+	sample(skeleton, timeInSeconds, scratch.pose, cursor);
+	skeleton.computePalette(scratch.pose, scratch.globals.data(), palette);
+}
+
+size_t AnimationClip::keyCount() const
+{
+	if (isCompressed)
+		return packedTranslationTimes.size() + packedRotationTimes.size() + packedScaleTimes.size();
+	return translationTimes.size() + rotationTimes.size() + scaleTimes.size();
+}
+
+size_t AnimationClip::bytes() const
+{
+	return channels.size() * sizeof(Channel)
+		+ (translationTimes.size() + rotationTimes.size() + scaleTimes.size()) * sizeof(float)
+		+ (translations.size() + scales.size()) * sizeof(glm::vec3) + rotations.size() * sizeof(glm::quat)
+		+ (packedTranslationTimes.size() + packedRotationTimes.size() + packedScaleTimes.size()) * sizeof(unsigned short)
+		+ (packedTranslations.size() + packedRotations.size() + packedScales.size()) * sizeof(unsigned short)
+		+ (translationRanges.size() + scaleRanges.size()) * sizeof(TrackRange);
+}
+
+void AnimationClip::compress(const Skeleton& skeleton, const ClipCompression& settings, ClipCompressionStats *stats)
+{
+	if (isCompressed)
+		return;
+
+	unsigned int numNodes = skeleton.numNodes();
+	const LocalPose& bind = skeleton.bindPose;
+
+	// how far each bone reaches - to its furthest child, or for the ends of chains from its parent - and the longest
+	// chain from the root, which the tolerance is a fraction of.  Those lengths leave out the bind pose's scales, so
+	// errors divide each node's scales by its bind scale to match: a skeleton whose every joint is scaled by 0.01, as
+	// FBX files exported from centimetres often are, would otherwise turn a hundred times the rotation error into the
+	// same bone space error
+	std::vector<float> reach(numNodes, 0.0f), depth(numNodes, 0.0f), bindScale(numNodes, 1.0f);
+	float size = 0.0f;
+	for (unsigned int i = 0; i < numNodes; i++)
+	{
+		const glm::vec3& scale = bind.scales[i];
+		float largest = std::max(std::max(std::fabs(scale.x), std::fabs(scale.y)), std::fabs(scale.z));
+		if (largest > 0.0f)
+			bindScale[i] = largest;
+
+		int parent = skeleton.parents[i];
+		if (parent < 0)
+			continue;
+		float length = glm::length(bind.translations[i]);
+		reach[parent] = std::max(reach[parent], length);
+		depth[i] = depth[parent] + length;
+		size = std::max(size, depth[i]);
+	}
+	if (size <= 0.0f)
+		size = 1.0f;
+	for (unsigned int i = 0; i < numNodes; i++)
+	{
+		int parent = skeleton.parents[i];
+		if (reach[i] <= 0.0f)
+			reach[i] = parent < 0 ? size : std::max(glm::length(bind.translations[i]), reach[parent]);
+	}
+
+	float tolerance = settings.tolerance * size;
+	float timeScale = duration > 0.0f ? 1.0f / duration : 0.0f;
+
+	AnimationClip packed;
+	packed.name = name;
+	packed.duration = duration;
+	packed.ticksPerSecond = ticksPerSecond;
+	packed.isCompressed = true;
+
+	std::vector<float> packedTimes;
+	std::vector<glm::vec3> decodedVectors;
+	std::vector<glm::quat> decodedRotations;
+	std::vector<unsigned int> kept;
+
+	// each key time as it will be after packing
+	auto packTimes = [&](const float *times, unsigned int count) {
+		packedTimes.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+			packedTimes[i] = packFraction(times[i] * timeScale, PACKED_MAX) / PACKED_MAX * duration;
+	};
+	auto appendTimes = [&](const float *times, std::vector<unsigned short>& out) {
+		for (unsigned int i = 0; i < kept.size(); i++)
+			out.push_back(packFraction(times[kept[i]] * timeScale, PACKED_MAX));
+	};
+
+	// translations and scales, in their channel's range; the error of each measured with the bone's other components
+	// as they are in the bind pose
+	auto packVectors = [&](const std::vector<float>& times, const std::vector<glm::vec3>& values, unsigned int first, unsigned int count,
+		const glm::vec3& bindValue, bool isScale, unsigned int node, std::vector<unsigned short>& outTimes,
+		std::vector<unsigned short>& outValues, TrackRange& range, unsigned int& outFirst, unsigned int& outCount) {
+		range = TrackRange();
+		outFirst = (unsigned int)outTimes.size();
+		outCount = 0;
+		if (count == 0)
+			return;
+
+		range = vectorRange(&values[first], count);
+		decodedVectors.resize(count);
+		unsigned short word[3];
+		for (unsigned int i = 0; i < count; i++)
+		{
+			packVector(values[first + i], range, word);
+			decodedVectors[i] = unpackVector(word, range);
+		}
+		packTimes(&times[first], count);
+
+		const glm::vec3& translation = bind.translations[node];
+		const glm::quat& rotation = bind.rotations[node];
+		float boneReach = reach[node], boneScale = bindScale[node];
+		auto error = [&](const glm::vec3& a, const glm::vec3& b) {
+			return isScale ? transformError(translation, rotation, a / boneScale, translation, rotation, b / boneScale, boneReach)
+				: glm::length(a - b);
+		};
+		auto lerp = [](const glm::vec3& a, const glm::vec3& b, float factor) { return glm::mix(a, b, factor); };
+
+		reduceKeys(&times[first], packedTimes.data(), &values[first], decodedVectors.data(), count, bindValue, lerp, lerp, error,
+			tolerance, kept);
+
+		appendTimes(&times[first], outTimes);
+		for (unsigned int i = 0; i < kept.size(); i++)
+		{
+			packVector(values[first + kept[i]], range, word);
+			outValues.insert(outValues.end(), word, word + 3);
+		}
+		outCount = (unsigned int)kept.size();
+	};
+
+	for (size_t c = 0; c < channels.size(); c++)
+	{
+		const Channel& channel = channels[c];
+		unsigned int node = channel.node;
+		Channel out;
+		out.node = node;
+		TrackRange translationRange, scaleRange;
+
+		packVectors(translationTimes, translations, channel.firstTranslation, channel.numTranslations, bind.translations[node], false,
+			node, packed.packedTranslationTimes, packed.packedTranslations, translationRange, out.firstTranslation, out.numTranslations);
+		packVectors(scaleTimes, scales, channel.firstScale, channel.numScales, bind.scales[node], true,
+			node, packed.packedScaleTimes, packed.packedScales, scaleRange, out.firstScale, out.numScales);
+
+		out.firstRotation = (unsigned int)packed.packedRotationTimes.size();
+		out.numRotations = 0;
+		if (channel.numRotations)
+		{
+			unsigned int first = channel.firstRotation, count = channel.numRotations;
+			decodedRotations.resize(count);
+			unsigned short word[3];
+			for (unsigned int i = 0; i < count; i++)
+			{
+				packRotation(rotations[first + i], word);
+				decodedRotations[i] = unpackRotation(word);
+			}
+			packTimes(&rotationTimes[first], count);
+
+			const glm::vec3& translation = bind.translations[node];
+			glm::vec3 scale = bind.scales[node] / bindScale[node];
+			float boneReach = reach[node];
+			auto error = [&](const glm::quat& a, const glm::quat& b) {
+				return transformError(translation, a, scale, translation, b, scale, boneReach);
+			};
+
+			reduceKeys(&rotationTimes[first], packedTimes.data(), &rotations[first], decodedRotations.data(), count, bind.rotations[node],
+				interpolate, nlerp, error, tolerance, kept);
+
+			appendTimes(&rotationTimes[first], packed.packedRotationTimes);
+			for (unsigned int i = 0; i < kept.size(); i++)
+			{
+				packRotation(rotations[first + kept[i]], word);
+				packed.packedRotations.insert(packed.packedRotations.end(), word, word + 3);
+			}
+			out.numRotations = (unsigned int)kept.size();
+		}
+
+		// a channel left with nothing to move
+		if (out.numTranslations + out.numRotations + out.numScales == 0)
+			continue;
+
+		packed.channels.push_back(out);
+		packed.translationRanges.push_back(translationRange);
+		packed.scaleRanges.push_back(scaleRange);
+	}
+
+	if (stats)
+	{
+		stats->originalBytes = bytes();
+		stats->compressedBytes = packed.bytes();
+		stats->originalKeys = keyCount();
+		stats->compressedKeys = packed.keyCount();
+		stats->tolerance = tolerance;
+		stats->maxError = 0.0f;
+		stats->maxRotationError = 0.0f;
+		stats->maxTranslationError = 0.0f;
+
+		// every time the original has a key, and halfway to the next
+		std::vector<float> times(translationTimes);
+		times.insert(times.end(), rotationTimes.begin(), rotationTimes.end());
+		times.insert(times.end(), scaleTimes.begin(), scaleTimes.end());
+		std::sort(times.begin(), times.end());
+		times.erase(std::unique(times.begin(), times.end()), times.end());
+		for (size_t i = 0, count = times.size(); i + 1 < count; i++)
+			times.push_back((times[i] + times[i + 1]) * 0.5f);
+
+		LocalPose original, compressed;
+		original.resize(numNodes);
+		compressed.resize(numNodes);
+		for (size_t i = 0; i < times.size(); i++)
+		{
+			float time = std::min(std::max(times[i], 0.0f), std::max(duration - 1e-3f, 0.0f));
+			sample(skeleton, time / ticksPerSecond, original);
+			packed.sample(skeleton, time / ticksPerSecond, compressed);
+			for (unsigned int node = 0; node < numNodes; node++)
+			{
+				float error = transformError(original.translations[node], original.rotations[node], original.scales[node] / bindScale[node],
+					compressed.translations[node], compressed.rotations[node], compressed.scales[node] / bindScale[node], reach[node]);
+				stats->maxError = std::max(stats->maxError, error);
+
+				// q and -q are the same rotation
+				float cosHalfAngle = std::min(std::fabs(glm::dot(original.rotations[node], compressed.rotations[node])), 1.0f);
+				stats->maxRotationError = std::max(stats->maxRotationError, glm::degrees(2.0f * std::acos(cosHalfAngle)));
+				stats->maxTranslationError = std::max(stats->maxTranslationError,
+					glm::length(original.translations[node] - compressed.translations[node]));
+			}
+		}
+	}
+
+	*this = std::move(packed);
+}
+
+
+//
+// Private functions
+//
+
+void AnimationClip::sampleKeys(float time, LocalPose& pose, unsigned int *keys) const
+{
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		const Channel& channel = channels[i];
+		unsigned int *channelKeys = keys ? keys + i * 3 : nullptr;
+
+		if (channel.numTranslations)
+			pose.translations[channel.node] = sampleVector(translationTimes, translations, channel.firstTranslation, channel.numTranslations,
+				time, channelKeys);
+
+		if (channel.numRotations == 1)
+			pose.rotations[channel.node] = rotations[channel.firstRotation];
+		else if (channel.numRotations)
+		{
+			unsigned int key = locateKey(&rotationTimes[channel.firstRotation], channel.numRotations, time, channelKeys ? channelKeys + 1 : nullptr);
+			float factor = keyFactor(&rotationTimes[channel.firstRotation], key, time);
+			pose.rotations[channel.node] = interpolate(rotations[channel.firstRotation + key], rotations[channel.firstRotation + key + 1], factor);
+		}
+
+		if (channel.numScales)
+			pose.scales[channel.node] = sampleVector(scaleTimes, scales, channel.firstScale, channel.numScales, time, channelKeys ? channelKeys + 2 : nullptr);
+	}
+}
+
+void AnimationClip::samplePacked(float time, LocalPose& pose, unsigned int *keys) const
+{
+	// searched in the packed times' units
+	float packedTime = duration > 0.0f ? time * (PACKED_MAX / duration) : 0.0f;
+
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		const Channel& channel = channels[i];
+		unsigned int *channelKeys = keys ? keys + i * 3 : nullptr;
+
+		if (channel.numTranslations)
+			pose.translations[channel.node] = samplePackedVector(&packedTranslationTimes[channel.firstTranslation],
+				&packedTranslations[channel.firstTranslation * 3], channel.numTranslations, translationRanges[i], packedTime, channelKeys);
+
+		if (channel.numRotations == 1)
+			pose.rotations[channel.node] = unpackRotation(&packedRotations[channel.firstRotation * 3]);
+		else if (channel.numRotations)
+		{
+			const unsigned short *times = &packedRotationTimes[channel.firstRotation];
+			const unsigned short *values = &packedRotations[channel.firstRotation * 3];
+			unsigned int key = locateKey(times, channel.numRotations, packedTime, channelKeys ? channelKeys + 1 : nullptr);
+			float factor = keyFactor(times, key, packedTime);
+			pose.rotations[channel.node] = nlerp(unpackRotation(values + key * 3), unpackRotation(values + (key + 1) * 3), factor);
+		}
+
+		if (channel.numScales)
+			pose.scales[channel.node] = samplePackedVector(&packedScaleTimes[channel.firstScale], &packedScales[channel.firstScale * 3],
+				channel.numScales, scaleRanges[i], packedTime, channelKeys ? channelKeys + 2 : nullptr);
+	}
+}
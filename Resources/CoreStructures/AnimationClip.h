@@ -0,0 +1,170 @@
+//  AnimationClip.h - Skeletal animations baked from Assimp into flat arrays, sampled without touching the aiScene
+#ifndef ANIMATION_CLIP_H
+#define ANIMATION_CLIP_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct aiAnimation;
+struct aiScene;
+
+// Local transforms of every node in a skeleton, as translation, rotation and scale arrays indexed by node
+struct LocalPose {
+
+	std::vector<glm::vec3>		translations;
+	std::vector<glm::quat>		rotations;
+	std::vector<glm::vec3>		scales;
+
+	void resize(unsigned int numNodes);
+};
+
+// A scene's node hierarchy flattened depth first, so every node comes after its parent and the whole tree can be walked
+// with one loop over the arrays.  Bones are numbered in the order the meshes first reference them, as the vertex data
+// uses, and map to the node of the same name.
+struct Skeleton {
+
+	std::vector<std::string>	names;
+	std::vector<int>			parents;			// -1 for the root
+	std::vector<int>			bones;				// the node's bone, or -1 for a node that only carries its children
+	std::vector<unsigned int>	unplacedBones;		// bones with no node of their name, which never move
+	LocalPose					bindPose;			// the nodes' own transforms, for nodes an animation doesn't move
+
+	std::vector<glm::mat4>		boneOffsets;		// mesh space to bone space, for each bone
+	glm::mat4					globalInverse;		// undoes the root's transform
+	std::map<std::string, unsigned int> boneMapping;	// bone name to bone index.  Only needed while loading
+
+	unsigned int numNodes() const { return (unsigned int)parents.size(); }
+	unsigned int numBones() const { return (unsigned int)boneOffsets.size(); }
+
+	void build(const aiScene *scene);
+
+	// the node's index, or -1.  A linear search, for loading
+	int findNode(const char *name) const;
+
+	// the skinning matrix of each bone for a pose: globals must hold numNodes() matrices and palette numBones().
+	// Every bone is written, those with no node as the identity, so palette can be write only (mapped) memory
+	void computePalette(const LocalPose& pose, glm::mat4 *globals, glm::mat4 *palette) const;
+};
+
+// Working memory for turning a clip into skinning matrices: the local pose and each node's model space transform.
+// Grows to the largest skeleton it's used with.  Each thread evaluating poses needs its own
+struct PoseScratch {
+
+	LocalPose					pose;
+	std::vector<glm::mat4>		globals;
+
+	void reserve(const Skeleton& skeleton);
+};
+
+// Where the last sample of a clip found each channel's keys, so playing forward only looks at the next key or two
+// instead of searching from the start.  Each instance playing a clip needs its own.  Playing backwards, or wrapping
+// round the end of the clip, starts the search again
+struct ClipCursor {
+
+	std::vector<unsigned int>	keys;				// translation, rotation and scale key of each channel
+	float						time = -1.0f;
+};
+
+// How closely AnimationClip::compress() keeps to the original clip.  Errors are measured in bone space: how far a bone's
+// origin and points a bone's length along each of its axes move in its parent's space.  The tolerance is a fraction of
+// the skeleton's size (its longest chain of bones from the root), so it means the same whatever units the model is in.
+// Bone lengths and errors both leave out each node's bind pose scale, so bones carrying one are held to it too.
+// It holds for each of a bone's translation, rotation and scale, so a bone moving all three can be off by a little more;
+// and no tolerance gets below the error of quantising the keys
+struct ClipCompression {
+	float						tolerance = 0.0001f;
+};
+
+// What compress() did to a clip
+struct ClipCompressionStats {
+	size_t						originalBytes = 0;
+	size_t						compressedBytes = 0;
+	size_t						originalKeys = 0;
+	size_t						compressedKeys = 0;
+	float						tolerance = 0.0f;			// in the skeleton's units
+	float						maxError = 0.0f;			// the same, measured at every original key time and halfway between
+	// the largest change to any node's local rotation, in degrees, and to its local translation, in the skeleton's units,
+	// at the same times
+	float						maxRotationError = 0.0f;
+	float						maxTranslationError = 0.0f;
+};
+
+// One aiAnimation baked against a Skeleton: each channel resolved to its node index once, and every key's time and
+// value copied into one array per component, so sampling is a linear pass over the channels with no name lookups,
+// maps or pointer chasing through the aiScene.  Times are in ticks, as Assimp stores them.
+//
+// A compressed clip keeps only the packed arrays, about a tenth of the size, and decodes the keys it needs as it samples.
+class AnimationClip {
+
+public:
+	// a channel's keys are count entries from first in the clip's arrays for each component
+	struct Channel {
+		unsigned int			node;
+		unsigned int			firstTranslation, numTranslations;
+		unsigned int			firstRotation, numRotations;
+		unsigned int			firstScale, numScales;
+	};
+
+	// a channel's packed translations or scales are minimum + packed value * step, for each component
+	struct TrackRange {
+		glm::vec3				minimum;
+		glm::vec3				step;
+	};
+
+	std::string					name;
+	float						duration = 0.0f;			// in ticks
+	float						ticksPerSecond = 25.0f;
+
+	std::vector<Channel>		channels;
+	std::vector<float>			translationTimes;
+	std::vector<glm::vec3>		translations;
+	std::vector<float>			rotationTimes;
+	std::vector<glm::quat>		rotations;
+	std::vector<float>			scaleTimes;
+	std::vector<glm::vec3>		scales;
+
+	// after compress() the keys are in these instead, and the arrays above are empty.  Times are 16 bit fractions of the
+	// duration, rotations the smallest three components in 48 bits and translations and scales 16 bits a component
+	// across their channel's range.  Channels then index these arrays (three values a key)
+	bool						isCompressed = false;
+	std::vector<unsigned short>	packedTranslationTimes;
+	std::vector<unsigned short>	packedTranslations;
+	std::vector<unsigned short>	packedRotationTimes;
+	std::vector<unsigned short>	packedRotations;
+	std::vector<unsigned short>	packedScaleTimes;
+	std::vector<unsigned short>	packedScales;
+	std::vector<TrackRange>		translationRanges;			// one a channel
+	std::vector<TrackRange>		scaleRanges;
+
+	// channels for nodes the skeleton doesn't have are dropped.  Returns false if none were left
+	static bool bake(const aiAnimation *animation, const Skeleton& skeleton, AnimationClip& clip);
+
+	float seconds() const { return duration / ticksPerSecond; }
+	size_t keyCount() const;
+	// the memory the channels and keys take
+	size_t bytes() const;
+
+	// quantises the keys, drops those that interpolating between the keys either side reproduces within the tolerance
+	// and drops tracks that never leave the bind pose.  Sampling afterwards interpolates rotations with nlerp rather
+	// than slerp, which compression allows for.  Nothing needs the aiScene once the clip is baked, compressed or not
+	void compress(const Skeleton& skeleton, const ClipCompression& settings = ClipCompression(), ClipCompressionStats *stats = nullptr);
+
+	// the pose at a time in seconds, looping: the skeleton's bind pose with the animated nodes overwritten.  pose must
+	// already be sized for the skeleton.  Without a cursor each key is found with a binary search
+	void sample(const Skeleton& skeleton, float timeInSeconds, LocalPose& pose, ClipCursor *cursor = nullptr) const;
+
+	// sample() then Skeleton::computePalette(), writing skeleton.numBones() matrices to palette.  Reads nothing but its
+	// arguments and the clip, so any number of threads can evaluate the same clip at once, each with its own scratch
+	// (and cursor, if it has one)
+	void evaluate(const Skeleton& skeleton, float timeInSeconds, PoseScratch& scratch, glm::mat4 *palette, ClipCursor *cursor = nullptr) const;
+
+private:
+	// the animated nodes of pose at a time in ticks, with three cursor keys a channel if keys isn't null
+	void sampleKeys(float time, LocalPose& pose, unsigned int *keys) const;
+	void samplePacked(float time, LocalPose& pose, unsigned int *keys) const;
+};
+
+#endif
@@ -0,0 +1,82 @@
+//  AnimationScheduler.cpp
+
+#include "AnimationScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+
+//
+// Private functions
+//
+
+// evaluates jobs from the shared counter until there are none left
+static void runJobs(AnimationInstance *instances, unsigned int count, std::atomic<unsigned int>& nextJob, PoseScratch& poseScratch,
+	BlendScratch& blendScratch)
+{
+	for (;;)
+	{
+		unsigned int first = nextJob.fetch_add(1) * AnimationScheduler::BATCH_SIZE;
+		if (first >= count)
+			return;
+
+		unsigned int last = std::min(first + AnimationScheduler::BATCH_SIZE, count);
+		for (unsigned int i = first; i < last; i++)
+		{
+			const AnimationInstance& instance = instances[i];
+			if (instance.tree)
+				instance.tree->evaluate(*instance.skeleton, blendScratch, instance.palette);
+			else
+				instance.clip->evaluate(*instance.skeleton, instance.time, poseScratch, instance.palette, instance.cursor);
+		}
+	}
+}
+
+
+//
+// AnimationScheduler public method implementation
+//
+
+AnimationScheduler::AnimationScheduler(unsigned int numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	if (numThreads > 1)
+		pool.reset(new ThreadPool(numThreads - 1));
+
+	scratch.resize(numThreads);
+}
+
+void AnimationScheduler::evaluate(AnimationInstance *instances, unsigned int count)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start = Clock::now();
+
+	unsigned int numJobs = (count + BATCH_SIZE - 1) / BATCH_SIZE;
+	std::atomic<unsigned int> nextJob(0);
+
+	// only wake as many workers as there are jobs for
+	unsigned int numWorkers = pool ? std::min(pool->size(), numJobs > 0 ? numJobs - 1 : 0) : 0;
+
+	std::vector<std::future<void>> workers(numWorkers);
+	for (unsigned int i = 0; i < numWorkers; i++)
+	{
+		ThreadScratch *workerScratch = &scratch[i];
+		workers[i] = pool->submit([instances, count, &nextJob, workerScratch]() {
+			runJobs(instances, count, nextJob, workerScratch->pose, workerScratch->blend);
+		});
+	}
+
+	runJobs(instances, count, nextJob, scratch.back().pose, scratch.back().blend);
+
+	for (unsigned int i = 0; i < workers.size(); i++)
+		workers[i].get();
+
+	lastStats.instances = count;
+	lastStats.jobs = numJobs;
+	lastStats.threads = numWorkers + 1;
+	lastStats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
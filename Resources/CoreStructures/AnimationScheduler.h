@@ -0,0 +1,67 @@
+//  AnimationScheduler.h - Evaluates the poses of many animated characters at once across worker threads
+#ifndef ANIMATION_SCHEDULER_H
+#define ANIMATION_SCHEDULER_H
+
+#include <memory>
+#include <vector>
+
+#include "AnimationBlend.h"
+#include "AnimationClip.h"
+#include "ThreadPool.h"
+
+// One character to pose: the clip it's playing, how far in, and where its skinning matrices go.  The skeleton and clip
+// are only read, so any number of instances can share them.  A character with a blend tree (eg. an AnimationPlayer's)
+// is posed by the tree instead, which keeps its own times and cursors
+struct AnimationInstance {
+	const Skeleton		*skeleton = nullptr;
+	const AnimationClip	*clip = nullptr;
+	BlendTree			*tree = nullptr;			// the instance's own
+	float				time = 0.0f;				// in seconds
+	ClipCursor			*cursor = nullptr;			// optional; the instance's own, kept from frame to frame
+	glm::mat4			*palette = nullptr;			// skeleton->numBones() matrices, owned by the caller
+};
+
+// How the last evaluate() went
+struct AnimationSchedulerStats {
+	unsigned int	instances = 0;
+	unsigned int	jobs = 0;
+	unsigned int	threads = 0;					// including the calling thread
+	double			milliseconds = 0.0;
+};
+
+// Splits a frame's instances into jobs of BATCH_SIZE and runs them on a pool of workers kept for the scheduler's
+// lifetime, with the calling thread working through the jobs alongside them rather than waiting.  Threads take the
+// next job as they finish their last, so characters with bigger skeletons or more channels don't leave threads idle.
+// Each thread has its own scratch memory and each instance writes only its own palette, so there's no locking beyond
+// handing out jobs.
+//
+// evaluate() returns once every palette is written.  Nothing here touches OpenGL.
+class AnimationScheduler {
+
+public:
+	static const unsigned int BATCH_SIZE = 16;
+
+	// numThreads includes the calling thread.  0 uses one per hardware thread
+	explicit AnimationScheduler(unsigned int numThreads = 0);
+
+	AnimationScheduler(const AnimationScheduler&) = delete;
+	AnimationScheduler& operator=(const AnimationScheduler&) = delete;
+
+	void evaluate(AnimationInstance *instances, unsigned int count);
+	void evaluate(std::vector<AnimationInstance>& instances) { evaluate(instances.data(), (unsigned int)instances.size()); }
+
+	unsigned int threads() const { return (unsigned int)scratch.size(); }
+	const AnimationSchedulerStats& stats() const { return lastStats; }
+
+private:
+	struct ThreadScratch {
+		PoseScratch					pose;
+		BlendScratch				blend;
+	};
+
+	std::unique_ptr<ThreadPool>		pool;			// none when running on the calling thread alone
+	std::vector<ThreadScratch>		scratch;		// one for each thread, the calling thread's last
+	AnimationSchedulerStats			lastStats;
+};
+
+#endif
@@ -0,0 +1,134 @@
+//  AssetLoader.cpp
+
+#include "AssetLoader.h"
+
+#include <chrono>
+#include <memory>
+
+AssetLoader::AssetLoader(ModelLibrary& library, unsigned int numThreads)
+	: library(library), uploads(nullptr), pool(numThreads), cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+AssetLoader::AssetLoader(ModelLibrary& library, UploadManager *uploads, unsigned int numThreads)
+	: library(library), uploads(uploads), pool(numThreads), cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+	*cancelled = true;
+}
+
+ModelHandle AssetLoader::loadModel(const std::string& path)
+{
+	bool created;
+	ModelHandle handle = library.reserve(path, created);
+
+	if (created)
+	{
+		PendingModel pending;
+		pending.handle = handle;
+		std::shared_ptr<std::atomic<bool>> skip = cancelled;
+		pending.data = pool.submit([path, skip]() { return *skip ? ModelData() : Model::import(path); });
+		pendingModels.push_back(std::move(pending));
+	}
+
+	return handle;
+}
+
+unsigned int AssetLoader::update(double budgetMilliseconds)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start = Clock::now();
+	unsigned int uploaded = 0;
+	unsigned int installed = 0;
+
+	// models are installed in whatever order their imports finish
+	for (unsigned int i = 0; i < pendingModels.size(); )
+	{
+		PendingModel& pending = pendingModels[i];
+
+		if (pending.uploading)
+		{
+			if (uploads->isComplete(pending.model.uploadTicket()))
+			{
+				install(pending);
+				pendingModels.erase(pendingModels.begin() + i);
+				installed++;
+			}
+			else
+				i++;
+			continue;
+		}
+
+		if (uploaded > 0 && std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= budgetMilliseconds)
+			break;
+
+		if (pending.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
+
+		upload(pending);
+		uploaded++;
+
+		if (pending.uploading)
+			i++;
+		else
+		{
+			install(pending);
+			pendingModels.erase(pendingModels.begin() + i);
+			installed++;
+		}
+	}
+
+	return installed;
+}
+
+void AssetLoader::finish()
+{
+	for (unsigned int i = 0; i < pendingModels.size(); i++)
+		if (!pendingModels[i].uploading)
+			upload(pendingModels[i]);
+
+	if (uploads)
+		uploads->flush();
+
+	for (unsigned int i = 0; i < pendingModels.size(); i++)
+		install(pendingModels[i]);
+
+	pendingModels.clear();
+}
+
+void AssetLoader::cancel()
+{
+	*cancelled = true;
+
+	// the skipped imports finish at once, so this only waits on those already running
+	for (unsigned int i = 0; i < pendingModels.size(); i++)
+		if (pendingModels[i].data.valid())
+			pendingModels[i].data.wait();
+
+	// deletes the created models' buffers and textures
+	pendingModels.clear();
+}
+
+// waits for the import if it's still running, then creates the model, queuing its data if there's an UploadManager
+void AssetLoader::upload(PendingModel& pending)
+{
+	if (uploads)
+	{
+		pending.model = Model(std::make_shared<ModelData>(pending.data.get()), *uploads);
+		pending.uploading = true;
+	}
+	else
+		pending.model = Model(pending.data.get());
+}
+
+void AssetLoader::install(PendingModel& pending)
+{
+	library.install(pending.handle, std::move(pending.model));
+}
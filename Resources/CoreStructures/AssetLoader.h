@@ -0,0 +1,71 @@
+//  AssetLoader.h - Imports models on worker threads and uploads them on the GL thread within a time budget
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include "ModelLibrary.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Model::import() (Assimp or the cooked cache, vertex conversion and texture decoding) runs on the pool.  The finished
+// ModelData waits until update() uploads it on the GL thread and installs it in the library, so the scene can keep
+// rendering, with the library's placeholder standing in for models that haven't arrived yet.
+//
+// Given an UploadManager, update() only creates each model's buffers and textures and queues their data there.  The
+// model is installed by a later update() once the manager has staged all of it, so a large model's data is spread
+// over as many frames as the manager's byte budget needs.  The manager must outlive the loader.
+//
+// Models still pending own OpenGL objects, so call cancel() while the context is current before shutting down.
+class AssetLoader {
+
+public:
+	// numThreads as ThreadPool
+	explicit AssetLoader(ModelLibrary& library, unsigned int numThreads = 0);
+	// uploads can be null, to upload each model in one go as the first constructor does
+	AssetLoader(ModelLibrary& library, UploadManager *uploads, unsigned int numThreads = 0);
+	// imports that haven't started are skipped, so the pool only waits for the ones running
+	~AssetLoader();
+
+	// returns at once with the model's handle, queuing the import if the library doesn't already have the path
+	ModelHandle loadModel(const std::string& path);
+
+	// uploads imported models until budgetMilliseconds has been used.  A model is uploaded in one go, so the budget
+	// can be overrun by one model, and at least one ready model is uploaded per call so loading always progresses.
+	// With an UploadManager, models whose uploads have been staged are installed too, outside the budget.  Returns the
+	// number of models installed.  Call once per frame on the GL thread
+	unsigned int update(double budgetMilliseconds);
+
+	// blocks until every queued model is imported and installed, flushing the UploadManager if there is one
+	void finish();
+
+	// drops every model not installed yet: imports that haven't started are skipped, running ones are waited for, and
+	// models already created are deleted.  Their handles keep drawing the placeholder.  Call on the GL thread, before
+	// releasing the UploadManager, whose queue may still hold their data.  The loader can't load anything afterwards
+	void cancel();
+
+	// models queued but not installed yet
+	unsigned int pending() const { return (unsigned int)pendingModels.size(); }
+
+private:
+	struct PendingModel {
+		ModelHandle				handle;
+		std::future<ModelData>	data;
+		bool					uploading = false;
+		Model					model;			// created, waiting on its uploads
+	};
+
+	ModelLibrary&				library;
+	UploadManager				*uploads;
+	ThreadPool					pool;
+	std::vector<PendingModel>	pendingModels;
+	std::shared_ptr<std::atomic<bool>> cancelled;	// read by queued imports, which may outlive a moved-from flag
+
+	void upload(PendingModel& pending);
+	void install(PendingModel& pending);
+};
+
+#endif
@@ -0,0 +1,475 @@
+//  BlockCompressor.cpp
+
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+//
+// Private functions
+//
+
+// 4x4 block of RGBA pixels
+typedef unsigned char Block[16][4];
+
+// copies the block at (blockX, blockY) out of the image as RGBA, repeating edge pixels past the image
+static void readBlock(const unsigned char *pixels, int width, int height, int channels, int blockX, int blockY, Block block)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		int py = std::min(blockY * 4 + y, height - 1);
+
+		for (int x = 0; x < 4; x++)
+		{
+			int px = std::min(blockX * 4 + x, width - 1);
+			const unsigned char *p = pixels + ((size_t)py * width + px) * channels;
+			unsigned char *out = block[y * 4 + x];
+
+			switch (channels)
+			{
+			case 1:	out[0] = out[1] = out[2] = p[0]; out[3] = 255; break;
+			case 2:	out[0] = out[1] = out[2] = p[0]; out[3] = p[1]; break;
+			case 3:	out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = 255; break;
+			default: out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = p[3]; break;
+			}
+		}
+	}
+}
+
+static unsigned short packRGB565(const float colour[3])
+{
+	int r = std::min(std::max((int)(colour[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+	int g = std::min(std::max((int)(colour[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+	int b = std::min(std::max((int)(colour[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(unsigned short packed, int colour[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+// the four colours a BC1 block can use.  forceFourColours is set for BC3, whose colour block ignores endpoint order
+static void colourPalette(unsigned short c0, unsigned short c1, bool forceFourColours, int palette[4][4])
+{
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = 255;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (c0 > c1 || forceFourColours)
+		{
+			palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+			palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+		}
+		else
+		{
+			palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+			palette[3][i] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = (c0 > c1 || forceFourColours) ? 255 : 0;
+}
+
+// picks the nearest palette entry for each pixel and returns the block's squared error
+static int fitColourIndices(const Block block, unsigned short c0, unsigned short c1, unsigned int& indices)
+{
+	int palette[4][4];
+	colourPalette(c0, c1, false, palette);
+
+	indices = 0;
+	int totalError = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0, bestError = 0x7FFFFFFF;
+		for (int p = 0; p < 4; p++)
+		{
+			int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+			int error = dr * dr + dg * dg + db * db;
+			if (error < bestError)
+			{
+				bestError = error;
+				best = p;
+			}
+		}
+		indices |= (unsigned int)best << (i * 2);
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+// least squares endpoints for a fixed set of four colour mode indices.  Returns false if the indices don't constrain
+// both endpoints
+static bool refineEndpoints(const Block block, unsigned int indices, unsigned short& c0, unsigned short& c1)
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+		aa += a * a; bb += b * b; ab += a * b;
+		for (int c = 0; c < 3; c++)
+		{
+			ax[c] += a * block[i][c];
+			bx[c] += b * block[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+		return false;
+
+	float maxColour[3], minColour[3];
+	for (int c = 0; c < 3; c++)
+	{
+		maxColour[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+		minColour[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+	}
+
+	c0 = packRGB565(maxColour);
+	c1 = packRGB565(minColour);
+	if (c0 < c1)
+		std::swap(c0, c1);
+	return c0 != c1;
+}
+
+// Endpoints along the principal axis of the block's colours, pulled in slightly so the interpolated colours land on
+// the cluster rather than its extremes, then one least squares refinement.  Good quality for a fraction of the cost of
+// an exhaustive search
+static void encodeColourBlock(const Block block, unsigned char out[8])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += block[i][c];
+	for (int c = 0; c < 3; c++)
+		mean[c] /= 16.0f;
+
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+
+	// power iteration for the principal axis
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+		if (length < 1e-6f)
+			break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float minT = 0.0f, maxT = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = ((block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2]) / axisLength;
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	float inset = (maxT - minT) / 16.0f;
+	minT += inset;
+	maxT -= inset;
+
+	float maxColour[3], minColour[3];
+	for (int c = 0; c < 3; c++)
+	{
+		maxColour[c] = mean[c] + axis[c] * maxT;
+		minColour[c] = mean[c] + axis[c] * minT;
+	}
+
+	unsigned short c0 = packRGB565(maxColour);
+	unsigned short c1 = packRGB565(minColour);
+
+	// c0 > c1 selects four colour mode
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	unsigned int indices = 0;
+	if (c0 != c1)
+	{
+		int error = fitColourIndices(block, c0, c1, indices);
+
+		unsigned short r0, r1;
+		unsigned int refinedIndices;
+		if (error > 0 && refineEndpoints(block, indices, r0, r1) && fitColourIndices(block, r0, r1, refinedIndices) < error)
+		{
+			c0 = r0;
+			c1 = r1;
+			indices = refinedIndices;
+		}
+	}
+
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// the eight values of a BC4 block with a0 > a1
+static void channelPalette(unsigned char a0, unsigned char a1, int palette[8])
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+			palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// one channel of the block as a BC4 block, used for BC3 alpha and both BC5 channels
+static void encodeChannelBlock(const Block block, int channel, unsigned char out[8])
+{
+	unsigned char minValue = 255, maxValue = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		minValue = std::min(minValue, block[i][channel]);
+		maxValue = std::max(maxValue, block[i][channel]);
+	}
+
+	out[0] = maxValue;
+	out[1] = minValue;
+
+	unsigned long long indices = 0;
+	if (maxValue != minValue)
+	{
+		int palette[8];
+		channelPalette(maxValue, minValue, palette);
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = std::abs(block[i][channel] - palette[p]);
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+static void decodeColourBlock(const unsigned char *in, bool forceFourColours, Block block)
+{
+	unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8));
+	unsigned short c1 = (unsigned short)(in[2] | (in[3] << 8));
+	unsigned int indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+
+	int palette[4][4];
+	colourPalette(c0, c1, forceFourColours, palette);
+
+	for (int i = 0; i < 16; i++)
+	{
+		const int *colour = palette[(indices >> (i * 2)) & 3];
+		for (int c = 0; c < 4; c++)
+			block[i][c] = (unsigned char)colour[c];
+	}
+}
+
+static void decodeChannelBlock(const unsigned char *in, int channel, Block block)
+{
+	int palette[8];
+	channelPalette(in[0], in[1], palette);
+
+	unsigned long long indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (unsigned long long)in[2 + i] << (i * 8);
+
+	for (int i = 0; i < 16; i++)
+		block[i][channel] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+}
+
+
+//
+// CompressedImage public method implementation
+//
+
+size_t CompressedImage::levelOffset(int level) const
+{
+	size_t offset = 0;
+	for (int i = 0; i < level; i++)
+		offset += levelSize(i);
+	return offset;
+}
+
+size_t CompressedImage::levelSize(int level) const
+{
+	return BlockCompressor::compressedSize(format, levelWidth(level), levelHeight(level));
+}
+
+
+//
+// BlockCompressor public method implementation
+//
+
+unsigned int BlockCompressor::blockBytes(BlockFormat format)
+{
+	return format == BLOCK_BC1 ? 8 : 16;
+}
+
+size_t BlockCompressor::compressedSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void BlockCompressor::compress(const unsigned char *pixels, int width, int height, int channels, BlockFormat format, CompressedImage& image)
+{
+	image.width = width;
+	image.height = height;
+	image.levels = 0;
+	image.format = format;
+	image.blocks.clear();
+
+	addLevel(pixels, width, height, channels, image);
+}
+
+void BlockCompressor::addLevel(const unsigned char *pixels, int width, int height, int channels, CompressedImage& image)
+{
+	BlockFormat format = image.format;
+	size_t offset = image.blocks.size();
+	image.blocks.resize(offset + compressedSize(format, width, height));
+	image.levels++;
+
+	int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	unsigned char *out = image.blocks.data() + offset;
+
+	for (int by = 0; by < blocksHigh; by++)
+	{
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			Block block;
+			readBlock(pixels, width, height, channels, bx, by, block);
+
+			switch (format)
+			{
+			case BLOCK_BC1:
+				encodeColourBlock(block, out);
+				break;
+			case BLOCK_BC3:
+				encodeChannelBlock(block, 3, out);
+				encodeColourBlock(block, out + 8);
+				break;
+			case BLOCK_BC5:
+				encodeChannelBlock(block, 0, out);
+				encodeChannelBlock(block, 1, out + 8);
+				break;
+			}
+
+			out += blockBytes(format);
+		}
+	}
+}
+
+void BlockCompressor::decompress(const CompressedImage& image, std::vector<unsigned char>& rgba, int level)
+{
+	int width = image.levelWidth(level), height = image.levelHeight(level);
+	rgba.resize((size_t)width * height * 4);
+
+	int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	const unsigned char *in = image.blocks.data() + image.levelOffset(level);
+
+	for (int by = 0; by < blocksHigh; by++)
+	{
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			Block block;
+
+			switch (image.format)
+			{
+			case BLOCK_BC1:
+				decodeColourBlock(in, false, block);
+				break;
+			case BLOCK_BC3:
+				decodeColourBlock(in + 8, true, block);
+				decodeChannelBlock(in, 3, block);
+				break;
+			case BLOCK_BC5:
+				decodeChannelBlock(in, 0, block);
+				decodeChannelBlock(in + 8, 1, block);
+				for (int i = 0; i < 16; i++)
+				{
+					float x = block[i][0] / 127.5f - 1.0f, y = block[i][1] / 127.5f - 1.0f;
+					float z = std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+					block[i][2] = (unsigned char)((z + 1.0f) * 127.5f + 0.5f);
+					block[i][3] = 255;
+				}
+				break;
+			}
+
+			// copy the part of the block inside the image
+			for (int y = 0; y < 4 && by * 4 + y < height; y++)
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+					memcpy(&rgba[(((size_t)by * 4 + y) * width + bx * 4 + x) * 4], block[y * 4 + x], 4);
+
+			in += blockBytes(image.format);
+		}
+	}
+}
+
+double BlockCompressor::psnr(const unsigned char *pixels, int channels, const std::vector<unsigned char>& rgba, int width, int height, int compareChannels)
+{
+	compareChannels = std::min(compareChannels, channels);
+
+	double squaredError = 0.0;
+	size_t count = (size_t)width * height;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int c = 0; c < compareChannels; c++)
+		{
+			// grey images were expanded to RGB, so their one channel compares with red
+			double difference = (double)pixels[i * channels + c] - rgba[i * 4 + c];
+			squaredError += difference * difference;
+		}
+	}
+
+	double meanSquaredError = squaredError / ((double)count * compareChannels);
+	if (meanSquaredError <= 0.0)
+		return 99.0;
+
+	return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+const char *BlockCompressor::formatName(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_BC1:	return "BC1";
+	case BLOCK_BC3:	return "BC3";
+	default:		return "BC5";
+	}
+}
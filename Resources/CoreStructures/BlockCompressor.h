@@ -0,0 +1,56 @@
+//  BlockCompressor.h - CPU encoder and decoder for BC1, BC3 and BC5 compressed textures
+#ifndef BLOCK_COMPRESSOR_H
+#define BLOCK_COMPRESSOR_H
+
+#include <string>
+#include <vector>
+
+// BC1 (DXT1)	- 8 bytes per 4x4 block.  RGB colour maps without alpha
+// BC3 (DXT5)	- 16 bytes per block.  BC1 colour plus a separate alpha block, for maps with alpha
+// BC5 (RGTC2)	- 16 bytes per block.  Two independent channels, for normal maps (X and Y, Z is rebuilt in the shader)
+enum BlockFormat { BLOCK_BC1, BLOCK_BC3, BLOCK_BC5 };
+
+// An image compressed into 4x4 blocks, stored left to right, top to bottom.  Images that aren't a multiple of 4 are
+// padded by repeating the edge pixels.  Mip levels follow the image in blocks, largest first, each half the size of the
+// one before (rounded down, at least 1)
+struct CompressedImage {
+
+	int							width = 0;
+	int							height = 0;
+	int							levels = 0;
+	BlockFormat					format = BLOCK_BC1;
+	std::vector<unsigned char>	blocks;
+
+	int levelWidth(int level) const { int w = width >> level; return w > 0 ? w : 1; }
+	int levelHeight(int level) const { int h = height >> level; return h > 0 ? h : 1; }
+	size_t levelOffset(int level) const;
+	size_t levelSize(int level) const;
+};
+
+// Pure CPU, so it runs on worker threads and can be checked without a GL context: compress, decompress and compare the
+// result with psnr()
+class BlockCompressor {
+
+public:
+	static unsigned int blockBytes(BlockFormat format);
+	static size_t compressedSize(BlockFormat format, int width, int height);
+
+	// pixels are width * height * channels bytes as decoded by stb_image.  1 and 2 channel images are grey (+ alpha).
+	// Replaces whatever was in image with a single level
+	static void compress(const unsigned char *pixels, int width, int height, int channels, BlockFormat format, CompressedImage& image);
+
+	// compresses the next mip level onto the end of image.  width and height must be image.levelWidth(image.levels) and
+	// image.levelHeight(image.levels)
+	static void addLevel(const unsigned char *pixels, int width, int height, int channels, CompressedImage& image);
+
+	// decodes a level back to RGBA8.  BC5 puts X and Y in red and green and rebuilds Z into blue, as a normal map would be
+	static void decompress(const CompressedImage& image, std::vector<unsigned char>& rgba, int level = 0);
+
+	// peak signal to noise ratio in dB between an image and an RGBA8 decompression of it, over the first
+	// compareChannels channels of each pixel.  Identical images return 99
+	static double psnr(const unsigned char *pixels, int channels, const std::vector<unsigned char>& rgba, int width, int height, int compareChannels);
+
+	static const char *formatName(BlockFormat format);
+};
+
+#endif
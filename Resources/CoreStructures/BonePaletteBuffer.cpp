@@ -0,0 +1,155 @@
+//  BonePaletteBuffer.cpp
+
+#include "BonePaletteBuffer.h"
+#include "GLState.h"
+
+#include <algorithm>
+
+
+//
+// BonePaletteBuffer public method implementation
+//
+
+BonePaletteBuffer::BonePaletteBuffer(unsigned int matricesPerFrame)
+	: buffer(0), paletteTexture(0), matricesPerFrame(matricesPerFrame), persistent(false), mapped(nullptr), frame(FRAMES - 1), used(0)
+{
+	for (unsigned int i = 0; i < FRAMES; i++)
+		fences[i] = 0;
+
+	// four texels a matrix
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	if (maxTexels > 0)
+		this->matricesPerFrame = std::min(matricesPerFrame, (unsigned int)maxTexels / (4 * FRAMES));
+
+	GLsizeiptr size = (GLsizeiptr)this->matricesPerFrame * FRAMES * sizeof(glm::mat4);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+	if (GLAD_GL_ARB_buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_TEXTURE_BUFFER, size, nullptr, flags);
+		mapped = (glm::mat4*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, size, flags);
+		persistent = mapped != nullptr;
+	}
+	else
+		glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &paletteTexture);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+}
+
+BonePaletteBuffer::~BonePaletteBuffer()
+{
+	release();
+}
+
+void BonePaletteBuffer::beginFrame()
+{
+	submit();
+
+	frame = (frame + 1) % FRAMES;
+	used = 0;
+	stats = BonePaletteStats();
+
+	// the GPU is normally done with a region long before it comes round again
+	if (fences[frame])
+	{
+		GLenum status = glClientWaitSync(fences[frame], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			stats.waited = true;
+			glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		}
+		glDeleteSync(fences[frame]);
+		fences[frame] = 0;
+	}
+
+	if (!persistent && buffer != 0)
+	{
+		// the fence has passed, so nothing needs synchronising
+		size_t regionBytes = (size_t)matricesPerFrame * sizeof(glm::mat4);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		mapped = (glm::mat4*)glMapBufferRange(GL_TEXTURE_BUFFER, frame * regionBytes, regionBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+glm::mat4 *BonePaletteBuffer::allocate(unsigned int count, GLint& base)
+{
+	if (!mapped || count > matricesPerFrame - used)
+	{
+		stats.overflows++;
+		return nullptr;
+	}
+
+	unsigned int first = frame * matricesPerFrame + used;
+	glm::mat4 *matrices = mapped + (persistent ? first : used);
+
+	base = (GLint)first;
+	used += count;
+	stats.palettes++;
+	stats.matrices += count;
+	return matrices;
+}
+
+void BonePaletteBuffer::submit()
+{
+	if (persistent || !mapped)
+		return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glUnmapBuffer(GL_TEXTURE_BUFFER);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	mapped = nullptr;
+}
+
+void BonePaletteBuffer::endFrame()
+{
+	submit();
+
+	if (fences[frame])
+		glDeleteSync(fences[frame]);
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void BonePaletteBuffer::bind(GLuint unit) const
+{
+	GLState::bindTexture(unit, GL_TEXTURE_BUFFER, paletteTexture);
+}
+
+void BonePaletteBuffer::release()
+{
+	for (unsigned int i = 0; i < FRAMES; i++)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+
+	if (mapped)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glUnmapBuffer(GL_TEXTURE_BUFFER);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	if (buffer != 0)
+		glDeleteBuffers(1, &buffer);
+
+	if (paletteTexture != 0)
+	{
+		GLState::forgetTexture(paletteTexture);
+		glDeleteTextures(1, &paletteTexture);
+	}
+
+	buffer = paletteTexture = 0;
+	mapped = nullptr;
+	persistent = false;
+}
@@ -0,0 +1,84 @@
+//  BonePaletteBuffer.h - Every skinned character's bone matrices for a frame in one texture buffer
+#ifndef BONE_PALETTE_BUFFER_H
+#define BONE_PALETTE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/*Shader side (see Tutorial21's Basic_shader.vert):
+ uniform samplerBuffer bonePalette;	- GL_RGBA32F, four texels per matrix, column by column
+ uniform int paletteBase;			- the character's first matrix, as returned by allocate()
+ uniform int paletteStride;			- bones per character, for instanced crowds whose palettes follow one another
+ bone i is the matrix at paletteBase + gl_InstanceID * paletteStride + i.  Tutorial21 draws its crowd of dragons like
+ that, with palettes from SkinnedMesh::BoneTransforms() and one SkinnedMesh::Render(shader, instances)
+ */
+
+// What the last frame held
+struct BonePaletteStats {
+	unsigned int	palettes = 0;
+	unsigned int	matrices = 0;
+	unsigned int	overflows = 0;			// allocations refused because the frame's region was full
+	bool			waited = false;			// beginFrame() had to wait for the GPU to finish with the region
+};
+
+// A buffer of FRAMES regions, each with room for a frame's skinning matrices, seen by the shaders as one texture
+// buffer.  Each frame's matrices are written straight into the region's mapped memory - by the calling thread or by
+// AnimationScheduler's workers - so a whole crowd's palettes reach the GPU without a single uniform call, and drawing
+// a character only needs its base index.  A texture buffer rather than a uniform block, since uniform blocks are
+// usually limited to 64 KB, about a thousand matrices.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently.  Otherwise each frame's region is mapped
+// unsynchronized in beginFrame() and unmapped in submit().  Either way regions are fenced after the frame's draws and
+// only rewritten once the GPU has finished with them, FRAMES frames later.
+//
+// Every call but writing through the pointers from allocate() belongs on the GL thread.
+class BonePaletteBuffer {
+
+public:
+	static const unsigned int FRAMES = 3;
+
+	// room for matricesPerFrame matrices each frame, less if the texture buffer would be bigger than the driver allows
+	explicit BonePaletteBuffer(unsigned int matricesPerFrame = 16384);
+	~BonePaletteBuffer();
+
+	BonePaletteBuffer(const BonePaletteBuffer&) = delete;
+	BonePaletteBuffer& operator=(const BonePaletteBuffer&) = delete;
+
+	// moves on to the next region, waiting for the GPU if it is still drawing with it
+	void beginFrame();
+
+	// count consecutive matrices in this frame's region, to be written before submit().  base is the index of the
+	// first for the shader's paletteBase.  Returns null, and leaves base alone, if the region is full
+	glm::mat4 *allocate(unsigned int count, GLint& base);
+
+	// makes the frame's matrices visible to the GPU.  Call after they're all written and before drawing with them
+	void submit();
+
+	// fences the frame's region.  Call once the draws using it have been issued
+	void endFrame();
+
+	// binds the texture buffer to a texture unit
+	void bind(GLuint unit) const;
+
+	// deletes the buffer and texture.  Must be called while the GL context is still current
+	void release();
+
+	GLuint texture() const { return paletteTexture; }
+	unsigned int capacity() const { return matricesPerFrame; }
+	bool persistentlyMapped() const { return persistent; }
+	const BonePaletteStats& lastFrameStats() const { return stats; }
+
+private:
+	GLuint				buffer;
+	GLuint				paletteTexture;
+	unsigned int		matricesPerFrame;
+	bool				persistent;
+	glm::mat4			*mapped;			// the whole buffer when persistent, else the current region while it's mapped
+
+	unsigned int		frame;				// current region
+	unsigned int		used;				// matrices allocated from it
+	GLsync				fences[FRAMES];
+	BonePaletteStats	stats;
+};
+
+#endif
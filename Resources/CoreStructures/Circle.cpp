@@ -1,4 +1,5 @@
 #include "Circle.h"
+#include "GLState.h"
 #include <iostream>
 
 using namespace std;
@@ -41,7 +42,7 @@ Circle::Circle(int numVertices, float radius)
 
 	// setup VAO for circle object
 	glGenVertexArrays(1, &modelVAO);
-	glBindVertexArray(modelVAO);
+	GLState::bindVertexArray(modelVAO);
 
 	glGenBuffers(1, &meshPositionVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, meshPositionVBO);
@@ -69,7 +70,7 @@ Circle::Circle(int numVertices, float radius)
 
 	glEnableVertexAttribArray(2);
 
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 Circle::~Circle()
@@ -87,13 +88,13 @@ Circle::~Circle()
 	glDeleteBuffers(1, &meshIndexVBO);
 
 	// delete VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
+	GLState::forgetVertexArray(modelVAO);
 	glDeleteVertexArrays(1, &modelVAO);
 }
 
 void Circle::render() {
 
-	glBindVertexArray(modelVAO);
+	GLState::bindVertexArray(modelVAO);
 	glDrawArrays(GL_TRIANGLE_FAN, 0, numElements);
-	glBindVertexArray(0);
 }
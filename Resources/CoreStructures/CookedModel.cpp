@@ -0,0 +1,308 @@
+//  CookedModel.cpp
+
+#include "CookedModel.h"
+#include "FileInfo.h"
+#include "ModelData.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char COOKED_MAGIC[4] = { 'C', 'M', 'D', 'L' };
+
+static unsigned int align(unsigned int offset, unsigned int alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+CookedModel::CookedModel()
+{
+	data = nullptr;
+	size = 0;
+	file = nullptr;
+	mapping = nullptr;
+}
+
+CookedModel::~CookedModel()
+{
+	close();
+}
+
+string CookedModel::cachePath(const string& sourcePath)
+{
+	return sourcePath + ".cooked";
+}
+
+bool CookedModel::write(const string& sourcePath, unsigned int importFlags, const ModelData& model)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+
+	// the size and modification time of the source model key the cache along with the import flags
+	if (!fileInfo(sourcePath, header.sourceSize, header.sourceTime))
+		return false;
+
+	header.version = VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.importFlags = importFlags;
+	header.numMeshes = (unsigned int)model.meshes.size();
+	header.numVertices = model.numVertices();
+	header.numIndices = model.numIndices();
+
+	// build the tables first, so the blob offsets are known before anything is written
+	vector<MeshRecord> meshRecords(model.meshes.size());
+	vector<TextureRecord> textureRecords;
+	string strings;
+
+	for (unsigned int i = 0; i < model.meshes.size(); i++)
+	{
+		const ModelData::MeshData& mesh = model.meshes[i];
+		MeshRecord& record = meshRecords[i];
+
+		record.firstVertex = mesh.firstVertex;
+		record.numVertices = mesh.numVertices;
+		record.firstIndex = mesh.firstIndex;
+		record.numIndices = mesh.numIndices;
+		record.firstTexture = (unsigned int)textureRecords.size();
+		record.numTextures = (unsigned int)mesh.textures.size();
+
+		for (unsigned int j = 0; j < mesh.textures.size(); j++)
+		{
+			const ModelData::TextureData& source = model.textures[mesh.textures[j]];
+
+			TextureRecord texture;
+			texture.type = (unsigned int)source.type;
+			texture.pathOffset = (unsigned int)strings.size();
+			texture.pathLength = (unsigned int)source.path.size();
+			textureRecords.push_back(texture);
+			strings += source.path;
+		}
+	}
+
+	header.numTextures = (unsigned int)textureRecords.size();
+	header.meshOffset = sizeof(Header);
+	header.textureOffset = header.meshOffset + header.numMeshes * sizeof(MeshRecord);
+	header.stringOffset = header.textureOffset + header.numTextures * sizeof(TextureRecord);
+	header.vertexOffset = align(header.stringOffset + (unsigned int)strings.size(), 16);
+	header.indexOffset = header.vertexOffset + header.numVertices * sizeof(Vertex);
+	header.fileSize = header.indexOffset + header.numIndices * sizeof(unsigned int);
+
+	string path = cachePath(sourcePath);
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	// the magic stays zeroed until everything else has been written
+	out.write((const char*)&header, sizeof(header));
+	if (!meshRecords.empty())
+		out.write((const char*)meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+	if (!textureRecords.empty())
+		out.write((const char*)textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+	out.write(strings.data(), strings.size());
+
+	static const char padding[16] = {};
+	out.write(padding, header.vertexOffset - header.stringOffset - strings.size());
+
+	out.write((const char*)model.vertexData(), header.numVertices * sizeof(Vertex));
+	out.write((const char*)model.indexData(), header.numIndices * sizeof(unsigned int));
+
+	out.seekp(0);
+	out.write(COOKED_MAGIC, sizeof(COOKED_MAGIC));
+	out.close();
+
+	if (!out)
+	{
+		remove(path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool CookedModel::open(const string& sourcePath, unsigned int importFlags)
+{
+	close();
+
+	if (!map(cachePath(sourcePath)))
+		return false;
+
+	if (!validate(sourcePath, importFlags))
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+// checks the file was cooked from the current source with the same settings, and that the tables fit in the file
+bool CookedModel::validate(const string& sourcePath, unsigned int importFlags) const
+{
+	if (size < sizeof(Header))
+		return false;
+
+	const Header& h = header();
+	if (memcmp(h.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) != 0 || h.version != VERSION ||
+		h.vertexSize != sizeof(Vertex) || h.importFlags != importFlags || h.fileSize != size)
+		return false;
+
+	unsigned long long sourceSize, sourceTime;
+	if (!fileInfo(sourcePath, sourceSize, sourceTime) || sourceSize != h.sourceSize || sourceTime != h.sourceTime)
+		return false;
+
+	// 64 bit sums so corrupt counts can't wrap around
+	if ((unsigned long long)h.meshOffset + (unsigned long long)h.numMeshes * sizeof(MeshRecord) > h.textureOffset ||
+		(unsigned long long)h.textureOffset + (unsigned long long)h.numTextures * sizeof(TextureRecord) > h.stringOffset ||
+		h.stringOffset > h.vertexOffset || h.vertexOffset % 16 != 0 ||
+		(unsigned long long)h.vertexOffset + (unsigned long long)h.numVertices * sizeof(Vertex) > h.indexOffset ||
+		(unsigned long long)h.indexOffset + (unsigned long long)h.numIndices * sizeof(unsigned int) > size)
+		return false;
+
+	for (unsigned int i = 0; i < h.numMeshes; i++)
+	{
+		const MeshRecord& m = mesh(i);
+		if ((unsigned long long)m.firstVertex + m.numVertices > h.numVertices ||
+			(unsigned long long)m.firstIndex + m.numIndices > h.numIndices ||
+			(unsigned long long)m.firstTexture + m.numTextures > h.numTextures)
+			return false;
+	}
+
+	for (unsigned int i = 0; i < h.numTextures; i++)
+	{
+		const TextureRecord& t = ((const TextureRecord*)(data + h.textureOffset))[i];
+		if (t.type > TEXTURE_NULL || (unsigned long long)h.stringOffset + t.pathOffset + t.pathLength > h.vertexOffset)
+			return false;
+	}
+
+	return true;
+}
+
+const CookedModel::MeshRecord& CookedModel::mesh(unsigned int index) const
+{
+	return ((const MeshRecord*)(data + header().meshOffset))[index];
+}
+
+TextureType CookedModel::textureType(unsigned int index) const
+{
+	return (TextureType)((const TextureRecord*)(data + header().textureOffset))[index].type;
+}
+
+string CookedModel::texturePath(unsigned int index) const
+{
+	const TextureRecord& texture = ((const TextureRecord*)(data + header().textureOffset))[index];
+	return string((const char*)data + header().stringOffset + texture.pathOffset, texture.pathLength);
+}
+
+const Vertex *CookedModel::vertices() const
+{
+	return (const Vertex*)(data + header().vertexOffset);
+}
+
+const unsigned int *CookedModel::indices() const
+{
+	return (const unsigned int*)(data + header().indexOffset);
+}
+
+#ifdef _WIN32
+
+bool CookedModel::map(const string& path)
+{
+	HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle == nullptr)
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	const void *view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	file = fileHandle;
+	mapping = mappingHandle;
+	data = (const unsigned char*)view;
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void CookedModel::close()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle((HANDLE)mapping);
+	if (file != nullptr)
+		CloseHandle((HANDLE)file);
+
+	data = nullptr;
+	size = 0;
+	file = nullptr;
+	mapping = nullptr;
+}
+
+#else
+
+bool CookedModel::map(const string& path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file open
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	data = (const unsigned char*)view;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void CookedModel::close()
+{
+	if (data != nullptr)
+		munmap((void*)data, size);
+
+	data = nullptr;
+	size = 0;
+	file = nullptr;
+	mapping = nullptr;
+}
+
+#endif
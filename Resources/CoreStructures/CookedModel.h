@@ -0,0 +1,105 @@
+//  CookedModel.h - Binary cache of a Model's imported meshes so later runs can skip Assimp
+#ifndef COOKED_MODEL_H
+#define COOKED_MODEL_H
+
+#include "Mesh.h"
+
+#include <string>
+#include <vector>
+
+struct ModelData;
+
+/*Cooked model file (<source path>.cooked), all offsets in bytes from the start of the file:
+ header					- CookedModel::Header
+ mesh table				- Header::numMeshes x CookedModel::MeshRecord
+ texture table			- Header::numTextures x CookedModel::TextureRecord
+ string table			- texture paths, not null terminated
+ vertex blob			- Header::numVertices x Vertex, 16 byte aligned
+ index blob				- Header::numIndices x unsigned int, relative to each mesh's first vertex
+
+ The file is only used if its version, vertex size, import flags and the source file's size and modification time
+ all match, so editing or replacing a model re-cooks it on the next run.
+ A model whose small textures were packed into a TextureAtlas when it was cooked lists the atlas as the texture
+ <model file>.atlas, whose blocks are in <model file>.atlas.dds, keyed to the model in the same way.
+ */
+
+// A cooked model file mapped into memory.  The vertex and index blobs are laid out exactly as VertexArena stores them,
+// so they can be uploaded straight from the mapping.
+//
+// Owns the mapping, so it can't be copied.
+class CookedModel {
+
+public:
+	static const unsigned int VERSION = 3;
+
+	struct Header {
+		char				magic[4];		// "CMDL", written last so a partly written file is never valid
+		unsigned int		version;
+		unsigned int		vertexSize;		// sizeof(Vertex) when cooked
+		unsigned int		importFlags;	// aiPostProcessSteps the source was imported with
+		unsigned long long	sourceSize;
+		unsigned long long	sourceTime;
+		unsigned int		numMeshes;
+		unsigned int		numTextures;
+		unsigned int		numVertices;
+		unsigned int		numIndices;
+		unsigned int		meshOffset;
+		unsigned int		textureOffset;
+		unsigned int		stringOffset;
+		unsigned int		vertexOffset;
+		unsigned int		indexOffset;
+		unsigned int		fileSize;
+	};
+
+	struct MeshRecord {
+		unsigned int		firstVertex;
+		unsigned int		numVertices;
+		unsigned int		firstIndex;
+		unsigned int		numIndices;
+		unsigned int		firstTexture;
+		unsigned int		numTextures;
+	};
+
+	struct TextureRecord {
+		unsigned int		type;			// TextureType
+		unsigned int		pathOffset;		// from the start of the string table
+		unsigned int		pathLength;
+	};
+
+	CookedModel();
+	~CookedModel();
+
+	CookedModel(const CookedModel&) = delete;
+	CookedModel& operator=(const CookedModel&) = delete;
+
+	// cache file used for a source model
+	static std::string cachePath(const std::string& sourcePath);
+
+	// writes a model imported from sourcePath.  Returns false if the file couldn't be written
+	static bool write(const std::string& sourcePath, unsigned int importFlags, const ModelData& model);
+
+	// maps the cache for sourcePath.  Returns false if there isn't one or it's stale, in which case the model should
+	// be imported (and cooked) again
+	bool open(const std::string& sourcePath, unsigned int importFlags);
+	void close();
+
+	const Header& header() const { return *(const Header*)data; }
+	const MeshRecord& mesh(unsigned int index) const;
+	TextureType textureType(unsigned int index) const;
+	std::string texturePath(unsigned int index) const;
+	const Vertex *vertices() const;
+	const unsigned int *indices() const;
+
+private:
+	const unsigned char	*data;
+	size_t				size;
+
+	// platform handles for the mapping
+	void				*file;
+	void				*mapping;
+
+	bool map(const std::string& path);
+	bool validate(const std::string& sourcePath, unsigned int importFlags) const;
+};
+
+#endif
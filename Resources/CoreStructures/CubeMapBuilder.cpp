@@ -0,0 +1,181 @@
+//  CubeMapBuilder.cpp
+
+#include "CubeMapBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define CUBE_MAP_BUILDER_SSE2
+#include <emmintrin.h>
+#endif
+
+
+//
+// Private data
+//
+
+static const float PI = 3.14159265358979323846f;
+
+// cell of each face in a horizontal cross, GL_TEXTURE_CUBE_MAP_POSITIVE_X order.  A vertical cross is the same but
+// for -Z, which hangs below -Y rotated half a turn
+static const int CROSS_COLUMN[6] = { 2, 0, 1, 1, 1, 3 };
+static const int CROSS_ROW[6] = { 1, 1, 0, 2, 1, 1 };
+static const int NEGATIVE_Z = 5;
+
+
+//
+// Private functions
+//
+
+// the direction through texel (s, t) of a face, s and t in -1..1 from the top left, as the OpenGL cube map face table
+static void faceDirection(int face, float s, float t, float& x, float& y, float& z)
+{
+	switch (face)
+	{
+	case 0:		x = 1.0f;	y = -t;		z = -s;		break;
+	case 1:		x = -1.0f;	y = -t;		z = s;		break;
+	case 2:		x = s;		y = 1.0f;	z = t;		break;
+	case 3:		x = s;		y = -1.0f;	z = -t;		break;
+	case 4:		x = s;		y = -t;		z = 1.0f;	break;
+	default:	x = -s;		y = -t;		z = -1.0f;	break;
+	}
+}
+
+// the panorama at (u, v) in texels, wrapping across and clamped top and bottom
+static inline void bilinear(const unsigned char *rgba, int width, int height, float u, float v, unsigned char *out)
+{
+	float fx = std::floor(u), fy = std::floor(v);
+	float wx = u - fx, wy = v - fy;
+
+	int x0 = ((int)fx % width + width) % width;
+	int x1 = (x0 + 1) % width;
+	int y0 = std::min(std::max((int)fy, 0), height - 1);
+	int y1 = std::min(std::max((int)fy + 1, 0), height - 1);
+
+	const unsigned char *p00 = rgba + ((size_t)y0 * width + x0) * 4;
+	const unsigned char *p10 = rgba + ((size_t)y0 * width + x1) * 4;
+	const unsigned char *p01 = rgba + ((size_t)y1 * width + x0) * 4;
+	const unsigned char *p11 = rgba + ((size_t)y1 * width + x1) * 4;
+
+#ifdef CUBE_MAP_BUILDER_SSE2
+	// each texel's four bytes widened to one register of floats
+	__m128i zero = _mm_setzero_si128();
+	int texel;
+	memcpy(&texel, p00, 4);
+	__m128 a = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero));
+	memcpy(&texel, p10, 4);
+	__m128 b = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero));
+	memcpy(&texel, p01, 4);
+	__m128 c = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero));
+	memcpy(&texel, p11, 4);
+	__m128 d = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero));
+
+	__m128 weightX = _mm_set1_ps(wx);
+	__m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), weightX));
+	__m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), weightX));
+	__m128 result = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(wy)));
+
+	// round and narrow back to bytes, saturating
+	__m128i bytes = _mm_cvtps_epi32(result);
+	bytes = _mm_packus_epi16(_mm_packs_epi32(bytes, zero), zero);
+	texel = _mm_cvtsi128_si32(bytes);
+	memcpy(out, &texel, 4);
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		float top = p00[i] + (p10[i] - p00[i]) * wx;
+		float bottom = p01[i] + (p11[i] - p01[i]) * wx;
+		out[i] = (unsigned char)std::min(std::max((int)(top + (bottom - top) * wy + 0.5f), 0), 255);
+	}
+#endif
+}
+
+
+//
+// CubeMapBuilder public method implementation
+//
+
+void CubeMapBuilder::toRGBA(const unsigned char *pixels, int width, int height, int channels, unsigned char *rgba)
+{
+	size_t count = (size_t)width * height;
+
+	if (channels == 4)
+	{
+		memcpy(rgba, pixels, count * 4);
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned char *src = pixels + i * channels;
+		unsigned char *dst = rgba + i * 4;
+
+		switch (channels)
+		{
+		case 1:	dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+		case 2:	dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+		default: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+		}
+	}
+}
+
+int CubeMapBuilder::crossFaceSize(int width, int height)
+{
+	if (width % 4 == 0 && width / 4 * 3 == height)
+		return width / 4;
+	if (height % 4 == 0 && height / 4 * 3 == width)
+		return width / 3;
+	return 0;
+}
+
+void CubeMapBuilder::fromCross(const unsigned char *rgba, int width, int height, int face, std::vector<unsigned char>& pixels)
+{
+	int size = crossFaceSize(width, height);
+	bool vertical = height > width;
+
+	pixels.resize((size_t)size * size * 4);
+	size_t rowBytes = (size_t)size * 4;
+
+	if (vertical && face == NEGATIVE_Z)
+	{
+		// bottom cell, rotated back the right way up
+		const unsigned char *cell = rgba + ((size_t)3 * size * width + size) * 4;
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+				memcpy(&pixels[((size_t)y * size + x) * 4], cell + ((size_t)(size - 1 - y) * width + (size - 1 - x)) * 4, 4);
+		return;
+	}
+
+	const unsigned char *cell = rgba + ((size_t)CROSS_ROW[face] * size * width + (size_t)CROSS_COLUMN[face] * size) * 4;
+	for (int y = 0; y < size; y++)
+		memcpy(&pixels[y * rowBytes], cell + (size_t)y * width * 4, rowBytes);
+}
+
+void CubeMapBuilder::fromEquirectangular(const unsigned char *rgba, int width, int height, int face, int size, std::vector<unsigned char>& pixels)
+{
+	pixels.resize((size_t)size * size * 4);
+
+	for (int y = 0; y < size; y++)
+	{
+		float t = (2.0f * y + 1.0f) / size - 1.0f;
+
+		for (int x = 0; x < size; x++)
+		{
+			float s = (2.0f * x + 1.0f) / size - 1.0f;
+
+			float dx, dy, dz;
+			faceDirection(face, s, t, dx, dy, dz);
+
+			// longitude 0 looks down -Z, latitude +90 degrees up +Y
+			float longitude = std::atan2(dx, -dz);
+			float latitude = std::atan2(dy, std::sqrt(dx * dx + dz * dz));
+
+			float u = (longitude / (2.0f * PI) + 0.5f) * width - 0.5f;
+			float v = (0.5f - latitude / PI) * height - 0.5f;
+
+			bilinear(rgba, width, height, u, v, &pixels[((size_t)y * size + x) * 4]);
+		}
+	}
+}
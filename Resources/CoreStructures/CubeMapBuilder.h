@@ -0,0 +1,48 @@
+//  CubeMapBuilder.h - Cube map faces from single image layouts, built on the CPU
+#ifndef CUBE_MAP_BUILDER_H
+#define CUBE_MAP_BUILDER_H
+
+#include <vector>
+
+#include "MipBuilder.h"
+
+// How the faces of a cube map stored in one image are laid out
+//	CUBE_CROSS				- square faces in a horizontal (4x3) or vertical (3x4) cross:
+//
+//								   +Y					   +Y
+//								-X +Z +X -Z				-X +Z +X
+//								   -Y					   -Y
+//														   -Z (upside down)
+//
+//	CUBE_EQUIRECTANGULAR	- a 2:1 longitude / latitude panorama, +Y along the top row and -Z in the middle column
+enum CubeMapLayout { CUBE_CROSS, CUBE_EQUIRECTANGULAR };
+
+// The six square faces of a cube map, RGBA and in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order.  Faces aren't flipped:
+// cube map texture coordinates start at the top left
+struct CubeMapImage {
+
+	int							size = 0;
+	std::vector<unsigned char>	faces[6];
+	std::vector<MipLevel>		mips[6];	// mips[face][i] is mip level i + 1, as for DecodedImage
+};
+
+// Nothing here touches OpenGL, and each face is built on its own so the faces can be made on worker threads
+class CubeMapBuilder {
+
+public:
+	// expands stb_image pixels of any channel count to width * height RGBA pixels: grey is spread to RGB and missing
+	// alpha is opaque
+	static void toRGBA(const unsigned char *pixels, int width, int height, int channels, unsigned char *rgba);
+
+	// the face size of a cross, or 0 if the image is neither cross shape
+	static int crossFaceSize(int width, int height);
+	// copies one face out of an RGBA cross
+	static void fromCross(const unsigned char *rgba, int width, int height, int face, std::vector<unsigned char>& pixels);
+
+	// resamples one size x size face out of an RGBA panorama, with bilinear filtering vectorised with SSE2 where it's
+	// available.  Filtering is in the stored encoding, so faces about a quarter of the panorama's width (one texel per
+	// panorama texel around the horizon) lose least
+	static void fromEquirectangular(const unsigned char *rgba, int width, int height, int face, int size, std::vector<unsigned char>& pixels);
+};
+
+#endif
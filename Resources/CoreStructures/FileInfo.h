@@ -0,0 +1,27 @@
+//  FileInfo.h - Size and modification time of a file, used to tell whether a cache file is older than its source
+#ifndef FILE_INFO_H
+#define FILE_INFO_H
+
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// false if the file doesn't exist
+inline bool fileInfo(const std::string& path, unsigned long long& size, unsigned long long& time)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+#endif
+
+	size = (unsigned long long)info.st_size;
+	time = (unsigned long long)info.st_mtime;
+	return true;
+}
+
+#endif
@@ -83,7 +83,7 @@ FloatImage::FloatImage(FloatImage *I) {
 FloatImage::~FloatImage() {
 
 	if (data)
-		free(data);
+		delete [] data;
 }
 
 
@@ -0,0 +1,101 @@
+//  FrameTimeHistogram.cpp
+
+#include "FrameTimeHistogram.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <string>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+static const unsigned int MAX_BAR_LENGTH = 50;
+
+
+//
+// FrameTimeHistogram public method implementation
+//
+
+FrameTimeHistogram::FrameTimeHistogram(double bucketMilliseconds, double rangeMilliseconds)
+	: bucketWidth(bucketMilliseconds), buckets((size_t)(rangeMilliseconds / bucketMilliseconds) + 1, 0)
+{
+	reset();
+}
+
+void FrameTimeHistogram::record(double milliseconds)
+{
+	size_t bucket = min((size_t)(max(milliseconds, 0.0) / bucketWidth), buckets.size() - 1);
+	buckets[bucket]++;
+
+	samples++;
+	total += milliseconds;
+	longest = max(longest, milliseconds);
+}
+
+void FrameTimeHistogram::reset()
+{
+	fill(buckets.begin(), buckets.end(), 0);
+	samples = 0;
+	total = 0.0;
+	longest = 0.0;
+}
+
+double FrameTimeHistogram::percentile(double percent) const
+{
+	if (samples == 0)
+		return 0.0;
+
+	// the first bucket at which the running count reaches the target, reported as its upper edge
+	double target = samples * percent / 100.0;
+	unsigned int counted = 0;
+
+	for (size_t i = 0; i + 1 < buckets.size(); i++)
+	{
+		counted += buckets[i];
+		if (counted >= target)
+			return (i + 1) * bucketWidth;
+	}
+
+	return longest;
+}
+
+unsigned int FrameTimeHistogram::countAbove(double milliseconds) const
+{
+	size_t first = min((size_t)(max(milliseconds, 0.0) / bucketWidth), buckets.size() - 1);
+
+	unsigned int above = 0;
+	for (size_t i = first; i < buckets.size(); i++)
+		above += buckets[i];
+	return above;
+}
+
+void FrameTimeHistogram::print(ostream& out, const char *title) const
+{
+	ios::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+
+	out << title << ": " << samples << " frames, mean " << fixed << setprecision(2) << mean() << "ms, P50 " << percentile(50.0)
+		<< "ms, P95 " << percentile(95.0) << "ms, P99 " << percentile(99.0) << "ms, max " << longest << "ms" << endl;
+
+	unsigned int peak = *max_element(buckets.begin(), buckets.end());
+	for (size_t i = 0; i < buckets.size(); i++)
+	{
+		if (buckets[i] == 0)
+			continue;
+
+		// every occupied bucket gets at least one mark, so single spikes show up
+		size_t length = max((size_t)1, (size_t)buckets[i] * MAX_BAR_LENGTH / peak);
+		if (i + 1 < buckets.size())
+			out << setw(7) << i * bucketWidth << "ms ";
+		else
+			out << setw(6) << i * bucketWidth << "+ms ";
+		out << string(length, '#') << " " << buckets[i] << endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,40 @@
+//  FrameTimeHistogram.h - Distribution of frame times, for spotting the hitches an average hides
+#ifndef FRAME_TIME_HISTOGRAM_H
+#define FRAME_TIME_HISTOGRAM_H
+
+#include <ostream>
+#include <vector>
+
+// Frame times counted into fixed width buckets, so percentiles can be read without keeping every sample.  Times past
+// the last bucket go in an overflow bucket, which still counts towards percentiles (as the range's upper end) and
+// the exact maximum is kept separately.
+class FrameTimeHistogram {
+
+public:
+	explicit FrameTimeHistogram(double bucketMilliseconds = 0.5, double rangeMilliseconds = 100.0);
+
+	void record(double milliseconds);
+	void reset();
+
+	unsigned int count() const { return samples; }
+	double mean() const { return samples > 0 ? total / samples : 0.0; }
+	double maximum() const { return longest; }
+
+	// the frame time percent% of frames were no slower than, to a bucket's width
+	double percentile(double percent) const;
+
+	// frames slower than milliseconds, to a bucket's width
+	unsigned int countAbove(double milliseconds) const;
+
+	// one line of percentiles, then a bar for each occupied bucket
+	void print(std::ostream& out, const char *title) const;
+
+private:
+	double						bucketWidth;
+	std::vector<unsigned int>	buckets;		// the last is the overflow
+	unsigned int				samples;
+	double						total;
+	double						longest;
+};
+
+#endif
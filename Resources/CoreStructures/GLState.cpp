@@ -0,0 +1,163 @@
+//  GLState.cpp
+
+#include "GLState.h"
+
+
+//
+// Private data
+//
+
+// value for state we can't be sure of - never matches a real object name so the next bind is always issued
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+// texture targets with a shadow binding per unit
+enum ShadowedTarget { SHADOW_TEXTURE_2D, SHADOW_TEXTURE_CUBE_MAP, NUM_SHADOWED_TARGETS };
+
+static GLuint currentProgram = UNKNOWN;
+static GLuint currentVertexArray = UNKNOWN;
+static GLuint currentUnit = UNKNOWN;
+static GLuint boundTextures[GLState::MAX_TEXTURE_UNITS][NUM_SHADOWED_TARGETS];
+
+static GLStateStats stats;
+
+
+//
+// Private functions
+//
+
+// returns the shadow slot for a texture target or -1 if binds to that target aren't tracked
+static int shadowSlot(GLenum target)
+{
+	switch (target) {
+
+	case GL_TEXTURE_2D:			return SHADOW_TEXTURE_2D;
+	case GL_TEXTURE_CUBE_MAP:	return SHADOW_TEXTURE_CUBE_MAP;
+	default:					return -1;
+	}
+}
+
+// start with every texture binding unknown
+static const bool texturesCleared = (GLState::invalidate(), true);
+
+
+//
+// GLState
+//
+
+void GLState::useProgram(GLuint program)
+{
+	if (program == currentProgram) {
+
+		stats.elided++;
+		return;
+	}
+
+	glUseProgram(program);
+	currentProgram = program;
+	stats.issued++;
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if (vertexArray == currentVertexArray) {
+
+		stats.elided++;
+		return;
+	}
+
+	glBindVertexArray(vertexArray);
+	currentVertexArray = vertexArray;
+	stats.issued++;
+}
+
+void GLState::activeTexture(GLuint unit)
+{
+	if (unit == currentUnit) {
+
+		stats.elided++;
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	currentUnit = unit;
+	stats.issued++;
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+	int slot = shadowSlot(target);
+
+	if (currentUnit >= MAX_TEXTURE_UNITS || slot < 0) {
+
+		// the unit or target isn't tracked so the bind can't be checked
+		glBindTexture(target, texture);
+		stats.issued++;
+		return;
+	}
+
+	if (boundTextures[currentUnit][slot] == texture) {
+
+		stats.elided++;
+		return;
+	}
+
+	glBindTexture(target, texture);
+	boundTextures[currentUnit][slot] = texture;
+	stats.issued++;
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	int slot = shadowSlot(target);
+
+	if (unit < MAX_TEXTURE_UNITS && slot >= 0 && boundTextures[unit][slot] == texture) {
+
+		stats.elided++;
+		return;
+	}
+
+	activeTexture(unit);
+	bindTexture(target, texture);
+}
+
+void GLState::forgetProgram(GLuint program)
+{
+	if (program == currentProgram)
+		currentProgram = UNKNOWN;
+}
+
+void GLState::forgetVertexArray(GLuint vertexArray)
+{
+	if (vertexArray == currentVertexArray)
+		currentVertexArray = UNKNOWN;
+}
+
+void GLState::forgetTexture(GLuint texture)
+{
+	for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		for (int slot = 0; slot < NUM_SHADOWED_TARGETS; slot++)
+			if (boundTextures[unit][slot] == texture)
+				boundTextures[unit][slot] = UNKNOWN;
+}
+
+void GLState::invalidate()
+{
+	currentProgram = UNKNOWN;
+	currentVertexArray = UNKNOWN;
+	currentUnit = UNKNOWN;
+
+	for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		for (int slot = 0; slot < NUM_SHADOWED_TARGETS; slot++)
+			boundTextures[unit][slot] = UNKNOWN;
+}
+
+const GLStateStats& GLState::frameStats()
+{
+	return stats;
+}
+
+void GLState::resetFrameStats()
+{
+	stats.issued = 0;
+	stats.elided = 0;
+}
@@ -0,0 +1,49 @@
+//  GLState.h - Shadow copy of the OpenGL binding state so redundant binds can be dropped
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Bind calls made through GLState since the last resetFrameStats().  'elided' counts calls that were dropped because
+// the object was already bound.
+struct GLStateStats {
+	unsigned int issued = 0;
+	unsigned int elided = 0;
+};
+
+// Remembers the current program, vertex array, active texture unit and the 2D / cube map texture bound to each unit,
+// and only calls OpenGL when a bind would change something.  Because nothing needs restoring, draw code doesn't unbind
+// when it's done - every VAO, program and texture bind in the engine goes through here instead.
+//
+// Code that binds with raw gl* calls must call invalidate() afterwards, and deleted objects must be forgotten since
+// OpenGL can hand their names out again.  The shadow belongs to the single context used by the application.
+class GLState {
+
+public:
+	static const GLuint MAX_TEXTURE_UNITS = 32;
+
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+
+	// select a texture unit by index (0, 1, ...) rather than GL_TEXTUREi
+	static void activeTexture(GLuint unit);
+
+	// bind a texture to the active unit
+	static void bindTexture(GLenum target, GLuint texture);
+
+	// bind a texture to the given unit.  The active unit is only switched if the binding actually changes
+	static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	// call before deleting an object so a new object given the same name isn't assumed to be bound
+	static void forgetProgram(GLuint program);
+	static void forgetVertexArray(GLuint vertexArray);
+	static void forgetTexture(GLuint texture);
+
+	// forget everything, eg. after state was changed with raw OpenGL calls
+	static void invalidate();
+
+	static const GLStateStats& frameStats();
+	static void resetFrameStats();
+};
+
+#endif
@@ -0,0 +1,143 @@
+//  HalfFloat.cpp
+
+#include "HalfFloat.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define HALF_FLOAT_SSE2
+#include <emmintrin.h>
+#endif
+
+
+//
+// Private data
+//
+
+// bit patterns of floats, with the sign cleared
+static const unsigned int SMALLEST_NORMAL_HALF = 0x38800000;	// 2^-14
+static const unsigned int HALF_OVERFLOW = 0x477ff000;			// 65520, halfway from the largest half to 2^16
+static const unsigned int FLOAT_INFINITY = 0x7f800000;
+
+// adding 0.5 to a value below 2^-14 leaves a float whose last mantissa bit is worth 2^-24, a half denormal's step,
+// so the FPU's own rounding does the work
+static const unsigned int DENORMAL_MAGIC = 0x3f000000;			// 0.5
+
+// rebiases the exponent from 127 to 15 and adds the rounding bias, short of a half unit, in one add
+static const unsigned int REBIAS_AND_ROUND = 0xc8000fff;		// -(112 << 23) + 0xfff
+
+static const unsigned short HALF_INFINITY = 0x7c00;
+static const unsigned short HALF_NAN = 0x7e00;
+
+
+//
+// Private functions
+//
+
+#ifdef HALF_FLOAT_SSE2
+
+static inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// the scalar fromFloat() for four values at once, every case computed and the right one picked for each lane.  Each
+// lane's half is left in its low 16 bits
+static inline __m128i toHalves(__m128 values)
+{
+	const __m128i magnitudeMask = _mm_set1_epi32(0x7fffffff);
+
+	__m128i bits = _mm_castps_si128(values);
+	__m128i magnitude = _mm_and_si128(bits, magnitudeMask);
+	__m128i sign = _mm_srli_epi32(_mm_andnot_si128(magnitudeMask, bits), 16);
+
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(magnitude, 13), _mm_set1_epi32(1));
+	__m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(magnitude, _mm_set1_epi32((int)REBIAS_AND_ROUND)), odd), 13);
+
+	__m128 shifted = _mm_add_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32((int)DENORMAL_MAGIC)));
+	__m128i denormal = _mm_sub_epi32(_mm_castps_si128(shifted), _mm_set1_epi32((int)DENORMAL_MAGIC));
+
+	// the magnitudes are all positive as signed integers, so signed compares order them as floats
+	__m128i isDenormal = _mm_cmplt_epi32(magnitude, _mm_set1_epi32((int)SMALLEST_NORMAL_HALF));
+	__m128i isInfinite = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32((int)HALF_OVERFLOW - 1));
+	__m128i isNaN = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32((int)FLOAT_INFINITY));
+
+	__m128i half = select(isDenormal, denormal, normal);
+	half = select(isInfinite, _mm_set1_epi32(HALF_INFINITY), half);
+	half = select(isNaN, _mm_set1_epi32(HALF_NAN), half);
+	return _mm_or_si128(half, sign);
+}
+
+// sign extended, so the saturating pack keeps every bit
+static inline __m128i signExtend16(__m128i halves)
+{
+	return _mm_srai_epi32(_mm_slli_epi32(halves, 16), 16);
+}
+
+#endif
+
+
+//
+// HalfFloat public method implementation
+//
+
+unsigned short HalfFloat::fromFloat(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+	unsigned int magnitude = bits & 0x7fffffff;
+
+	if (magnitude > FLOAT_INFINITY)
+		return (unsigned short)(sign | HALF_NAN);
+	if (magnitude >= HALF_OVERFLOW)
+		return (unsigned short)(sign | HALF_INFINITY);
+
+	if (magnitude < SMALLEST_NORMAL_HALF)
+	{
+		float shifted;
+		memcpy(&shifted, &magnitude, sizeof(shifted));
+		shifted += 0.5f;
+		memcpy(&bits, &shifted, sizeof(bits));
+		return (unsigned short)(sign | (bits - DENORMAL_MAGIC));
+	}
+
+	// ties to even: the bias is a half unit when the bit above the cut is set, just short of one when it isn't
+	return (unsigned short)(sign | ((magnitude + REBIAS_AND_ROUND + ((magnitude >> 13) & 1)) >> 13));
+}
+
+float HalfFloat::toFloat(unsigned short half)
+{
+	unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+	unsigned int exponent = (half >> 10) & 31;
+	unsigned int mantissa = half & 0x3ff;
+
+	if (exponent == 0)
+	{
+		float value = mantissa * (1.0f / 16777216.0f);
+		return sign ? -value : value;
+	}
+
+	unsigned int bits = sign | (exponent == 31 ? FLOAT_INFINITY : (exponent + 112) << 23) | (mantissa << 13);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+void HalfFloat::fromFloat(const float *values, unsigned short *halves, size_t count)
+{
+	size_t i = 0;
+
+#ifdef HALF_FLOAT_SSE2
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i low = signExtend16(toHalves(_mm_loadu_ps(values + i)));
+		__m128i high = signExtend16(toHalves(_mm_loadu_ps(values + i + 4)));
+		_mm_storeu_si128((__m128i*)(halves + i), _mm_packs_epi32(low, high));
+	}
+#endif
+
+	for (; i < count; i++)
+		halves[i] = fromFloat(values[i]);
+}
@@ -0,0 +1,20 @@
+//  HalfFloat.h - Conversion between floats and the 16 bit half floats of GL_HALF_FLOAT textures
+#ifndef HALF_FLOAT_H
+#define HALF_FLOAT_H
+
+#include <cstddef>
+
+// Floats are rounded to the nearest half, ties to even, as the GPU would convert them.  Values too large for a half
+// become infinity, ones too small become half denormals or zero, and NaNs stay NaNs.  The array conversion does eight
+// values at a time with SSE2 where it's available, giving the same results as the scalar one.
+class HalfFloat {
+
+public:
+	static unsigned short fromFloat(float value);
+	static float toFloat(unsigned short half);
+
+	// halves[i] = fromFloat(values[i]) for count values
+	static void fromFloat(const float *values, unsigned short *halves, size_t count);
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "InstanceBuffer.h"
+
+#include <cstddef>
+
+static unsigned int nextSerialNumber = 1;
+
+InstanceBuffer::InstanceBuffer()
+{
+	buffer = 0;
+	capacity = 0;
+	count = 0;
+	serialNumber = 0;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	release();
+}
+
+InstanceBuffer::InstanceBuffer(InstanceBuffer&& other) noexcept
+	: buffer(other.buffer),
+	capacity(other.capacity),
+	count(other.count),
+	serialNumber(other.serialNumber)
+{
+	other.buffer = 0;
+	other.capacity = other.count = other.serialNumber = 0;
+}
+
+InstanceBuffer& InstanceBuffer::operator=(InstanceBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+
+		buffer = other.buffer;
+		capacity = other.capacity;
+		count = other.count;
+		serialNumber = other.serialNumber;
+
+		other.buffer = 0;
+		other.capacity = other.count = other.serialNumber = 0;
+	}
+	return *this;
+}
+
+void InstanceBuffer::upload(const InstanceData *instances, unsigned int count)
+{
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+		serialNumber = nextSerialNumber++;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// grow geometrically so a slowly growing crowd doesn't change the buffer size every frame
+	if (count > capacity)
+		capacity = (count > capacity * 2) ? count : capacity * 2;
+
+	// orphan the old contents rather than overwriting data the GPU may still be drawing from
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+
+	if (count > 0)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	this->count = count;
+}
+
+void InstanceBuffer::setupAttributes() const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// a mat4 attribute takes 4 consecutive locations, one per column
+	for (GLuint column = 0; column < 4; column++)
+	{
+		GLuint location = TRANSFORM_LOCATION + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, transform) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	glEnableVertexAttribArray(MATERIAL_LOCATION);
+	glVertexAttribIPointer(MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)offsetof(InstanceData, material));
+	glVertexAttribDivisor(MATERIAL_LOCATION, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::release()
+{
+	if (buffer != 0)
+		glDeleteBuffers(1, &buffer);
+
+	buffer = 0;
+	capacity = 0;
+	count = 0;
+}
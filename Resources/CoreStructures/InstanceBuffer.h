@@ -0,0 +1,61 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/*Instance attribute layouts (after the Mesh vertex attributes at 0-4):
+ model matrix			- layout (location=5) in mat4 (uses locations 5-8)
+ material ID			- layout (location=9) in uint
+ */
+
+// Per-instance data streamed to the GPU for an instanced draw
+struct InstanceData {
+	glm::mat4	transform;
+	GLuint		material;
+};
+
+// Vertex buffer of InstanceData for glDrawElementsInstanced.  The contents are replaced by each upload(), which
+// orphans the old storage so the driver doesn't have to wait for draws still reading it.  The buffer grows to fit the
+// largest upload and never shrinks.
+//
+// Owns its OpenGL buffer, so like Mesh it can be moved but not copied.
+class InstanceBuffer {
+
+public:
+	static const GLuint TRANSFORM_LOCATION = 5;
+	static const GLuint MATERIAL_LOCATION = 9;
+
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+	InstanceBuffer(InstanceBuffer&& other) noexcept;
+	InstanceBuffer& operator=(InstanceBuffer&& other) noexcept;
+
+	void upload(const InstanceData *instances, unsigned int count);
+
+	GLuint id() const { return buffer; }
+
+	// number of instances in the last upload
+	unsigned int size() const { return count; }
+
+	// unique for every OpenGL buffer an InstanceBuffer creates, unlike buffer names which OpenGL recycles.  Lets a VAO
+	// tell whether its instance attributes still point at this buffer
+	unsigned int serial() const { return serialNumber; }
+
+	// points the instance attributes of the currently bound VAO at this buffer
+	void setupAttributes() const;
+
+	// deletes the OpenGL buffer.  Must be called while the GL context is still current
+	void release();
+
+private:
+	GLuint			buffer;
+	unsigned int	capacity;
+	unsigned int	count;
+	unsigned int	serialNumber;
+};
+
+#endif
@@ -1,97 +1,235 @@
 #include "Mesh.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <map>
+
+const char *textureTypeName(TextureType type)
+{
+	switch (type)
+	{
+	case TEXTURE_DIFFUSE:	return "texture_diffuse";
+	case TEXTURE_SPECULAR:	return "texture_specular";
+	case TEXTURE_NORMAL:	return "texture_normal";
+	case TEXTURE_HEIGHT:	return "texture_height";
+	default:				return "texture_null";
+	}
+}
 
 // constructor
 Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
 {
-	this->vertices = vertices;
-	this->indices = indices;
-	this->textures = textures;
+	this->vertices = std::move(vertices);
+	this->indices = std::move(indices);
+	this->textures = std::move(textures);
+
+	// the buffers are filled by the model once it knows the size of all its meshes
+	VAO = 0;
+	arena = nullptr;
+	range.baseVertex = 0;
+	range.firstIndex = 0;
+	range.indexCount = 0;
+	numberSamplers();
+}
 
-	// now that we have all the required data, set the vertex buffers and its attribute pointers.
-	setupMesh();
+void Mesh::setRange(const VertexArena& arena, const VertexArena::Range& range)
+{
+	this->arena = &arena;
+	this->range = range;
+	VAO = arena.vertexArray();
 }
 
 // render the mesh
-void Mesh::draw(GLuint shader)
+void Mesh::draw(GLuint shader) const
 {
-	glUseProgram(shader);
+	GLState::useProgram(shader);
 	// bind appropriate textures
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	unsigned int normalNr = 1;
-	unsigned int heightNr = 1;
-	for (unsigned int i = 0; i < textures.size(); i++)
+	const BindingTable& table = bindingTable(shader);
+	for (unsigned int i = 0; i < table.bindings.size(); i++)
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-										  // retrieve texture number (the N in diffuse_textureN)
-		string number;
-		string name = textures[i].type;
-		if (name == "texture_diffuse")
-			number = std::to_string(diffuseNr++);
-		else if (name == "texture_specular")
-			number = std::to_string(specularNr++); // transfer unsigned int to stream
-		else if (name == "texture_normal")
-			number = std::to_string(normalNr++); // transfer unsigned int to stream
-		else if (name == "texture_height")
-			number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-												 // now set the sampler to the correct texture unit
-		glUniform1i(glGetUniformLocation(shader, (name + number).c_str()), i);
-		// and finally bind the texture
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		const TextureBinding& binding = table.bindings[i];
+		// set the sampler to the correct texture unit
+		glUniform1i(binding.location, binding.unit);
+		// and bind the texture to that unit
+		GLState::bindTexture(binding.unit, GL_TEXTURE_2D, binding.texture);
 	}
 
-	// draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
-	glBindVertexArray(0);
+	// draw mesh.  The VAO is left bound - GLState skips the bind if the next mesh drawn is this one again
+	bindVertexArray();
+	drawElements();
+}
+
+// render the mesh with a program that is already in use
+void Mesh::draw(const ShaderProgram& program) const
+{
+	bindTextures(program);
+	bindVertexArray();
+	drawElements();
+}
+
+// render one copy of the mesh per instance
+void Mesh::drawInstanced(const ShaderProgram& program, const InstanceBuffer& instances) const
+{
+	if (instances.size() == 0 || arena == nullptr)
+		return;
+
+	bindTextures(program);
+	bindVertexArray();
+
+	// the VAO remembers which buffer its instance attributes read from, so they only need setting for a new buffer
+	arena->useInstances(instances);
+
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+		(void*)(range.firstIndex * sizeof(GLuint)), instances.size(), range.baseVertex);
+}
+
+// the samplers already point at their units, so just bind the textures
+void Mesh::bindTextures(const ShaderProgram& program) const
+{
+	const BindingTable& table = bindingTable(program);
+	for (unsigned int i = 0; i < table.bindings.size(); i++)
+		GLState::bindTexture(table.bindings[i].unit, GL_TEXTURE_2D, table.bindings[i].texture);
+}
+
+void Mesh::bindVertexArray() const
+{
+	GLState::bindVertexArray(VAO);
+}
 
-	// always good practice to set everything back to defaults once configured.
-	glActiveTexture(GL_TEXTURE0);
+// the mesh's indices are relative to its own vertices, so offset them by where those start in the arena
+void Mesh::drawElements() const
+{
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+		(void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
 }
 
 void Mesh::insertTexture(Texture texture)
 {
 	this->textures.push_back(texture);
+	numberSamplers();
+}
+
+// The ID of each texture set, keyed by its textures' names.  forgetTexture() drops the sets of a deleted texture, so
+// this only holds sets that can still be drawn.  Created on first use and never destroyed, as textures can be released
+// during static destruction
+struct TextureSetRegistry {
+	map<vector<GLuint>, unsigned int>	sets;
+	unsigned int						nextID = 1;
+};
+
+static TextureSetRegistry& textureSetRegistry()
+{
+	static TextureSetRegistry *registry = new TextureSetRegistry();
+	return *registry;
+}
+
+// returns the ID shared by every mesh using exactly these textures.  Only called when a mesh's textures change.  IDs
+// aren't reused, so a set made from names OpenGL has recycled never shares an ID with one still held by a mesh
+static unsigned int findTextureSet(const vector<Texture>& textures)
+{
+	if (textures.empty())
+		return 0;
+
+	vector<GLuint> names(textures.size());
+	for (unsigned int i = 0; i < textures.size(); i++)
+		names[i] = textures[i].id;
+
+	TextureSetRegistry& registry = textureSetRegistry();
+	map<vector<GLuint>, unsigned int>::iterator found = registry.sets.find(names);
+	if (found != registry.sets.end())
+		return found->second;
+
+	unsigned int id = registry.nextID++;
+	registry.sets[names] = id;
+	return id;
+}
+
+void Mesh::forgetTexture(GLuint texture)
+{
+	TextureSetRegistry& registry = textureSetRegistry();
+	for (map<vector<GLuint>, unsigned int>::iterator set = registry.sets.begin(); set != registry.sets.end(); )
+	{
+		if (find(set->first.begin(), set->first.end(), texture) != set->first.end())
+			set = registry.sets.erase(set);
+		else
+			++set;
+	}
+}
+
+// work out the sampler number for each texture (the N in diffuse_textureN) once, rather than on every draw
+void Mesh::numberSamplers()
+{
+	unsigned int typeCount[TEXTURE_NULL + 1] = {};
+
+	samplerNumbers.resize(textures.size());
+	for (unsigned int i = 0; i < textures.size(); i++)
+		samplerNumbers[i] = ++typeCount[textures[i].type];
+
+	textureSetID = findTextureSet(textures);
+
+	// the textures changed so every binding table is stale
+	bindingTables.clear();
 }
 
-// initializes all the buffer objects/arrays
-void Mesh::setupMesh()
+// sampler uniform name for a texture, eg. "texture_diffuse1".  Null textures have no number
+string Mesh::samplerName(unsigned int textureIndex) const
 {
-	// create buffers/arrays
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
+	string name = textureTypeName(textures[textureIndex].type);
+	if (textures[textureIndex].type != TEXTURE_NULL)
+		name += std::to_string(samplerNumbers[textureIndex]);
+
+	return name;
+}
 
-	glBindVertexArray(VAO);
-	// load data into vertex buffers
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// A great thing about structs is that their memory layout is sequential for all its items.
-	// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-	// again translates to 3/2 floats which translates to a byte array.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+// bindings for drawing with a raw program object.  Texture i uses unit i, as the sampler is set on every draw.
+// Program names can be reused by OpenGL once deleted, so insertTexture() or a new mesh is needed after recreating a shader
+const Mesh::BindingTable& Mesh::bindingTable(GLuint shader) const
+{
+	for (unsigned int i = 0; i < bindingTables.size(); i++)
+		if (bindingTables[i].program == shader && !bindingTables[i].fixedUnits)
+			return bindingTables[i];
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	BindingTable table;
+	table.program = shader;
+	table.fixedUnits = false;
 
-	// set the vertex attribute pointers
-	// vertex Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	// vertex normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-	// vertex texture coords
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-	// vertex tangent
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-	// vertex bitangent
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		TextureBinding binding;
+		binding.location = glGetUniformLocation(shader, samplerName(i).c_str());
+		binding.unit = (GLint)i;
+		binding.texture = textures[i].id;
+		table.bindings.push_back(binding);
+	}
 
-	glBindVertexArray(0);
+	bindingTables.push_back(std::move(table));
+	return bindingTables.back();
 }
 
+// bindings for drawing with a ShaderProgram.  Textures whose sampler the program doesn't use are left out
+const Mesh::BindingTable& Mesh::bindingTable(const ShaderProgram& program) const
+{
+	for (unsigned int i = 0; i < bindingTables.size(); i++)
+		if (bindingTables[i].program == program.id() && bindingTables[i].fixedUnits)
+			return bindingTables[i];
+
+	BindingTable table;
+	table.program = program.id();
+	table.fixedUnits = true;
+
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		UniformID sampler = program.uniform(samplerName(i));
+		if (sampler == ShaderProgram::NO_UNIFORM)
+			continue;
+
+		TextureBinding binding;
+		binding.location = program.location(sampler);
+		binding.unit = program.textureUnit(sampler);
+		binding.texture = textures[i].id;
+		table.bindings.push_back(binding);
+	}
 
+	bindingTables.push_back(std::move(table));
+	return bindingTables.back();
+}
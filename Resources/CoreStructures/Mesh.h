@@ -6,6 +6,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "ShaderProgram.h"
+#include "InstanceBuffer.h"
+#include "VertexArena.h"
+
 #include <string>
 #include <vector>
 using namespace std;
@@ -23,35 +27,98 @@ struct Vertex {
 	glm::vec3 Bitangent;
 };
 
+// What a texture is used for.  Decided once at load time; the sampler a texture is bound to in the shader is
+// named after its type ("texture_diffuseN" etc.)
+enum TextureType { TEXTURE_DIFFUSE, TEXTURE_SPECULAR, TEXTURE_NORMAL, TEXTURE_HEIGHT, TEXTURE_NULL };
+
+// sampler name prefix for a texture type, eg. "texture_diffuse"
+const char *textureTypeName(TextureType type);
+
 struct Texture {
 	unsigned int id;
-	string type;
+	TextureType type;
 	string path;
 };
 
+// A Mesh draws a range of its model's VertexArena rather than owning buffers of its own, so the meshes of a model
+// share one VAO.  It can be moved but never copied, as copying would duplicate the CPU-side vertex data.
 class Mesh {
 public:
 	/*  Mesh Data  */
+	// CPU copies of the data uploaded to the arena.  Empty for meshes loaded from a cooked model
 	vector<Vertex> vertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
-	unsigned int VAO;
+	unsigned int VAO;	// the arena's VAO, 0 until setRange()
 
 	/*  Functions  */
-	// constructor
+	// constructor.  Nothing is uploaded until the mesh is given a range of an arena
 	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures);
 
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+	Mesh(Mesh&&) = default;
+	Mesh& operator=(Mesh&&) = default;
+
+	// draw from the range the mesh's vertices and indices were added to.  The arena must outlive the mesh
+	void setRange(const VertexArena& arena, const VertexArena::Range& range);
+
 	// render the mesh
-	void draw(GLuint shader);
+	void draw(GLuint shader) const;
+	// render the mesh with a program that is already in use.  The program assigned each sampler a fixed texture unit
+	// when it was attached, so this only binds textures
+	void draw(const ShaderProgram& program) const;
+	// render one copy of the mesh per instance in the buffer, with a program that reads the instance attributes
+	void drawInstanced(const ShaderProgram& program, const InstanceBuffer& instances) const;
 	void insertTexture(Texture);
 
+	// The steps of draw(const ShaderProgram&), for a render queue that skips the ones that wouldn't change anything
+	void bindTextures(const ShaderProgram& program) const;
+	void bindVertexArray() const;
+	void drawElements() const;
+
+	// Meshes with the same textures in the same order share a texture set ID.  IDs start at 0 for meshes without textures
+	unsigned int textureSet() const { return textureSetID; }
+
+	// drops the texture sets using a texture that is being deleted, before OpenGL can give its name to another.
+	// TextureCache calls this for the textures it deletes; anything else deleting a texture attached to a mesh should too
+	static void forgetTexture(GLuint texture);
+
+	// where the mesh's data is in the arena's buffers, for batching the draws of several meshes
+	GLint baseVertex() const { return range.baseVertex; }
+	GLuint firstIndex() const { return range.firstIndex; }
+	GLsizei indexCount() const { return range.indexCount; }
+
 private:
 	/*  Render data  */
-	unsigned int VBO, EBO;
+	const VertexArena *arena;
+	VertexArena::Range range;
+
+	// A texture to bind when drawing with a particular program
+	struct TextureBinding {
+		GLint	location;	// sampler uniform location (-1 if the program doesn't use it)
+		GLint	unit;		// texture unit the sampler reads from
+		GLuint	texture;	// OpenGL texture name
+	};
+
+	// The bindings for one program, resolved the first time the mesh is drawn with it.  Tables built for a
+	// ShaderProgram use the program's fixed sampler units, so the samplers don't need setting on every draw
+	struct BindingTable {
+		GLuint					program;
+		bool					fixedUnits;
+		vector<TextureBinding>	bindings;
+	};
 
-	// initializes all the buffer objects/arrays
-	void setupMesh();
+	// the N in texture_diffuseN for each texture
+	vector<unsigned int> samplerNumbers;
+	unsigned int textureSetID;
+
+	mutable vector<BindingTable> bindingTables;
+
+	void numberSamplers();
+	const BindingTable& bindingTable(GLuint shader) const;
+	const BindingTable& bindingTable(const ShaderProgram& program) const;
+	string samplerName(unsigned int textureIndex) const;
 
 };
 #endif
-
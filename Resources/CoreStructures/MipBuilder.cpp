@@ -0,0 +1,431 @@
+//  MipBuilder.cpp
+
+#include "MipBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MIP_BUILDER_SSE2
+#include <emmintrin.h>
+#endif
+
+
+//
+// Private data
+//
+
+// The structs are in an anonymous namespace so they can't clash with a type of the same name elsewhere, such as
+// FloatImage.h's FloatImage
+namespace {
+
+// Levels are held as four floats per pixel whatever the source channels, so every pixel is one SSE register
+struct MipImage {
+	int					width = 0;
+	int					height = 0;
+	std::vector<float>	pixels;
+
+	float *pixel(int x, int y) { return &pixels[((size_t)y * width + x) * 4]; }
+	const float *pixel(int x, int y) const { return &pixels[((size_t)y * width + x) * 4]; }
+};
+
+static const int KAISER_TAPS = 8;
+
+// sRGB decode for each byte value, and encode from linear quantised to 4096 steps (fine enough that no byte is
+// skipped, even in the darks)
+struct GammaTables {
+	float			toLinear[256];
+	unsigned char	toSRGB[4096];
+
+	GammaTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; i++)
+		{
+			float l = i / 4095.0f;
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			toSRGB[i] = (unsigned char)std::min(std::max((int)(c * 255.0f + 0.5f), 0), 255);
+		}
+	}
+};
+
+static const GammaTables& gammaTables()
+{
+	static const GammaTables tables;
+	return tables;
+}
+
+// Kaiser windowed sinc weights for halving.  Destination pixel x is centred between source pixels 2x and 2x + 1, so
+// the taps are 2x - 3 .. 2x + 4 and the weights are the same for every pixel
+struct KaiserWeights {
+	float		weights[KAISER_TAPS];
+
+	KaiserWeights()
+	{
+		const double alpha = 4.0, support = 2.0;
+		const double pi = 3.14159265358979323846;
+		double sum = 0.0;
+
+		for (int i = 0; i < KAISER_TAPS; i++)
+		{
+			// distance from the centre in destination pixels
+			double d = std::fabs(i - (KAISER_TAPS / 2 - 0.5)) * 0.5;
+			double sinc = std::sin(pi * d) / (pi * d);
+			double r = d / support;
+			double window = besselI0(alpha * std::sqrt(std::max(1.0 - r * r, 0.0))) / besselI0(alpha);
+			weights[i] = (float)(sinc * window);
+			sum += weights[i];
+		}
+		for (int i = 0; i < KAISER_TAPS; i++)
+			weights[i] = (float)(weights[i] / sum);
+	}
+
+	static double besselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 20; k++)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+};
+
+}
+
+static const KaiserWeights& kaiserWeights()
+{
+	static const KaiserWeights weights;
+	return weights;
+}
+
+
+//
+// Private functions
+//
+
+// dst[0..4) += src[0..4) * weight
+static inline void accumulate(float *dst, const float *src, float weight)
+{
+#ifdef MIP_BUILDER_SSE2
+	_mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(weight))));
+#else
+	for (int c = 0; c < 4; c++)
+		dst[c] += src[c] * weight;
+#endif
+}
+
+static inline void average4(float *dst, const float *a, const float *b, const float *c, const float *d)
+{
+#ifdef MIP_BUILDER_SSE2
+	__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)), _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(d)));
+	_mm_storeu_ps(dst, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+	for (int i = 0; i < 4; i++)
+		dst[i] = (a[i] + b[i] + c[i] + d[i]) * 0.25f;
+#endif
+}
+
+static inline void clampPixel(float *p, float low)
+{
+#ifdef MIP_BUILDER_SSE2
+	_mm_storeu_ps(p, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), _mm_set1_ps(low)), _mm_set1_ps(1.0f)));
+#else
+	for (int c = 0; c < 4; c++)
+		p[c] = std::min(std::max(p[c], low), 1.0f);
+#endif
+}
+
+// bytes to linear floats.  Grey images are spread to RGB and missing alpha is opaque; normal maps go to -1..1
+static void toFloat(const unsigned char *pixels, int width, int height, int channels, ImageContent content, MipImage& image)
+{
+	const GammaTables& gamma = gammaTables();
+
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+
+	size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned char *src = pixels + i * channels;
+		float *dst = &image.pixels[i * 4];
+
+		unsigned char rgba[4];
+		switch (channels)
+		{
+		case 1:	rgba[0] = rgba[1] = rgba[2] = src[0]; rgba[3] = 255; break;
+		case 2:	rgba[0] = rgba[1] = rgba[2] = src[0]; rgba[3] = src[1]; break;
+		case 3:	rgba[0] = src[0]; rgba[1] = src[1]; rgba[2] = src[2]; rgba[3] = 255; break;
+		default: rgba[0] = src[0]; rgba[1] = src[1]; rgba[2] = src[2]; rgba[3] = src[3]; break;
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			if (content == IMAGE_COLOUR)
+				dst[c] = gamma.toLinear[rgba[c]];
+			else if (content == IMAGE_NORMAL_MAP)
+				dst[c] = rgba[c] / 127.5f - 1.0f;
+			else
+				dst[c] = rgba[c] / 255.0f;
+		}
+		dst[3] = rgba[3] / 255.0f;
+	}
+}
+
+// linear floats as they are, spread to RGBA like toFloat()
+static void toFloat(const float *pixels, int width, int height, int channels, MipImage& image)
+{
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+
+	size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; i++)
+	{
+		const float *src = pixels + i * channels;
+		float *dst = &image.pixels[i * 4];
+
+		switch (channels)
+		{
+		case 1:	dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 1.0f; break;
+		case 2:	dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+		case 3:	dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 1.0f; break;
+		default: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3]; break;
+		}
+	}
+}
+
+static void toBytes(const MipImage& image, int channels, ImageContent content, MipLevel& level)
+{
+	const GammaTables& gamma = gammaTables();
+
+	level.width = image.width;
+	level.height = image.height;
+	level.pixels.resize((size_t)image.width * image.height * channels);
+
+	size_t count = (size_t)image.width * image.height;
+	for (size_t i = 0; i < count; i++)
+	{
+		const float *src = &image.pixels[i * 4];
+		unsigned char rgba[4];
+
+		for (int c = 0; c < 3; c++)
+		{
+			if (content == IMAGE_COLOUR)
+				rgba[c] = gamma.toSRGB[(int)(src[c] * 4095.0f + 0.5f)];
+			else if (content == IMAGE_NORMAL_MAP)
+				rgba[c] = (unsigned char)((src[c] + 1.0f) * 127.5f + 0.5f);
+			else
+				rgba[c] = (unsigned char)(src[c] * 255.0f + 0.5f);
+		}
+		rgba[3] = (unsigned char)(src[3] * 255.0f + 0.5f);
+
+		unsigned char *dst = &level.pixels[i * channels];
+		switch (channels)
+		{
+		case 1:	dst[0] = rgba[0]; break;
+		case 2:	dst[0] = rgba[0]; dst[1] = rgba[3]; break;
+		case 3:	dst[0] = rgba[0]; dst[1] = rgba[1]; dst[2] = rgba[2]; break;
+		default: dst[0] = rgba[0]; dst[1] = rgba[1]; dst[2] = rgba[2]; dst[3] = rgba[3]; break;
+		}
+	}
+}
+
+static void toFloatLevel(const MipImage& image, int channels, FloatMipLevel& level)
+{
+	level.width = image.width;
+	level.height = image.height;
+	level.pixels.resize((size_t)image.width * image.height * channels);
+
+	size_t count = (size_t)image.width * image.height;
+	for (size_t i = 0; i < count; i++)
+	{
+		const float *src = &image.pixels[i * 4];
+		float *dst = &level.pixels[i * channels];
+
+		switch (channels)
+		{
+		case 1:	dst[0] = src[0]; break;
+		case 2:	dst[0] = src[0]; dst[1] = src[3]; break;
+		case 3:	dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; break;
+		default: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3]; break;
+		}
+	}
+}
+
+static void downsampleBox(const MipImage& src, MipImage& dst)
+{
+	for (int y = 0; y < dst.height; y++)
+	{
+		int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+
+		for (int x = 0; x < dst.width; x++)
+		{
+			int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+			average4(dst.pixel(x, y), src.pixel(x0, y0), src.pixel(x1, y0), src.pixel(x0, y1), src.pixel(x1, y1));
+		}
+	}
+}
+
+// separable: halve the width into a scratch image, then halve its height.  Taps past the edges repeat the edge pixel
+static void downsampleKaiser(const MipImage& src, MipImage& dst, MipImage& scratch)
+{
+	const float *weights = kaiserWeights().weights;
+
+	scratch.width = dst.width;
+	scratch.height = src.height;
+	scratch.pixels.assign((size_t)scratch.width * scratch.height * 4, 0.0f);
+
+	for (int y = 0; y < src.height; y++)
+	{
+		for (int x = 0; x < dst.width; x++)
+		{
+			float *out = scratch.pixel(x, y);
+			for (int t = 0; t < KAISER_TAPS; t++)
+			{
+				int sx = std::min(std::max(x * 2 - KAISER_TAPS / 2 + 1 + t, 0), src.width - 1);
+				accumulate(out, src.pixel(sx, y), weights[t]);
+			}
+		}
+	}
+
+	// a whole row at a time, so the inner loop runs straight along memory
+	std::fill(dst.pixels.begin(), dst.pixels.end(), 0.0f);
+	for (int y = 0; y < dst.height; y++)
+	{
+		float *out = dst.pixel(0, y);
+		for (int t = 0; t < KAISER_TAPS; t++)
+		{
+			int sy = std::min(std::max(y * 2 - KAISER_TAPS / 2 + 1 + t, 0), src.height - 1);
+			const float *in = scratch.pixel(0, sy);
+			for (int x = 0; x < dst.width; x++)
+				accumulate(out + x * 4, in + x * 4, weights[t]);
+		}
+	}
+}
+
+// the sinc's negative lobes can overshoot, and normals must stay unit length
+static void finishLevel(MipImage& image, ImageContent content)
+{
+	size_t count = (size_t)image.width * image.height;
+	for (size_t i = 0; i < count; i++)
+	{
+		float *p = &image.pixels[i * 4];
+
+		if (content == IMAGE_NORMAL_MAP)
+		{
+			float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+			if (length > 1e-6f)
+			{
+				p[0] /= length;
+				p[1] /= length;
+				p[2] /= length;
+			}
+			else
+			{
+				p[0] = p[1] = 0.0f;
+				p[2] = 1.0f;
+			}
+			p[3] = std::min(std::max(p[3], 0.0f), 1.0f);
+		}
+		else
+			clampPixel(p, 0.0f);
+	}
+}
+
+// HDR colour only loses the negative overshoot.  Alpha is still coverage, so stays in 0..1
+static void finishHDRLevel(MipImage& image)
+{
+	size_t count = (size_t)image.width * image.height;
+	for (size_t i = 0; i < count; i++)
+	{
+		float *p = &image.pixels[i * 4];
+#ifdef MIP_BUILDER_SSE2
+		_mm_storeu_ps(p, _mm_max_ps(_mm_loadu_ps(p), _mm_setzero_ps()));
+#else
+		for (int c = 0; c < 3; c++)
+			p[c] = std::max(p[c], 0.0f);
+#endif
+		p[3] = std::min(std::max(p[3], 0.0f), 1.0f);
+	}
+}
+
+
+//
+// MipBuilder public method implementation
+//
+
+int MipBuilder::levelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+		levels++;
+	}
+	return levels;
+}
+
+void MipBuilder::build(const unsigned char *pixels, int width, int height, int channels, ImageContent content, MipFilter filter,
+	std::vector<MipLevel>& levels)
+{
+	levels.clear();
+	if (!pixels || width <= 0 || height <= 0)
+		return;
+
+	levels.resize(levelCount(width, height) - 1);
+
+	MipImage current, next, scratch;
+	toFloat(pixels, width, height, channels, content, current);
+
+	for (unsigned int i = 0; i < levels.size(); i++)
+	{
+		next.width = std::max(current.width / 2, 1);
+		next.height = std::max(current.height / 2, 1);
+		next.pixels.resize((size_t)next.width * next.height * 4);
+
+		if (filter == MIP_KAISER)
+			downsampleKaiser(current, next, scratch);
+		else
+			downsampleBox(current, next);
+
+		finishLevel(next, content);
+		toBytes(next, channels, content, levels[i]);
+		std::swap(current, next);
+	}
+}
+
+void MipBuilder::build(const float *pixels, int width, int height, int channels, MipFilter filter, std::vector<FloatMipLevel>& levels)
+{
+	levels.clear();
+	if (!pixels || width <= 0 || height <= 0)
+		return;
+
+	levels.resize(levelCount(width, height) - 1);
+
+	MipImage current, next, scratch;
+	toFloat(pixels, width, height, channels, current);
+
+	for (unsigned int i = 0; i < levels.size(); i++)
+	{
+		next.width = std::max(current.width / 2, 1);
+		next.height = std::max(current.height / 2, 1);
+		next.pixels.resize((size_t)next.width * next.height * 4);
+
+		if (filter == MIP_KAISER)
+			downsampleKaiser(current, next, scratch);
+		else
+			downsampleBox(current, next);
+
+		finishHDRLevel(next);
+		toFloatLevel(next, channels, levels[i]);
+		std::swap(current, next);
+	}
+}
@@ -0,0 +1,53 @@
+//  MipBuilder.h - CPU mipmap chains, filtered in linear space
+#ifndef MIP_BUILDER_H
+#define MIP_BUILDER_H
+
+#include <vector>
+
+// What an image's values mean, which decides how they're filtered (and later compressed)
+//	IMAGE_COLOUR		- sRGB encoded colour.  Averaged in linear light, so mips don't darken
+//	IMAGE_DATA			- values used as they are (specular, roughness, height)
+//	IMAGE_NORMAL_MAP	- tangent space normals.  Averaged as vectors and renormalised
+enum ImageContent { IMAGE_COLOUR, IMAGE_DATA, IMAGE_NORMAL_MAP };
+
+// MIP_BOX averages each 2x2 block - cheap, but soft and prone to aliasing.  MIP_KAISER is an 8 tap Kaiser windowed
+// sinc in each direction, keeping detail a box filter blurs away, for about four times the cost
+enum MipFilter { MIP_BOX, MIP_KAISER };
+
+// One level of a chain, with the same number of channels as the image it was built from
+struct MipLevel {
+
+	int							width = 0;
+	int							height = 0;
+	std::vector<unsigned char>	pixels;
+};
+
+// A level of a floating point chain, for high dynamic range images
+struct FloatMipLevel {
+
+	int							width = 0;
+	int							height = 0;
+	std::vector<float>			pixels;
+};
+
+// Builds mipmaps on the CPU instead of glGenerateMipmap, whose filtering is up to the driver and usually a box filter
+// in whatever space the texture is stored in.  Each level is filtered from the floating point level above rather than
+// the rounded bytes, and the filters are vectorised with SSE2 where it's available.  Nothing here touches OpenGL, so
+// chains can be built on worker threads or by the texture cooker.
+class MipBuilder {
+
+public:
+	// levels in the full chain down to 1x1, including the image itself
+	static int levelCount(int width, int height);
+
+	// levels[i] is mip level i + 1, each half the size of the one above (rounded down, at least 1).  pixels is
+	// width * height * channels bytes, as decoded by stb_image
+	static void build(const unsigned char *pixels, int width, int height, int channels, ImageContent content, MipFilter filter,
+		std::vector<MipLevel>& levels);
+
+	// as build() for linear floating point pixels, eg. from stbi_loadf().  Colours aren't clamped to 1, as HDR values
+	// go well past it; only the filter's undershoot below 0 is
+	static void build(const float *pixels, int width, int height, int channels, MipFilter filter, std::vector<FloatMipLevel>& levels);
+};
+
+#endif
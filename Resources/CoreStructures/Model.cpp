@@ -1,55 +1,444 @@
 #include "Model.h"
+#include "GLState.h"
+#include "TextureAtlas.h"
+#include "TextureCooker.h"
+
+// post processing the meshes are imported with.  Part of the key for cooked models
+static const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
+
+// Textures packed into a model's atlas: any solid colour image, or others up to this size (whose meshes keep their
+// texture coordinates in 0..1, as an atlas can't repeat them).  Larger textures gain little from sharing a bind
+static const int ATLAS_MAX_IMAGE_SIZE = 256;
+static const int ATLAS_MAX_SIZE = 2048;
+// an atlas is listed among the model's textures as <model file><suffix>, and cooked to that path's .dds
+static const string ATLAS_SUFFIX = ".atlas";
+
+static bool isAtlasPath(const string& path)
+{
+	return path.size() >= ATLAS_SUFFIX.size() && path.compare(path.size() - ATLAS_SUFFIX.size(), ATLAS_SUFFIX.size(), ATLAS_SUFFIX) == 0;
+}
+
+// how each kind of texture is filtered, compressed and uploaded.  Only diffuse maps are colour, and then only with
+// gamma correction
+static ImageContent imageContent(TextureType type, bool gammaCorrection)
+{
+	switch (type)
+	{
+	case TEXTURE_DIFFUSE:	return gammaCorrection ? IMAGE_COLOUR : IMAGE_DATA;
+	case TEXTURE_NORMAL:	return IMAGE_NORMAL_MAP;
+	default:				return IMAGE_DATA;
+	}
+}
+
+Model::Model()
+{
+	gammaCorrection = false;
+}
 
 // constructor, expects a filepath to a 3D model.
-Model::Model(string const &path)
+Model::Model(string const &path, bool gammaCorrection)
+{
+	ModelData data = import(path, gammaCorrection);
+	upload(data);
+}
+
+Model::Model(ModelData&& data)
 {
-	loadModel(path);
+	upload(data);
+}
+
+Model::Model(shared_ptr<ModelData> data, UploadManager& uploads)
+{
+	upload(*data, &uploads, data);
 }
 
 // draws the model, and thus all its meshes
-void Model::draw(GLuint shader)
+void Model::draw(GLuint shader) const
 {
 	for (unsigned int i = 0; i < meshes.size(); i++)
 		meshes[i].draw(shader);
 }
-/* string types:
-	"texture_diffuse" DEFAULT
-	"texture_specular"
-	"texture_normal"
-	"texture_height"
+
+// draws the model with a ShaderProgram.  The program is made current and the VAO bound once for all the meshes
+void Model::draw(const ShaderProgram& program) const
+{
+	if (!arena)
+		return;
+
+	program.use();
+	GLState::bindVertexArray(arena->vertexArray());
+
+	for (unsigned int i = 0; i < drawRuns.size(); i++)
+	{
+		const DrawRun& run = drawRuns[i];
+		meshes[run.firstMesh].bindTextures(program);
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, run.counts.data(), GL_UNSIGNED_INT, run.offsets.data(),
+			(GLsizei)run.counts.size(), run.baseVertices.data());
+	}
+}
+
+// draws every instance in the buffer with one instanced draw per mesh
+void Model::drawInstanced(const ShaderProgram& program, const InstanceBuffer& instances) const
+{
+	program.use();
+	for (unsigned int i = 0; i < meshes.size(); i++)
+		meshes[i].drawInstanced(program, instances);
+}
+
+/* texture types:
+	TEXTURE_DIFFUSE DEFAULT
+	TEXTURE_SPECULAR
+	TEXTURE_NORMAL
+	TEXTURE_HEIGHT
 */
-void Model::attachTexture(GLuint textureID, string type)
+void Model::attachTexture(GLuint textureID, TextureType type)
 {
 	Texture texture;
 	texture.id = textureID;
 	texture.type = type;
 
 	meshes.front().insertTexture(texture);
+
+	// the first mesh's texture set changed, which may split or join runs
+	buildDrawRuns();
+}
+
+
+// reads the model from its cooked cache if that's up to date, otherwise through ASSIMP, then decodes its textures
+ModelData Model::import(string const &path, bool gammaCorrection)
+{
+	ModelData data;
+	data.path = path;
+	data.gammaCorrection = gammaCorrection;
+	// retrieve the directory path of the filepath
+	data.directory = path.substr(0, path.find_last_of("/\\"));
+
+	if (!importCooked(data))
+	{
+		// read file via ASSIMP.  Each call has its own importer, so models can be imported on several threads at once
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+
+		// check for errors
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+		{
+			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+			return data;
+		}
+
+		// process ASSIMP's root node recursively
+		processNode(scene->mRootNode, scene, data);
+
+		// before cooking, so the cache holds the atlas's texture coordinates and later runs just read the atlas
+		packAtlas(data);
+
+		// a failed write only means the next run imports the model again
+		CookedModel::write(path, IMPORT_FLAGS, data);
+	}
+
+	// load every texture the meshes use that isn't already in the texture cache, all at once.  Images are mipmapped and
+	// block compressed, cooking them into .dds files beside the images the first time.  A texture that fails to decode is
+	// created as texture 0, as before
+	vector<string> texturePaths;
+	vector<ImageContent> contents;
+	vector<unsigned int> loadIndices;
+	for (unsigned int i = 0; i < data.textures.size(); i++)
+	{
+		string fullPath = data.directory + "\\" + data.textures[i].path;
+		ImageContent content = imageContent(data.textures[i].type, data.gammaCorrection);
+		if (!data.textures[i].image.blocks.empty() || TextureCache::containsCompressed(fullPath, content))
+			continue;
+
+		texturePaths.push_back(fullPath);
+		contents.push_back(content);
+		loadIndices.push_back(i);
+	}
+
+	vector<CompressedImage> images;
+	TextureLoader::loadCompressedImages(texturePaths, true, contents, images);
+	for (unsigned int i = 0; i < loadIndices.size(); i++)
+		data.textures[loadIndices[i]].image = std::move(images[i]);
+
+	data.valid = true;
+	return data;
 }
 
+bool Model::importCooked(ModelData& data)
+{
+	unique_ptr<CookedModel> cooked(new CookedModel());
+	if (!cooked->open(data.path, IMPORT_FLAGS))
+		return false;
+
+	const CookedModel::Header& header = cooked->header();
+
+	data.meshes.resize(header.numMeshes);
+	for (unsigned int i = 0; i < header.numMeshes; i++)
+	{
+		const CookedModel::MeshRecord& record = cooked->mesh(i);
+		ModelData::MeshData& mesh = data.meshes[i];
 
-// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-void Model::loadModel(string const &path)
+		mesh.firstVertex = record.firstVertex;
+		mesh.numVertices = record.numVertices;
+		mesh.firstIndex = record.firstIndex;
+		mesh.numIndices = record.numIndices;
+
+		for (unsigned int j = 0; j < record.numTextures; j++)
+			mesh.textures.push_back(data.findTexture(cooked->texturePath(record.firstTexture + j), cooked->textureType(record.firstTexture + j)));
+	}
+
+	// the atlas was cooked with the model, so without it the model is imported and packed again
+	for (unsigned int i = 0; i < data.textures.size(); i++)
+	{
+		ModelData::TextureData& texture = data.textures[i];
+		string fullPath = data.directory + "\\" + texture.path;
+		if (!isAtlasPath(texture.path) || TextureCache::containsCompressed(fullPath, imageContent(texture.type, data.gammaCorrection)))
+			continue;
+
+		if (!TextureCooker::read(fullPath, data.path, true, IMAGE_COLOUR, texture.image))
+		{
+			data.meshes.clear();
+			data.textures.clear();
+			return false;
+		}
+	}
+
+	// the vertex and index blobs are uploaded straight from the mapping
+	data.cooked = std::move(cooked);
+	return true;
+}
+
+void Model::packAtlas(ModelData& data)
 {
-	// read file via ASSIMP
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals);
-	
-	// check for errors
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+	// candidates are textures only ever used as a mesh's one diffuse texture
+	enum { UNUSED, CANDIDATE, EXCLUDED };
+	vector<int> usage(data.textures.size(), UNUSED);
+	for (unsigned int i = 0; i < data.meshes.size(); i++)
 	{
-		cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+		const vector<unsigned int>& meshTextures = data.meshes[i].textures;
+		bool single = meshTextures.size() == 1 && data.textures[meshTextures[0]].type == TEXTURE_DIFFUSE;
+
+		for (unsigned int j = 0; j < meshTextures.size(); j++)
+			if (!single)
+				usage[meshTextures[j]] = EXCLUDED;
+			else if (usage[meshTextures[j]] == UNUSED)
+				usage[meshTextures[j]] = CANDIDATE;
+	}
+
+	vector<unsigned int> candidates;
+	vector<string> paths;
+	for (unsigned int i = 0; i < data.textures.size(); i++)
+	{
+		if (usage[i] != CANDIDATE)
+			continue;
+
+		candidates.push_back(i);
+		paths.push_back(data.directory + "\\" + data.textures[i].path);
+	}
+
+	if (candidates.size() < 2)
 		return;
+
+	vector<DecodedImage> images;
+	TextureLoader::decodeImages(paths, true, images);
+
+	const Vertex *vertices = data.vertexData();
+	vector<const DecodedImage*> packed;
+	vector<int> packedIndex(data.textures.size(), -1);
+
+	for (unsigned int i = 0; i < candidates.size(); i++)
+	{
+		const DecodedImage& image = images[i];
+		if (!image.pixels)
+			continue;
+
+		if (!TextureAtlas::isSolid(image))
+		{
+			if (image.width > ATLAS_MAX_IMAGE_SIZE || image.height > ATLAS_MAX_IMAGE_SIZE)
+				continue;
+
+			bool inRange = true;
+			for (unsigned int m = 0; m < data.meshes.size() && inRange; m++)
+			{
+				const ModelData::MeshData& mesh = data.meshes[m];
+				if (mesh.textures.size() != 1 || mesh.textures[0] != candidates[i])
+					continue;
+
+				for (unsigned int v = mesh.firstVertex; v < mesh.firstVertex + mesh.numVertices && inRange; v++)
+				{
+					const glm::vec2& uv = vertices[v].TexCoords;
+					inRange = uv.x >= -1e-4f && uv.x <= 1.0001f && uv.y >= -1e-4f && uv.y <= 1.0001f;
+				}
+			}
+
+			if (!inRange)
+				continue;
+		}
+
+		packedIndex[candidates[i]] = (int)packed.size();
+		packed.push_back(&image);
 	}
-	// retrieve the directory path of the filepath
-	directory = path.substr(0, path.find_last_of("/\\"));
 
-	// process ASSIMP's root node recursively
-	processNode(scene->mRootNode, scene);
+	AtlasImage atlas;
+	if (packed.size() < 2 || !TextureAtlas::build(packed, ATLAS_MAX_SIZE, atlas))
+		return;
+
+	// the atlas goes at the end of the texture list and the packed textures are dropped, so they're never loaded
+	vector<ModelData::TextureData> textures;
+	vector<unsigned int> newIndex(data.textures.size());
+	for (unsigned int i = 0; i < data.textures.size(); i++)
+	{
+		if (packedIndex[i] >= 0)
+			continue;
+
+		newIndex[i] = (unsigned int)textures.size();
+		textures.push_back(std::move(data.textures[i]));
+	}
+
+	ModelData::TextureData atlasTexture;
+	atlasTexture.path = data.path.substr(data.path.find_last_of("/\\") + 1) + ATLAS_SUFFIX;
+	atlasTexture.type = TEXTURE_DIFFUSE;
+	TextureAtlas::compress(atlas, atlasTexture.image);
+	// keyed by the model, as the cooked model is.  Built from images flipped for OpenGL
+	TextureCooker::write(data.directory + "\\" + atlasTexture.path, data.path, true, IMAGE_COLOUR, atlasTexture.image);
+	unsigned int atlasIndex = (unsigned int)textures.size();
+	textures.push_back(std::move(atlasTexture));
+
+	for (unsigned int m = 0; m < data.meshes.size(); m++)
+	{
+		ModelData::MeshData& mesh = data.meshes[m];
+		if (mesh.textures.size() == 1 && packedIndex[mesh.textures[0]] >= 0)
+		{
+			glm::vec4 transform = atlas.transforms[packedIndex[mesh.textures[0]]];
+			for (unsigned int v = mesh.firstVertex; v < mesh.firstVertex + mesh.numVertices; v++)
+			{
+				glm::vec2& uv = data.vertices[v].TexCoords;
+				uv = uv * glm::vec2(transform.x, transform.y) + glm::vec2(transform.z, transform.w);
+			}
+			mesh.textures[0] = atlasIndex;
+			continue;
+		}
+
+		for (unsigned int j = 0; j < mesh.textures.size(); j++)
+			mesh.textures[j] = newIndex[mesh.textures[j]];
+	}
+
+	data.textures = std::move(textures);
+}
+
+void Model::upload(ModelData& data, UploadManager *uploads, const shared_ptr<const void>& owner)
+{
+	directory = data.directory;
+	gammaCorrection = data.gammaCorrection;
+	ticket = 0;
+
+	if (!data.valid)
+		return;
+
+	// the data is already in arena order, so the whole model is uploaded with one copy per buffer.  Queued first, so a
+	// texture shared with a model still streaming in has always been staged by the time this model's ticket completes
+	unsigned int numVertices = data.numVertices();
+	unsigned int numIndices = data.numIndices();
+
+	if (numVertices > 0 && numIndices > 0)
+	{
+		arena.reset(new VertexArena());
+		arena->allocate(numVertices, numIndices);
+
+		if (uploads)
+		{
+			arena->reserve(numVertices, numIndices);
+			uploads->uploadBuffer(arena->vertexBuffer(), 0, data.vertexData(), numVertices * sizeof(Vertex), owner);
+			ticket = uploads->uploadBuffer(arena->indexBuffer(), 0, data.indexData(), numIndices * sizeof(unsigned int), owner);
+		}
+		else
+			arena->add(data.vertexData(), numVertices, data.indexData(), numIndices);
+	}
+
+	// create the textures, or share them if another model already has, freeing each image once it's on the GPU
+	vector<Texture> created(data.textures.size());
+	for (unsigned int i = 0; i < data.textures.size(); i++)
+	{
+		string path = directory + "\\" + data.textures[i].path;
+		ImageContent content = imageContent(data.textures[i].type, data.gammaCorrection);
+
+		if (uploads)
+			created[i].id = TextureCache::acquire(path, data.textures[i].image, content, *uploads, owner, ticket);
+		else
+		{
+			created[i].id = TextureCache::acquire(path, data.textures[i].image, content);
+			data.textures[i].image = CompressedImage();
+		}
+
+		cachedTextures.emplace_back(created[i].id);
+		created[i].type = data.textures[i].type;
+		created[i].path = data.textures[i].path;
+		textures_loaded.push_back(created[i]);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+	}
+
+	meshes.reserve(data.meshes.size());
+	for (unsigned int i = 0; i < data.meshes.size(); i++)
+	{
+		const ModelData::MeshData& source = data.meshes[i];
+
+		vector<Texture> textures;
+		for (unsigned int j = 0; j < source.textures.size(); j++)
+			textures.push_back(created[source.textures[j]]);
+
+		// cooked models don't keep CPU copies of their vertices and indices
+		vector<Vertex> vertices;
+		vector<unsigned int> indices;
+		if (!data.cooked)
+		{
+			vertices.assign(data.vertices.begin() + source.firstVertex, data.vertices.begin() + source.firstVertex + source.numVertices);
+			indices.assign(data.indices.begin() + source.firstIndex, data.indices.begin() + source.firstIndex + source.numIndices);
+		}
+
+		Mesh mesh(vertices, indices, textures);
+		if (arena)
+		{
+			VertexArena::Range range;
+			range.baseVertex = (GLint)source.firstVertex;
+			range.firstIndex = source.firstIndex;
+			range.indexCount = (GLsizei)source.numIndices;
+			mesh.setRange(*arena, range);
+		}
+		meshes.push_back(std::move(mesh));
+	}
+
+	buildDrawRuns();
+
+	// the mapping isn't needed once the buffers are filled.  Queued uploads still read from it, and it goes with owner
+	if (!uploads)
+		data.cooked.reset();
+}
+
+// groups consecutive meshes that bind the same textures.  Meshes are kept in load order, so the draw order is unchanged
+void Model::buildDrawRuns()
+{
+	drawRuns.clear();
+
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[i];
+		if (mesh.indexCount() == 0)
+			continue;
+
+		if (drawRuns.empty() || meshes[drawRuns.back().firstMesh].textureSet() != mesh.textureSet())
+		{
+			DrawRun run;
+			run.firstMesh = i;
+			drawRuns.push_back(std::move(run));
+		}
+
+		DrawRun& run = drawRuns.back();
+		run.counts.push_back(mesh.indexCount());
+		run.offsets.push_back((const void*)(mesh.firstIndex() * sizeof(GLuint)));
+		run.baseVertices.push_back(mesh.baseVertex());
+	}
 }
 
 // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-void Model::processNode(aiNode *node, const aiScene *scene)
+void Model::processNode(aiNode *node, const aiScene *scene, ModelData& data)
 {
 	// process each mesh located at the current node
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -57,22 +446,25 @@ void Model::processNode(aiNode *node, const aiScene *scene)
 		// the node object only contains indices to index the actual objects in the scene. 
 		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		processMesh(mesh, scene, data);
 	}
 	// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, data);
 	}
 
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
+// converts a mesh into the model's packed vertex and index data
+void Model::processMesh(aiMesh *mesh, const aiScene *scene, ModelData& data)
 {
-	// data to fill
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
-	vector<Texture> textures;
+	// data to fill.  Indices stay relative to the mesh's own vertices; the draw adds the base vertex
+	ModelData::MeshData meshData;
+	meshData.firstVertex = (unsigned int)data.vertices.size();
+	meshData.firstIndex = (unsigned int)data.indices.size();
+	vector<Vertex>& vertices = data.vertices;
+	vector<unsigned int>& indices = data.indices;
 
 	// Walk through each of the mesh's vertices
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -133,57 +525,38 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
 	// diffuse: texture_diffuseN
 	// specular: texture_specularN
 	// normal: texture_normalN
+	vector<unsigned int>& textures = meshData.textures;
 
 	// 1. diffuse maps
-	vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+	vector<unsigned int> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE, data);
 	textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 	// 2. specular maps
-	vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+	vector<unsigned int> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TEXTURE_SPECULAR, data);
 	textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	// 3. normal maps
-	std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+	vector<unsigned int> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TEXTURE_NORMAL, data);
 	textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 	// 4. height maps
-	std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+	vector<unsigned int> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TEXTURE_HEIGHT, data);
 	textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-	// return a mesh object created from the extracted mesh data
-	return Mesh(vertices, indices, textures);
+	meshData.numVertices = (unsigned int)vertices.size() - meshData.firstVertex;
+	meshData.numIndices = (unsigned int)indices.size() - meshData.firstIndex;
+	data.meshes.push_back(std::move(meshData));
 }
 
-// checks all material textures of a given type and loads the textures if they're not loaded yet.
-// the required info is returned as a Texture struct.
-vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+// checks all material textures of a given type and adds the ones not used yet to the model's texture list.
+// the required info is returned as indices into the list.
+vector<unsigned int> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType textureType, ModelData& data)
 {
-	vector<Texture> textures;
+	vector<unsigned int> textures;
 
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-
-		// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-				break;
-			}
-		}
-		if (!skip)
-		{   // if texture hasn't been loaded already, load it
-			Texture texture;
-			string fullPath = directory;
-			fullPath.append("\\" + string(str.C_Str()));
-			texture.id = TextureLoader::loadTexture(fullPath);
-			texture.type = typeName;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-		}
+		// a texture with the same filepath is only decoded once (optimization)
+		textures.push_back(data.findTexture(str.C_Str(), textureType));
 	}
 	return textures;
-}
\ No newline at end of file
+}
@@ -2,13 +2,15 @@
 #define MODEL_H
 
 #include "Mesh.h"
-#include "TextureLoader.h"
+#include "ModelData.h"
+#include "TextureCache.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include <map>
+#include <memory>
 #include <fstream>
 #include <iostream>
 
@@ -24,6 +26,8 @@ using namespace std;
  */
 
 
+// A Model owns its meshes and the VertexArena holding all of their vertices and indices, so like Mesh it is move-only.
+// Share a loaded model between scene objects through a ModelLibrary handle rather than by copying it.
 class Model
 {
 public:
@@ -31,29 +35,81 @@ public:
 	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
 	vector<Mesh> meshes;
 	string directory;
-	bool gammaCorrection;
+	bool gammaCorrection;	// whether the diffuse maps were loaded as sRGB, so shaders sample them in linear light
 
 	/*  Functions   */
+	// an empty model, which draws nothing until a loaded one is moved into it
+	Model();
 	// constructor, expects a filepath to a 3D model.
-	Model(string const &path);
+	Model(string const &path, bool gammaCorrection = true);
+	// creates the OpenGL objects for a model imported by import().  Must be called on the GL thread
+	explicit Model(ModelData&& data);
+	// as Model(ModelData&&), but the vertices, indices and textures are queued on uploads and copied in over the next
+	// frames rather than now.  The data is kept until its last upload is staged.  Don't draw the model until
+	// uploads.isComplete(uploadTicket())
+	Model(shared_ptr<ModelData> data, UploadManager& uploads);
+
+	// reads a model and decodes its textures without any OpenGL calls, so it can run on any thread.  The meshes are
+	// cooked to a cache file, which is read instead while the source is unchanged.  Without gammaCorrection the diffuse
+	// maps are treated as linear data, for shaders that do their own gamma handling
+	static ModelData import(string const &path, bool gammaCorrection = true);
+
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+	Model(Model&&) = default;
+	Model& operator=(Model&&) = default;
 
 	// draws the model, and thus all its meshes
-	void draw(GLuint shader);
-	void attachTexture(GLuint textureID, string type = "texture_diffuse");
+	void draw(GLuint shader) const;
+	// binds the arena's VAO once, then draws each run of meshes sharing textures with one multi-draw
+	void draw(const ShaderProgram& program) const;
+	// draws every instance in the buffer with one instanced draw per mesh
+	void drawInstanced(const ShaderProgram& program, const InstanceBuffer& instances) const;
+	void attachTexture(GLuint textureID, TextureType type = TEXTURE_DIFFUSE);
+
+	// the last upload queued by Model(data, uploads), or 0 when the model was filled immediately
+	UploadManager::Ticket uploadTicket() const { return ticket; }
 
 private:
+	// Consecutive meshes with the same texture set, drawn with one glMultiDrawElementsBaseVertex.  The arrays are
+	// the per-mesh arguments, built once rather than on every draw
+	struct DrawRun {
+		unsigned int			firstMesh;
+		vector<GLsizei>			counts;
+		vector<const void*>		offsets;
+		vector<GLint>			baseVertices;
+	};
+
+	// one cache reference for each texture in textures_loaded, dropped with the model
+	vector<CachedTexture> cachedTextures;
+
+	// on the heap so the meshes' pointers to it survive the model being moved
+	unique_ptr<VertexArena> arena;
+	vector<DrawRun> drawRuns;
+	UploadManager::Ticket ticket = 0;
+
 	/*  Functions   */
-	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-	void loadModel(string const &path);
+	// creates the textures, uploads every mesh into one arena and builds the meshes on it.  With uploads the data is
+	// queued there instead, owned by owner
+	void upload(ModelData& data, UploadManager *uploads = nullptr, const shared_ptr<const void>& owner = nullptr);
+	void buildDrawRuns();
+
+	// reads the meshes and texture references of a cooked model.  Returns false if there's no up to date cache
+	static bool importCooked(ModelData& data);
+
+	// replaces the small diffuse textures of meshes that use nothing else with one TextureAtlas, remapping the meshes'
+	// texture coordinates into it, so the meshes share a texture set and draw together.  Runs on a model imported
+	// through Assimp, before it's cooked, and writes the atlas's .dds, which importCooked() reads back
+	static void packAtlas(ModelData& data);
 
 	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode *node, const aiScene *scene);
+	static void processNode(aiNode *node, const aiScene *scene, ModelData& data);
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+	static void processMesh(aiMesh *mesh, const aiScene *scene, ModelData& data);
 
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName);
+	// checks all material textures of a given type and adds the ones not used yet to the model's texture list.
+	// returns the index of each texture in the list
+	static vector<unsigned int> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType textureType, ModelData& data);
 };
 
 #endif
@@ -0,0 +1,67 @@
+//  ModelData.h - CPU side result of importing a model, ready to be uploaded to OpenGL
+#ifndef MODEL_DATA_H
+#define MODEL_DATA_H
+
+#include "Mesh.h"
+#include "CookedModel.h"
+#include "TextureLoader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Everything Model needs from disk, produced by Model::import() without any OpenGL calls so it can be built on a
+// worker thread.  The vertices and indices of all meshes are packed in VertexArena order, either in the vectors or,
+// for a cooked model, in the mapped cache file.
+struct ModelData {
+
+	struct MeshData {
+		unsigned int			firstVertex = 0;
+		unsigned int			numVertices = 0;
+		unsigned int			firstIndex = 0;
+		unsigned int			numIndices = 0;
+		std::vector<unsigned int> textures;		// indices into ModelData::textures
+	};
+
+	struct TextureData {
+		std::string				path;			// relative to the model's directory
+		TextureType				type;
+		CompressedImage			image;			// block compressed by TextureCooker or TextureAtlas, empty if already in the TextureCache
+	};
+
+	std::string					path;
+	std::string					directory;
+	bool						valid = false;
+	bool						gammaCorrection = true;	// diffuse maps are sRGB colour, rather than linear data
+
+	std::vector<MeshData>		meshes;
+	std::vector<TextureData>	textures;
+
+	// packed mesh data from Assimp.  Empty when the model was cooked
+	std::vector<Vertex>			vertices;
+	std::vector<unsigned int>	indices;
+
+	// the cache file the data was read from, kept mapped until the upload
+	std::unique_ptr<CookedModel> cooked;
+
+	unsigned int numVertices() const { return cooked ? cooked->header().numVertices : (unsigned int)vertices.size(); }
+	unsigned int numIndices() const { return cooked ? cooked->header().numIndices : (unsigned int)indices.size(); }
+	const Vertex *vertexData() const { return cooked ? cooked->vertices() : vertices.data(); }
+	const unsigned int *indexData() const { return cooked ? cooked->indices() : indices.data(); }
+
+	// index of the texture at path, adding it (still to be decoded) if no mesh has used it yet
+	unsigned int findTexture(const std::string& texturePath, TextureType type)
+	{
+		for (unsigned int i = 0; i < textures.size(); i++)
+			if (textures[i].path == texturePath)
+				return i;
+
+		TextureData texture;
+		texture.path = texturePath;
+		texture.type = type;
+		textures.push_back(std::move(texture));
+		return (unsigned int)textures.size() - 1;
+	}
+};
+
+#endif
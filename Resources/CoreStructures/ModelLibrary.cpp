@@ -0,0 +1,47 @@
+#include "ModelLibrary.h"
+
+ModelHandle ModelLibrary::load(const std::string& path)
+{
+	// return the existing model if this path has been loaded before
+	bool created;
+	ModelHandle handle = reserve(path, created);
+
+	if (created)
+		install(handle, Model(path));
+
+	return handle;
+}
+
+ModelHandle ModelLibrary::reserve(const std::string& path, bool& created)
+{
+	std::map<std::string, ModelHandle>::const_iterator found = handlesByPath.find(path);
+	if (found != handlesByPath.end())
+	{
+		created = false;
+		return found->second;
+	}
+
+	ModelHandle handle;
+	handle.index = (unsigned int)models.size();
+
+	models.emplace_back();
+	loaded.push_back(false);
+	handlesByPath[path] = handle;
+
+	created = true;
+	return handle;
+}
+
+void ModelLibrary::install(ModelHandle handle, Model&& model)
+{
+	models[handle.index] = std::move(model);
+	loaded[handle.index] = true;
+}
+
+void ModelLibrary::clear()
+{
+	models.clear();
+	loaded.clear();
+	handlesByPath.clear();
+	placeholder = ModelHandle();
+}
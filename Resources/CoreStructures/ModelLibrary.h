@@ -0,0 +1,66 @@
+#ifndef MODEL_LIBRARY_H
+#define MODEL_LIBRARY_H
+
+#include "Model.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Lightweight reference to a model held by a ModelLibrary.  Handles are plain indices so they can be
+// copied around freely (and stored in scene objects) without touching the model data itself.
+struct ModelHandle {
+	static const unsigned int INVALID = 0xFFFFFFFF;
+
+	unsigned int index = INVALID;
+
+	bool isValid() const { return index != INVALID; }
+	bool operator==(const ModelHandle& other) const { return index == other.index; }
+	bool operator!=(const ModelHandle& other) const { return index != other.index; }
+};
+
+// Owns every loaded Model and hands out handles to them.  Models are immutable once loaded, so any number
+// of scene objects can share one without copying its meshes.  Loading the same path twice returns the
+// existing handle.
+//
+// A handle can also be reserved before its model is loaded (see AssetLoader).  Until the model is installed, get()
+// returns the placeholder model if one is set and loaded, otherwise an empty model that draws nothing.
+class ModelLibrary
+{
+public:
+	// loads the model at path (or finds it if already loaded or reserved) and returns a handle to it
+	ModelHandle load(const std::string& path);
+
+	// returns the handle for path, adding an empty slot for it if the path is new.  created is set if it was
+	ModelHandle reserve(const std::string& path, bool& created);
+
+	// fills a reserved slot with its loaded model
+	void install(ModelHandle handle, Model&& model);
+
+	bool isLoaded(ModelHandle handle) const { return loaded[handle.index]; }
+
+	// model drawn in place of any model that hasn't been installed yet
+	void setPlaceholder(ModelHandle handle) { placeholder = handle; }
+
+	// access the model referenced by a handle.  The handle must come from this library.
+	const Model& get(ModelHandle handle) const
+	{
+		if (!loaded[handle.index] && placeholder.isValid() && loaded[placeholder.index])
+			return models[placeholder.index];
+
+		return models[handle.index];
+	}
+
+	unsigned int size() const { return (unsigned int)models.size(); }
+
+	// releases all models and their OpenGL buffers.  Must be called while the GL context is still current.
+	void clear();
+
+private:
+	std::vector<Model> models;
+	std::vector<bool> loaded;
+	std::map<std::string, ModelHandle> handlesByPath;
+	ModelHandle placeholder;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "PrincipleAxes.h"
 #include "ShaderLoader.h"
+#include "GLState.h"
 
 
 using namespace std;
@@ -80,7 +81,7 @@ PrincipleAxes::PrincipleAxes() {
 
 	// setup VAO for principle axes object
 	glGenVertexArrays(1, &paVertexArrayObj);
-	glBindVertexArray(paVertexArrayObj);
+	GLState::bindVertexArray(paVertexArrayObj);
 
 
 	// setup vbo for position attribute
@@ -110,13 +111,13 @@ PrincipleAxes::PrincipleAxes() {
 	glEnableVertexAttribArray(1);
 
 	// unbind principle axes VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 
 PrincipleAxes::~PrincipleAxes() {
 
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -125,6 +126,8 @@ PrincipleAxes::~PrincipleAxes() {
 	glDeleteBuffers(1, &paColourBuffer);
 	glDeleteBuffers(1, &paIndexBuffer);
 
+	GLState::forgetVertexArray(paVertexArrayObj);
+	GLState::forgetProgram(paShader);
 	glDeleteVertexArrays(1, &paVertexArrayObj);
 
 	glDeleteShader(paShader);
@@ -135,15 +138,12 @@ void PrincipleAxes::render(const glm::mat4& T) {
 
 	static GLint mvpLocation = glGetUniformLocation(paShader, "mvpMatrix");
 
-	glUseProgram(paShader);
+	GLState::useProgram(paShader);
 	glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(T));
 
-	glBindVertexArray(paVertexArrayObj);
+	GLState::bindVertexArray(paVertexArrayObj);
 
 	glDrawElements(GL_LINES, 20, GL_UNSIGNED_INT, nullptr);
-
-	glBindVertexArray(0);
-	glUseProgram(0);
 }
 
 
@@ -0,0 +1,245 @@
+//  RenderQueue.cpp
+
+#include "RenderQueue.h"
+#include "Mesh.h"
+
+#include <cstring>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+static const unsigned int RADIX_BITS = 8;
+static const unsigned int RADIX_BUCKETS = 1 << RADIX_BITS;
+static const unsigned int RADIX_PASSES = 64 / RADIX_BITS;
+
+
+//
+// GLRenderBackend
+//
+
+GLRenderBackend::GLRenderBackend(const string& transformUniform)
+	: transformName(transformUniform)
+{
+	this->transformUniform = ShaderProgram::NO_UNIFORM;
+}
+
+void GLRenderBackend::setProgram(const DrawPacket& packet)
+{
+	packet.program->use();
+	transformUniform = packet.program->uniform(transformName);
+}
+
+void GLRenderBackend::setMaterial(const DrawPacket&)
+{
+}
+
+void GLRenderBackend::setTextures(const DrawPacket& packet)
+{
+	packet.mesh->bindTextures(*packet.program);
+}
+
+void GLRenderBackend::setVertexArray(const DrawPacket& packet)
+{
+	packet.mesh->bindVertexArray();
+}
+
+void GLRenderBackend::draw(const DrawPacket& packet)
+{
+	packet.program->setMat4(transformUniform, *packet.transform);
+	packet.mesh->drawElements();
+}
+
+
+//
+// RecordingRenderBackend
+//
+
+void RecordingRenderBackend::setProgram(const DrawPacket& packet)
+{
+	record(SET_PROGRAM, packet);
+}
+
+void RecordingRenderBackend::setMaterial(const DrawPacket& packet)
+{
+	record(SET_MATERIAL, packet);
+}
+
+void RecordingRenderBackend::setTextures(const DrawPacket& packet)
+{
+	record(SET_TEXTURES, packet);
+}
+
+void RecordingRenderBackend::setVertexArray(const DrawPacket& packet)
+{
+	record(SET_VERTEX_ARRAY, packet);
+}
+
+void RecordingRenderBackend::draw(const DrawPacket& packet)
+{
+	record(DRAW, packet);
+}
+
+unsigned int RecordingRenderBackend::count(CallType type) const
+{
+	unsigned int total = 0;
+	for (size_t i = 0; i < recorded.size(); i++)
+		if (recorded[i].type == type)
+			total++;
+	return total;
+}
+
+void RecordingRenderBackend::record(CallType type, const DrawPacket& packet)
+{
+	Call call;
+	call.type = type;
+	call.packet = packet;
+	recorded.push_back(call);
+}
+
+
+//
+// RenderQueue
+//
+
+SortKey RenderQueue::makeKey(unsigned int program, unsigned int material, unsigned int textureSet, unsigned int vertexArray, float depth)
+{
+	// quantise depth to 16 bits, clamping anything outside the view range
+	if (depth < 0.0f)
+		depth = 0.0f;
+	if (depth > 1.0f)
+		depth = 1.0f;
+
+	SortKey depthBits = (SortKey)(depth * 65535.0f);
+
+	return ((SortKey)(program & 0xFF) << 56) |
+		((SortKey)(material & 0xFF) << 48) |
+		((SortKey)(textureSet & 0xFFFF) << 32) |
+		((SortKey)(vertexArray & 0xFFFF) << 16) |
+		depthBits;
+}
+
+void RenderQueue::reserve(unsigned int numPackets)
+{
+	packets.reserve(numPackets);
+	sorted.reserve(numPackets);
+	scratch.reserve(numPackets);
+}
+
+void RenderQueue::submit(ShaderProgram *program, unsigned int material, const Mesh& mesh, const glm::mat4& transform, float depth)
+{
+	DrawPacket packet;
+	packet.programID = program->id();
+	packet.program = program;
+	packet.material = material;
+	packet.textureSet = mesh.textureSet();
+	packet.vertexArray = mesh.VAO;
+	packet.mesh = &mesh;
+	packet.transform = &transform;
+
+	submit(packet, depth);
+}
+
+void RenderQueue::submit(const DrawPacket& packet, float depth)
+{
+	packets.push_back(packet);
+	packets.back().key = makeKey(packet.programID, packet.material, packet.textureSet, packet.vertexArray, depth);
+}
+
+// LSD radix sort of the keys, 8 bits per pass.  The histograms for every pass are built in one walk over the keys, and
+// passes where every key has the same digit are skipped - with a handful of programs and materials most of the high
+// passes never run.  The sort is stable, so packets with equal keys keep their submission order
+void RenderQueue::sort()
+{
+	unsigned int numPackets = (unsigned int)packets.size();
+
+	sorted.resize(numPackets);
+	scratch.resize(numPackets);
+
+	unsigned int histograms[RADIX_PASSES][RADIX_BUCKETS];
+	memset(histograms, 0, sizeof(histograms));
+
+	for (unsigned int i = 0; i < numPackets; i++) {
+
+		SortKey key = packets[i].key;
+		sorted[i].key = key;
+		sorted[i].packet = i;
+
+		for (unsigned int pass = 0; pass < RADIX_PASSES; pass++)
+			histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+	}
+
+	for (unsigned int pass = 0; pass < RADIX_PASSES; pass++) {
+
+		unsigned int *counts = histograms[pass];
+		unsigned int shift = pass * RADIX_BITS;
+
+		// all keys share this digit - the pass wouldn't move anything
+		if (numPackets == 0 || counts[(sorted[0].key >> shift) & (RADIX_BUCKETS - 1)] == numPackets)
+			continue;
+
+		// turn the counts into each bucket's first output slot
+		unsigned int offset = 0;
+		for (unsigned int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+
+			unsigned int count = counts[bucket];
+			counts[bucket] = offset;
+			offset += count;
+		}
+
+		for (unsigned int i = 0; i < numPackets; i++)
+			scratch[counts[(sorted[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = sorted[i];
+
+		sorted.swap(scratch);
+	}
+}
+
+void RenderQueue::flush(RenderBackend& backend)
+{
+	stats = RenderQueueStats();
+	stats.packets = (unsigned int)packets.size();
+
+	sort();
+
+	const DrawPacket *previous = nullptr;
+
+	for (unsigned int i = 0; i < sorted.size(); i++) {
+
+		const DrawPacket& packet = packets[sorted[i].packet];
+
+		// uniforms and sampler units belong to the program, so a new program needs its material and textures set again
+		bool newProgram = !previous || packet.programID != previous->programID;
+
+		if (newProgram) {
+
+			backend.setProgram(packet);
+			stats.programChanges++;
+		}
+
+		if (newProgram || packet.material != previous->material) {
+
+			backend.setMaterial(packet);
+			stats.materialChanges++;
+		}
+
+		if (newProgram || packet.textureSet != previous->textureSet) {
+
+			backend.setTextures(packet);
+			stats.textureChanges++;
+		}
+
+		if (!previous || packet.vertexArray != previous->vertexArray) {
+
+			backend.setVertexArray(packet);
+			stats.vertexArrayChanges++;
+		}
+
+		backend.draw(packet);
+		previous = &packet;
+	}
+
+	packets.clear();
+}
@@ -0,0 +1,141 @@
+//  RenderQueue.h - Draw packets sorted by render state before submission
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "ShaderProgram.h"
+
+class Mesh;
+
+// 64 bit sort key.  From the most significant bits down:
+//	program (8) | material (8) | texture set (16) | vertex array (16) | depth (16)
+// so sorting by key groups packets by the most expensive state first and draws each group front to back
+typedef unsigned long long SortKey;
+
+// Everything needed to draw one mesh.  The queue itself only looks at the state IDs and never dereferences the
+// pointers, so packets can be recorded headless with any values (eg. into a mock backend)
+struct DrawPacket {
+	SortKey				key;
+	unsigned int		programID;
+	ShaderProgram		*program;
+	unsigned int		material;
+	unsigned int		textureSet;
+	unsigned int		vertexArray;
+	const Mesh			*mesh;
+	const glm::mat4		*transform;
+};
+
+// State changes made by the last flush().  Each counter is one call to the matching RenderBackend function
+struct RenderQueueStats {
+	unsigned int packets = 0;
+	unsigned int programChanges = 0;
+	unsigned int materialChanges = 0;
+	unsigned int textureChanges = 0;
+	unsigned int vertexArrayChanges = 0;
+};
+
+// Receives the sorted packets from RenderQueue::flush().  The set* functions are only called when the state differs
+// from the previous packet's
+class RenderBackend {
+
+public:
+	virtual ~RenderBackend() {}
+
+	virtual void setProgram(const DrawPacket& packet) = 0;
+	virtual void setMaterial(const DrawPacket& packet) = 0;
+	virtual void setTextures(const DrawPacket& packet) = 0;
+	virtual void setVertexArray(const DrawPacket& packet) = 0;
+	virtual void draw(const DrawPacket& packet) = 0;
+};
+
+// Draws Mesh packets with OpenGL.  Materials mean nothing to the engine, so setMaterial() does nothing - override it to
+// set the application's material uniforms on packet.program
+class GLRenderBackend : public RenderBackend {
+
+public:
+	// transformUniform is the name of the model matrix uniform in the programs being drawn with
+	explicit GLRenderBackend(const std::string& transformUniform = "model");
+
+	void setProgram(const DrawPacket& packet) override;
+	void setMaterial(const DrawPacket& packet) override;
+	void setTextures(const DrawPacket& packet) override;
+	void setVertexArray(const DrawPacket& packet) override;
+	void draw(const DrawPacket& packet) override;
+
+private:
+	std::string		transformName;
+	UniformID		transformUniform;
+};
+
+// Records the calls flush() makes instead of drawing, so the queue's state changes can be checked headless.  Never
+// touches OpenGL or the packets' pointers
+class RecordingRenderBackend : public RenderBackend {
+
+public:
+	enum CallType { SET_PROGRAM, SET_MATERIAL, SET_TEXTURES, SET_VERTEX_ARRAY, DRAW };
+
+	struct Call {
+		CallType		type;
+		DrawPacket		packet;
+	};
+
+	void setProgram(const DrawPacket& packet) override;
+	void setMaterial(const DrawPacket& packet) override;
+	void setTextures(const DrawPacket& packet) override;
+	void setVertexArray(const DrawPacket& packet) override;
+	void draw(const DrawPacket& packet) override;
+
+	const std::vector<Call>& calls() const { return recorded; }
+	// how many calls of a type have been recorded
+	unsigned int count(CallType type) const;
+	void clear() { recorded.clear(); }
+
+private:
+	std::vector<Call>	recorded;
+
+	void record(CallType type, const DrawPacket& packet);
+};
+
+// Objects submit packets during the frame; flush() radix sorts them by key and hands them to a backend, skipping
+// state that the previous packet already set.  The queue's buffers are kept between frames so a frame that doesn't
+// submit more packets than an earlier one doesn't allocate
+class RenderQueue {
+
+public:
+	// IDs wider than their key field still work but stop sorting exactly
+	static SortKey makeKey(unsigned int program, unsigned int material, unsigned int textureSet, unsigned int vertexArray, float depth);
+
+	void reserve(unsigned int numPackets);
+
+	// depth is the normalised view distance (0 = eye, 1 = far plane) used to order packets with identical state
+	void submit(ShaderProgram *program, unsigned int material, const Mesh& mesh, const glm::mat4& transform, float depth);
+
+	// queue a packet built by the caller, eg. for a mock backend.  The key is recalculated from the packet's state IDs
+	void submit(const DrawPacket& packet, float depth);
+
+	// sort, draw and clear the queue
+	void flush(RenderBackend& backend);
+
+	unsigned int size() const { return (unsigned int)packets.size(); }
+	void clear() { packets.clear(); }
+
+	const RenderQueueStats& lastFlushStats() const { return stats; }
+
+private:
+	struct SortEntry {
+		SortKey			key;
+		unsigned int	packet;
+	};
+
+	std::vector<DrawPacket>		packets;
+	std::vector<SortEntry>		sorted;
+	std::vector<SortEntry>		scratch;
+	RenderQueueStats			stats;
+
+	void sort();
+};
+
+#endif
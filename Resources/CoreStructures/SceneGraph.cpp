@@ -0,0 +1,72 @@
+#include "SceneGraph.h"
+
+#include <cstring>
+
+SceneGraph::SceneGraph()
+{
+	firstDirty = 0;
+	updatedCount = 0;
+}
+
+SceneNode SceneGraph::createNode(const glm::mat4& local, SceneNode parent)
+{
+	SceneNode node = (SceneNode)parents.size();
+
+	parents.push_back(parent);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(1);
+
+	if (node < firstDirty)
+		firstDirty = node;
+
+	return node;
+}
+
+void SceneGraph::setLocalTransform(SceneNode node, const glm::mat4& local)
+{
+	if (locals[node] == local)
+		return;
+
+	locals[node] = local;
+	dirty[node] = 1;
+
+	if (node < firstDirty)
+		firstDirty = node;
+}
+
+void SceneGraph::reserve(unsigned int numNodes)
+{
+	parents.reserve(numNodes);
+	locals.reserve(numNodes);
+	worlds.reserve(numNodes);
+	dirty.reserve(numNodes);
+}
+
+void SceneGraph::update()
+{
+	const SceneNode numNodes = size();
+
+	updatedCount = 0;
+
+	if (firstDirty >= numNodes)
+		return;
+
+	// Parents always come before their children, so by the time we reach a node its parent's world matrix
+	// is final.  A recomputed node stays flagged for the rest of the pass so its children get recomputed too.
+	for (SceneNode i = firstDirty; i < numNodes; i++)
+	{
+		SceneNode p = parents[i];
+		bool parentChanged = (p != NO_PARENT && dirty[p]);
+
+		if (dirty[i] || parentChanged)
+		{
+			worlds[i] = (p == NO_PARENT) ? locals[i] : worlds[p] * locals[i];
+			dirty[i] = 1;
+			updatedCount++;
+		}
+	}
+
+	memset(&dirty[firstDirty], 0, numNodes - firstDirty);
+	firstDirty = numNodes;
+}
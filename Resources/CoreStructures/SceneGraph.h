@@ -0,0 +1,57 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Index of a node in a SceneGraph
+typedef unsigned int SceneNode;
+
+// Persistent transform hierarchy.  Nodes are stored as parallel arrays (parent, local, world, dirty) in
+// creation order.  A parent must be created before its children, so the arrays are always topologically
+// ordered and one forward pass is enough to propagate changes down the hierarchy.
+//
+// World matrices are cached: update() only recomputes nodes whose local transform changed since the last
+// update, plus everything below them.  Static props cost nothing once their world matrix has been built.
+class SceneGraph
+{
+public:
+	static const SceneNode NO_PARENT = 0xFFFFFFFF;
+
+	SceneGraph();
+
+	// adds a node below parent (or a root node if parent is NO_PARENT) and returns its index
+	SceneNode createNode(const glm::mat4& local = glm::mat4(1.0), SceneNode parent = NO_PARENT);
+
+	// sets the node's transform relative to its parent.  Nothing is marked dirty if the value hasn't changed.
+	void setLocalTransform(SceneNode node, const glm::mat4& local);
+
+	const glm::mat4& localTransform(SceneNode node) const { return locals[node]; }
+
+	// world matrix as of the last update()
+	const glm::mat4& worldTransform(SceneNode node) const { return worlds[node]; }
+
+	SceneNode parent(SceneNode node) const { return parents[node]; }
+
+	unsigned int size() const { return (unsigned int)parents.size(); }
+
+	void reserve(unsigned int numNodes);
+
+	// recomputes the world matrices of every dirty node and its descendants
+	void update();
+
+	// number of world matrices recomputed by the last update()
+	unsigned int lastUpdateCount() const { return updatedCount; }
+
+private:
+	std::vector<SceneNode> parents;
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<unsigned char> dirty;
+
+	// lowest dirty index - update() starts scanning here since nothing before it can have changed
+	SceneNode firstDirty;
+	unsigned int updatedCount;
+};
+
+#endif
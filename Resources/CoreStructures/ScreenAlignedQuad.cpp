@@ -1,4 +1,5 @@
 #include "ScreenAlignedQuad.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -24,7 +25,7 @@ ScreenAlignedQuad::ScreenAlignedQuad() {
 
 	// Setup VAO for textured quad object
 	glGenVertexArrays(1, &quadVertexArrayObj);
-	glBindVertexArray(quadVertexArrayObj);
+	GLState::bindVertexArray(quadVertexArrayObj);
 
 
 	// Setup VBO for position attribute
@@ -47,14 +48,14 @@ ScreenAlignedQuad::ScreenAlignedQuad() {
 	glEnableVertexAttribArray(2);
 
 	// Unbind textured quad VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 
 ScreenAlignedQuad::~ScreenAlignedQuad() {
 
 	// Unbind textured quad VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	// Unbind VBOs
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -63,15 +64,14 @@ ScreenAlignedQuad::~ScreenAlignedQuad() {
 	glDeleteBuffers(1, &quadVertexBuffer);
 	glDeleteBuffers(1, &quadTextureCoordBuffer);
 
+	GLState::forgetVertexArray(quadVertexArrayObj);
 	glDeleteVertexArrays(1, &quadVertexArrayObj);
 }
 
 
 void ScreenAlignedQuad::render() {
 
-	glBindVertexArray(quadVertexArrayObj);
+	GLState::bindVertexArray(quadVertexArrayObj);
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-	glBindVertexArray(0);
 }
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <fstream>
 #include "ShaderLoader.h"
+#include "ShaderProgram.h"
 
 using namespace std;
 
@@ -159,6 +160,19 @@ GLSL_ERROR ShaderLoader::createShaderProgram(const string& vsPath, const string&
 }
 
 
+// Overload of the basic createShaderProgram that returns the linked program as a ShaderProgram object in *result.  The program's active uniforms are introspected once here so uniform locations never need to be queried while rendering
+GLSL_ERROR ShaderLoader::createShaderProgram(const string& vsPath, const string& fsPath, ShaderProgram *result) {
+
+	GLuint glslProgram = 0;
+	GLSL_ERROR err = createShaderProgram(vsPath, fsPath, &glslProgram, 0);
+
+	if (err == GLSL_OK)
+		result->attach(glslProgram);
+
+	return err;
+}
+
+
 // Overload of createShaderProgram that allows vertex attribute locations to be declared in C/C++ and bound during shader creation.  This avoids the need to specify the layout in the vertex shader 'in' variable declarations, but this is not as convinient!
 GLSL_ERROR ShaderLoader::createShaderProgram(const string& vsPath, const string& fsPath, GLuint *result, int numAttributes, ...) {
 
@@ -5,6 +5,8 @@
 #include <string>
 #include <glad/glad.h>
 
+class ShaderProgram;
+
 // Declare GLSL setup return / error codes
 typedef enum GLSL_ERROR_CODES {
 
@@ -47,6 +49,9 @@ public:
 	// Basic shader object creation function takes a path to a vertex shader file and fragment shader file and returns a bound and linked shader program object in *result.  No attribute bindings are specified in this function so it is assumed 'in' variable declarations have associated location declarations in the shader source file
 	static GLSL_ERROR createShaderProgram(const std::string& vsPath, const std::string& fsPath, GLuint *result);
 
+	// Overload of the basic createShaderProgram that returns the linked program as a ShaderProgram object in *result.  The program's active uniforms are introspected once here so uniform locations never need to be queried while rendering
+	static GLSL_ERROR createShaderProgram(const std::string& vsPath, const std::string& fsPath, ShaderProgram *result);
+
 	// Overload of createShaderProgram that allows vertex attribute locations to be declared in C/C++ and bound during shader creation.  This avoids the need to specify the layout in the vertex shader 'in' variable declarations, but this is not as convinient!
 	static GLSL_ERROR createShaderProgram(const std::string& vsPath, const std::string& fsPath, GLuint *result, int numAttributes, ...);
 
@@ -0,0 +1,276 @@
+//  ShaderProgram.cpp
+
+#include "ShaderProgram.h"
+#include "GLState.h"
+
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+
+//
+// Private functions
+//
+
+// size in bytes of a single element of a uniform of the given GLSL type
+static unsigned int uniformTypeSize(GLenum type)
+{
+	switch (type) {
+
+	case GL_FLOAT:				return 4;
+	case GL_FLOAT_VEC2:			return 8;
+	case GL_FLOAT_VEC3:			return 12;
+	case GL_FLOAT_VEC4:			return 16;
+	case GL_INT:
+	case GL_UNSIGNED_INT:
+	case GL_BOOL:				return 4;
+	case GL_INT_VEC2:
+	case GL_UNSIGNED_INT_VEC2:
+	case GL_BOOL_VEC2:			return 8;
+	case GL_INT_VEC3:
+	case GL_UNSIGNED_INT_VEC3:
+	case GL_BOOL_VEC3:			return 12;
+	case GL_INT_VEC4:
+	case GL_UNSIGNED_INT_VEC4:
+	case GL_BOOL_VEC4:			return 16;
+	case GL_FLOAT_MAT2:			return 16;
+	case GL_FLOAT_MAT3:			return 36;
+	case GL_FLOAT_MAT4:			return 64;
+	case GL_FLOAT_MAT2x3:
+	case GL_FLOAT_MAT3x2:		return 24;
+	case GL_FLOAT_MAT2x4:
+	case GL_FLOAT_MAT4x2:		return 32;
+	case GL_FLOAT_MAT3x4:
+	case GL_FLOAT_MAT4x3:		return 48;
+
+	default:					return 4; // samplers and images are set as a single int
+	}
+}
+
+static bool isSamplerType(GLenum type)
+{
+	switch (type) {
+
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_1D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_MULTISAMPLE:
+	case GL_SAMPLER_BUFFER:
+	case GL_SAMPLER_2D_RECT:
+	case GL_INT_SAMPLER_2D:
+	case GL_INT_SAMPLER_BUFFER:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+
+//
+// ShaderProgram
+//
+
+ShaderProgram::ShaderProgram()
+{
+	program = 0;
+}
+
+ShaderProgram::ShaderProgram(GLuint program)
+{
+	this->program = 0;
+	attach(program);
+}
+
+void ShaderProgram::attach(GLuint newProgram)
+{
+	program = newProgram;
+
+	uniforms.clear();
+	uniformIDs.clear();
+	valueCache.clear();
+	resetFrameStats();
+
+	if (!program)
+		return;
+
+	GLint numActive = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numActive);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	vector<GLchar> nameBuffer(maxNameLength + 1);
+	unsigned int cacheBytes = 0;
+
+	for (GLint i = 0; i < numActive; i++) {
+
+		GLsizei nameLength = 0;
+		GLint arraySize = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &arraySize, &type, nameBuffer.data());
+
+		string name(nameBuffer.data(), nameLength);
+		GLint location = glGetUniformLocation(program, name.c_str());
+
+		// uniforms inside uniform blocks have no location and can't be set with glUniform*
+		if (location < 0)
+			continue;
+
+		UniformEntry entry;
+		entry.location = location;
+		entry.type = type;
+		entry.arraySize = arraySize;
+		entry.cacheOffset = cacheBytes;
+		entry.cacheSize = uniformTypeSize(type) * arraySize;
+		entry.validBytes = 0;
+		entry.textureUnit = -1;
+
+		UniformID id = (UniformID)uniforms.size();
+		uniforms.push_back(entry);
+		cacheBytes += entry.cacheSize;
+
+		// arrays are reported as "name[0]" - register the plain name too
+		uniformIDs[name] = id;
+		size_t bracket = name.find('[');
+		if (bracket != string::npos)
+			uniformIDs[name.substr(0, bracket)] = id;
+	}
+
+	valueCache.resize(cacheBytes);
+
+	assignTextureUnits();
+}
+
+// give each sampler its own texture unit, in the order the samplers were reported.  Sampler arrays aren't used by
+// this project's shaders so each sampler takes a single unit.  The program is left current
+void ShaderProgram::assignTextureUnits()
+{
+	GLint maxUnits = 0;
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
+
+	GLState::useProgram(program);
+
+	GLint nextUnit = 0;
+	for (UniformID id = 0; id < (UniformID)uniforms.size(); id++) {
+
+		if (!isSamplerType(uniforms[id].type) || nextUnit >= maxUnits)
+			continue;
+
+		uniforms[id].textureUnit = nextUnit;
+		setInt(id, nextUnit);
+		nextUnit++;
+	}
+
+	resetFrameStats();
+}
+
+void ShaderProgram::use() const
+{
+	GLState::useProgram(program);
+}
+
+UniformID ShaderProgram::uniform(const string& name) const
+{
+	unordered_map<string, UniformID>::const_iterator found = uniformIDs.find(name);
+	return (found != uniformIDs.end()) ? found->second : NO_UNIFORM;
+}
+
+bool ShaderProgram::changed(UniformID id, const void *data, unsigned int bytes)
+{
+	if (id < 0)
+		return false;
+
+	UniformEntry& entry = uniforms[id];
+
+	if (bytes > entry.cacheSize)
+		bytes = entry.cacheSize;
+
+	unsigned char *shadow = &valueCache[entry.cacheOffset];
+
+	if (bytes <= entry.validBytes && memcmp(shadow, data, bytes) == 0) {
+
+		stats.skipped++;
+		return false;
+	}
+
+	memcpy(shadow, data, bytes);
+	if (bytes > entry.validBytes)
+		entry.validBytes = bytes;
+
+	stats.uploads++;
+	return true;
+}
+
+void ShaderProgram::setInt(UniformID id, GLint value)
+{
+	if (changed(id, &value, sizeof(value)))
+		glUniform1i(uniforms[id].location, value);
+}
+
+void ShaderProgram::setFloat(UniformID id, GLfloat value)
+{
+	if (changed(id, &value, sizeof(value)))
+		glUniform1f(uniforms[id].location, value);
+}
+
+void ShaderProgram::setVec3(UniformID id, const glm::vec3& value)
+{
+	if (changed(id, glm::value_ptr(value), sizeof(value)))
+		glUniform3fv(uniforms[id].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::setVec4(UniformID id, const glm::vec4& value)
+{
+	if (changed(id, glm::value_ptr(value), sizeof(value)))
+		glUniform4fv(uniforms[id].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::setMat4(UniformID id, const glm::mat4& value)
+{
+	if (changed(id, glm::value_ptr(value), sizeof(value)))
+		glUniformMatrix4fv(uniforms[id].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void ShaderProgram::setFloatArray(UniformID id, const GLfloat *values, GLsizei count)
+{
+	if (changed(id, values, count * sizeof(GLfloat)))
+		glUniform1fv(uniforms[id].location, count, values);
+}
+
+void ShaderProgram::setVec3Array(UniformID id, const glm::vec3 *values, GLsizei count)
+{
+	if (changed(id, values, count * sizeof(glm::vec3)))
+		glUniform3fv(uniforms[id].location, count, glm::value_ptr(values[0]));
+}
+
+void ShaderProgram::setVec4Array(UniformID id, const glm::vec4 *values, GLsizei count)
+{
+	if (changed(id, values, count * sizeof(glm::vec4)))
+		glUniform4fv(uniforms[id].location, count, glm::value_ptr(values[0]));
+}
+
+void ShaderProgram::setMat4Array(UniformID id, const glm::mat4 *values, GLsizei count)
+{
+	if (changed(id, values, count * sizeof(glm::mat4)))
+		glUniformMatrix4fv(uniforms[id].location, count, GL_FALSE, glm::value_ptr(values[0]));
+}
+
+void ShaderProgram::resetFrameStats()
+{
+	stats.uploads = 0;
+	stats.skipped = 0;
+}
+
+void ShaderProgram::invalidateCache()
+{
+	for (size_t i = 0; i < uniforms.size(); i++)
+		uniforms[i].validBytes = 0;
+}
@@ -0,0 +1,96 @@
+//  ShaderProgram.h - Linked shader program with a cached uniform table
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Index of an active uniform in a ShaderProgram's uniform table
+typedef int UniformID;
+
+// Upload counters for a ShaderProgram.  'skipped' counts setter calls that were dropped because the
+// uniform already held the value.
+struct UniformStats {
+	unsigned int uploads = 0;
+	unsigned int skipped = 0;
+};
+
+// Wraps a linked GLSL program.  All active uniforms are introspected once when the program is attached and
+// stored in an indexed table, so per-frame code looks up a UniformID once and never calls glGetUniformLocation.
+// The typed setters keep a shadow copy of each uniform's value and skip the glUniform* call when it hasn't changed.
+//
+// Every sampler uniform is given its own texture unit when the program is attached, so meshes only need to bind
+// textures to those units and never set the samplers while drawing.
+//
+// Uniforms belong to the program, so the setters assume the program is current (call use() first).
+class ShaderProgram {
+
+public:
+	static const UniformID NO_UNIFORM = -1;
+
+	ShaderProgram();
+	explicit ShaderProgram(GLuint program);
+
+	// take over a linked program and build its uniform table
+	void attach(GLuint program);
+
+	GLuint id() const { return program; }
+	bool isValid() const { return program != 0; }
+
+	void use() const;
+
+	// returns the uniform's index in the table or NO_UNIFORM if the program has no such active uniform.  Arrays can
+	// be looked up as "name" or "name[0]"
+	UniformID uniform(const std::string& name) const;
+
+	GLint location(UniformID id) const { return id < 0 ? -1 : uniforms[id].location; }
+	// texture unit assigned to a sampler uniform when the program was attached, -1 if the uniform isn't a sampler
+	GLint textureUnit(UniformID id) const { return id < 0 ? -1 : uniforms[id].textureUnit; }
+	unsigned int numUniforms() const { return (unsigned int)uniforms.size(); }
+
+	// Typed setters.  Setting NO_UNIFORM is a no-op so optional uniforms don't need to be checked by the caller
+	void setInt(UniformID id, GLint value);
+	void setFloat(UniformID id, GLfloat value);
+	void setVec3(UniformID id, const glm::vec3& value);
+	void setVec4(UniformID id, const glm::vec4& value);
+	void setMat4(UniformID id, const glm::mat4& value);
+	void setFloatArray(UniformID id, const GLfloat *values, GLsizei count);
+	void setVec3Array(UniformID id, const glm::vec3 *values, GLsizei count);
+	void setVec4Array(UniformID id, const glm::vec4 *values, GLsizei count);
+	void setMat4Array(UniformID id, const glm::mat4 *values, GLsizei count);
+
+	// uploads issued / saved since the last resetFrameStats()
+	const UniformStats& frameStats() const { return stats; }
+	void resetFrameStats();
+
+	// forget the shadow copies, eg. after uniforms were changed with raw glUniform* calls
+	void invalidateCache();
+
+private:
+	struct UniformEntry {
+		GLint			location;
+		GLenum			type;
+		GLint			arraySize;
+		unsigned int	cacheOffset;	// byte offset of the shadow copy in valueCache
+		unsigned int	cacheSize;		// size of the whole uniform (all array elements) in bytes
+		unsigned int	validBytes;		// how much of the shadow copy holds an uploaded value
+		GLint			textureUnit;	// fixed unit for sampler uniforms, -1 otherwise
+	};
+
+	GLuint										program;
+	std::vector<UniformEntry>					uniforms;
+	std::unordered_map<std::string, UniformID>	uniformIDs;
+	std::vector<unsigned char>					valueCache;
+	UniformStats								stats;
+
+	void assignTextureUnits();
+
+	// returns true if data differs from the shadow copy (and updates it), false if the upload can be skipped
+	bool changed(UniformID id, const void *data, unsigned int bytes);
+};
+
+#endif
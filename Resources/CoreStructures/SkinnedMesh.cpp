@@ -1,5 +1,6 @@
 #include "SkinnedMesh.h"
-#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "GLState.h"
 #include <iostream>
 
 #define POSITION_LOCATION    0
@@ -8,28 +9,6 @@
 #define BONE_ID_LOCATION     3
 #define BONE_WEIGHT_LOCATION 4
 
-static glm::mat4 AssimpToGLM(const aiMatrix4x4 &matrix) 
-{
-	//the documentation says Assimp is row major while GLM and OpenGL is colomn major,
-	//but access to elements are the same, so the following is correct.
-	return glm::mat4(
-		matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0],
-		matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1],
-		matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2],
-		matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]
-	);
-}
-
-static glm::mat3 AssimpToGLM(const aiMatrix3x3 &matrix) 
-{
-	//the documentation says Assimp is row major while GLM and OpenGL is colomn major,
-	//but access to elements are the same, so the following is correct.
-	return glm::mat3(
-		matrix[0][0], matrix[1][0], matrix[2][0],
-		matrix[0][1], matrix[1][1], matrix[2][1],
-		matrix[0][2], matrix[1][2], matrix[2][2]
-	);
-}
 
 void SkinnedMesh::VertexBoneData::AddBoneData(GLuint BoneID, float Weight)
 {
@@ -50,8 +29,8 @@ SkinnedMesh::SkinnedMesh()
 {
     m_VAO = 0;
 	memset(m_Buffers, 0, sizeof(m_Buffers));
-    m_NumBones = 0;
     m_pScene = NULL;
+	m_SamplerProgram = 0;
 }
 
 
@@ -69,9 +48,17 @@ void SkinnedMesh::Clear()
     }
        
     if (m_VAO != 0) {
+        GLState::forgetVertexArray(m_VAO);
         glDeleteVertexArrays(1, &m_VAO);
         m_VAO = 0;
     }
+
+	// drop this mesh's references to its cached textures.  Null textures aren't from the cache
+	for (GLuint i = 0; i < m_Textures.size(); i++) {
+		if (m_Textures[i].type != TEXTURE_NULL)
+			TextureCache::release(m_Textures[i].id);
+	}
+	m_Textures.clear();
 }
 
 
@@ -82,7 +69,7 @@ bool SkinnedMesh::LoadMesh(const string& Filename)
  
     // Create the VAO
     glGenVertexArrays(1, &m_VAO);   
-    glBindVertexArray(m_VAO);
+    GLState::bindVertexArray(m_VAO);
     
     // Create the buffers for the vertices attributes
     glGenBuffers(sizeof(m_Buffers) / sizeof(GLuint), m_Buffers);
@@ -93,16 +80,34 @@ bool SkinnedMesh::LoadMesh(const string& Filename)
     
     if (m_pScene) 
 	{  
-        m_GlobalInverseTransform = AssimpToGLM(m_pScene->mRootNode->mTransformation);
-        m_GlobalInverseTransform = glm::inverse(m_GlobalInverseTransform);
+        // flatten the hierarchy and bake the animations against it once, rather than walking the scene every frame
+        m_Skeleton.build(m_pScene);
+        m_Animations.resize(m_pScene->mNumAnimations);
+        for (GLuint i = 0 ; i < m_pScene->mNumAnimations ; i++) {
+            AnimationClip::bake(m_pScene->mAnimations[i], m_Skeleton, m_Animations[i]);
+            m_Animations[i].compress(m_Skeleton);
+        }
+        m_Cursors.assign(m_Animations.size(), ClipCursor());
+
+        // PlayAnimation() starts from the first animation
+        m_Player = AnimationPlayer();
+        if (!m_Animations.empty()) {
+            m_Player.play(m_Skeleton, &m_Animations[0], 0.0f);
+        }
+        m_Scratch.reserve(m_Skeleton);
+
         Ret = InitFromScene(m_pScene, Filename);
+
+        // everything needed is copied out of the scene by now, so its keys needn't be kept
+        m_Importer.FreeScene();
+        m_pScene = NULL;
     }
     else {
         printf("Error parsing '%s': '%s'\n", Filename.c_str(), m_Importer.GetErrorString());
     }
 
     // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);	
+    GLState::bindVertexArray(0);	
 
     return Ret;
 }
@@ -218,23 +223,8 @@ void SkinnedMesh::LoadBones(GLuint MeshIndex, const aiMesh* pMesh, vector<Vertex
 {
     for (GLuint i = 0 ; i < pMesh->mNumBones ; i++) 
 	{                
-        GLuint BoneIndex = 0;        
-        string BoneName(pMesh->mBones[i]->mName.data);
-        
-        if (m_BoneMapping.find(BoneName) == m_BoneMapping.end()) 
-		{
-            // Allocate an index for a new bone
-            BoneIndex = m_NumBones;
-            m_NumBones++;            
-	        BoneInfo bi;			
-			m_BoneInfo.push_back(bi);
-            m_BoneInfo[BoneIndex].BoneOffset = AssimpToGLM(pMesh->mBones[i]->mOffsetMatrix);            
-            m_BoneMapping[BoneName] = BoneIndex;
-        }
-        else 
-		{
-            BoneIndex = m_BoneMapping[BoneName];
-        }                      
+        // the skeleton numbered every bone of every mesh when it was built
+        GLuint BoneIndex = m_Skeleton.boneMapping[pMesh->mBones[i]->mName.data];
         
         for (GLuint j = 0 ; j < pMesh->mBones[i]->mNumWeights ; j++) 
 		{
@@ -275,8 +265,8 @@ bool SkinnedMesh::InitMaterials(const aiScene* pScene, const string& Filename)
 			Texture texture;
 			string fullPath = Dir;
 			fullPath.append("\\" + string(str.C_Str()));
-			texture.id = TextureLoader::loadTexture(fullPath);
-			texture.type = "texture_diffuse";
+			texture.id = TextureCache::acquire(fullPath);
+			texture.type = TEXTURE_DIFFUSE;
 			texture.path = str.C_Str();
 			m_Textures.push_back(texture);
 		}
@@ -284,20 +274,48 @@ bool SkinnedMesh::InitMaterials(const aiScene* pScene, const string& Filename)
 		{
 			Texture texture{};
 			texture.id = 55;
-			texture.type = "texture_null";
+			texture.type = TEXTURE_NULL;
 			texture.path = "null";
 			m_Textures.push_back(texture);
 		}
 
     }
+
+	// retrieve the sampler name for each texture (the N in diffuse_textureN) now rather than on every draw
+	unsigned int diffuseNr = 1;
+	m_SamplerNames.clear();
+	for (GLuint i = 0; i < m_Textures.size(); i++)
+	{
+		string name = textureTypeName(m_Textures[i].type);
+		if (m_Textures[i].type == TEXTURE_DIFFUSE)
+			name += std::to_string(diffuseNr++);
+		m_SamplerNames.push_back(name);
+	}
+	m_SamplerProgram = 0;
+	m_SamplerLocations.clear();
+
     return Ret;
 }
 
 
 void SkinnedMesh::Render(GLuint shader)
 {
-    glBindVertexArray(m_VAO);
-	unsigned int diffuseNr = 1;
+	Render(shader, 1);
+}
+
+
+void SkinnedMesh::Render(GLuint shader, GLsizei Instances)
+{
+	// look the sampler locations up once per shader
+	if (shader != m_SamplerProgram || m_SamplerLocations.size() != m_SamplerNames.size())
+	{
+		m_SamplerLocations.resize(m_SamplerNames.size());
+		for (GLuint i = 0; i < m_SamplerNames.size(); i++)
+			m_SamplerLocations[i] = glGetUniformLocation(shader, m_SamplerNames[i].c_str());
+		m_SamplerProgram = shader;
+	}
+
+    GLState::bindVertexArray(m_VAO);
 	int numberOfMaterials = m_Entries.size();
 
 	//Check if some textures have failed to be matched properly
@@ -306,222 +324,96 @@ void SkinnedMesh::Render(GLuint shader)
 
     for (GLuint i = 0 ; i < numberOfMaterials; i++)
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-										  // retrieve texture number (the N in diffuse_textureN)
-		string number;
-		string name = m_Textures[i].type;
-		if (name == "texture_diffuse")
-			number = std::to_string(diffuseNr++);
-
-												 // now set the sampler to the correct texture unit
-		glUniform1i(glGetUniformLocation(shader, (name + number).c_str()), i);
-		// and finally bind the texture
-		glBindTexture(GL_TEXTURE_2D, m_Textures[i].id);
+		// set the sampler to the correct texture unit
+		glUniform1i(m_SamplerLocations[i], i);
+		// and bind the texture to that unit
+		GLState::bindTexture(i, GL_TEXTURE_2D, m_Textures[i].id);
 
 
-		glDrawElementsBaseVertex(GL_TRIANGLES, m_Entries[i].NumIndices, GL_UNSIGNED_INT, 
+		if (Instances == 1)
+			glDrawElementsBaseVertex(GL_TRIANGLES, m_Entries[i].NumIndices, GL_UNSIGNED_INT, 
                                  (void*)(sizeof(GLuint) * m_Entries[i].BaseIndex), 
                                  m_Entries[i].BaseVertex);
+		else
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m_Entries[i].NumIndices, GL_UNSIGNED_INT,
+				(void*)(sizeof(GLuint) * m_Entries[i].BaseIndex), Instances, m_Entries[i].BaseVertex);
     }
-
-    // Make sure the VAO is not changed from the outside    
-    glBindVertexArray(0);
 }
 
 
-GLuint SkinnedMesh::FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim)
-{    
-    for (GLuint i = 0 ; i < pNodeAnim->mNumPositionKeys - 1 ; i++) {
-        if (AnimationTime < static_cast<float>(pNodeAnim->mPositionKeys[i + 1].mTime)) {
-            return i;
-        }
-    }
-    
-    assert(0);
-
-    return 0;
-}
-
-
-GLuint SkinnedMesh::FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim)
+void SkinnedMesh::BoneTransform(float TimeInSeconds, vector<glm::mat4>& Transforms, unsigned int animationNumber)
 {
-    assert(pNodeAnim->mNumRotationKeys > 0);
-
-    for (GLuint i = 0 ; i < pNodeAnim->mNumRotationKeys - 1 ; i++) {
-        if (AnimationTime < static_cast<float>(pNodeAnim->mRotationKeys[i + 1].mTime)) {
-            return i;
-        }
-    }
-    
-    assert(0);
-
-    return 0;
+	Transforms.resize(m_Skeleton.numBones());
+	if (!Transforms.empty())
+		EvaluatePalette(TimeInSeconds, Transforms.data(), animationNumber);
 }
 
 
-GLuint SkinnedMesh::FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim)
+GLint SkinnedMesh::BoneTransform(float TimeInSeconds, BonePaletteBuffer& Palettes, unsigned int animationNumber)
 {
-    assert(pNodeAnim->mNumScalingKeys > 0);
-    
-    for (GLuint i = 0 ; i < pNodeAnim->mNumScalingKeys - 1 ; i++) {
-        if (AnimationTime < static_cast<float>(pNodeAnim->mScalingKeys[i + 1].mTime)) 
-		{
-            return i;
-        }
-    }
-    
-    assert(0);
-
-    return 0;
+	GLint Base = -1;
+	glm::mat4* Palette = Palettes.allocate(m_Skeleton.numBones(), Base);
+	if (Palette)
+		EvaluatePalette(TimeInSeconds, Palette, animationNumber);
+	return Base;
 }
 
 
-void SkinnedMesh::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
+GLint SkinnedMesh::BoneTransforms(const float* TimesInSeconds, unsigned int Count, BonePaletteBuffer& Palettes, unsigned int animationNumber)
 {
-    if (pNodeAnim->mNumPositionKeys == 1) {
-        Out = pNodeAnim->mPositionKeys[0].mValue;
-        return;
-    }
-            
-    GLuint PositionIndex = FindPosition(AnimationTime, pNodeAnim);
-    GLuint NextPositionIndex = (PositionIndex + 1);
-    assert(NextPositionIndex < pNodeAnim->mNumPositionKeys);
-    float DeltaTime = static_cast<float>(pNodeAnim->mPositionKeys[NextPositionIndex].mTime - pNodeAnim->mPositionKeys[PositionIndex].mTime);
-    float Factor = (AnimationTime - static_cast<float>(pNodeAnim->mPositionKeys[PositionIndex].mTime)) / DeltaTime;
-    assert(Factor >= 0.0f && Factor <= 1.0f);
-    const aiVector3D& Start = pNodeAnim->mPositionKeys[PositionIndex].mValue;
-    const aiVector3D& End = pNodeAnim->mPositionKeys[NextPositionIndex].mValue;
-    aiVector3D Delta = End - Start;
-    Out = Start + Factor * Delta;
+	GLint Base = -1;
+	glm::mat4* Palette = Palettes.allocate(m_Skeleton.numBones() * Count, Base);
+	if (Palette)
+		for (unsigned int i = 0; i < Count; i++)
+			EvaluatePalette(TimesInSeconds[i], Palette + i * m_Skeleton.numBones(), animationNumber);
+	return Base;
 }
 
 
-void SkinnedMesh::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
+void SkinnedMesh::EvaluatePalette(float TimeInSeconds, glm::mat4* Palette, unsigned int animationNumber)
 {
-	// we need at least two values to interpolate...
-    if (pNodeAnim->mNumRotationKeys == 1) {
-        Out = pNodeAnim->mRotationKeys[0].mValue;
-        return;
-    }
-    
-    GLuint RotationIndex = FindRotation(AnimationTime, pNodeAnim);
-    GLuint NextRotationIndex = (RotationIndex + 1);
-    assert(NextRotationIndex < pNodeAnim->mNumRotationKeys);
-    float DeltaTime = static_cast<float>(pNodeAnim->mRotationKeys[NextRotationIndex].mTime - pNodeAnim->mRotationKeys[RotationIndex].mTime);
-    float Factor = (AnimationTime - static_cast<float>(pNodeAnim->mRotationKeys[RotationIndex].mTime)) / DeltaTime;
-    assert(Factor >= 0.0f && Factor <= 1.0f);
-    const aiQuaternion& StartRotationQ = pNodeAnim->mRotationKeys[RotationIndex].mValue;
-    const aiQuaternion& EndRotationQ   = pNodeAnim->mRotationKeys[NextRotationIndex].mValue;    
-    aiQuaternion::Interpolate(Out, StartRotationQ, EndRotationQ, Factor);
-    Out = Out.Normalize();
+	// each animation runs on its own ticks and duration, sampled from the baked clip
+	if (animationNumber < m_Animations.size())
+	{
+		m_Animations[animationNumber].evaluate(m_Skeleton, TimeInSeconds, m_Scratch, Palette, &m_Cursors[animationNumber]);
+	}
+	else
+	{
+		m_Scratch.reserve(m_Skeleton);
+		m_Scratch.pose = m_Skeleton.bindPose;
+		m_Skeleton.computePalette(m_Scratch.pose, m_Scratch.globals.data(), Palette);
+	}
 }
 
-
-void SkinnedMesh::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
+int SkinnedMesh::getNumberOfAnimations()
 {
-    if (pNodeAnim->mNumScalingKeys == 1) {
-        Out = pNodeAnim->mScalingKeys[0].mValue;
-        return;
-    }
-
-    GLuint ScalingIndex = FindScaling(AnimationTime, pNodeAnim);
-    GLuint NextScalingIndex = (ScalingIndex + 1);
-    assert(NextScalingIndex < pNodeAnim->mNumScalingKeys);
-    float DeltaTime = static_cast<float>(pNodeAnim->mScalingKeys[NextScalingIndex].mTime - pNodeAnim->mScalingKeys[ScalingIndex].mTime);
-    float Factor = (AnimationTime - static_cast<float>(pNodeAnim->mScalingKeys[ScalingIndex].mTime)) / DeltaTime;
-    assert(Factor >= 0.0f && Factor <= 1.0f);
-    const aiVector3D& Start = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
-    const aiVector3D& End   = pNodeAnim->mScalingKeys[NextScalingIndex].mValue;
-    aiVector3D Delta = End - Start;
-    Out = Start + Factor * Delta;
+	return (int)m_Animations.size();
 }
 
 
-void SkinnedMesh::ReadNodeHeirarchy(float AnimationTime, const aiNode* pNode, const glm::mat4& ParentTransform, unsigned int animationNumber)
-{    
-    string NodeName(pNode->mName.data);
-    
-    const aiAnimation* pAnimation = m_pScene->mAnimations[animationNumber];
-        
-	glm::mat4 NodeTransformation(AssimpToGLM(pNode->mTransformation));
-     
-    const aiNodeAnim* pNodeAnim = FindNodeAnim(pAnimation, NodeName);
-    
-    if (pNodeAnim) 
-	{
-        // Interpolate scaling and generate scaling transformation matrix
-        aiVector3D Scaling;
-        CalcInterpolatedScaling(Scaling, AnimationTime, pNodeAnim);
-		glm::mat4 ScalingM;
-        ScalingM = glm::scale(glm::mat4(1.0),glm::vec3(Scaling.x, Scaling.y, Scaling.z));
-        
-        // Interpolate rotation and generate rotation transformation matrix
-        aiQuaternion RotationQ;
-        CalcInterpolatedRotation(RotationQ, AnimationTime, pNodeAnim);
-    	
-		glm::mat4 RotationM = glm::mat4(AssimpToGLM(RotationQ.GetMatrix()));
-
-        // Interpolate translation and generate translation transformation matrix
-        aiVector3D Translation;
-        CalcInterpolatedPosition(Translation, AnimationTime, pNodeAnim);
-		glm::mat4 TranslationM(1.0);
-        TranslationM = glm::translate(glm::mat4(1.0), glm::vec3(Translation.x, Translation.y, Translation.z));
-        
-        // Combine the above transformations
-        NodeTransformation = TranslationM * RotationM * ScalingM;
-    }
-       
-	glm::mat4 GlobalTransformation = ParentTransform * NodeTransformation;
-    
-    if (m_BoneMapping.find(NodeName) != m_BoneMapping.end()) {
-        GLuint BoneIndex = m_BoneMapping[NodeName];
-        m_BoneInfo[BoneIndex].FinalTransformation = m_GlobalInverseTransform * GlobalTransformation * m_BoneInfo[BoneIndex].BoneOffset;
-    }
-    
-    for (GLuint i = 0 ; i < pNode->mNumChildren ; i++) {
-        ReadNodeHeirarchy(AnimationTime, pNode->mChildren[i], GlobalTransformation, animationNumber);
-    }
+void SkinnedMesh::PlayAnimation(unsigned int animationNumber, float FadeSeconds)
+{
+	m_Player.play(m_Skeleton, animationNumber < m_Animations.size() ? &m_Animations[animationNumber] : nullptr, FadeSeconds);
 }
 
 
-void SkinnedMesh::BoneTransform(float TimeInSeconds, vector<glm::mat4>& Transforms, unsigned int animationNumber)
+void SkinnedMesh::UpdateAnimation(float DeltaSeconds, vector<glm::mat4>& Transforms)
 {
-	glm::mat4 Identity(1.0);
-    
-    float TicksPerSecond = static_cast<float>(m_pScene->mAnimations[0]->mTicksPerSecond != 0 ? m_pScene->mAnimations[0]->mTicksPerSecond : 25.0f);
-    float TimeInTicks = TimeInSeconds * TicksPerSecond;
-    float AnimationTime = fmod(TimeInTicks, static_cast<float>(m_pScene->mAnimations[0]->mDuration));
-
-
-    ReadNodeHeirarchy(AnimationTime, m_pScene->mRootNode, Identity, animationNumber);
-
-	printf("Animation time: %.3f Ticks Per Second: %.3f Time In Ticks: %.3f\n", AnimationTime, TicksPerSecond, TimeInTicks);
-
-    Transforms.resize(m_NumBones);
+	m_Player.update(DeltaSeconds);
 
-    for (GLuint i = 0 ; i < m_NumBones ; i++) 
-	{
-        Transforms[i] = m_BoneInfo[i].FinalTransformation;
-    }
-}
-
-int SkinnedMesh::getNumberOfAnimations()
-{
-	return m_pScene->mNumAnimations;
+	Transforms.resize(m_Skeleton.numBones());
+	if (!Transforms.empty())
+		m_Player.tree().evaluate(m_Skeleton, m_BlendScratch, Transforms.data());
 }
 
 
-const aiNodeAnim* SkinnedMesh::FindNodeAnim(const aiAnimation* pAnimation, const string NodeName)
+GLint SkinnedMesh::UpdateAnimation(float DeltaSeconds, BonePaletteBuffer& Palettes)
 {
-    for (GLuint i = 0 ; i < pAnimation->mNumChannels ; i++) 
-	{
-        const aiNodeAnim* pNodeAnim = pAnimation->mChannels[i];
+	m_Player.update(DeltaSeconds);
 
-        if (strcmp(NodeName.c_str(), pNodeAnim->mNodeName.data) == 0)
-		{
-            return pNodeAnim;
-        }
-    }
-    
-    return nullptr;
+	GLint Base = -1;
+	glm::mat4* Palette = Palettes.allocate(m_Skeleton.numBones(), Base);
+	if (Palette)
+		m_Player.tree().evaluate(m_Skeleton, m_BlendScratch, Palette);
+	return Base;
 }
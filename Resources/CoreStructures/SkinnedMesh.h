@@ -12,6 +12,9 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "AnimationBlend.h"
+#include "AnimationClip.h"
+#include "BonePaletteBuffer.h"
 
 class SkinnedMesh
 {
@@ -23,30 +26,41 @@ public:
     bool LoadMesh(const std::string& Filename);
 
     void Render(GLuint shader);
+	// draws Instances copies in one instanced draw.  The shader tells them apart by gl_InstanceID, eg. to pick each
+	// one's palette from those BoneTransforms() wrote
+	void Render(GLuint shader, GLsizei Instances);
 	
     GLuint NumBones() const
     {
-        return m_NumBones;
+        return m_Skeleton.numBones();
     }
     
+	// the skinning matrices of the animation at a time in seconds, looping.  Animations the scene doesn't have give
+	// the bind pose
     void BoneTransform(float TimeInSeconds, std::vector<glm::mat4>& Transforms, unsigned int animationNumber);
+	// the same, written straight into the frame's palette buffer.  Returns the base index of the matrices for the
+	// shader's paletteBase, or -1 if the buffer is full
+	GLint BoneTransform(float TimeInSeconds, BonePaletteBuffer& Palettes, unsigned int animationNumber);
+	// a palette for each of Count times, one after another, so copy i's bones start at the returned base plus
+	// i * NumBones().  Returns -1 if the buffer hasn't room for them all
+	GLint BoneTransforms(const float* TimesInSeconds, unsigned int Count, BonePaletteBuffer& Palettes, unsigned int animationNumber);
 	int getNumberOfAnimations();
+
+	// cross-fades from whatever is showing to the animation, played from its start, over FadeSeconds.  Animations the
+	// scene doesn't have fade to the bind pose
+	void PlayAnimation(unsigned int animationNumber, float FadeSeconds);
+	// moves the playing animations and any fade on, and writes the blended pose's skinning matrices
+	void UpdateAnimation(float DeltaSeconds, std::vector<glm::mat4>& Transforms);
+	// the same, written straight into the frame's palette buffer, returning the base index as BoneTransform() does
+	GLint UpdateAnimation(float DeltaSeconds, BonePaletteBuffer& Palettes);
+
+	// the node hierarchy and the animations baked from the scene when it was loaded
+	const Skeleton& getSkeleton() const { return m_Skeleton; }
+	const std::vector<AnimationClip>& getAnimations() const { return m_Animations; }
     
 private:
     #define NUM_BONES_PER_VEREX 4
 
-    struct BoneInfo
-    {
-		glm::mat4 BoneOffset;
-		glm::mat4 FinalTransformation;
-
-        BoneInfo()
-        {
-            BoneOffset = glm::mat4(0.0);
-            FinalTransformation = glm::mat4(0.0);
-        }
-    };
-    
     struct VertexBoneData
     {        
         GLuint IDs[NUM_BONES_PER_VEREX];
@@ -66,14 +80,7 @@ private:
         void AddBoneData(GLuint BoneID, float Weight);
     };
 
-    void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);    
-    GLuint FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    GLuint FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    GLuint FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    const aiNodeAnim* FindNodeAnim(const aiAnimation* pAnimation, const std::string NodeName);
-    void ReadNodeHeirarchy(float AnimationTime, const aiNode* pNode, const glm::mat4& ParentTransform, unsigned int animationNumber);
+    void EvaluatePalette(float TimeInSeconds, glm::mat4* Palette, unsigned int animationNumber);
     bool InitFromScene(const aiScene* pScene, const std::string& Filename);
     void InitMesh(GLuint MeshIndex,
                   const aiMesh* paiMesh,
@@ -117,13 +124,18 @@ enum VB_TYPES {
 
 	std::vector<MeshEntry> m_Entries;
 	std::vector<Texture> m_Textures;
-
-	std::map<std::string, GLuint> m_BoneMapping; // maps a bone name to its index
-	GLuint m_NumBones;
-	std::vector<BoneInfo> m_BoneInfo;
-    glm::mat4 m_GlobalInverseTransform;
+	std::vector<std::string> m_SamplerNames;	// sampler uniform for each texture, eg. "texture_diffuse1"
+	GLuint m_SamplerProgram;					// shader m_SamplerLocations were looked up in
+	std::vector<GLint> m_SamplerLocations;
+
+	Skeleton m_Skeleton;
+	std::vector<AnimationClip> m_Animations;	// one for each of the scene's animations, baked and compressed when it's loaded
+	std::vector<ClipCursor> m_Cursors;			// where the last BoneTransform() of each animation got to
+	PoseScratch m_Scratch;
+	AnimationPlayer m_Player;					// what PlayAnimation() started
+	BlendScratch m_BlendScratch;
     
-    const aiScene* m_pScene;
+    const aiScene* m_pScene;					// only while loading
     Assimp::Importer m_Importer;
 };
 
@@ -2,6 +2,7 @@
 
 #include "ShaderLoader.h"
 #include "TextureLoader.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -58,22 +59,7 @@ static float skyboxPositionArray[] = {
 
 Skybox::Skybox(const string& cubemapPath, const string& cubemapName, const string& cubemapExtension) {
 
-	// Load shader
-	GLSL_ERROR glsl_err = ShaderLoader::createShaderProgram(string("Resources\\Shaders\\Skybox_shader.vert"), string("Resources\\Shaders\\Skybox_shader.frag"), &skyboxShader);
-
-	// Setup VAO
-	glGenVertexArrays(1, &skyboxVAO);
-	glBindVertexArray(skyboxVAO);
-
-	// Setup VBO for vertex position data
-	glGenBuffers(1, &skyboxVertexBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxPositionArray), skyboxPositionArray, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-	// Unbind VAO when finished setup
-	glBindVertexArray(0);
+	createGeometry();
 
 	//
 	// Load cubemap texture
@@ -100,6 +86,7 @@ Skybox::Skybox(const string& cubemapPath, const string& cubemapName, const strin
 
 	texture = TextureLoader::loadCubeMapTexture(
 		cubemapPath, cubemapName, cubemapExtension,
+		GL_SRGB8_ALPHA8,
 		GL_LINEAR,
 		GL_LINEAR,
 		4.0f,
@@ -109,15 +96,54 @@ Skybox::Skybox(const string& cubemapPath, const string& cubemapName, const strin
 		false);
 
 #endif
+}
+
+
+Skybox::Skybox(const string& cubemapFile, CubeMapLayout layout) {
+
+	createGeometry();
+
+	texture = TextureLoader::loadCubeMapTexture(
+		cubemapFile, layout,
+		GL_SRGB8_ALPHA8,
+		GL_LINEAR,
+		GL_LINEAR,
+		4.0f,
+		GL_MIRRORED_REPEAT,
+		GL_MIRRORED_REPEAT,
+		GL_MIRRORED_REPEAT,
+		false);
+}
+
+
+void Skybox::createGeometry() {
+
+	skyboxNormalVectorBuffer = 0;
+	texture = 0;
+
+	// Load shader
+	GLSL_ERROR glsl_err = ShaderLoader::createShaderProgram(string("Resources\\Shaders\\Skybox_shader.vert"), string("Resources\\Shaders\\Skybox_shader.frag"), &skyboxShader);
 
+	// Setup VAO
+	glGenVertexArrays(1, &skyboxVAO);
+	GLState::bindVertexArray(skyboxVAO);
+
+	// Setup VBO for vertex position data
+	glGenBuffers(1, &skyboxVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, skyboxVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxPositionArray), skyboxPositionArray, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
+	// Unbind VAO when finished setup
+	GLState::bindVertexArray(0);
 }
 
 
 Skybox::~Skybox() {
 
 	// Unbind VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	// Unbind VBOs
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -126,6 +152,9 @@ Skybox::~Skybox() {
 	// Delete GL resources
 	glDeleteBuffers(1, &skyboxVertexBuffer);
 	glDeleteBuffers(1, &skyboxNormalVectorBuffer);
+	GLState::forgetVertexArray(skyboxVAO);
+	GLState::forgetProgram(skyboxShader);
+	GLState::forgetTexture(texture);
 	glDeleteVertexArrays(1, &skyboxVAO);
 	glDeleteShader(skyboxShader);
 	glDeleteTextures(1, &texture);
@@ -143,8 +172,11 @@ void Skybox::setSkyboxTexture(const GLuint newTexture) {
 	if (newTexture == 0)
 		return;
 
-	if (texture)
+	if (texture) {
+
+		GLState::forgetTexture(texture);
 		glDeleteTextures(1, &texture);
+	}
 
 	texture = newTexture;
 }
@@ -155,20 +187,15 @@ void Skybox::render(const glm::mat4& T) {
 	static GLint mvpLocation = glGetUniformLocation(skyboxShader, "modelViewProjectionMatrix");
 
 	glDepthMask(GL_FALSE);
-	glUseProgram(skyboxShader);
+	GLState::useProgram(skyboxShader);
 
 	glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(T));
 
 	// Draw skybox directly - no indexing used
-	glBindVertexArray(skyboxVAO);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	GLState::bindVertexArray(skyboxVAO);
+	GLState::bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
 
 	glDrawArrays(GL_TRIANGLES, 0, 36);
 
-	// Unbind VAO once drawing complete
-	glBindVertexArray(0);
-	glUseProgram(0);
 	glDepthMask(GL_TRUE);
 }
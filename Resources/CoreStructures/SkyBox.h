@@ -5,6 +5,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <string>
 
+#include "CubeMapBuilder.h"
+
 class ShaderLoader;
 class TextureLoader;
 
@@ -22,9 +24,15 @@ private:
 
 	GLuint					texture;
 
+	// loads the shader and the cube's vertex buffer
+	void createGeometry();
+
 public:
 
+	// six face images, <cubemapPath><cubemapName>_positive_x<cubemapExtension> and so on
 	Skybox(const std::string& cubemapPath, const std::string& cubemapName, const std::string& cubemapExtension);
+	// one image holding every face, as a cross or a panorama
+	Skybox(const std::string& cubemapFile, CubeMapLayout layout);
 	~Skybox();
 
 	GLuint skyboxTexture();
@@ -1,4 +1,5 @@
 #include "Sphere.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -135,7 +136,7 @@ Sphere::Sphere(int n, int m, float radius, const glm::vec4& vertexColour, const
 
 		// setup and bind VAO
 		glGenVertexArrays(1, &sphereVAO);
-		glBindVertexArray(sphereVAO);
+		GLState::bindVertexArray(sphereVAO);
 
 		// 1. setup VBO for vertex positions (bind to attribute location 0) type: vec4
 		glGenBuffers(1, &meshPositionVBO);
@@ -172,7 +173,7 @@ Sphere::Sphere(int n, int m, float radius, const glm::vec4& vertexColour, const
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * m * 2 * 3 * sizeof(unsigned int), indexArray, GL_STATIC_DRAW);
 
 		// unbind VAO
-		glBindVertexArray(0);
+		GLState::bindVertexArray(0);
 
 		// store number of actual vertices to render (equals number of faces/triangles * 3 vertices per triangle)
 		numElements = n * m * 2 * 3;
@@ -193,8 +194,6 @@ Sphere::~Sphere() = default;
 
 void Sphere::render() {
 
-	glBindVertexArray(sphereVAO);
+	GLState::bindVertexArray(sphereVAO);
 	glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, (const GLvoid*)0);
-
-	glBindVertexArray(0);
 }
@@ -1,4 +1,5 @@
 #include "TextRenderer.h"
+#include "GLState.h"
 
 
 void TextRenderer::setupVAO()
@@ -6,13 +7,13 @@ void TextRenderer::setupVAO()
 	// Configure VAO/VBO for texture quads
 	glGenVertexArrays(1, &this->VAO);
 	glGenBuffers(1, &this->VBO);
-	glBindVertexArray(this->VAO);
+	GLState::bindVertexArray(this->VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 void TextRenderer::loadFonts()
@@ -46,7 +47,7 @@ void TextRenderer::loadFonts()
 		// Generate texture
 
 		glGenTextures(1, &this->texture);
-		glBindTexture(GL_TEXTURE_2D, this->texture);
+		GLState::bindTexture(GL_TEXTURE_2D, this->texture);
 		glTexImage2D(
 			GL_TEXTURE_2D,
 			0,
@@ -72,7 +73,7 @@ void TextRenderer::loadFonts()
 		};
 		Characters.insert(std::pair<GLchar, Character>(c, character));
 	}
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
 	// Destroy FreeType once we're finished
 	FT_Done_Face(face);
 	FT_Done_FreeType(ft);
@@ -90,13 +91,11 @@ TextRenderer::TextRenderer(int Width, int Heigh)
 
 	glm::mat4 projection = glm::ortho(0.0f, static_cast<GLfloat>(Width), 0.0f, static_cast<GLfloat>(Heigh));
 
-	glUseProgram(this->textShader);
+	GLState::useProgram(this->textShader);
 	glUniformMatrix4fv(glGetUniformLocation(this->textShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
 	loadFonts();
 	setupVAO();
-
-	glUseProgram(0);
 }
 
 TextRenderer::~TextRenderer()
@@ -105,10 +104,9 @@ TextRenderer::~TextRenderer()
 
 void TextRenderer::renderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
 {
-	glUseProgram(this->textShader);
+	GLState::useProgram(this->textShader);
 	glUniform3f(glGetUniformLocation(this->textShader, "textColor"), color.x, color.y, color.z);
-	glActiveTexture(GL_TEXTURE0);
-	glBindVertexArray(this->VAO);
+	GLState::bindVertexArray(this->VAO);
 
 	// Iterate through all characters
 	std::string::const_iterator c;
@@ -132,7 +130,7 @@ void TextRenderer::renderText(std::string text, GLfloat x, GLfloat y, GLfloat sc
 			{ xpos + w, ypos + h,   1.0, 0.0 }
 		};
 		// Render glyph texture over quad
-		glBindTexture(GL_TEXTURE_2D, ch.TextureID);
+		GLState::bindTexture(0, GL_TEXTURE_2D, ch.TextureID);
 		// Update content of VBO memory
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // Be sure to use glBufferSubData and not glBufferData
@@ -143,6 +141,4 @@ void TextRenderer::renderText(std::string text, GLfloat x, GLfloat y, GLfloat sc
 		// Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
 		x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
 	}
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
@@ -0,0 +1,181 @@
+//  TextureAtlas.cpp
+
+#include "TextureAtlas.h"
+#include "MipBuilder.h"
+#include "TextureCooker.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+struct AtlasCell {
+	unsigned int	image;
+	int				x = 0;
+	int				y = 0;
+	int				width = 0;		// including the gutter
+	int				height = 0;
+	bool			solid = false;
+};
+
+
+//
+// Private functions
+//
+
+static int alignUp(int value, int alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// RGBA of pixel (x, y), clamped to the image
+static void readPixel(const DecodedImage& image, int x, int y, unsigned char rgba[4])
+{
+	x = min(max(x, 0), image.width - 1);
+	y = min(max(y, 0), image.height - 1);
+	const unsigned char *p = image.pixels + ((size_t)y * image.width + x) * image.channels;
+
+	switch (image.channels)
+	{
+	case 1:	rgba[0] = rgba[1] = rgba[2] = p[0]; rgba[3] = 255; break;
+	case 2:	rgba[0] = rgba[1] = rgba[2] = p[0]; rgba[3] = p[1]; break;
+	case 3:	rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = 255; break;
+	default: rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = p[3]; break;
+	}
+}
+
+// shelf packing in a size x size square: cells fill a row left to right, and a new shelf starts above the tallest
+// cell of the last one.  Cells must be sorted tallest first
+static bool packCells(vector<AtlasCell>& cells, int size)
+{
+	int x = 0, y = 0, shelfHeight = 0;
+
+	for (unsigned int i = 0; i < cells.size(); i++)
+	{
+		if (cells[i].width > size)
+			return false;
+
+		if (x + cells[i].width > size)
+		{
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+
+		if (y + cells[i].height > size)
+			return false;
+
+		cells[i].x = x;
+		cells[i].y = y;
+		x += cells[i].width;
+		shelfHeight = max(shelfHeight, cells[i].height);
+	}
+
+	return true;
+}
+
+
+//
+// TextureAtlas public method implementation
+//
+
+bool TextureAtlas::isSolid(const DecodedImage& image)
+{
+	if (!image.pixels)
+		return false;
+
+	size_t pixelSize = image.channels;
+	size_t count = (size_t)image.width * image.height;
+	for (size_t i = 1; i < count; i++)
+		if (memcmp(image.pixels, image.pixels + i * pixelSize, pixelSize) != 0)
+			return false;
+
+	return true;
+}
+
+bool TextureAtlas::build(const vector<const DecodedImage*>& images, int maxSize, AtlasImage& atlas)
+{
+	atlas = AtlasImage();
+
+	vector<AtlasCell> cells(images.size());
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		if (!images[i]->pixels)
+			return false;
+
+		cells[i].image = i;
+		cells[i].solid = isSolid(*images[i]);
+		cells[i].width = cells[i].solid ? CELL_ALIGNMENT : alignUp(images[i]->width + GUTTER * 2, CELL_ALIGNMENT);
+		cells[i].height = cells[i].solid ? CELL_ALIGNMENT : alignUp(images[i]->height + GUTTER * 2, CELL_ALIGNMENT);
+	}
+
+	sort(cells.begin(), cells.end(), [](const AtlasCell& a, const AtlasCell& b) {
+		return a.height != b.height ? a.height > b.height : a.image < b.image;
+	});
+
+	int size = CELL_ALIGNMENT;
+	while (!packCells(cells, size))
+	{
+		size *= 2;
+		if (size > maxSize)
+			return false;
+	}
+
+	// trim the unused rows above the last shelf
+	int usedHeight = 0;
+	for (unsigned int i = 0; i < cells.size(); i++)
+		usedHeight = max(usedHeight, cells[i].y + cells[i].height);
+
+	atlas.width = size;
+	atlas.height = max(usedHeight, CELL_ALIGNMENT);
+	atlas.pixels.assign((size_t)atlas.width * atlas.height * 4, 0);
+	atlas.transforms.resize(images.size());
+
+	for (unsigned int i = 0; i < cells.size(); i++)
+	{
+		const AtlasCell& cell = cells[i];
+		const DecodedImage& image = *images[cell.image];
+
+		// the image's edge pixels are repeated across the gutter (and a solid image fills its whole cell)
+		int left = cell.solid ? cell.x : cell.x + GUTTER;
+		int bottom = cell.solid ? cell.y : cell.y + GUTTER;
+
+		for (int y = 0; y < cell.height; y++)
+		{
+			for (int x = 0; x < cell.width; x++)
+			{
+				unsigned char *out = &atlas.pixels[(((size_t)cell.y + y) * atlas.width + cell.x + x) * 4];
+				readPixel(image, cell.x + x - left, cell.y + y - bottom, out);
+				if (out[3] != 255)
+					atlas.opaque = false;
+			}
+		}
+
+		if (cell.solid)
+			atlas.transforms[cell.image] = glm::vec4(0.0f, 0.0f, (cell.x + cell.width * 0.5f) / atlas.width, (cell.y + cell.height * 0.5f) / atlas.height);
+		else
+			atlas.transforms[cell.image] = glm::vec4((float)image.width / atlas.width, (float)image.height / atlas.height,
+				(float)left / atlas.width, (float)bottom / atlas.height);
+	}
+
+	return true;
+}
+
+void TextureAtlas::compress(const AtlasImage& atlas, CompressedImage& image)
+{
+	BlockFormat format = TextureCooker::chooseFormat(atlas.opaque ? 3 : 4, IMAGE_COLOUR);
+	BlockCompressor::compress(atlas.pixels.data(), atlas.width, atlas.height, 4, format, image);
+
+	// a box filter's footprint at level 2 is 4x4 texels of level 0, well inside the gutter, which is sized for sampling
+	// the last level
+	vector<MipLevel> mips;
+	MipBuilder::build(atlas.pixels.data(), atlas.width, atlas.height, 4, IMAGE_COLOUR, MIP_BOX, mips);
+
+	for (unsigned int i = 0; i + 1 < MAX_LEVELS && i < mips.size(); i++)
+		BlockCompressor::addLevel(mips[i].pixels.data(), mips[i].width, mips[i].height, 4, image);
+}
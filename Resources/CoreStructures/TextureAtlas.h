@@ -0,0 +1,52 @@
+//  TextureAtlas.h - Packs small textures into one, so meshes that used them draw with a single texture bind
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "TextureLoader.h"
+
+// An RGBA atlas and where each source image went in it
+struct AtlasImage {
+
+	int							width = 0;
+	int							height = 0;
+	std::vector<unsigned char>	pixels;			// RGBA, rows in the same order as the source images
+	bool						opaque = true;	// every source pixel had alpha 255
+
+	// texture coordinates for source image i become uv * xy + zw.  Solid colour images map every coordinate to the
+	// middle of their cell (xy = 0), so they work with any coordinates, including ones that repeat
+	std::vector<glm::vec4>		transforms;
+};
+
+// Each image gets a cell padded by a gutter of its own edge pixels, aligned so no compressed block straddles two cells
+// down to the last mip level the atlas keeps.  Images that are a single colour (eg. the CW2 character's material
+// swatches) shrink to one minimum sized cell.  Cells are placed with a shelf packer, tallest first, in the smallest
+// power of two square that fits them.
+//
+// Nothing here touches OpenGL, so atlases can be built on worker threads.
+class TextureAtlas {
+
+public:
+	static const int CELL_ALIGNMENT = 16;
+	// levels the atlas keeps, so mip filtering never reaches past the gutter into the next cell
+	static const int MAX_LEVELS = 3;
+	// the anisotropy atlases are sampled with, TextureGenProperties::defaultQuality()'s
+	static const int MAX_ANISOTROPY = 8;
+	// an anisotropic sample's taps reach up to half the anisotropy in texels of the level sampled either side of it,
+	// plus one for the bilinear filter.  The gutter holds that at the last level kept, which is 20 texels of level 0
+	static const int GUTTER = (MAX_ANISOTROPY / 2 + 1) << (MAX_LEVELS - 1);
+
+	// whether every pixel of the image is the same
+	static bool isSolid(const DecodedImage& image);
+
+	// false if the images won't fit in maxSize x maxSize
+	static bool build(const std::vector<const DecodedImage*>& images, int maxSize, AtlasImage& atlas);
+
+	// box filtered mips (up to MAX_LEVELS) and BC1 or BC3 compression, ready for TextureLoader::createTexture()
+	static void compress(const AtlasImage& atlas, CompressedImage& image);
+};
+
+#endif
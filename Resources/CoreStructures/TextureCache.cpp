@@ -0,0 +1,321 @@
+//  TextureCache.cpp
+
+#include "TextureCache.h"
+#include "GLState.h"
+#include "Mesh.h"
+#include "TextureCooker.h"
+
+#include <cctype>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+
+//
+// Private data
+//
+
+struct CacheEntry {
+	GLuint			texture;
+	unsigned int	references;
+	size_t			bytes;
+};
+
+struct CacheRegistry {
+	std::mutex								mutex;
+	std::unordered_map<std::string, CacheEntry>	entries;
+	std::unordered_map<GLuint, std::string>	keysByTexture;
+	TextureCacheStats						stats;
+};
+
+// Created on first use and never destroyed, so models released during static destruction can still find it
+static CacheRegistry& registry()
+{
+	static CacheRegistry *cache = new CacheRegistry();
+	return *cache;
+}
+
+// properties suffix for textures made by loadTexture(path)
+static const char DEFAULT_PROPERTIES[] = "|default";
+// and for block compressed textures, followed by the image content
+static const char COMPRESSED_PROPERTIES[] = "|compressed";
+
+
+//
+// Private functions
+//
+
+static std::string propertiesKey(const TextureGenProperties& properties)
+{
+	std::ostringstream key;
+	key << "|" << properties.internalFormat << "," << properties.minFilter << "," << properties.maxFilter << ","
+		<< properties.anisotropicLevel << "," << properties.wrap_s << "," << properties.wrap_t << "," << properties.genMipMaps;
+	return key.str();
+}
+
+static std::string compressedKey(const std::string& path, ImageContent content)
+{
+	return TextureCache::canonicalPath(path) + COMPRESSED_PROPERTIES + (char)('0' + content);
+}
+
+static size_t imageBytes(const DecodedImage& image, bool mipmapped)
+{
+	size_t bytes = (size_t)image.width * image.height * image.channels;
+	return mipmapped ? bytes + bytes / 3 : bytes;
+}
+
+// looks up a key, adding a reference on a hit.  Returns 0 on a miss
+static GLuint findEntry(const std::string& key)
+{
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+
+	std::unordered_map<std::string, CacheEntry>::iterator found = cache.entries.find(key);
+	if (found == cache.entries.end())
+	{
+		cache.stats.misses++;
+		return 0;
+	}
+
+	found->second.references++;
+	cache.stats.hits++;
+	return found->second.texture;
+}
+
+static void addEntry(const std::string& key, GLuint texture, size_t bytes)
+{
+	if (texture == 0)
+		return;
+
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+
+	CacheEntry entry;
+	entry.texture = texture;
+	entry.references = 1;
+	entry.bytes = bytes;
+	cache.entries[key] = entry;
+	cache.keysByTexture[texture] = key;
+
+	cache.stats.residentTextures++;
+	cache.stats.residentBytes += bytes;
+}
+
+// loads a texture as TextureLoader::loadTexture(path) and adds it to the cache
+static GLuint loadEntry(const std::string& path, const std::string& key)
+{
+	DecodedImage image;
+	if (!TextureLoader::decodeImage(path, true, image))
+		return 0;
+
+	GLuint texture = TextureLoader::createTexture(image);
+	addEntry(key, texture, imageBytes(image, TextureGenProperties::defaultQuality().genMipMaps));
+	return texture;
+}
+
+
+//
+// TextureCache public method implementation
+//
+
+GLuint TextureCache::acquire(const std::string& path)
+{
+	std::string key = canonicalPath(path) + DEFAULT_PROPERTIES;
+
+	GLuint texture = findEntry(key);
+	if (texture != 0)
+		return texture;
+
+	return loadEntry(path, key);
+}
+
+GLuint TextureCache::acquire(const std::string& path, const TextureGenProperties& properties)
+{
+	std::string key = canonicalPath(path) + propertiesKey(properties);
+
+	GLuint texture = findEntry(key);
+	if (texture != 0)
+		return texture;
+
+	DecodedImage image;
+	if (!TextureLoader::decodeImage(path, false, image))
+		return 0;
+
+	texture = TextureLoader::createTexture(image, properties);
+	addEntry(key, texture, imageBytes(image, properties.genMipMaps));
+	return texture;
+}
+
+GLuint TextureCache::acquire(const std::string& path, const DecodedImage& image)
+{
+	std::string key = canonicalPath(path) + DEFAULT_PROPERTIES;
+
+	GLuint texture = findEntry(key);
+	if (texture != 0)
+		return texture;
+
+	// the image wasn't decoded because the texture was cached, but it has been released since
+	if (!image.pixels)
+		return loadEntry(path, key);
+
+	texture = TextureLoader::createTexture(image);
+	addEntry(key, texture, imageBytes(image, TextureGenProperties::defaultQuality().genMipMaps));
+	return texture;
+}
+
+GLuint TextureCache::acquire(const std::string& path, const CompressedImage& image, ImageContent content)
+{
+	std::string key = compressedKey(path, content);
+
+	GLuint texture = findEntry(key);
+	if (texture != 0)
+		return texture;
+
+	// released since the image was skipped, as for decoded images
+	if (image.blocks.empty())
+	{
+		CompressedImage loaded;
+		if (!TextureCooker::load(path, true, content, loaded))
+			return 0;
+
+		texture = TextureLoader::createTexture(loaded, content);
+		addEntry(key, texture, loaded.blocks.size());
+		return texture;
+	}
+
+	texture = TextureLoader::createTexture(image, content);
+	addEntry(key, texture, image.blocks.size());
+	return texture;
+}
+
+GLuint TextureCache::acquire(const std::string& path, const CompressedImage& image, ImageContent content, UploadManager& uploads,
+	std::shared_ptr<const void> owner, UploadManager::Ticket& ticket)
+{
+	if (image.blocks.empty())
+		return acquire(path, image, content);
+
+	std::string key = compressedKey(path, content);
+
+	GLuint texture = findEntry(key);
+	if (texture != 0)
+		return texture;
+
+	texture = TextureLoader::createTexture(image, content, uploads, std::move(owner), ticket);
+	addEntry(key, texture, image.blocks.size());
+	return texture;
+}
+
+void TextureCache::addReference(GLuint texture)
+{
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+
+	std::unordered_map<GLuint, std::string>::iterator key = cache.keysByTexture.find(texture);
+	if (key != cache.keysByTexture.end())
+		cache.entries[key->second].references++;
+}
+
+void TextureCache::release(GLuint texture)
+{
+	if (texture == 0)
+		return;
+
+	{
+		CacheRegistry& cache = registry();
+		std::lock_guard<std::mutex> lock(cache.mutex);
+
+		std::unordered_map<GLuint, std::string>::iterator key = cache.keysByTexture.find(texture);
+		if (key == cache.keysByTexture.end())
+			return;
+
+		std::unordered_map<std::string, CacheEntry>::iterator entry = cache.entries.find(key->second);
+		if (--entry->second.references > 0)
+			return;
+
+		cache.stats.residentTextures--;
+		cache.stats.residentBytes -= entry->second.bytes;
+		cache.stats.evictions++;
+		cache.entries.erase(entry);
+		cache.keysByTexture.erase(key);
+	}
+
+	// last reference gone - delete it outside the lock
+	GLState::forgetTexture(texture);
+	Mesh::forgetTexture(texture);
+	glDeleteTextures(1, &texture);
+}
+
+bool TextureCache::contains(const std::string& path)
+{
+	std::string key = canonicalPath(path) + DEFAULT_PROPERTIES;
+
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.entries.find(key) != cache.entries.end();
+}
+
+bool TextureCache::containsCompressed(const std::string& path, ImageContent content)
+{
+	std::string key = compressedKey(path, content);
+
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.entries.find(key) != cache.entries.end();
+}
+
+std::string TextureCache::canonicalPath(const std::string& path)
+{
+	// split into components, dropping "." and resolving ".." against the previous component where there is one
+	std::vector<std::string> parts;
+	std::string part;
+	bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+
+	for (size_t i = 0; i <= path.size(); i++)
+	{
+		if (i < path.size() && path[i] != '/' && path[i] != '\\')
+		{
+			part += (char)tolower((unsigned char)path[i]);
+			continue;
+		}
+
+		if (part == "..")
+		{
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (!absolute)
+				parts.push_back(part);
+		}
+		else if (!part.empty() && part != ".")
+			parts.push_back(part);
+
+		part.clear();
+	}
+
+	std::string canonical = absolute ? "\\" : "";
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		if (i > 0)
+			canonical += '\\';
+		canonical += parts[i];
+	}
+
+	return canonical;
+}
+
+TextureCacheStats TextureCache::stats()
+{
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.stats;
+}
+
+void TextureCache::resetCounters()
+{
+	CacheRegistry& cache = registry();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+
+	cache.stats.hits = 0;
+	cache.stats.misses = 0;
+	cache.stats.evictions = 0;
+}
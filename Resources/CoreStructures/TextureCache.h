@@ -0,0 +1,95 @@
+//  TextureCache.h - Reference counted textures shared by everything that loads the same image
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <memory>
+#include <string>
+
+#include "TextureLoader.h"
+
+// Lookups since the last resetCounters(), and what is resident now.  Bytes are the decoded size of each image (plus
+// a third for mipmaps), or the block size of a compressed one, which is what the driver has to hold for it
+struct TextureCacheStats {
+	unsigned int	hits = 0;
+	unsigned int	misses = 0;
+	unsigned int	evictions = 0;
+	unsigned int	residentTextures = 0;
+	size_t			residentBytes = 0;
+};
+
+// Every texture loaded by path goes through here, so two models using the same Wood.jpg share one texture.  Entries
+// are keyed by the canonical path and the properties the texture was created with, so the same image loaded with
+// different settings gets a texture for each.  acquire() adds a reference and release() drops one; a texture is
+// deleted as soon as nothing references it.
+//
+// acquire() and release() make OpenGL calls so belong on the GL thread.  contains() and stats() can be called from any
+// thread, eg. so a worker can skip decoding an image that is already resident.
+class TextureCache {
+
+public:
+	// TextureLoader::loadTexture(path), or the cached texture if the image is already loaded.  Returns 0 if the image
+	// can't be loaded
+	static GLuint acquire(const std::string& path);
+	static GLuint acquire(const std::string& path, const TextureGenProperties& properties);
+
+	// as acquire(path), but on a miss the texture is created from an image decoded elsewhere (eg. on a worker thread)
+	static GLuint acquire(const std::string& path, const DecodedImage& image);
+
+	// the block compressed texture for an image, created from one loaded elsewhere with TextureCooker::load().  Cached
+	// separately from the uncompressed texture of the same image
+	static GLuint acquire(const std::string& path, const CompressedImage& image, ImageContent content);
+	// and on a miss, copied in through uploads as TextureLoader::createTexture(image, content, uploads, owner, ticket).
+	// ticket is left alone on a hit, or if the image had to be reloaded and was created immediately
+	static GLuint acquire(const std::string& path, const CompressedImage& image, ImageContent content, UploadManager& uploads,
+		std::shared_ptr<const void> owner, UploadManager::Ticket& ticket);
+
+	// adds a reference to a texture already in the cache
+	static void addReference(GLuint texture);
+
+	// drops a reference, deleting the texture if it was the last one.  Textures not from the cache are ignored
+	static void release(GLuint texture);
+
+	// whether acquire(path) would be a hit
+	static bool contains(const std::string& path);
+	// and acquire(path, compressedImage, content)
+	static bool containsCompressed(const std::string& path, ImageContent content);
+
+	// the form paths are compared in: separators unified, "." and ".." resolved and case folded, as on Windows
+	static std::string canonicalPath(const std::string& path);
+
+	static TextureCacheStats stats();
+	static void resetCounters();
+};
+
+// One reference to a cached texture, dropped when the holder is destroyed.  Can be moved but not copied
+class CachedTexture {
+
+public:
+	CachedTexture() : texture(0) {}
+	// takes over a reference already acquired from the cache
+	explicit CachedTexture(GLuint texture) : texture(texture) {}
+	~CachedTexture() { TextureCache::release(texture); }
+
+	CachedTexture(const CachedTexture&) = delete;
+	CachedTexture& operator=(const CachedTexture&) = delete;
+
+	CachedTexture(CachedTexture&& other) noexcept : texture(other.texture) { other.texture = 0; }
+	CachedTexture& operator=(CachedTexture&& other) noexcept
+	{
+		if (this != &other)
+		{
+			TextureCache::release(texture);
+			texture = other.texture;
+			other.texture = 0;
+		}
+		return *this;
+	}
+
+	GLuint id() const { return texture; }
+
+private:
+	GLuint texture;
+};
+
+#endif
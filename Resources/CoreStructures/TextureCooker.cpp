@@ -0,0 +1,249 @@
+//  TextureCooker.cpp
+
+#include "TextureCooker.h"
+#include "FileInfo.h"
+#include "TextureLoader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+// DDS_HEADER and DDS_PIXELFORMAT from the DirectX documentation, preceded in the file by "DDS "
+struct DDSPixelFormat {
+	unsigned int	size;
+	unsigned int	flags;
+	unsigned int	fourCC;
+	unsigned int	rgbBitCount;
+	unsigned int	bitMasks[4];
+};
+
+struct DDSHeader {
+	unsigned int	size;
+	unsigned int	flags;
+	unsigned int	height;
+	unsigned int	width;
+	unsigned int	pitchOrLinearSize;
+	unsigned int	depth;
+	unsigned int	mipMapCount;
+	unsigned int	reserved1[11];
+	DDSPixelFormat	pixelFormat;
+	unsigned int	caps;
+	unsigned int	caps2;
+	unsigned int	caps3;
+	unsigned int	caps4;
+	unsigned int	reserved2;
+};
+
+static const char DDS_MAGIC[4] = { 'D', 'D', 'S', ' ' };
+
+static const unsigned int DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+static const unsigned int DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+static const unsigned int DDPF_FOURCC = 0x4;
+static const unsigned int DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+// the reserved1 words used to key the cache.  Bump the version when the compressor's output changes
+static const unsigned int COOKER_TAG = 0x58544B43;		// "CKTX"
+static const unsigned int COOKER_VERSION = 2;
+
+// mips are always Kaiser filtered - cooking is done once, so the better filter is worth its cost
+static const MipFilter COOKED_MIP_FILTER = MIP_KAISER;
+
+enum CookerWords { WORD_TAG, WORD_VERSION, WORD_SETTINGS, WORD_SIZE_LOW, WORD_SIZE_HIGH, WORD_TIME_LOW, WORD_TIME_HIGH };
+
+
+//
+// Private functions
+//
+
+static unsigned int makeFourCC(char a, char b, char c, char d)
+{
+	return (unsigned int)(unsigned char)a | ((unsigned int)(unsigned char)b << 8) | ((unsigned int)(unsigned char)c << 16) | ((unsigned int)(unsigned char)d << 24);
+}
+
+static unsigned int formatFourCC(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_BC1:	return makeFourCC('D', 'X', 'T', '1');
+	case BLOCK_BC3:	return makeFourCC('D', 'X', 'T', '5');
+	default:		return makeFourCC('A', 'T', 'I', '2');
+	}
+}
+
+// flip (1 bit) | content (2 bits) | mip filter (1 bit)
+static unsigned int cookSettings(bool flipVertically, ImageContent content)
+{
+	return (flipVertically ? 1 : 0) | ((unsigned int)content << 1) | ((unsigned int)COOKED_MIP_FILTER << 3);
+}
+
+
+//
+// TextureCooker public method implementation
+//
+
+BlockFormat TextureCooker::chooseFormat(int channels, ImageContent content)
+{
+	if (content == IMAGE_NORMAL_MAP)
+		return BLOCK_BC5;
+
+	return (channels == 2 || channels == 4) ? BLOCK_BC3 : BLOCK_BC1;
+}
+
+string TextureCooker::cachePath(const string& imagePath)
+{
+	return imagePath + ".dds";
+}
+
+bool TextureCooker::load(const string& imagePath, bool flipVertically, ImageContent content, CompressedImage& image)
+{
+	if (read(imagePath, flipVertically, content, image))
+		return true;
+
+	return cook(imagePath, flipVertically, content, image);
+}
+
+bool TextureCooker::cook(const string& imagePath, bool flipVertically, ImageContent content, CompressedImage& image)
+{
+	image = CompressedImage();
+
+	DecodedImage decoded;
+	if (!TextureLoader::decodeImage(imagePath, flipVertically, decoded))
+		return false;
+
+	BlockCompressor::compress(decoded.pixels, decoded.width, decoded.height, decoded.channels,
+		chooseFormat(decoded.channels, content), image);
+
+	vector<MipLevel> mips;
+	MipBuilder::build(decoded.pixels, decoded.width, decoded.height, decoded.channels, content, COOKED_MIP_FILTER, mips);
+	for (unsigned int i = 0; i < mips.size(); i++)
+		BlockCompressor::addLevel(mips[i].pixels.data(), mips[i].width, mips[i].height, decoded.channels, image);
+
+	write(imagePath, flipVertically, content, image);
+	return true;
+}
+
+bool TextureCooker::read(const string& imagePath, bool flipVertically, ImageContent content, CompressedImage& image)
+{
+	return read(imagePath, imagePath, flipVertically, content, image);
+}
+
+bool TextureCooker::write(const string& imagePath, bool flipVertically, ImageContent content, const CompressedImage& image)
+{
+	return write(imagePath, imagePath, flipVertically, content, image);
+}
+
+bool TextureCooker::read(const string& imagePath, const string& sourcePath, bool flipVertically, ImageContent content,
+	CompressedImage& image)
+{
+	image = CompressedImage();
+
+	unsigned long long sourceSize, sourceTime;
+	if (!fileInfo(sourcePath, sourceSize, sourceTime))
+		return false;
+
+	ifstream in(cachePath(imagePath), ios::binary);
+	if (!in)
+		return false;
+
+	char magic[4];
+	DDSHeader header;
+	if (!in.read(magic, sizeof(magic)) || !in.read((char*)&header, sizeof(header)))
+		return false;
+
+	if (memcmp(magic, DDS_MAGIC, sizeof(DDS_MAGIC)) != 0 || header.size != sizeof(DDSHeader) ||
+		header.reserved1[WORD_TAG] != COOKER_TAG || header.reserved1[WORD_VERSION] != COOKER_VERSION ||
+		header.reserved1[WORD_SETTINGS] != cookSettings(flipVertically, content) ||
+		header.reserved1[WORD_SIZE_LOW] != (unsigned int)sourceSize || header.reserved1[WORD_SIZE_HIGH] != (unsigned int)(sourceSize >> 32) ||
+		header.reserved1[WORD_TIME_LOW] != (unsigned int)sourceTime || header.reserved1[WORD_TIME_HIGH] != (unsigned int)(sourceTime >> 32))
+		return false;
+
+	BlockFormat formats[3] = { BLOCK_BC1, BLOCK_BC3, BLOCK_BC5 };
+	int format = 0;
+	while (format < 3 && formatFourCC(formats[format]) != header.pixelFormat.fourCC)
+		format++;
+
+	if (format == 3 || header.width == 0 || header.height == 0 || header.width > 16384 || header.height > 16384)
+		return false;
+
+	image.width = header.width;
+	image.height = header.height;
+	image.format = formats[format];
+	image.levels = (header.flags & DDSD_MIPMAPCOUNT) ? header.mipMapCount : 1;
+
+	if (image.levels < 1 || image.levels > MipBuilder::levelCount(image.width, image.height) ||
+		header.pitchOrLinearSize != image.levelSize(0))
+	{
+		image = CompressedImage();
+		return false;
+	}
+
+	size_t size = image.levelOffset(image.levels);
+	image.blocks.resize(size);
+
+	if (!in.read((char*)image.blocks.data(), size))
+	{
+		image = CompressedImage();
+		return false;
+	}
+
+	return true;
+}
+
+bool TextureCooker::write(const string& imagePath, const string& sourcePath, bool flipVertically, ImageContent content,
+	const CompressedImage& image)
+{
+	unsigned long long sourceSize, sourceTime;
+	if (image.blocks.empty() || !fileInfo(sourcePath, sourceSize, sourceTime))
+		return false;
+
+	DDSHeader header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = image.height;
+	header.width = image.width;
+	header.pitchOrLinearSize = (unsigned int)image.levelSize(0);
+	header.mipMapCount = image.levels;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = formatFourCC(image.format);
+	header.caps = DDSCAPS_TEXTURE | (image.levels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	header.reserved1[WORD_TAG] = COOKER_TAG;
+	header.reserved1[WORD_VERSION] = COOKER_VERSION;
+	header.reserved1[WORD_SETTINGS] = cookSettings(flipVertically, content);
+	header.reserved1[WORD_SIZE_LOW] = (unsigned int)sourceSize;
+	header.reserved1[WORD_SIZE_HIGH] = (unsigned int)(sourceSize >> 32);
+	header.reserved1[WORD_TIME_LOW] = (unsigned int)sourceTime;
+	header.reserved1[WORD_TIME_HIGH] = (unsigned int)(sourceTime >> 32);
+
+	string path = cachePath(imagePath);
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	// the magic stays zeroed until everything else has been written
+	static const char noMagic[4] = {};
+	out.write(noMagic, sizeof(noMagic));
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)image.blocks.data(), image.blocks.size());
+
+	out.seekp(0);
+	out.write(DDS_MAGIC, sizeof(DDS_MAGIC));
+	out.close();
+
+	if (!out)
+	{
+		remove(path.c_str());
+		return false;
+	}
+
+	return true;
+}
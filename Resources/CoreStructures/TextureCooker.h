@@ -0,0 +1,43 @@
+//  TextureCooker.h - Block compressed copies of texture images, cached as DDS files beside the images
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <string>
+
+#include "BlockCompressor.h"
+#include "MipBuilder.h"
+
+// Cooking an image decodes it, builds its full mip chain with MipBuilder (Kaiser filtered), compresses every level with
+// BlockCompressor and writes <image>.dds (DXT1, DXT5 or ATI2), which any DDS viewer can open.  The file's reserved
+// header words record the source image's size and modification time and the settings it was cooked with, so a changed
+// image or different settings cook it again.
+//
+// Nothing here touches OpenGL, so images can be cooked on worker threads or ahead of time by a tool.
+class TextureCooker {
+
+public:
+	// BC5 for normal maps, BC3 for images with alpha and BC1 for everything else
+	static BlockFormat chooseFormat(int channels, ImageContent content);
+
+	static std::string cachePath(const std::string& imagePath);
+
+	// reads the cached image, cooking it first if there isn't an up to date one.  False if the image can't be decoded
+	static bool load(const std::string& imagePath, bool flipVertically, ImageContent content, CompressedImage& image);
+
+	// decodes and compresses the image and writes the cache file, whether or not it's up to date.  A cache file that
+	// can't be written isn't an error, the image is just cooked again next time
+	static bool cook(const std::string& imagePath, bool flipVertically, ImageContent content, CompressedImage& image);
+
+	// false if there is no cache file or it's older than the image or was cooked with other settings
+	static bool read(const std::string& imagePath, bool flipVertically, ImageContent content, CompressedImage& image);
+	static bool write(const std::string& imagePath, bool flipVertically, ImageContent content, const CompressedImage& image);
+
+	// the same for an image built from another file rather than decoded, eg. a model's TextureAtlas.  The cache is
+	// <imagePath>.dds, keyed by sourcePath's size and modification time
+	static bool read(const std::string& imagePath, const std::string& sourcePath, bool flipVertically, ImageContent content,
+		CompressedImage& image);
+	static bool write(const std::string& imagePath, const std::string& sourcePath, bool flipVertically, ImageContent content,
+		const CompressedImage& image);
+};
+
+#endif
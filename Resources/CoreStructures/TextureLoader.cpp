@@ -1,93 +1,749 @@
 #include "TextureLoader.h"
+#include "GLState.h"
+#include "HalfFloat.h"
+#include "TextureCooker.h"
+#include "ThreadPool.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 
-GLuint TextureLoader::loadTexture(const std::string& textureFilePath)
+DecodedImage::~DecodedImage()
 {
-	GLuint				newTexture = 0;
-	unsigned char		*buffer;
-	int t_width, t_height, t_nrChannels;
+	if (pixels)
+		stbi_image_free(pixels);
+}
+
+DecodedImage::DecodedImage(DecodedImage&& other) noexcept
+	: width(other.width), height(other.height), channels(other.channels), pixels(other.pixels), mips(std::move(other.mips))
+{
+	other.pixels = nullptr;
+}
+
+DecodedImage& DecodedImage::operator=(DecodedImage&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (pixels)
+			stbi_image_free(pixels);
+
+		width = other.width;
+		height = other.height;
+		channels = other.channels;
+		pixels = other.pixels;
+		mips = std::move(other.mips);
+		other.pixels = nullptr;
+	}
+	return *this;
+}
 
-	stbi_set_flip_vertically_on_load(true);
-	buffer = stbi_load(textureFilePath.c_str(), &t_width, &t_height, &t_nrChannels, 0);
+
+// The upload format for stb_image's channel counts.  Grey images are swizzled so they sample as grey rather than red
+static GLenum pixelFormat(int channels)
+{
+	switch (channels)
+	{
+	case 1:		return GL_RED;
+	case 2:		return GL_RG;
+	case 3:		return GL_RGB;
+	default:	return GL_RGBA;
+	}
+}
+
+static bool isSRGBFormat(GLint internalFormat)
+{
+	return internalFormat == GL_SRGB || internalFormat == GL_SRGB8 || internalFormat == GL_SRGB_ALPHA || internalFormat == GL_SRGB8_ALPHA8;
+}
+
+// Grey and alpha images go in as GL_RG, but an sRGB texture would decode the alpha in green as if it were colour, so
+// they're expanded to RGBA instead (and need no swizzle)
+static bool expandsToRGBA(int channels, GLint internalFormat)
+{
+	return channels == 2 && isSRGBFormat(internalFormat);
+}
+
+static void setGreySwizzle(GLenum target, int channels, GLint internalFormat)
+{
+	if (channels == 1 || (channels == 2 && !expandsToRGBA(channels, internalFormat)))
+	{
+		GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+		glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+}
+
+static bool isMipmapFilter(GLint filter)
+{
+	return filter == GL_NEAREST_MIPMAP_NEAREST || filter == GL_LINEAR_MIPMAP_NEAREST ||
+		filter == GL_NEAREST_MIPMAP_LINEAR || filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+// the internal format for a decoded image.  Only colour is sRGB, so the sampler hands the shader linear values
+static GLint decodedFormat(int channels, ImageContent content)
+{
+	bool alpha = channels == 2 || channels == 4;
+	if (content == IMAGE_COLOUR)
+		return alpha ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+	return alpha ? GL_RGBA8 : GL_RGB8;
+}
+
+static GLenum halfFloatFormat(int channels)
+{
+	switch (channels)
+	{
+	case 1:		return GL_R16F;
+	case 2:		return GL_RG16F;
+	case 3:		return GL_RGB16F;
+	default:	return GL_RGBA16F;
+	}
+}
+
+// BC5 holds two channels of data so is never sRGB
+static GLenum compressedFormat(BlockFormat format, bool sRGB)
+{
+	switch (format)
+	{
+	case BLOCK_BC1:	return sRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BLOCK_BC3:	return sRGB ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	default:		return GL_COMPRESSED_RG_RGTC2;
+	}
+}
+
+// RGTC (BC5) is core in OpenGL 3.0, but S3TC (BC1 and BC3) is still an extension, and its sRGB formats another
+static bool hasCompressedFormat(BlockFormat format, bool sRGB)
+{
+	return format == BLOCK_BC5 || (GLAD_GL_EXT_texture_compression_s3tc && (!sRGB || GLAD_GL_EXT_texture_sRGB));
+}
+
+static void flipRows(unsigned char *pixels, size_t rowSize, int height)
+{
+	std::vector<unsigned char> row(rowSize);
+
+	for (int top = 0, bottom = height - 1; top < bottom; top++, bottom--)
+	{
+		unsigned char *topRow = pixels + top * rowSize;
+		unsigned char *bottomRow = pixels + bottom * rowSize;
+		memcpy(row.data(), topRow, rowSize);
+		memcpy(topRow, bottomRow, rowSize);
+		memcpy(bottomRow, row.data(), rowSize);
+	}
+}
+
+// filtering, wrapping and the number of levels for the bound texture
+static void setTextureProperties(GLenum target, const TextureGenProperties& textureProperties, int levels)
+{
+	// Verify we don't use a mipmap filter, which has no meaning in non-mipmapped textures.  If set, fall back to GL_LINEAR (bi-linear) filtering.
+	GLint minFilter = (levels <= 1 && isMipmapFilter(textureProperties.minFilter)) ? GL_LINEAR : textureProperties.minFilter;
+	GLint maxFilter = isMipmapFilter(textureProperties.maxFilter) ? GL_LINEAR : textureProperties.maxFilter;
+
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, maxFilter);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, textureProperties.wrap_s);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, textureProperties.wrap_t);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+	if (textureProperties.anisotropicLevel > 0.0f && GLAD_GL_EXT_texture_filter_anisotropic)
+	{
+		GLfloat maxAnisotropy = 1.0f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(textureProperties.anisotropicLevel, maxAnisotropy));
+	}
+}
+
+// uploads an image and its mips (if any) into the bound texture
+static void uploadLevels(const DecodedImage& image, const std::vector<MipLevel>& mips, GLint internalFormat)
+{
+	GLenum format = pixelFormat(image.channels);
+
+	// rows of 1, 2 and 3 channel images (and small mips of any) aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (expandsToRGBA(image.channels, internalFormat))
+	{
+		std::vector<unsigned char> rgba((size_t)image.width * image.height * 4);
+		CubeMapBuilder::toRGBA(image.pixels, image.width, image.height, image.channels, rgba.data());
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+		for (unsigned int i = 0; i < mips.size(); i++)
+		{
+			CubeMapBuilder::toRGBA(mips[i].pixels.data(), mips[i].width, mips[i].height, image.channels, rgba.data());
+			glTexImage2D(GL_TEXTURE_2D, i + 1, internalFormat, mips[i].width, mips[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+		}
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+		for (unsigned int i = 0; i < mips.size(); i++)
+			glTexImage2D(GL_TEXTURE_2D, i + 1, internalFormat, mips[i].width, mips[i].height, 0, format, GL_UNSIGNED_BYTE, mips[i].pixels.data());
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+
+bool TextureLoader::decodeImage(const std::string& textureFilePath, bool flipVertically, DecodedImage& image)
+{
+	image = DecodedImage();
+	image.pixels = stbi_load(textureFilePath.c_str(), &image.width, &image.height, &image.channels, 0);
 
 	//Check if texture was loaded correctly
-	if(!buffer)
+	if (!image.pixels)
 	{
 		std::size_t found = textureFilePath.find_last_of("/\\");
 		std::cout << "Failed the load the texture: " << textureFilePath.substr(found + 1) << std::endl;
-		return 0;
+		return false;
 	}
 
+	if (flipVertically)
+		flipRows(image.pixels, (size_t)image.width * image.channels, image.height);
+
+	return true;
+}
+
+
+void TextureLoader::buildMipmaps(DecodedImage& image, ImageContent content)
+{
+	MipBuilder::build(image.pixels, image.width, image.height, image.channels, content, TextureGenProperties::defaultQuality().mipFilter, image.mips);
+}
+
+
+GLuint TextureLoader::createTexture(const DecodedImage& image, ImageContent content)
+{
+	GLuint				newTexture = 0;
+
+	if (!image.pixels)
+		return 0;
+
+	TextureGenProperties textureProperties = TextureGenProperties::defaultQuality();
+	GLint internalFormat = decodedFormat(image.channels, content);
+
+	// mips built here if they weren't built off the GL thread
+	std::vector<MipLevel> builtMips;
+	if (textureProperties.genMipMaps && image.mips.empty())
+		MipBuilder::build(image.pixels, image.width, image.height, image.channels, content, textureProperties.mipFilter, builtMips);
+	const std::vector<MipLevel>& mips = image.mips.empty() ? builtMips : image.mips;
+
 	glGenTextures(1, &newTexture);
-	glBindTexture(GL_TEXTURE_2D, newTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, newTexture);
 
 	if (newTexture) {
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		setTextureProperties(GL_TEXTURE_2D, textureProperties, (int)mips.size() + 1);
+		setGreySwizzle(GL_TEXTURE_2D, image.channels, internalFormat);
 	}
 
-	if(t_nrChannels > 3)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t_width, t_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
-	else
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, t_width, t_height, 0, GL_RGB, GL_UNSIGNED_BYTE, buffer);
+	uploadLevels(image, mips, internalFormat);
 
 	// Setup default texture properties
-	glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(buffer);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
 	return newTexture;
 }
 
 
+// Every batch, from every thread, shares these workers, so AssetLoader's model imports decoding at the same time
+// can't start more threads than the machine has.  The workers live as long as the process
+static ThreadPool& decodePool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+// Runs job(0) to job(count - 1), on up to numThreads threads (0 = one per hardware thread) and returns how many
+// failed.  The calling thread takes jobs too, so a batch finishes even while the pool is busy with other batches.
+// numThreads is set to the number of threads used
+static unsigned int runBatch(unsigned int count, unsigned int& numThreads, const std::function<bool(unsigned int)>& job)
+{
+	ThreadPool& pool = decodePool();
+
+	if (numThreads == 0)
+		numThreads = pool.size() + 1;
+	numThreads = std::max(std::min(std::min(numThreads, pool.size() + 1), count), 1u);
+
+	// helpers still queued once the batch is done find no jobs left, and only touch the shared state
+	struct Batch {
+		const std::function<bool(unsigned int)>	*job;
+		unsigned int							count;
+		std::atomic<unsigned int>				next;
+		std::atomic<unsigned int>				failed;
+		std::mutex								mutex;
+		std::condition_variable					finished;
+		unsigned int							done;
+	};
+
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->job = &job;
+	batch->count = count;
+	batch->next = 0;
+	batch->failed = 0;
+	batch->done = 0;
+
+	auto work = [batch]() {
+
+		for (unsigned int i = batch->next++; i < batch->count; i = batch->next++)
+		{
+			bool succeeded = false;
+			try { succeeded = (*batch->job)(i); }
+			catch (...) {}
+
+			if (!succeeded)
+				batch->failed++;
+
+			std::lock_guard<std::mutex> lock(batch->mutex);
+			if (++batch->done == batch->count)
+				batch->finished.notify_all();
+		}
+	};
+
+	for (unsigned int i = 1; i < numThreads; i++)
+		pool.submit(work);
+
+	work();
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->finished.wait(lock, [&batch]() { return batch->done == batch->count; });
+
+	return batch->failed;
+}
+
+
+bool TextureLoader::decodeImages(const std::vector<std::string>& paths, bool flipVertically, std::vector<DecodedImage>& images,
+	unsigned int numThreads, TextureBatchStats *stats)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start = Clock::now();
+
+	images.clear();
+	images.resize(paths.size());
+
+	unsigned int failed = runBatch((unsigned int)paths.size(), numThreads,
+		[&](unsigned int i) { return decodeImage(paths[i], flipVertically, images[i]); });
+
+	if (stats)
+	{
+		*stats = TextureBatchStats();
+		stats->images = (unsigned int)paths.size();
+		stats->failed = failed;
+		stats->threads = numThreads;
+		for (unsigned int i = 0; i < images.size(); i++)
+			stats->decodedBytes += (size_t)images[i].width * images[i].height * images[i].channels;
+		stats->decodeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	return failed == 0;
+}
+
+
+bool TextureLoader::loadCompressedImages(const std::vector<std::string>& paths, bool flipVertically, const std::vector<ImageContent>& contents,
+	std::vector<CompressedImage>& images, unsigned int numThreads, TextureBatchStats *stats)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start = Clock::now();
+
+	images.clear();
+	images.resize(paths.size());
+
+	unsigned int failed = runBatch((unsigned int)paths.size(), numThreads,
+		[&](unsigned int i) { return TextureCooker::load(paths[i], flipVertically, i < contents.size() ? contents[i] : IMAGE_COLOUR, images[i]); });
+
+	if (stats)
+	{
+		*stats = TextureBatchStats();
+		stats->images = (unsigned int)paths.size();
+		stats->failed = failed;
+		stats->threads = numThreads;
+		for (unsigned int i = 0; i < images.size(); i++)
+			stats->decodedBytes += images[i].blocks.size();
+		stats->decodeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	return failed == 0;
+}
+
+
+GLuint TextureLoader::createTexture(const CompressedImage& image, ImageContent content)
+{
+	GLuint				newTexture = 0;
+
+	if (image.blocks.empty())
+		return 0;
+
+	bool sRGB = content == IMAGE_COLOUR;
+
+	glGenTextures(1, &newTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, newTexture);
+
+	if (newTexture)
+		setTextureProperties(GL_TEXTURE_2D, TextureGenProperties::defaultQuality(), image.levels);
+
+	if (!hasCompressedFormat(image.format, sRGB))
+	{
+		std::vector<unsigned char> rgba;
+		for (int level = 0; level < image.levels; level++)
+		{
+			BlockCompressor::decompress(image, rgba, level);
+			glTexImage2D(GL_TEXTURE_2D, level, sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8, image.levelWidth(level), image.levelHeight(level), 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+		}
+	}
+	else
+	{
+		GLenum format = compressedFormat(image.format, sRGB);
+		for (int level = 0; level < image.levels; level++)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, image.levelWidth(level), image.levelHeight(level), 0,
+				(GLsizei)image.levelSize(level), image.blocks.data() + image.levelOffset(level));
+	}
+
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	return newTexture;
+}
+
+
+GLuint TextureLoader::createTexture(const CompressedImage& image, ImageContent content, UploadManager& uploads,
+	std::shared_ptr<const void> owner, UploadManager::Ticket& ticket)
+{
+	GLuint				newTexture = 0;
+
+	if (image.blocks.empty())
+		return 0;
+
+	bool sRGB = content == IMAGE_COLOUR;
+
+	glGenTextures(1, &newTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, newTexture);
+
+	if (newTexture)
+		setTextureProperties(GL_TEXTURE_2D, TextureGenProperties::defaultQuality(), image.levels);
+
+	if (!hasCompressedFormat(image.format, sRGB))
+	{
+		// decompressed here, with each level's pixels owned by its own upload
+		for (int level = 0; level < image.levels; level++)
+		{
+			std::shared_ptr<std::vector<unsigned char>> rgba = std::make_shared<std::vector<unsigned char>>();
+			BlockCompressor::decompress(image, *rgba, level);
+			glTexImage2D(GL_TEXTURE_2D, level, sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8, image.levelWidth(level), image.levelHeight(level), 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			ticket = uploads.uploadTexture(newTexture, level, image.levelWidth(level), image.levelHeight(level), GL_RGBA, GL_UNSIGNED_BYTE,
+				rgba->data(), rgba);
+		}
+	}
+	else
+	{
+		// glCompressedTexImage2D with no data just allocates the level
+		GLenum format = compressedFormat(image.format, sRGB);
+		for (int level = 0; level < image.levels; level++)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, image.levelWidth(level), image.levelHeight(level), 0,
+				(GLsizei)image.levelSize(level), nullptr);
+			ticket = uploads.uploadCompressedTexture(newTexture, level, image.levelWidth(level), image.levelHeight(level), format,
+				(GLsizei)image.levelSize(level), image.blocks.data() + image.levelOffset(level), owner);
+		}
+	}
+
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	return newTexture;
+}
+
+
+std::vector<GLuint> TextureLoader::loadTextures(const std::vector<std::string>& paths, TextureBatchStats *stats)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::vector<DecodedImage> images;
+	decodeImages(paths, true, images, 0, stats);
+
+	// mipmaps are built on the workers too, timed with the decoding
+	Clock::time_point mipStart = Clock::now();
+	unsigned int numThreads = 0;
+	runBatch((unsigned int)images.size(), numThreads, [&](unsigned int i) { buildMipmaps(images[i]); return true; });
+
+	if (stats)
+		stats->decodeMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - mipStart).count();
+
+	// OpenGL calls stay on this thread.  Each image is freed as soon as it's uploaded
+	Clock::time_point start = Clock::now();
+
+	std::vector<GLuint> textures(paths.size());
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		textures[i] = createTexture(images[i]);
+		images[i] = DecodedImage();
+	}
+
+	if (stats)
+		stats->uploadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	return textures;
+}
+
+
+GLuint TextureLoader::loadTexture(const std::string& textureFilePath)
+{
+	DecodedImage image;
+	if (!decodeImage(textureFilePath, true, image))
+		return 0;
+
+	return createTexture(image);
+}
+
+
 GLuint TextureLoader::loadTexture(const std::string& textureFilePath, const TextureGenProperties& textureProperties)
+{
+	DecodedImage		image;
+
+	if (!decodeImage(textureFilePath, false, image))
+		return 0;
+
+	return createTexture(image, textureProperties);
+}
+
+
+GLuint TextureLoader::createTexture(const DecodedImage& image, const TextureGenProperties& textureProperties)
 {
 	GLuint				newTexture = 0;
-	unsigned char		*buffer;
-	int t_width, t_height, t_nrChannels;
 
-	stbi_set_flip_vertically_on_load(false);
-	buffer = stbi_load(textureFilePath.c_str(), &t_width, &t_height, &t_nrChannels, 0);
+	if (!image.pixels)
+		return 0;
 
-	//Check if texture was loaded correctly
-	if (!buffer)
+	// mips are filtered in linear light for sRGB textures, which is what the GPU will do when sampling them
+	std::vector<MipLevel> mips;
+	if (textureProperties.genMipMaps)
+		MipBuilder::build(image.pixels, image.width, image.height, image.channels,
+			isSRGBFormat(textureProperties.internalFormat) ? IMAGE_COLOUR : IMAGE_DATA, textureProperties.mipFilter, mips);
+
+	glGenTextures(1, &newTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, newTexture);
+	uploadLevels(image, mips, textureProperties.internalFormat);
+
+	// Setup default texture properties
+	if (newTexture) {
+
+		setTextureProperties(GL_TEXTURE_2D, textureProperties, (int)mips.size() + 1);
+		setGreySwizzle(GL_TEXTURE_2D, image.channels, textureProperties.internalFormat);
+	}
+	return newTexture;
+}
+
+
+bool TextureLoader::decodeHDRImage(const std::string& textureFilePath, bool flipVertically, HDRImage& image, bool genMipMaps)
+{
+	image = HDRImage();
+
+	int width, height, channels;
+	float *pixels = stbi_loadf(textureFilePath.c_str(), &width, &height, &channels, 0);
+
+	if (!pixels)
 	{
 		std::size_t found = textureFilePath.find_last_of("/\\");
 		std::cout << "Failed the load the texture: " << textureFilePath.substr(found + 1) << std::endl;
-		return 0;
+		return false;
 	}
 
-	glGenTextures(1, &newTexture);
-	glBindTexture(GL_TEXTURE_2D, newTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, textureProperties.internalFormat, t_width, t_height, 0, GL_RGB, GL_UNSIGNED_BYTE, buffer);
+	if (flipVertically)
+		flipRows((unsigned char*)pixels, (size_t)width * channels * sizeof(float), height);
 
+	std::vector<FloatMipLevel> mips;
+	if (genMipMaps)
+		MipBuilder::build(pixels, width, height, channels, TextureGenProperties::defaultQuality().mipFilter, mips);
+
+	image.channels = channels;
+	image.levels.resize(mips.size() + 1);
+	for (unsigned int level = 0; level < image.levels.size(); level++)
+	{
+		HDRImage::Level& out = image.levels[level];
+		out.width = level == 0 ? width : mips[level - 1].width;
+		out.height = level == 0 ? height : mips[level - 1].height;
+		out.pixels.resize((size_t)out.width * out.height * channels);
+		HalfFloat::fromFloat(level == 0 ? pixels : mips[level - 1].pixels.data(), out.pixels.data(), out.pixels.size());
+	}
+
+	stbi_image_free(pixels);
+	return true;
+}
+
+
+GLuint TextureLoader::createTexture(const HDRImage& image)
+{
+	GLuint				newTexture = 0;
+
+	if (image.levels.empty())
+		return 0;
+
+	GLenum internalFormat = halfFloatFormat(image.channels);
+	GLenum format = pixelFormat(image.channels);
+
+	glGenTextures(1, &newTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, newTexture);
 
-	// Setup default texture properties
 	if (newTexture) {
 
-		// Verify we don't use GL_LINEAR_MIPMAP_LINEAR which has no meaning in non-mipmapped textures.  If not set, default to GL_LINEAR (bi-linear) filtering.
-		GLint minFilter = (!textureProperties.genMipMaps && textureProperties.minFilter == GL_LINEAR_MIPMAP_LINEAR) ? GL_LINEAR : textureProperties.minFilter;
-		GLint maxFilter = (!textureProperties.genMipMaps && textureProperties.maxFilter == GL_LINEAR_MIPMAP_LINEAR) ? GL_LINEAR : textureProperties.maxFilter;
+		setTextureProperties(GL_TEXTURE_2D, TextureGenProperties::defaultQuality(), (int)image.levels.size());
+		setGreySwizzle(GL_TEXTURE_2D, image.channels, internalFormat);
+	}
+
+	// rows of one or three halves per pixel are only 2 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	for (unsigned int level = 0; level < image.levels.size(); level++)
+		glTexImage2D(GL_TEXTURE_2D, level, internalFormat, image.levels[level].width, image.levels[level].height, 0, format, GL_HALF_FLOAT,
+			image.levels[level].pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, maxFilter);
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, textureProperties.anisotropicLevel);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, textureProperties.wrap_s);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, textureProperties.wrap_t);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	return newTexture;
+}
 
-		if (textureProperties.genMipMaps) {
-			glGenerateMipmap(GL_TEXTURE_2D);
+
+GLuint TextureLoader::loadHDRTexture(const std::string& textureFilePath)
+{
+	HDRImage image;
+	if (!decodeHDRImage(textureFilePath, true, image))
+		return 0;
+
+	return createTexture(image);
+}
+
+
+
+static const std::string cubeFaceName[6] = {
+
+	std::string("_positive_x"),
+	std::string("_negative_x"),
+	std::string("_positive_y"),
+	std::string("_negative_y"),
+	std::string("_positive_z"),
+	std::string("_negative_z")
+};
+
+
+bool TextureLoader::decodeCubeMap(const std::string& directory, const std::string& file_prefix, const std::string& file_extension,
+	CubeMapImage& image)
+{
+	image = CubeMapImage();
+
+	std::vector<std::string> paths(6);
+	for (int i = 0; i < 6; i++)
+		paths[i] = directory + file_prefix + cubeFaceName[i] + file_extension;
+
+	// each face is freed as soon as it's been copied out, so only the RGBA copies outlive the call
+	std::vector<DecodedImage> faces;
+	if (!decodeImages(paths, false, faces, 6))
+		return false;
+
+	image.size = faces[0].width;
+	for (int i = 0; i < 6; i++)
+		if (faces[i].width != image.size || faces[i].height != image.size)
+		{
+			std::cout << "Cube map faces must be square and the same size: " << paths[i] << std::endl;
+			image = CubeMapImage();
+			return false;
 		}
+
+	unsigned int numThreads = 6;
+	runBatch(6, numThreads, [&](unsigned int i) {
+
+		image.faces[i].resize((size_t)image.size * image.size * 4);
+		CubeMapBuilder::toRGBA(faces[i].pixels, image.size, image.size, faces[i].channels, image.faces[i].data());
+		faces[i] = DecodedImage();
+		return true;
+	});
+
+	return true;
+}
+
+
+bool TextureLoader::decodeCubeMap(const std::string& path, CubeMapLayout layout, CubeMapImage& image, int faceSize)
+{
+	image = CubeMapImage();
+
+	DecodedImage source;
+	if (!decodeImage(path, false, source))
+		return false;
+
+	if (layout == CUBE_CROSS)
+		faceSize = CubeMapBuilder::crossFaceSize(source.width, source.height);
+	else if (faceSize <= 0)
+		faceSize = source.width / 4;
+
+	if (faceSize <= 0)
+	{
+		std::cout << "Not a cube map cross: " << path << std::endl;
+		return false;
 	}
-	stbi_image_free(buffer);
-	return newTexture;
+
+	std::vector<unsigned char> rgba((size_t)source.width * source.height * 4);
+	CubeMapBuilder::toRGBA(source.pixels, source.width, source.height, source.channels, rgba.data());
+	int width = source.width, height = source.height;
+	source = DecodedImage();
+
+	image.size = faceSize;
+	unsigned int numThreads = 6;
+	runBatch(6, numThreads, [&](unsigned int i) {
+
+		if (layout == CUBE_CROSS)
+			CubeMapBuilder::fromCross(rgba.data(), width, height, i, image.faces[i]);
+		else
+			CubeMapBuilder::fromEquirectangular(rgba.data(), width, height, i, faceSize, image.faces[i]);
+		return true;
+	});
+
+	return true;
+}
+
+
+void TextureLoader::buildMipmaps(CubeMapImage& image, ImageContent content)
+{
+	unsigned int numThreads = 6;
+	runBatch(6, numThreads, [&](unsigned int i) {
+
+		MipBuilder::build(image.faces[i].data(), image.size, image.size, 4, content, TextureGenProperties::defaultQuality().mipFilter, image.mips[i]);
+		return true;
+	});
 }
 
 
+GLuint TextureLoader::createCubeMapTexture(const CubeMapImage& image, GLenum format, GLint minFilter, GLint maxFilter,
+	const GLfloat anisotropicLevel, const GLint wrap_s, const GLint wrap_t, const GLint wrap_r)
+{
+	GLuint		newTexture = 0;
+
+	if (image.size == 0)
+		return 0;
+
+	glGenTextures(1, &newTexture);
+	GLState::bindTexture(GL_TEXTURE_CUBE_MAP, newTexture);
+
+	// every face has the same number of levels
+	int levels = (int)image.mips[0].size() + 1;
+	setTextureProperties(GL_TEXTURE_CUBE_MAP, TextureGenProperties(format, minFilter, maxFilter, anisotropicLevel, wrap_s, wrap_t, levels > 1), levels);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, wrap_r);
+
+	// small mips of any size aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (int i = 0; i < 6; i++)
+	{
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, image.size, image.size, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.faces[i].data());
+		for (unsigned int level = 0; level < image.mips[i].size(); level++)
+		{
+			const MipLevel& mip = image.mips[i][level];
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level + 1, format, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return newTexture;
+}
+
 
 GLuint TextureLoader::loadCubeMapTexture(
 	const std::string& directory,
@@ -102,69 +758,37 @@ GLuint TextureLoader::loadCubeMapTexture(
 	const GLint wrap_r,
 	const bool genMipMaps) {
 
-	GLuint		newTexture = 0;
-	GLuint		w = 0;
-	GLuint		h = 0;
-	BYTE		*buffer;
-
-	// 1. Setup texture names in array (makes following setup loop easier to implement)
-	static const std::string cubeFaceName[6] = {
-
-		std::string("_positive_x"),
-		std::string("_negative_x"),
-		std::string("_positive_y"),
-		std::string("_negative_y"),
-		std::string("_positive_z"),
-		std::string("_negative_z")
-	};
-
-	// 2. Generate cubemap texture
-	glGenTextures(1, &newTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, newTexture);
+	CubeMapImage		image;
 
-	// 3. Verify we don't use GL_LINEAR_MIPMAP_LINEAR which has no meaning in non-mipmapped textures.  If not set, default to GL_LINEAR (bi-linear) filtering
-	minFilter = (!genMipMaps && minFilter == GL_LINEAR_MIPMAP_LINEAR) ? GL_LINEAR : minFilter;
-	maxFilter = (!genMipMaps && maxFilter == GL_LINEAR_MIPMAP_LINEAR) ? GL_LINEAR : maxFilter;
+	if (!decodeCubeMap(directory, file_prefix, file_extension, image))
+		return 0;
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, minFilter);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, maxFilter);
-	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropicLevel);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, wrap_s);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, wrap_t);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, wrap_r);
+	if (genMipMaps)
+		buildMipmaps(image, isSRGBFormat(format) ? IMAGE_COLOUR : IMAGE_DATA);
 
+	return createCubeMapTexture(image, format, minFilter, maxFilter, anisotropicLevel, wrap_s, wrap_t, wrap_r);
+}
 
-	// 4. Load bitmap images and setup each one in turn
-	for (int i = 0; i < 6; i++) {
 
-		// Generate filename
-		std::string filename = directory;
+GLuint TextureLoader::loadCubeMapTexture(
+	const std::string& path,
+	CubeMapLayout layout,
+	GLenum format,
+	GLint minFilter,
+	GLint maxFilter,
+	const GLfloat anisotropicLevel,
+	const GLint wrap_s,
+	const GLint wrap_t,
+	const GLint wrap_r,
+	const bool genMipMaps) {
 
-		filename.append(file_prefix);
-		filename.append(cubeFaceName[i]);
-		filename.append(file_extension);
+	CubeMapImage		image;
 
-		int t_width, t_height, t_nrChannels;
+	if (!decodeCubeMap(path, layout, image))
+		return 0;
 
-		buffer = stbi_load(filename.c_str(), &t_width, &t_height, &t_nrChannels, 0);
-		//Check if texture was loaded correctly
-		if (!buffer)
-		{
-			std::size_t found = filename.find_last_of("/\\");
-			std::cout << "Failed the load the texture: " << filename.substr(found + 1) << std::endl;
-			return 0;
-		}
-		if (genMipMaps)
-		{
-			// Setup Mip-Mapped cubemap texture if required
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, t_width, t_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
-		else
-			// Setup single cubemap texture image
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, t_width, t_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+	if (genMipMaps)
+		buildMipmaps(image, isSRGBFormat(format) ? IMAGE_COLOUR : IMAGE_DATA);
 
-	}
-	stbi_image_free(buffer);
-	return newTexture;
+	return createCubeMapTexture(image, format, minFilter, maxFilter, anisotropicLevel, wrap_s, wrap_t, wrap_r);
 }
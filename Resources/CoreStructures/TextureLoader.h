@@ -3,7 +3,14 @@
 #define TEXTURE_LOADER_H
 
 #include <glad/glad.h>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "CubeMapBuilder.h"
+#include "MipBuilder.h"
+#include "UploadManager.h"
 
 
 // Structure to define properties for new textures
@@ -16,6 +23,7 @@ struct TextureGenProperties {
 	GLint		wrap_s = GL_REPEAT;
 	GLint		wrap_t = GL_REPEAT;
 	bool		genMipMaps = FALSE;
+	MipFilter	mipFilter = MIP_KAISER;		// how genMipMaps builds the chain (on the CPU, see MipBuilder)
 
 	TextureGenProperties(GLint _format) {
 
@@ -31,16 +39,131 @@ struct TextureGenProperties {
 		wrap_t(_wt),
 		genMipMaps(_genmm) {}
 
+	// The quality every texture loaded without properties gets (loadTexture(path), models and the texture cache):
+	// trilinear filtering over a CPU built mip chain, with 8x anisotropic filtering where the driver supports it.  Without
+	// mipmaps, distant textures sample texels far apart and thrash the GPU's texture cache.  Colour is stored as sRGB,
+	// so it's sampled in linear light; data and normal maps get the linear equivalent of whatever format they're in
+	static TextureGenProperties defaultQuality() {
+
+		return TextureGenProperties(GL_SRGB8_ALPHA8, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, 8.0f, GL_REPEAT, GL_REPEAT, true);
+	}
+};
+
+// Pixels decoded by stb_image, not yet uploaded to OpenGL.  Owns the pixel buffer, so it can be moved but not copied
+struct DecodedImage {
+
+	int				width = 0;
+	int				height = 0;
+	int				channels = 0;
+	unsigned char	*pixels = nullptr;
+
+	// levels 1 and down, once built by TextureLoader::buildMipmaps().  Textures created from an image without them
+	// build them as they're created
+	std::vector<MipLevel>	mips;
+
+	DecodedImage() {}
+	~DecodedImage();
+
+	DecodedImage(const DecodedImage&) = delete;
+	DecodedImage& operator=(const DecodedImage&) = delete;
+	DecodedImage(DecodedImage&& other) noexcept;
+	DecodedImage& operator=(DecodedImage&& other) noexcept;
+};
+
+// A high dynamic range image decoded with stbi_loadf() (a Radiance .hdr, or any other image stb_image reads, converted
+// to linear light) and converted to half floats for a GL_R16F .. GL_RGBA16F texture.  levels[0] is the image itself,
+// followed by its mips if they were built
+struct HDRImage {
+
+	struct Level {
+		int							width = 0;
+		int							height = 0;
+		std::vector<unsigned short>	pixels;		// width * height * channels halves
+	};
+
+	int					channels = 0;
+	std::vector<Level>	levels;
+};
+
+// Timings of a batch of textures loaded by decodeImages() or loadTextures()
+struct TextureBatchStats {
+
+	unsigned int	images = 0;
+	unsigned int	failed = 0;
+	unsigned int	threads = 0;
+	size_t			decodedBytes = 0;
+	double			decodeMilliseconds = 0.0;	// wall clock time for the whole batch to decode (or cook)
+	double			uploadMilliseconds = 0.0;	// time spent creating the textures (loadTextures only)
 };
 
 class TextureLoader {
 
 public:
-	// FreeImage-based image loader
+	// Decodes an image without touching OpenGL, so it can be called from any thread.  Images are flipped here rather
+	// than with stbi_set_flip_vertically_on_load, as that setting is shared by every thread
+	static bool decodeImage(const std::string& textureFilePath, bool flipVertically, DecodedImage& image);
+
+	// builds the image's mip chain as TextureGenProperties::defaultQuality() would, so it can be done off the GL thread
+	static void buildMipmaps(DecodedImage& image, ImageContent content = IMAGE_COLOUR);
+
+	// creates a texture from a decoded image with the same settings as loadTexture(textureFilePath).  Colour is uploaded
+	// as GL_SRGB8 or GL_SRGB8_ALPHA8, anything else as plain RGB or RGBA
+	static GLuint createTexture(const DecodedImage& image, ImageContent content = IMAGE_COLOUR);
+	// and with the same settings as loadTexture(textureFilePath, textureProperties)
+	static GLuint createTexture(const DecodedImage& image, const TextureGenProperties& textureProperties);
+
+	// Decodes a batch of images concurrently, on the calling thread and the decode threads every batch shares, up to
+	// numThreads at once (0 = one per hardware thread).  images[i] is left empty if paths[i] fails to decode.  Returns false if any image failed.  Like decodeImage()
+	// this can be called from any thread
+	static bool decodeImages(const std::vector<std::string>& paths, bool flipVertically, std::vector<DecodedImage>& images,
+		unsigned int numThreads = 0, TextureBatchStats *stats = nullptr);
+
+	// creates a texture from a block compressed image, and its mip levels, with the same settings as
+	// createTexture(image, content).  Colour gets the sRGB S3TC formats.  Where the driver has no S3TC support (or no sRGB
+	// S3TC for colour) BC1 and BC3 images are decompressed and uploaded as RGBA
+	static GLuint createTexture(const CompressedImage& image, ImageContent content);
+	// as createTexture(image, content), but only the storage is created here: the levels are queued on uploads, which
+	// copies them in over the next frames.  owner keeps image alive until then.  ticket is set to the last level's upload
+	static GLuint createTexture(const CompressedImage& image, ImageContent content, UploadManager& uploads,
+		std::shared_ptr<const void> owner, UploadManager::Ticket& ticket);
+
+	// Decodes an HDR image as decodeImage() does, converting it to half floats (and building its mips, filtered in
+	// floating point, first) off the GL thread
+	static bool decodeHDRImage(const std::string& textureFilePath, bool flipVertically, HDRImage& image, bool genMipMaps = true);
+	// creates a GL_HALF_FLOAT texture from one, filtered as TextureGenProperties::defaultQuality()
+	static GLuint createTexture(const HDRImage& image);
+	static GLuint loadHDRTexture(const std::string& textureFilePath);
+
+	// TextureCooker::load() for a batch of images concurrently, as decodeImages().  contents[i] is what paths[i] holds.
+	// images[i] is left empty if paths[i] fails to decode
+	static bool loadCompressedImages(const std::vector<std::string>& paths, bool flipVertically, const std::vector<ImageContent>& contents,
+		std::vector<CompressedImage>& images, unsigned int numThreads = 0, TextureBatchStats *stats = nullptr);
+
+	// batched loadTexture(textureFilePath): decodes every image and builds its mipmaps concurrently, then creates the
+	// textures on the calling (GL) thread.  textures[i] is 0 if paths[i] failed to load
+	static std::vector<GLuint> loadTextures(const std::vector<std::string>& paths, TextureBatchStats *stats = nullptr);
+
+	// FreeImage-based image loader.  The first uses TextureGenProperties::defaultQuality(), treating the image as colour
 	static GLuint loadTexture(const std::string& textureFilePath);
 	static GLuint loadTexture(const std::string& textureFilePath, const TextureGenProperties& textureProperties);
 
-	// loadCubeMapTexture creates and returns a cubemap texture in OpenGL.  This uses the WIC library.  Six images are loaded - the path to each of the six images is determined by <directory><file_prefix><face><extension>.  The 'directory' parameter represents the path to the containing folder of the texture files in the form "C:\...\Textures\" for example.  The 'file_prefix' parameter represents the first part of the texture filename.  The <face> part of the filename is created within loadCubeMapTexture.  This is of the form "_positive_x" and "_negative_x" for example.  The extension parameter is of the form ".bmp" for example.  All image filenames must be of the same type and follow the same structure.  For example, given the texture files "snow_positive_x.bmp" and "snow_negative_x.bmp", 'file_prefix' would be "snow" and 'extension' would be ".bmp"
+	// Decodes the six faces of a cube map concurrently, without touching OpenGL.  The path to each face is
+	// <directory><file_prefix><face><extension>, where <face> is "_positive_x", "_negative_x" and so on.  The faces must
+	// be square and the same size
+	static bool decodeCubeMap(const std::string& directory, const std::string& file_prefix, const std::string& file_extension,
+		CubeMapImage& image);
+	// and a cube map stored in one image, its faces cut out or resampled concurrently.  faceSize is only used for a
+	// panorama, 0 picking a quarter of its width
+	static bool decodeCubeMap(const std::string& path, CubeMapLayout layout, CubeMapImage& image, int faceSize = 0);
+
+	// builds the mip chain of each face concurrently
+	static void buildMipmaps(CubeMapImage& image, ImageContent content = IMAGE_COLOUR);
+
+	// creates a cube map texture from decoded faces, with their mips if buildMipmaps() has been called
+	static GLuint createCubeMapTexture(const CubeMapImage& image, GLenum format, GLint minFilter, GLint maxFilter,
+		const GLfloat anisotropicLevel, const GLint wrap_s, const GLint wrap_t, const GLint wrap_r);
+
+	// loadCubeMapTexture creates and returns a cubemap texture in OpenGL, decoding the faces as decodeCubeMap().  The 'directory' parameter represents the path to the containing folder of the texture files in the form "C:\...\Textures\" for example.  The 'file_prefix' parameter represents the first part of the texture filename.  The extension parameter is of the form ".bmp" for example.  All image filenames must be of the same type and follow the same structure.  For example, given the texture files "snow_positive_x.bmp" and "snow_negative_x.bmp", 'file_prefix' would be "snow" and 'extension' would be ".bmp".  With genMipMaps the faces' mips are built on the CPU, filtered in linear light for an sRGB format
 
 	static GLuint loadCubeMapTexture(
 		const std::string& directory,
@@ -54,6 +177,19 @@ public:
 		const GLint wrap_t,
 		const GLint wrap_r,
 		const bool genMipMaps);
+
+	// the same for a cube map stored in one cross or panorama image
+	static GLuint loadCubeMapTexture(
+		const std::string& path,
+		CubeMapLayout layout,
+		GLenum format,
+		GLint minFilter,
+		GLint maxFilter,
+		const GLfloat anisotropicLevel,
+		const GLint wrap_s,
+		const GLint wrap_t,
+		const GLint wrap_r,
+		const bool genMipMaps);
 };
 
 #endif
\ No newline at end of file
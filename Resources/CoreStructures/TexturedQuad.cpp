@@ -1,6 +1,7 @@
 #include "TexturedQuad.h"
 #include "ShaderLoader.h"
 #include "TextureLoader.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -47,7 +48,7 @@ void TexturedQuad::setupVAO(bool invertV) {
 
 	// setup VAO for textured quad object
 	glGenVertexArrays(1, &quadVertexArrayObj);
-	glBindVertexArray(quadVertexArrayObj);
+	GLState::bindVertexArray(quadVertexArrayObj);
 
 
 	// setup vbo for position attribute
@@ -78,7 +79,7 @@ void TexturedQuad::setupVAO(bool invertV) {
 	glEnableVertexAttribArray(2);
 
 	// unbind textured quad VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 
@@ -115,7 +116,7 @@ TexturedQuad::TexturedQuad(const string& texturePath, const TextureGenProperties
 TexturedQuad::~TexturedQuad() {
 
 	// unbind textured quad VAO
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	// unbind VBOs
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -124,6 +125,8 @@ TexturedQuad::~TexturedQuad() {
 	glDeleteBuffers(1, &quadVertexBuffer);
 	glDeleteBuffers(1, &quadTextureCoordBuffer);
 
+	GLState::forgetVertexArray(quadVertexArrayObj);
+	GLState::forgetProgram(quadShader);
 	glDeleteVertexArrays(1, &quadVertexArrayObj);
 
 	glDeleteShader(quadShader);
@@ -134,20 +137,15 @@ void TexturedQuad::render(const glm::mat4& T) {
 
 	static GLint mvpLocation = glGetUniformLocation(quadShader, "mvpMatrix");
 
-	glUseProgram(quadShader);
+	GLState::useProgram(quadShader);
 	glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(T));
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	GLState::bindTexture(0, GL_TEXTURE_2D, texture);
 
-	glBindVertexArray(quadVertexArrayObj);
+	GLState::bindVertexArray(quadVertexArrayObj);
 
 	// draw quad directly - no indexing needed
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-	// unbind VAO for textured quad
-	glBindVertexArray(0);
-	glUseProgram(0);
 }
 
 
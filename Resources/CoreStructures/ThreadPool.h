@@ -0,0 +1,54 @@
+//  ThreadPool.h - Fixed set of worker threads running queued jobs
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs run in the order they are submitted, on whichever worker is free.  Jobs must not make OpenGL calls, as the
+// context is only current on the main thread.
+//
+// The destructor runs every job still queued before joining the workers.
+class ThreadPool {
+
+public:
+	// 0 uses one thread per hardware thread, less one for the main thread
+	explicit ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// queues a job and returns a future for its result.  Exceptions thrown by the job are rethrown by future::get()
+	template <typename Job>
+	auto submit(Job job) -> std::future<decltype(job())>
+	{
+		typedef decltype(job()) Result;
+
+		// std::function has to be copyable, so the task lives on the heap
+		std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+		std::future<Result> result = task->get_future();
+		enqueue([task]() { (*task)(); });
+		return result;
+	}
+
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+private:
+	std::vector<std::thread>			workers;
+	std::deque<std::function<void()>>	jobs;
+	std::mutex							mutex;
+	std::condition_variable				wake;
+	bool								stopping;
+
+	void enqueue(std::function<void()> job);
+	void work();
+};
+
+#endif
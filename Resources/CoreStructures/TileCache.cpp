@@ -0,0 +1,271 @@
+//  TileCache.cpp
+
+#include "TileCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+//
+// Private functions
+//
+
+static bool byTile(const TileRequest& a, const TileRequest& b)
+{
+	return a.tile < b.tile;
+}
+
+// coarsest first, so the fallbacks arrive before the detail
+static bool byPriority(const TileRequest& a, const TileRequest& b)
+{
+	if (tileLevel(a.tile) != tileLevel(b.tile))
+		return tileLevel(a.tile) > tileLevel(b.tile);
+	if (a.pixels != b.pixels)
+		return a.pixels > b.pixels;
+	return a.tile < b.tile;
+}
+
+
+//
+// TileFeedback public method implementation
+//
+
+int TileFeedback::mipLevel(const VirtualTextureInfo& info, glm::vec2 dUVdx, glm::vec2 dUVdy, float lodBias)
+{
+	glm::vec2 size((float)info.width, (float)info.height);
+	glm::vec2 dx = dUVdx * size;
+	glm::vec2 dy = dUVdy * size;
+
+	float lod = 0.5f * log2(max(max(glm::dot(dx, dx), glm::dot(dy, dy)), 1e-8f)) + lodBias;
+	return min(max((int)floor(lod), 0), info.levels - 1);
+}
+
+unsigned int TileFeedback::tileAt(const VirtualTextureInfo& info, glm::vec2 uv, int level)
+{
+	int tilesX = info.tilesX(level);
+	int tilesY = info.tilesY(level);
+
+	int x = min(max((int)(uv.x * tilesX), 0), tilesX - 1);
+	int y = min(max((int)(uv.y * tilesY), 0), tilesY - 1);
+	return tileKey(level, x, y);
+}
+
+void TileFeedback::encode(unsigned int tile, unsigned char rgba[4])
+{
+	int x = tileX(tile), y = tileY(tile);
+
+	rgba[0] = (unsigned char)(x & 255);
+	rgba[1] = (unsigned char)(y & 255);
+	rgba[2] = (unsigned char)(((x >> 8) & 15) | (((y >> 8) & 15) << 4));
+	rgba[3] = (unsigned char)(tileLevel(tile) + 1);
+}
+
+void TileFeedback::analyse(const VirtualTextureInfo& info, const unsigned char *rgba, size_t pixelCount)
+{
+	keys.clear();
+	requested.clear();
+
+	for (size_t i = 0; i < pixelCount; i++, rgba += 4)
+	{
+		if (rgba[3] == 0)
+			continue;
+
+		int level = rgba[3] - 1;
+		int x = rgba[0] | ((rgba[2] & 15) << 8);
+		int y = rgba[1] | ((rgba[2] >> 4) << 8);
+
+		// anything that doesn't decode to a tile of this texture is ignored rather than trusted
+		if (level < info.levels && x < info.tilesX(level) && y < info.tilesY(level))
+			keys.push_back(tileKey(level, x, y));
+	}
+
+	sort(keys.begin(), keys.end());
+
+	for (size_t i = 0; i < keys.size(); )
+	{
+		size_t run = i + 1;
+		while (run < keys.size() && keys[run] == keys[i])
+			run++;
+
+		TileRequest request = { keys[i], (unsigned int)(run - i) };
+		requested.push_back(request);
+		i = run;
+	}
+
+	// each tile's ancestors get its pixels too, then the duplicates are merged
+	size_t leaves = requested.size();
+	for (size_t i = 0; i < leaves; i++)
+	{
+		int x = tileX(requested[i].tile), y = tileY(requested[i].tile);
+		for (int level = tileLevel(requested[i].tile) + 1; level < info.levels; level++)
+		{
+			x /= 2;
+			y /= 2;
+			TileRequest ancestor = { tileKey(level, x, y), requested[i].pixels };
+			requested.push_back(ancestor);
+		}
+	}
+
+	sort(requested.begin(), requested.end(), byTile);
+
+	size_t merged = 0;
+	for (size_t i = 0; i < requested.size(); i++)
+	{
+		if (merged > 0 && requested[merged - 1].tile == requested[i].tile)
+			requested[merged - 1].pixels += requested[i].pixels;
+		else
+			requested[merged++] = requested[i];
+	}
+	requested.resize(merged);
+
+	sort(requested.begin(), requested.end(), byPriority);
+}
+
+
+//
+// TileCache public method implementation
+//
+
+TileCache::TileCache(const VirtualTextureInfo& info, int slotsX, int slotsY)
+	: info(info), slotsX(min(slotsX, 256)), slotsY(min(slotsY, 256)), frame(1), pageTableChanged(true)
+{
+	slots.resize(this->slotsX * this->slotsY);
+	for (unsigned int i = 0; i < slots.size(); i++)
+		slots[i].position = lru.insert(lru.end(), i);
+
+	size_t offset = 0;
+	for (int level = 0; level < info.levels; level++)
+	{
+		levelOffsets.push_back(offset);
+		offset += (size_t)info.tilesX(level) * info.tilesY(level) * 4;
+	}
+	pageTable.assign(offset, 0);
+}
+
+bool TileCache::touch(unsigned int key)
+{
+	unordered_map<unsigned int, unsigned int>::iterator found = tileSlots.find(key);
+	if (found == tileSlots.end())
+		return false;
+
+	Slot& slot = slots[found->second];
+	slot.lastTouched = frame;
+	lru.splice(lru.begin(), lru, slot.position);
+	return true;
+}
+
+bool TileCache::isResident(unsigned int key) const
+{
+	unordered_map<unsigned int, unsigned int>::const_iterator found = tileSlots.find(key);
+	return found != tileSlots.end() && slots[found->second].resident;
+}
+
+bool TileCache::reserve(unsigned int key, unsigned int& slot, bool pinned)
+{
+	unordered_map<unsigned int, unsigned int>::iterator found = tileSlots.find(key);
+	if (found != tileSlots.end())
+	{
+		slot = found->second;
+		touch(key);
+		return true;
+	}
+
+	// the least recently touched slots are at the back.  Slots touched this frame are all at the front, so the search
+	// stops as soon as it reaches one
+	list<unsigned int>::reverse_iterator candidate = lru.rbegin();
+	while (candidate != lru.rend())
+	{
+		const Slot& s = slots[*candidate];
+		if (s.used && s.lastTouched == frame)
+			candidate = lru.rend();
+		else if (!s.used || (s.resident && !s.pinned))
+			break;
+		else
+			++candidate;
+	}
+
+	if (candidate == lru.rend())
+	{
+		counters.refused++;
+		return false;
+	}
+
+	slot = *candidate;
+	Slot& s = slots[slot];
+
+	if (s.used)
+	{
+		tileSlots.erase(s.key);
+		counters.residentTiles--;
+		counters.evictions++;
+		pageTableChanged = true;
+	}
+
+	s.key = key;
+	s.used = true;
+	s.resident = false;
+	s.pinned = pinned;
+	s.lastTouched = frame;
+	lru.splice(lru.begin(), lru, s.position);
+	tileSlots[key] = slot;
+	counters.loadingTiles++;
+	return true;
+}
+
+void TileCache::markResident(unsigned int key)
+{
+	unordered_map<unsigned int, unsigned int>::iterator found = tileSlots.find(key);
+	if (found == tileSlots.end() || slots[found->second].resident)
+		return;
+
+	slots[found->second].resident = true;
+	counters.loadingTiles--;
+	counters.residentTiles++;
+	counters.loads++;
+	pageTableChanged = true;
+}
+
+void TileCache::buildPageTable()
+{
+	// coarsest first, so each level can copy its ancestors' entries
+	for (int level = info.levels - 1; level >= 0; level--)
+	{
+		int tilesX = info.tilesX(level), tilesY = info.tilesY(level);
+		unsigned char *entry = pageTable.data() + levelOffsets[level];
+
+		for (int y = 0; y < tilesY; y++)
+			for (int x = 0; x < tilesX; x++, entry += 4)
+			{
+				unordered_map<unsigned int, unsigned int>::const_iterator found = tileSlots.find(tileKey(level, x, y));
+
+				if (found != tileSlots.end() && slots[found->second].resident)
+				{
+					entry[0] = (unsigned char)(found->second % slotsX);
+					entry[1] = (unsigned char)(found->second / slotsX);
+					entry[2] = (unsigned char)level;
+					entry[3] = 255;
+				}
+				else if (level + 1 < info.levels)
+				{
+					const unsigned char *parent = pageTable.data() + levelOffsets[level + 1] + ((size_t)(y / 2) * info.tilesX(level + 1) + x / 2) * 4;
+					entry[0] = parent[0];
+					entry[1] = parent[1];
+					entry[2] = parent[2];
+					entry[3] = parent[3];
+				}
+				else
+					entry[0] = entry[1] = entry[2] = entry[3] = 0;
+			}
+	}
+
+	pageTableChanged = false;
+}
+
+void TileCache::resetCounters()
+{
+	counters.loads = 0;
+	counters.evictions = 0;
+	counters.refused = 0;
+}
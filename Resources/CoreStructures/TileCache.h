@@ -0,0 +1,127 @@
+//  TileCache.h - Which virtual texture tiles the camera needs, and which of them have a slot in the tile cache
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <glm/glm.hpp>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "VirtualTextureFile.h"
+
+// A tile the feedback pass asked for, and how many feedback pixels wanted it (or one of its finer descendants)
+struct TileRequest {
+	unsigned int	tile;
+	unsigned int	pixels;
+};
+
+// Turns a frame's feedback buffer into a list of tile requests.  The feedback pass renders the virtual textured
+// geometry at a fraction of the screen's resolution, writing the tile each pixel would sample as
+//	r, g	- the tile's column and row, low 8 bits
+//	b		- the high 4 bits of the column, then of the row
+//	a		- the level + 1, or 0 where nothing virtual textured was drawn
+// encode() does the same on the CPU, so tile selection can be checked (or driven) without a GPU.
+class TileFeedback {
+
+public:
+	// the mip level a sample whose texture coordinates change by dUVdx and dUVdy per pixel is taken from, as the shaders
+	// compute it.  lodBias is added first, eg. to account for the feedback buffer's lower resolution
+	static int mipLevel(const VirtualTextureInfo& info, glm::vec2 dUVdx, glm::vec2 dUVdy, float lodBias = 0.0f);
+
+	// the tile holding uv at a level, and the feedback pixel the shader writes for it
+	static unsigned int tileAt(const VirtualTextureInfo& info, glm::vec2 uv, int level);
+	static void encode(unsigned int tile, unsigned char rgba[4]);
+
+	// counts the tiles a buffer of RGBA8 feedback pixels asks for.  Each tile's coarser ancestors are requested too, so
+	// something close is always on its way, and the list is ordered coarsest level first, then by pixels
+	void analyse(const VirtualTextureInfo& info, const unsigned char *rgba, size_t pixelCount);
+
+	const std::vector<TileRequest>& requests() const { return requested; }
+
+private:
+	// kept between frames so analysing doesn't allocate
+	std::vector<unsigned int>	keys;
+	std::vector<TileRequest>	requested;
+};
+
+// Residency since the last resetCounters(), and now
+struct TileCacheStats {
+	unsigned int	residentTiles = 0;
+	unsigned int	loadingTiles = 0;
+	unsigned int	loads = 0;
+	unsigned int	evictions = 0;
+	unsigned int	refused = 0;		// reserve() calls with every slot in use this frame
+};
+
+// A fixed number of slots in the tile cache texture, handed out least recently used first.  A tile is touched each
+// frame the feedback asks for it; a slot can be reused once its tile has gone a frame without being touched.  Pinned
+// tiles (the coarsest level, the fallback for everything else) are never evicted.
+//
+// The cache also builds the page table: one RGBA8 texel per tile of every level, holding the slot's column and row
+// and the level of the tile actually in it.  A tile that isn't resident gets its nearest resident ancestor's entry,
+// so the shader always samples the finest data there is.  Alpha is 0 where no ancestor is resident either.
+//
+// Nothing here touches OpenGL.
+class TileCache {
+
+public:
+	TileCache() : slotsX(0), slotsY(0), frame(0), pageTableChanged(false) {}
+	// at most 256 slots across and down, as the page table stores slot coordinates in bytes
+	TileCache(const VirtualTextureInfo& info, int slotsX, int slotsY);
+
+	int columns() const { return slotsX; }
+	int rows() const { return slotsY; }
+	unsigned int numSlots() const { return (unsigned int)slots.size(); }
+
+	// starts a new frame, after which tiles are only protected from eviction once they're touched again
+	void beginFrame() { frame++; }
+
+	// marks a tile as wanted this frame.  Returns false if it has no slot (resident or loading)
+	bool touch(unsigned int key);
+
+	bool contains(unsigned int key) const { return tileSlots.count(key) != 0; }
+	bool isResident(unsigned int key) const;
+
+	// gives a tile about to be loaded a slot, evicting the least recently used tile not touched this frame.  The tile
+	// counts as touched.  False if every slot is pinned, loading or in use this frame
+	bool reserve(unsigned int key, unsigned int& slot, bool pinned = false);
+
+	// the tile's data is in its slot, so the page table can point to it
+	void markResident(unsigned int key);
+
+	// whether a tile became resident or was evicted since the last buildPageTable()
+	bool pageTableDirty() const { return pageTableChanged; }
+	void buildPageTable();
+
+	// the page table level's tilesX(level) * tilesY(level) entries, in rows
+	const unsigned char *pageTableLevel(int level) const { return pageTable.data() + levelOffsets[level]; }
+
+	const TileCacheStats& stats() const { return counters; }
+	void resetCounters();
+
+private:
+	struct Slot {
+		unsigned int						key;
+		bool								used = false;
+		bool								resident = false;
+		bool								pinned = false;
+		unsigned long long					lastTouched = 0;
+		std::list<unsigned int>::iterator	position;		// in lru
+	};
+
+	VirtualTextureInfo							info;
+	int											slotsX;
+	int											slotsY;
+	std::vector<Slot>							slots;
+	std::unordered_map<unsigned int, unsigned int> tileSlots;
+	std::list<unsigned int>						lru;			// slot indices, most recently touched first
+	unsigned long long							frame;
+
+	std::vector<unsigned char>					pageTable;
+	std::vector<size_t>							levelOffsets;
+	bool										pageTableChanged;
+
+	TileCacheStats								counters;
+};
+
+#endif
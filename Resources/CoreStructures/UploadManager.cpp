@@ -0,0 +1,400 @@
+//  UploadManager.cpp
+
+#include "UploadManager.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+// staging offsets are aligned for any pixel type
+static const size_t STAGING_ALIGNMENT = 16;
+
+
+//
+// Private functions
+//
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t pixelBytes(GLenum format, GLenum type)
+{
+	size_t components;
+	switch (format)
+	{
+	case GL_RED:	components = 1; break;
+	case GL_RG:		components = 2; break;
+	case GL_RGB:	components = 3; break;
+	default:		components = 4; break;
+	}
+
+	switch (type)
+	{
+	case GL_HALF_FLOAT:	return components * 2;
+	case GL_FLOAT:		return components * 4;
+	default:			return components;
+	}
+}
+
+
+//
+// UploadManager public method implementation
+//
+
+UploadManager::UploadManager(size_t ringSize)
+	: ring(0), ringSize(ringSize), mapped(nullptr), head(0), used(0), openBytes(0), nextTicket(1), completedTicket(0)
+{
+	glGenBuffers(1, &ring);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+
+	if (GLAD_GL_ARB_buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, ringSize, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, ringSize, flags);
+	}
+	else
+		glBufferData(GL_COPY_WRITE_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+UploadManager::~UploadManager()
+{
+	release();
+}
+
+UploadManager::Ticket UploadManager::uploadBuffer(GLuint buffer, size_t offset, const void *data, size_t size, shared_ptr<const void> owner)
+{
+	Job job;
+	job.type = UPLOAD_BUFFER;
+	job.destination = buffer;
+	job.offset = offset;
+	job.data = (const unsigned char*)data;
+	job.rowBytes = 1;
+	job.rowPixels = 1;
+	job.rows = size;
+	job.owner = std::move(owner);
+	return queue(job);
+}
+
+UploadManager::Ticket UploadManager::uploadTexture(GLuint texture, GLint level, GLsizei width, GLsizei height, GLenum format, GLenum type,
+	const void *pixels, shared_ptr<const void> owner)
+{
+	return uploadTexture(texture, level, 0, 0, width, height, format, type, pixels, std::move(owner));
+}
+
+UploadManager::Ticket UploadManager::uploadCompressedTexture(GLuint texture, GLint level, GLsizei width, GLsizei height, GLenum format,
+	GLsizei imageSize, const void *data, shared_ptr<const void> owner)
+{
+	return uploadCompressedTexture(texture, level, 0, 0, width, height, format, imageSize, data, std::move(owner));
+}
+
+UploadManager::Ticket UploadManager::uploadTexture(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+	GLenum format, GLenum type, const void *pixels, shared_ptr<const void> owner)
+{
+	Job job;
+	job.type = UPLOAD_TEXTURE;
+	job.destination = texture;
+	job.level = level;
+	job.x = x;
+	job.y = y;
+	job.width = width;
+	job.height = height;
+	job.format = format;
+	job.pixelType = type;
+	job.data = (const unsigned char*)pixels;
+	job.rowBytes = pixelBytes(format, type) * width;
+	job.rowPixels = 1;
+	job.rows = height;
+	job.owner = std::move(owner);
+	return queue(job);
+}
+
+UploadManager::Ticket UploadManager::uploadCompressedTexture(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+	GLenum format, GLsizei imageSize, const void *data, shared_ptr<const void> owner)
+{
+	size_t blockRows = (height + 3) / 4;
+
+	Job job;
+	job.type = UPLOAD_COMPRESSED_TEXTURE;
+	job.destination = texture;
+	job.level = level;
+	job.x = x;
+	job.y = y;
+	job.width = width;
+	job.height = height;
+	job.format = format;
+	job.data = (const unsigned char*)data;
+	job.rowBytes = imageSize / blockRows;
+	job.rowPixels = 4;
+	job.rows = blockRows;
+	job.owner = std::move(owner);
+	return queue(job);
+}
+
+void UploadManager::update(size_t budgetBytes)
+{
+	stats = UploadStats();
+	retire(false);
+	stats.ringFull = !stage(budgetBytes, true);
+	closeRegion();
+}
+
+void UploadManager::flush()
+{
+	stats = UploadStats();
+
+	while (!jobs.empty())
+	{
+		retire(false);
+		if (!stage(ringSize, true))
+		{
+			// the ring is full of data the GPU is still reading - fence what's staged and wait for the oldest region
+			stats.ringFull = true;
+			closeRegion();
+			retire(true);
+		}
+	}
+
+	closeRegion();
+}
+
+void UploadManager::release()
+{
+	for (unsigned int i = 0; i < regions.size(); i++)
+		glDeleteSync(regions[i].fence);
+	regions.clear();
+	jobs.clear();
+
+	if (mapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	if (ring != 0)
+		glDeleteBuffers(1, &ring);
+
+	ring = 0;
+	mapped = nullptr;
+	head = used = openBytes = 0;
+}
+
+size_t UploadManager::pendingBytes() const
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < jobs.size(); i++)
+		bytes += (jobs[i].rows - jobs[i].rowsDone) * jobs[i].rowBytes;
+	return bytes;
+}
+
+
+//
+// Private functions
+//
+
+UploadManager::Ticket UploadManager::queue(Job& job)
+{
+	job.rowsDone = 0;
+	job.ticket = nextTicket++;
+
+	// nothing to copy - complete as soon as everything before it is
+	if (job.rows == 0 || job.rowBytes == 0)
+		job.rows = job.rowsDone = 0;
+
+	jobs.push_back(std::move(job));
+	return jobs.back().ticket;
+}
+
+// frees the ring space of regions the GPU has finished with.  With wait, blocks until the oldest region is free
+void UploadManager::retire(bool wait)
+{
+	while (!regions.empty())
+	{
+		GLenum status = glClientWaitSync(regions.front().fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+
+		glDeleteSync(regions.front().fence);
+		used -= regions.front().bytes;
+		regions.pop_front();
+		wait = false;
+	}
+}
+
+void UploadManager::closeRegion()
+{
+	if (openBytes == 0)
+		return;
+
+	Region region;
+	region.bytes = openBytes;
+	region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	regions.push_back(region);
+	openBytes = 0;
+}
+
+// takes bytes of ring space after head, skipping the end of the ring if they don't fit there
+bool UploadManager::allocate(size_t bytes, size_t& offset)
+{
+	bytes = alignUp(bytes, STAGING_ALIGNMENT);
+
+	// an empty ring starts again from the beginning, so anything up to its whole size fits
+	if (used == 0)
+		head = 0;
+	size_t skipped = head + bytes > ringSize ? ringSize - head : 0;
+
+	if (bytes > ringSize || used + skipped + bytes > ringSize)
+		return false;
+
+	offset = skipped > 0 ? 0 : head;
+	head = (offset + bytes) % ringSize;
+	used += skipped + bytes;
+	openBytes += skipped + bytes;
+	return true;
+}
+
+// copies rows of the job into the ring at offset and issues the GPU copy out of it
+void UploadManager::stageChunk(Job& job, size_t rows, size_t offset)
+{
+	size_t bytes = rows * job.rowBytes;
+	const unsigned char *source = job.data + job.rowsDone * job.rowBytes;
+
+	if (mapped)
+		memcpy(mapped + offset, source, bytes);
+	else
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+		void *chunk = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (chunk)
+		{
+			memcpy(chunk, source, bytes);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	if (job.type == UPLOAD_BUFFER)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, ring);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, job.destination);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, job.offset + job.rowsDone, bytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	else
+	{
+		// the last chunk of a compressed level can end on a partial block row
+		GLint y = (GLint)(job.rowsDone * job.rowPixels);
+		GLsizei height = min((GLsizei)(rows * job.rowPixels), job.height - y);
+		y += job.y;
+
+		GLState::bindTexture(GL_TEXTURE_2D, job.destination);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+
+		if (job.type == UPLOAD_TEXTURE)
+			glTexSubImage2D(GL_TEXTURE_2D, job.level, job.x, y, job.width, height, job.format, job.pixelType, (const void*)offset);
+		else
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, job.level, job.x, y, job.width, height, job.format, (GLsizei)bytes, (const void*)offset);
+
+		// client memory uploads elsewhere must not read from the ring
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	job.rowsDone += rows;
+	stats.stagedBytes += bytes;
+	stats.chunks++;
+}
+
+size_t UploadManager::uploadDirect(Job& job)
+{
+	size_t bytes = (job.rows - job.rowsDone) * job.rowBytes;
+	const unsigned char *source = job.data + job.rowsDone * job.rowBytes;
+
+	if (job.type == UPLOAD_BUFFER)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, job.destination);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, job.offset + job.rowsDone, bytes, source);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	else
+	{
+		GLint y = (GLint)(job.rowsDone * job.rowPixels);
+		GLsizei height = job.height - y;
+		y += job.y;
+
+		GLState::bindTexture(GL_TEXTURE_2D, job.destination);
+
+		if (job.type == UPLOAD_TEXTURE)
+			glTexSubImage2D(GL_TEXTURE_2D, job.level, job.x, y, job.width, height, job.format, job.pixelType, source);
+		else
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, job.level, job.x, y, job.width, height, job.format, (GLsizei)bytes, source);
+	}
+
+	job.rowsDone = job.rows;
+	stats.directBytes += bytes;
+	stats.chunks++;
+	return bytes;
+}
+
+bool UploadManager::stage(size_t budgetBytes, bool atLeastOne)
+{
+	// chunks are at most a quarter of the ring, so a big upload can't wait on the whole ring draining
+	size_t maxChunk = max(ringSize / 4, (size_t)STAGING_ALIGNMENT);
+	size_t staged = 0;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	while (!jobs.empty())
+	{
+		Job& job = jobs.front();
+
+		if (job.rowsDone < job.rows)
+		{
+			if (staged >= budgetBytes && !(atLeastOne && stats.chunks == 0))
+				break;
+
+			// a row the ring can never hold would wait for space forever
+			if (alignUp(job.rowBytes, STAGING_ALIGNMENT) > ringSize)
+			{
+				staged += uploadDirect(job);
+				continue;
+			}
+
+			size_t remaining = job.rows - job.rowsDone;
+			size_t allowed = max(min(maxChunk, budgetBytes > staged ? budgetBytes - staged : 0), job.rowBytes);
+			size_t rows = max(min(remaining, allowed / job.rowBytes), (size_t)1);
+
+			size_t offset;
+			if (!allocate(rows * job.rowBytes, offset))
+			{
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+				return false;
+			}
+
+			stageChunk(job, rows, offset);
+			staged += rows * job.rowBytes;
+		}
+
+		if (job.rowsDone >= job.rows)
+		{
+			completedTicket = job.ticket;
+			stats.completedJobs++;
+			jobs.pop_front();
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return true;
+}
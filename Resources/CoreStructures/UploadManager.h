@@ -0,0 +1,137 @@
+//  UploadManager.h - Streams buffer and texture data to the GPU through a fenced ring of staging buffer memory
+#ifndef UPLOAD_MANAGER_H
+#define UPLOAD_MANAGER_H
+
+#include <glad/glad.h>
+#include <deque>
+#include <memory>
+
+// What the last update() or flush() did
+struct UploadStats {
+	size_t			stagedBytes = 0;
+	unsigned int	chunks = 0;
+	unsigned int	completedJobs = 0;
+	bool			ringFull = false;		// stopped early because the GPU hadn't finished reading the ring
+	size_t			directBytes = 0;		// uploaded straight from client memory, in rows too big for the ring
+};
+
+// Uploads are queued from client memory and copied into a ring buffer a budget's worth per frame.  The GPU then copies
+// from the ring into the destination (glCopyBufferSubData for buffers, a pixel unpack buffer for textures) without
+// the CPU waiting: the driver can DMA the data while the frame carries on.  Each update()'s share of the ring is fenced,
+// and ring space is only reused once its fence has passed.  When the GPU is behind, update() leaves the rest of the
+// queue for the next frame rather than stalling.
+//
+// With ARB_buffer_storage the ring is mapped once, persistently.  Otherwise each chunk is mapped unsynchronized, which
+// the fences make safe.
+//
+// Large uploads are split into chunks of whole rows (rows of blocks for compressed textures), so one big texture
+// spreads over several frames.  A row bigger than the whole ring can never be staged, so it's uploaded straight from
+// client memory instead (glBufferSubData, glTexSubImage2D), which may stall while the driver copies it.  Queued data isn't copied until it's staged, so each upload takes an owner that keeps
+// the data alive until then.  Tickets are issued in queue order: once isComplete(ticket), the commands filling that
+// upload's destination have been issued and anything drawn afterwards sees the data.
+//
+// Every call belongs on the GL thread.
+class UploadManager {
+
+public:
+	typedef unsigned long long Ticket;
+
+	explicit UploadManager(size_t ringSize = 16 * 1024 * 1024);
+	~UploadManager();
+
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+
+	// copies size bytes to offset in buffer
+	Ticket uploadBuffer(GLuint buffer, size_t offset, const void *data, size_t size, std::shared_ptr<const void> owner);
+
+	// fills a whole level of a 2D texture whose storage already exists.  format and type as glTexSubImage2D, with
+	// tightly packed rows
+	Ticket uploadTexture(GLuint texture, GLint level, GLsizei width, GLsizei height, GLenum format, GLenum type,
+		const void *pixels, std::shared_ptr<const void> owner);
+	// and a level of a block compressed texture
+	Ticket uploadCompressedTexture(GLuint texture, GLint level, GLsizei width, GLsizei height, GLenum format,
+		GLsizei imageSize, const void *data, std::shared_ptr<const void> owner);
+
+	// the same for a width x height rectangle of a level at x, y, eg. one tile of a VirtualTexture's tile cache.  For a
+	// compressed texture x and y must be multiples of 4
+	Ticket uploadTexture(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type,
+		const void *pixels, std::shared_ptr<const void> owner);
+	Ticket uploadCompressedTexture(GLuint texture, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format,
+		GLsizei imageSize, const void *data, std::shared_ptr<const void> owner);
+
+	// stages queued uploads in order until budgetBytes have been copied, the queue is empty or the ring is full of
+	// data the GPU hasn't read yet.  At least one chunk is staged if there is room, so uploads always progress.  Call
+	// once per frame
+	void update(size_t budgetBytes);
+
+	// stages everything queued, waiting for the GPU whenever the ring is full
+	void flush();
+
+	// drops anything still queued and deletes the ring.  Must be called while the GL context is still current, and
+	// the manager can't be used afterwards
+	void release();
+
+	bool isComplete(Ticket ticket) const { return ticket <= completedTicket; }
+	Ticket lastTicket() const { return nextTicket - 1; }
+
+	unsigned int pending() const { return (unsigned int)jobs.size(); }
+	size_t pendingBytes() const;
+
+	bool persistentlyMapped() const { return mapped != nullptr; }
+	const UploadStats& lastUpdateStats() const { return stats; }
+
+private:
+	enum JobType { UPLOAD_BUFFER, UPLOAD_TEXTURE, UPLOAD_COMPRESSED_TEXTURE };
+
+	struct Job {
+		JobType							type;
+		GLuint							destination;
+		GLint							level;
+		GLint							x;				// texture rectangle
+		GLint							y;
+		GLsizei							width;
+		GLsizei							height;
+		GLenum							format;
+		GLenum							pixelType;
+		size_t							offset;			// buffer offset
+		const unsigned char				*data;
+		size_t							rowBytes;		// bytes in one chunkable row (a byte, for buffers)
+		unsigned int					rowPixels;		// pixel rows in one chunkable row (4 for compressed textures)
+		size_t							rows;
+		size_t							rowsDone;
+		std::shared_ptr<const void>		owner;
+		Ticket							ticket;
+	};
+
+	// ring space handed out by one update, freed when its fence passes
+	struct Region {
+		size_t		bytes;
+		GLsync		fence;
+	};
+
+	GLuint				ring;
+	size_t				ringSize;
+	unsigned char		*mapped;		// persistent mapping, or null
+	size_t				head;			// next free byte
+	size_t				used;			// bytes between the oldest unfenced data and head, including skipped tails
+	size_t				openBytes;		// used bytes not fenced yet
+
+	std::deque<Job>		jobs;
+	std::deque<Region>	regions;
+	Ticket				nextTicket;
+	Ticket				completedTicket;
+	UploadStats			stats;
+
+	Ticket queue(Job& job);
+	void retire(bool wait);
+	void closeRegion();
+	bool allocate(size_t bytes, size_t& offset);
+	void stageChunk(Job& job, size_t rows, size_t offset);
+	// uploads the rest of the job from client memory.  Returns the bytes uploaded
+	size_t uploadDirect(Job& job);
+	// stages as much of the queue as budget and the ring allow.  Returns false if it stopped on a full ring
+	bool stage(size_t budgetBytes, bool atLeastOne);
+};
+
+#endif
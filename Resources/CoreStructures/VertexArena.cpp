@@ -0,0 +1,111 @@
+#include "VertexArena.h"
+#include "Mesh.h"
+#include "GLState.h"
+
+#include <cstddef>
+
+VertexArena::VertexArena()
+{
+	VAO = VBO = EBO = 0;
+	vertexCapacity = indexCapacity = 0;
+	vertexCount = indexCount = 0;
+	instanceSource = 0;
+}
+
+VertexArena::~VertexArena()
+{
+	if (VBO != 0)
+		glDeleteBuffers(1, &VBO);
+	if (EBO != 0)
+		glDeleteBuffers(1, &EBO);
+	if (VAO != 0)
+	{
+		GLState::forgetVertexArray(VAO);
+		glDeleteVertexArrays(1, &VAO);
+	}
+}
+
+void VertexArena::allocate(unsigned int numVertices, unsigned int numIndices)
+{
+	vertexCapacity = numVertices;
+	indexCapacity = numIndices;
+	vertexCount = indexCount = 0;
+
+	// create buffers/arrays
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	GLState::bindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+	// set the vertex attribute pointers
+	// vertex Positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	// vertex normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	// vertex texture coords
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	// vertex tangent
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	// vertex bitangent
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+
+	GLState::bindVertexArray(0);
+}
+
+VertexArena::Range VertexArena::add(const Vertex *vertices, unsigned int numVertices, const unsigned int *indices, unsigned int numIndices)
+{
+	unsigned int firstVertex = vertexCount;
+	Range range = reserve(numVertices, numIndices);
+	if (range.indexCount != (GLsizei)numIndices)
+		return range;
+
+	// the element buffer binding is VAO state, so bind the arena's VAO rather than touch whichever is current
+	GLState::bindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(Vertex), numVertices * sizeof(Vertex), vertices);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.firstIndex * sizeof(unsigned int), numIndices * sizeof(unsigned int), indices);
+
+	return range;
+}
+
+VertexArena::Range VertexArena::reserve(unsigned int numVertices, unsigned int numIndices)
+{
+	Range range;
+	range.baseVertex = (GLint)vertexCount;
+	range.firstIndex = indexCount;
+	range.indexCount = (GLsizei)numIndices;
+
+	if (vertexCount + numVertices > vertexCapacity || indexCount + numIndices > indexCapacity)
+	{
+		// allocate() was given the wrong totals - leave the range empty rather than write past the buffers
+		range.indexCount = 0;
+		return range;
+	}
+
+	vertexCount += numVertices;
+	indexCount += numIndices;
+
+	return range;
+}
+
+void VertexArena::useInstances(const InstanceBuffer& instances) const
+{
+	if (instanceSource != instances.serial())
+	{
+		instances.setupAttributes();
+		instanceSource = instances.serial();
+	}
+}
@@ -0,0 +1,60 @@
+//  VertexArena.h - Shared vertex/index buffers for all the meshes of a model
+#ifndef VERTEX_ARENA_H
+#define VERTEX_ARENA_H
+
+#include <glad/glad.h>
+
+#include "InstanceBuffer.h"
+
+struct Vertex;
+
+// One vertex buffer, index buffer and VAO shared by every mesh of a model.  Each mesh is given a range of the
+// buffers and drawn with glDrawElementsBaseVertex, so drawing a multi-mesh model only binds one VAO.
+//
+// The arena is filled in two steps: allocate() sizes the buffers for every mesh, then add() copies each mesh's data
+// in behind the previous one.  Meshes keep a pointer to their arena, so it can't be copied or moved.
+class VertexArena {
+
+public:
+	// where a mesh's data landed in the arena
+	struct Range {
+		GLint		baseVertex;		// added to each index by glDrawElementsBaseVertex
+		GLuint		firstIndex;
+		GLsizei		indexCount;
+	};
+
+	VertexArena();
+	~VertexArena();
+
+	VertexArena(const VertexArena&) = delete;
+	VertexArena& operator=(const VertexArena&) = delete;
+
+	// creates the buffers and VAO with room for numVertices / numIndices in total
+	void allocate(unsigned int numVertices, unsigned int numIndices);
+
+	// copies a mesh's vertices and indices in after the previous mesh's.  The indices stay relative to the mesh's
+	// own vertices
+	Range add(const Vertex *vertices, unsigned int numVertices, const unsigned int *indices, unsigned int numIndices);
+	// claims the next range as add() without filling it, for data copied in some other way (eg. by an UploadManager)
+	Range reserve(unsigned int numVertices, unsigned int numIndices);
+
+	GLuint vertexArray() const { return VAO; }
+	GLuint vertexBuffer() const { return VBO; }
+	GLuint indexBuffer() const { return EBO; }
+
+	unsigned int numVertices() const { return vertexCount; }
+	unsigned int numIndices() const { return indexCount; }
+
+	// points the VAO's instance attributes at the buffer, unless they already read from it.  The VAO must be bound
+	void useInstances(const InstanceBuffer& instances) const;
+
+private:
+	GLuint			VAO, VBO, EBO;
+	unsigned int	vertexCapacity, indexCapacity;
+	unsigned int	vertexCount, indexCount;
+
+	// serial of the InstanceBuffer the VAO's instance attributes point at, 0 if none
+	mutable unsigned int instanceSource;
+};
+
+#endif
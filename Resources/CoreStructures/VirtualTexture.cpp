@@ -0,0 +1,430 @@
+//  VirtualTexture.cpp
+
+#include "VirtualTexture.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+// tiles being read on the workers at once, and tiles queued on the UploadManager per update().  A tile is only a few
+// KB, so these bound the work per frame rather than the bytes
+static const unsigned int MAX_TILES_LOADING = 16;
+static const unsigned int MAX_TILE_UPLOADS = 8;
+
+
+//
+// Private functions
+//
+
+static GLenum compressedFormat(BlockFormat format, bool sRGB)
+{
+	switch (format)
+	{
+	case BLOCK_BC1:	return sRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BLOCK_BC3:	return sRGB ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	default:		return GL_COMPRESSED_RG_RGTC2;
+	}
+}
+
+
+//
+// VirtualTexture public method implementation
+//
+
+VirtualTexture::VirtualTexture()
+	: tileCacheTexture(0), pageTableTexture(0), compressed(true), tileFormat(0),
+	feedbackFramebuffer(0), feedbackTexture(0), feedbackBuffer(0), feedbackFence(0), feedbackWidth(0), feedbackHeight(0),
+	screenWidth(0), screenHeight(0), pool(2), uploadedTiles(0), requestedTiles(0)
+{
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	release();
+}
+
+bool VirtualTexture::create(const string& imagePath, ImageContent content, size_t budgetBytes, int screenWidth, int screenHeight)
+{
+	release();
+
+	if (!file.open(imagePath, true, content))
+		return false;
+
+	const VirtualTextureInfo& vt = file.info();
+	int padded = vt.paddedTileSize();
+
+	// RGTC (BC5) is core, S3TC (BC1 and BC3) is an extension and its sRGB formats another.  Colour is sampled from
+	// sRGB slots, so the shaders light it in linear space
+	bool sRGB = content == IMAGE_COLOUR;
+	compressed = vt.format == BLOCK_BC5 || (GLAD_GL_EXT_texture_compression_s3tc && (!sRGB || GLAD_GL_EXT_texture_sRGB));
+	tileFormat = compressed ? compressedFormat(vt.format, sRGB) : (sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+	size_t slotBytes = compressed ? vt.tileBytes() : (size_t)padded * padded * 4;
+
+	GLint maxSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	int side = min(min((int)sqrt((double)(budgetBytes / slotBytes)), maxSize / padded), 256);
+
+	// the coarsest level is pinned, so there has to be room for it and some tiles to stream
+	int top = vt.levels - 1;
+	int pinnedTiles = vt.tilesX(top) * vt.tilesY(top);
+	if (side * side < pinnedTiles * 2)
+	{
+		file.close();
+		return false;
+	}
+
+	cache = TileCache(vt, side, side);
+
+	int cacheSize = side * padded;
+	glGenTextures(1, &tileCacheTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, tileCacheTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	if (compressed)
+		glCompressedTexImage2D(GL_TEXTURE_2D, 0, tileFormat, cacheSize, cacheSize, 0,
+			(GLsizei)BlockCompressor::compressedSize(vt.format, cacheSize, cacheSize), nullptr);
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, tileFormat, cacheSize, cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	// the page table's mip levels are the tile levels, read with texelFetch
+	glGenTextures(1, &pageTableTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, pageTableTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, top);
+
+	for (int level = 0; level < vt.levels; level++)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, vt.tilesX(level), vt.tilesY(level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	// the coarsest level is read and copied in now, without the UploadManager
+	GLState::bindTexture(GL_TEXTURE_2D, tileCacheTexture);
+	for (int y = 0; y < vt.tilesY(top); y++)
+		for (int x = 0; x < vt.tilesX(top); x++)
+		{
+			unsigned int key = tileKey(top, x, y);
+			unsigned int slot;
+			shared_ptr<vector<unsigned char>> data = readTile(key);
+			if (!data || !cache.reserve(key, slot, true))
+				continue;
+
+			GLint slotX = (slot % side) * padded, slotY = (slot / side) * padded;
+			if (compressed)
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, slotX, slotY, padded, padded, tileFormat, (GLsizei)data->size(), data->data());
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, 0, slotX, slotY, padded, padded, GL_RGBA, GL_UNSIGNED_BYTE, data->data());
+
+			cache.markResident(key);
+		}
+
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	uploadPageTable();
+
+	this->screenWidth = this->screenHeight = 0;
+	resize(screenWidth, screenHeight);
+	return true;
+}
+
+void VirtualTexture::resize(int screenWidth, int screenHeight)
+{
+	if (!isCreated() || (screenWidth == this->screenWidth && screenHeight == this->screenHeight))
+		return;
+
+	this->screenWidth = screenWidth;
+	this->screenHeight = screenHeight;
+	deleteFeedbackTarget();
+	createFeedbackTarget();
+}
+
+void VirtualTexture::release()
+{
+	// the workers read from file, so wait for them before closing it
+	for (unsigned int i = 0; i < loading.size(); i++)
+		loading[i].data.wait();
+	loading.clear();
+	uploading.clear();
+	inFlight.clear();
+
+	deleteFeedbackTarget();
+
+	if (tileCacheTexture != 0)
+	{
+		GLState::forgetTexture(tileCacheTexture);
+		glDeleteTextures(1, &tileCacheTexture);
+	}
+
+	if (pageTableTexture != 0)
+	{
+		GLState::forgetTexture(pageTableTexture);
+		glDeleteTextures(1, &pageTableTexture);
+	}
+
+	tileCacheTexture = pageTableTexture = 0;
+	cache = TileCache();
+	file.close();
+}
+
+bool VirtualTexture::beginFeedback()
+{
+	if (!isCreated() || feedbackFence != 0)
+		return false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+	glViewport(0, 0, feedbackWidth, feedbackHeight);
+
+	// alpha 0 marks pixels with no virtual texture
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	return true;
+}
+
+void VirtualTexture::endFeedback(int viewportWidth, int viewportHeight)
+{
+	// into the pixel pack buffer, so glReadPixels returns at once and update() maps it when the fence has passed
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffer);
+	glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	feedbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void VirtualTexture::update(UploadManager& uploads)
+{
+	if (!isCreated())
+		return;
+
+	uploadedTiles = 0;
+	cache.beginFrame();
+	collectFeedback();
+
+	// tiles whose data has been staged can be sampled
+	for (unsigned int i = 0; i < uploading.size(); )
+	{
+		if (uploads.isComplete(uploading[i].ticket))
+		{
+			cache.markResident(uploading[i].key);
+			inFlight.erase(uploading[i].key);
+			uploading.erase(uploading.begin() + i);
+		}
+		else
+			i++;
+	}
+
+	// the last feedback is used again until a newer one arrives, so the tiles in view stay touched.  Tiles the cache
+	// doesn't have are read in priority order, coarsest first
+	const vector<TileRequest>& requests = feedback.requests();
+	requestedTiles = (unsigned int)requests.size();
+
+	for (unsigned int i = 0; i < requests.size(); i++)
+	{
+		unsigned int key = requests[i].tile;
+		if (cache.touch(key) || inFlight.count(key) != 0 || loading.size() >= MAX_TILES_LOADING)
+			continue;
+
+		LoadingTile tile;
+		tile.key = key;
+		tile.data = pool.submit([this, key]() { return readTile(key); });
+		loading.push_back(std::move(tile));
+		inFlight.insert(key);
+	}
+
+	// tiles that have been read get a slot and are queued for upload.  A tile that gets no slot, because every slot is in
+	// use this frame, is dropped and asked for again by a later feedback
+	int padded = file.info().paddedTileSize();
+	for (unsigned int i = 0; i < loading.size() && uploadedTiles < MAX_TILE_UPLOADS; )
+	{
+		if (loading[i].data.wait_for(chrono::seconds(0)) != future_status::ready)
+		{
+			i++;
+			continue;
+		}
+
+		unsigned int key = loading[i].key;
+		shared_ptr<vector<unsigned char>> data = loading[i].data.get();
+		loading.erase(loading.begin() + i);
+
+		unsigned int slot;
+		if (!data || !cache.reserve(key, slot))
+		{
+			inFlight.erase(key);
+			continue;
+		}
+
+		GLint slotX = (slot % cache.columns()) * padded, slotY = (slot / cache.columns()) * padded;
+
+		UploadingTile tile;
+		tile.key = key;
+		if (compressed)
+			tile.ticket = uploads.uploadCompressedTexture(tileCacheTexture, 0, slotX, slotY, padded, padded, tileFormat, (GLsizei)data->size(),
+				data->data(), data);
+		else
+			tile.ticket = uploads.uploadTexture(tileCacheTexture, 0, slotX, slotY, padded, padded, GL_RGBA, GL_UNSIGNED_BYTE, data->data(), data);
+		uploading.push_back(tile);
+		uploadedTiles++;
+	}
+
+	// evictions must reach the page table before the UploadManager overwrites their slots
+	if (cache.pageTableDirty())
+		uploadPageTable();
+}
+
+VirtualTextureUniforms VirtualTexture::findUniforms(const ShaderProgram& program)
+{
+	VirtualTextureUniforms uniforms;
+	uniforms.tileCache = program.uniform("tileCache");
+	uniforms.pageTable = program.uniform("pageTable");
+	uniforms.virtualSize = program.uniform("virtualSize");
+	uniforms.cacheLayout = program.uniform("cacheLayout");
+	uniforms.lodBias = program.uniform("lodBias");
+	return uniforms;
+}
+
+void VirtualTexture::apply(ShaderProgram& program, const VirtualTextureUniforms& uniforms, bool feedback) const
+{
+	const VirtualTextureInfo& vt = file.info();
+
+	if (program.textureUnit(uniforms.tileCache) >= 0)
+		GLState::bindTexture(program.textureUnit(uniforms.tileCache), GL_TEXTURE_2D, tileCacheTexture);
+	if (program.textureUnit(uniforms.pageTable) >= 0)
+		GLState::bindTexture(program.textureUnit(uniforms.pageTable), GL_TEXTURE_2D, pageTableTexture);
+
+	float cacheSize = (float)(cache.columns() * vt.paddedTileSize());
+	program.setVec4(uniforms.virtualSize, glm::vec4((float)vt.width, (float)vt.height, (float)vt.levels, (float)vt.tileSize));
+	program.setVec4(uniforms.cacheLayout, glm::vec4((float)vt.paddedTileSize(), (float)vt.border, 1.0f / cacheSize, 1.0f / cacheSize));
+
+	// the feedback target's derivatives are FEEDBACK_SCALE times the screen's, so it would ask for coarser tiles
+	program.setFloat(uniforms.lodBias, feedback && feedbackWidth > 0 ? -log2((float)screenWidth / (float)feedbackWidth) : 0.0f);
+}
+
+VirtualTextureStats VirtualTexture::stats() const
+{
+	VirtualTextureStats stats;
+	stats.requestedTiles = requestedTiles;
+	stats.residentTiles = cache.stats().residentTiles;
+	stats.loadingTiles = (unsigned int)inFlight.size();
+	stats.slots = cache.numSlots();
+	stats.uploadedTiles = uploadedTiles;
+	stats.evictions = cache.stats().evictions;
+	return stats;
+}
+
+
+//
+// Private functions
+//
+
+// runs on the workers
+shared_ptr<vector<unsigned char>> VirtualTexture::readTile(unsigned int key)
+{
+	shared_ptr<vector<unsigned char>> blocks = make_shared<vector<unsigned char>>();
+	if (!file.readTile(key, *blocks))
+		return nullptr;
+
+	if (compressed)
+		return blocks;
+
+	CompressedImage tile;
+	tile.width = tile.height = file.info().paddedTileSize();
+	tile.levels = 1;
+	tile.format = file.info().format;
+	tile.blocks.swap(*blocks);
+
+	BlockCompressor::decompress(tile, *blocks);
+	return blocks;
+}
+
+void VirtualTexture::createFeedbackTarget()
+{
+	feedbackWidth = max(screenWidth / FEEDBACK_SCALE, 1);
+	feedbackHeight = max(screenHeight / FEEDBACK_SCALE, 1);
+
+	glGenTextures(1, &feedbackTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, feedbackTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, feedbackWidth, feedbackHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+
+	// no depth buffer: nothing else is drawn into the feedback, so geometry in front of the virtual textured surface
+	// doesn't hide it and the tiles behind it are asked for too
+	glGenFramebuffers(1, &feedbackFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackTexture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(1, &feedbackBuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 4, nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::deleteFeedbackTarget()
+{
+	if (feedbackFence != 0)
+		glDeleteSync(feedbackFence);
+
+	if (feedbackFramebuffer != 0)
+		glDeleteFramebuffers(1, &feedbackFramebuffer);
+
+	if (feedbackTexture != 0)
+	{
+		GLState::forgetTexture(feedbackTexture);
+		glDeleteTextures(1, &feedbackTexture);
+	}
+
+	if (feedbackBuffer != 0)
+		glDeleteBuffers(1, &feedbackBuffer);
+
+	feedbackFence = 0;
+	feedbackFramebuffer = feedbackTexture = feedbackBuffer = 0;
+}
+
+// analyses the read back feedback if the GPU has written it, leaving the last requests in place if not
+void VirtualTexture::collectFeedback()
+{
+	if (feedbackFence == 0)
+		return;
+
+	GLenum status = glClientWaitSync(feedbackFence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return;
+
+	glDeleteSync(feedbackFence);
+	feedbackFence = 0;
+
+	size_t pixels = (size_t)feedbackWidth * feedbackHeight;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffer);
+	const unsigned char *rgba = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels * 4, GL_MAP_READ_BIT);
+	if (rgba)
+	{
+		feedback.analyse(file.info(), rgba, pixels);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::uploadPageTable()
+{
+	cache.buildPageTable();
+
+	const VirtualTextureInfo& vt = file.info();
+	GLState::bindTexture(GL_TEXTURE_2D, pageTableTexture);
+	for (int level = 0; level < vt.levels; level++)
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, vt.tilesX(level), vt.tilesY(level), GL_RGBA, GL_UNSIGNED_BYTE, cache.pageTableLevel(level));
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,137 @@
+//  VirtualTexture.h - Keeps only the tiles of a huge texture the camera can see in video memory, streaming the rest in
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ShaderProgram.h"
+#include "ThreadPool.h"
+#include "TileCache.h"
+#include "UploadManager.h"
+#include "VirtualTextureFile.h"
+
+// Uniforms of a program sampling a virtual texture, as declared in Virtual_texture.frag and
+// Virtual_texture_feedback.frag
+struct VirtualTextureUniforms {
+	UniformID	tileCache;
+	UniformID	pageTable;
+	UniformID	virtualSize;		// width, height, levels, tile size
+	UniformID	cacheLayout;		// padded tile size, border, 1 / cache width, 1 / cache height
+	UniformID	lodBias;
+};
+
+// What the last update() did, and the cache as it stands
+struct VirtualTextureStats {
+	unsigned int	requestedTiles = 0;		// in the last feedback read back
+	unsigned int	residentTiles = 0;
+	unsigned int	loadingTiles = 0;		// reading on the workers or waiting for their upload
+	unsigned int	slots = 0;
+	unsigned int	uploadedTiles = 0;
+	unsigned int	evictions = 0;			// since the texture was created
+};
+
+// A cooked VirtualTextureFile sampled through a tile cache: one texture of fixed size slots, each holding one padded
+// tile, and a page table texture mapping every tile of every level to the slot holding it or its nearest resident
+// ancestor.  The shaders pick the level from the texture coordinates' derivatives, look the tile up and sample the
+// slot, so only the tiles in view take video memory however large the image is.
+//
+// Which tiles are in view comes from a feedback pass: the virtual textured geometry drawn at 1 / FEEDBACK_SCALE of the
+// screen's resolution with Virtual_texture_feedback.frag, read back a frame later through a pixel pack buffer so the
+// CPU never waits for the GPU.  update() analyses it with TileFeedback, reads the missing tiles on worker threads,
+// copies them into the tile cache through an UploadManager and points the page table at them once they've landed.
+// The coarsest level is read when the texture is created and never evicted, so there is always something to draw.
+//
+// Every call belongs on the GL thread.
+class VirtualTexture {
+
+public:
+	static const int FEEDBACK_SCALE = 8;
+
+	VirtualTexture();
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	// opens the image's cooked tiles (cooking them first if there aren't up to date ones) and creates the tile cache,
+	// no more than budgetBytes, the page table and the feedback target for a screenWidth x screenHeight framebuffer
+	bool create(const std::string& imagePath, ImageContent content, size_t budgetBytes, int screenWidth, int screenHeight);
+
+	// resizes the feedback target.  Does nothing if the size hasn't changed
+	void resize(int screenWidth, int screenHeight);
+
+	// deletes the GL objects.  Must be called while the context is still current, and after the UploadManager's
+	// release() if it may still have tiles queued
+	void release();
+
+	bool isCreated() const { return tileCacheTexture != 0; }
+	const VirtualTextureInfo& info() const { return file.info(); }
+
+	// binds and clears the feedback target.  Draw the virtual textured geometry with a feedback program, then call
+	// endFeedback().  Returns false, binding nothing, while the last feedback is still being read back
+	bool beginFeedback();
+	// queues the read back and restores the default framebuffer and the viewport
+	void endFeedback(int viewportWidth, int viewportHeight);
+
+	// collects finished feedback, reads the tiles it asks for on the workers and queues the ones that have been read on
+	// uploads.  Call once per frame, before uploads.update()
+	void update(UploadManager& uploads);
+
+	static VirtualTextureUniforms findUniforms(const ShaderProgram& program);
+
+	// binds the tile cache and page table to the program's samplers and sets its uniforms.  The program must be in use.
+	// feedback programs get the bias for the feedback target's lower resolution
+	void apply(ShaderProgram& program, const VirtualTextureUniforms& uniforms, bool feedback) const;
+
+	VirtualTextureStats stats() const;
+
+private:
+	struct LoadingTile {
+		unsigned int										key;
+		std::future<std::shared_ptr<std::vector<unsigned char>>>	data;
+	};
+
+	struct UploadingTile {
+		unsigned int			key;
+		UploadManager::Ticket	ticket;
+	};
+
+	VirtualTextureFile				file;
+	TileCache						cache;
+	TileFeedback					feedback;
+
+	GLuint							tileCacheTexture;
+	GLuint							pageTableTexture;
+	bool							compressed;		// false where there's no S3TC, so tiles are decompressed as they're read
+	GLenum							tileFormat;		// the tile cache's internal format, sRGB for colour
+
+	GLuint							feedbackFramebuffer;
+	GLuint							feedbackTexture;
+	GLuint							feedbackBuffer;	// pixel pack buffer the feedback is read back into
+	GLsync							feedbackFence;
+	int								feedbackWidth;
+	int								feedbackHeight;
+	int								screenWidth;
+	int								screenHeight;
+
+	ThreadPool						pool;
+	std::vector<LoadingTile>		loading;
+	std::vector<UploadingTile>		uploading;
+	std::unordered_set<unsigned int> inFlight;		// keys in loading or uploading
+	unsigned int					uploadedTiles;
+	unsigned int					requestedTiles;
+
+	// reads a tile's blocks, decompressed to RGBA if the tile cache isn't compressed
+	std::shared_ptr<std::vector<unsigned char>> readTile(unsigned int key);
+	void createFeedbackTarget();
+	void deleteFeedbackTarget();
+	void collectFeedback();
+	void uploadPageTable();
+};
+
+#endif
@@ -0,0 +1,299 @@
+//  VirtualTextureFile.cpp
+
+#include "VirtualTextureFile.h"
+#include "FileInfo.h"
+#include "TextureCooker.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+
+//
+// Private data
+//
+
+// written after everything else, so a file cut short by a crash is never mistaken for a cooked one
+struct VirtualTextureHeader {
+	char			magic[4];
+	unsigned int	version;
+	unsigned int	settings;
+	unsigned int	sourceSize[2];
+	unsigned int	sourceTime[2];
+	unsigned int	width;
+	unsigned int	height;
+	unsigned int	tileSize;
+	unsigned int	border;
+	unsigned int	levels;
+	unsigned int	format;
+};
+
+static const char VTEX_MAGIC[4] = { 'V', 'T', 'E', 'X' };
+
+// bump when the tile layout or the compressor's output changes
+static const unsigned int VTEX_VERSION = 1;
+
+// the key has 14 bits for each tile coordinate and 4 for the level
+static const int MAX_TILES_ACROSS = 1 << 14;
+static const int MAX_LEVELS = 16;
+
+
+//
+// Private functions
+//
+
+static bool isPowerOfTwo(int value)
+{
+	return value > 0 && (value & (value - 1)) == 0;
+}
+
+// flip (1 bit) | content (2 bits)
+static unsigned int cookSettings(bool flipVertically, ImageContent content)
+{
+	return (flipVertically ? 1 : 0) | ((unsigned int)content << 1);
+}
+
+// copies the size x size square at x0, y0 out of an image, repeating the edge pixels where it hangs over
+static void extractTile(const unsigned char *pixels, int width, int height, int channels, int x0, int y0, int size,
+	vector<unsigned char>& tile)
+{
+	tile.resize((size_t)size * size * channels);
+	unsigned char *out = tile.data();
+
+	for (int y = 0; y < size; y++)
+	{
+		const unsigned char *row = pixels + (size_t)min(max(y0 + y, 0), height - 1) * width * channels;
+
+		for (int x = 0; x < size; x++, out += channels)
+			memcpy(out, row + (size_t)min(max(x0 + x, 0), width - 1) * channels, channels);
+	}
+}
+
+
+//
+// VirtualTextureInfo public method implementation
+//
+
+unsigned int VirtualTextureInfo::numTiles() const
+{
+	unsigned int tiles = 0;
+	for (int level = 0; level < levels; level++)
+		tiles += tilesX(level) * tilesY(level);
+	return tiles;
+}
+
+unsigned int VirtualTextureInfo::tileIndex(unsigned int key) const
+{
+	unsigned int index = 0;
+	for (int level = 0; level < tileLevel(key); level++)
+		index += tilesX(level) * tilesY(level);
+	return index + tileY(key) * tilesX(tileLevel(key)) + tileX(key);
+}
+
+
+//
+// VirtualTextureFile public method implementation
+//
+
+string VirtualTextureFile::cachePath(const string& imagePath)
+{
+	return imagePath + ".vtex";
+}
+
+bool VirtualTextureFile::cook(const string& imagePath, bool flipVertically, ImageContent content, int tileSize, int border)
+{
+	if (!isPowerOfTwo(tileSize) || tileSize < 4 || border < 0 || (tileSize + 2 * border) % 4 != 0)
+		return false;
+
+	unsigned long long sourceSize, sourceTime;
+	DecodedImage decoded;
+	if (!fileInfo(imagePath, sourceSize, sourceTime) || !TextureLoader::decodeImage(imagePath, flipVertically, decoded))
+		return false;
+
+	if (!isPowerOfTwo(decoded.width) || !isPowerOfTwo(decoded.height) || decoded.width < tileSize || decoded.height < tileSize ||
+		decoded.width / tileSize >= MAX_TILES_ACROSS || decoded.height / tileSize >= MAX_TILES_ACROSS)
+		return false;
+
+	VirtualTextureInfo info;
+	info.width = decoded.width;
+	info.height = decoded.height;
+	info.tileSize = tileSize;
+	info.border = border;
+	info.format = TextureCooker::chooseFormat(decoded.channels, content);
+	info.levels = 1;
+	while (info.tilesX(info.levels - 1) > 1 && info.tilesY(info.levels - 1) > 1 && info.levels < MAX_LEVELS)
+		info.levels++;
+
+	vector<MipLevel> mips;
+	if (info.levels > 1)
+		MipBuilder::build(decoded.pixels, decoded.width, decoded.height, decoded.channels, content, MIP_KAISER, mips);
+
+	VirtualTextureHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = VTEX_VERSION;
+	header.settings = cookSettings(flipVertically, content);
+	header.sourceSize[0] = (unsigned int)sourceSize;
+	header.sourceSize[1] = (unsigned int)(sourceSize >> 32);
+	header.sourceTime[0] = (unsigned int)sourceTime;
+	header.sourceTime[1] = (unsigned int)(sourceTime >> 32);
+	header.width = info.width;
+	header.height = info.height;
+	header.tileSize = info.tileSize;
+	header.border = info.border;
+	header.levels = info.levels;
+	header.format = info.format;
+
+	string path = cachePath(imagePath);
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	out.write((const char*)&header, sizeof(header));
+
+	// each row of tiles is compressed on a worker, then written in order
+	ThreadPool pool;
+	int padded = info.paddedTileSize();
+
+	for (int level = 0; level < info.levels && out; level++)
+	{
+		const unsigned char *pixels = level == 0 ? decoded.pixels : mips[level - 1].pixels.data();
+		int width = level == 0 ? decoded.width : mips[level - 1].width;
+		int height = level == 0 ? decoded.height : mips[level - 1].height;
+		int tilesX = info.tilesX(level);
+
+		vector<future<vector<unsigned char>>> rows(info.tilesY(level));
+		for (int y = 0; y < (int)rows.size(); y++)
+			rows[y] = pool.submit([&, pixels, width, height, tilesX, y]()
+			{
+				vector<unsigned char> row, tile;
+				CompressedImage compressed;
+				row.reserve(tilesX * info.tileBytes());
+
+				for (int x = 0; x < tilesX; x++)
+				{
+					extractTile(pixels, width, height, decoded.channels, x * info.tileSize - info.border, y * info.tileSize - info.border, padded, tile);
+					BlockCompressor::compress(tile.data(), padded, padded, decoded.channels, info.format, compressed);
+					row.insert(row.end(), compressed.blocks.begin(), compressed.blocks.end());
+				}
+				return row;
+			});
+
+		for (unsigned int y = 0; y < rows.size(); y++)
+		{
+			vector<unsigned char> row = rows[y].get();
+			out.write((const char*)row.data(), row.size());
+		}
+	}
+
+	out.seekp(0);
+	out.write(VTEX_MAGIC, sizeof(VTEX_MAGIC));
+	out.close();
+
+	if (!out)
+	{
+		remove(path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool VirtualTextureFile::open(const string& imagePath, bool flipVertically, ImageContent content)
+{
+	close();
+
+	if (read(imagePath, flipVertically, content))
+		return true;
+
+	return cook(imagePath, flipVertically, content) && read(imagePath, flipVertically, content);
+}
+
+void VirtualTextureFile::close()
+{
+	lock_guard<mutex> lock(fileMutex);
+	if (file.is_open())
+		file.close();
+	file.clear();
+	info_ = VirtualTextureInfo();
+}
+
+bool VirtualTextureFile::readTile(unsigned int key, vector<unsigned char>& blocks)
+{
+	int level = tileLevel(key);
+	if (level >= info_.levels || tileX(key) >= info_.tilesX(level) || tileY(key) >= info_.tilesY(level))
+		return false;
+
+	size_t bytes = info_.tileBytes();
+	blocks.resize(bytes);
+
+	lock_guard<mutex> lock(fileMutex);
+	file.seekg(sizeof(VirtualTextureHeader) + (streamoff)info_.tileIndex(key) * bytes);
+	if (!file.read((char*)blocks.data(), bytes))
+	{
+		file.clear();
+		return false;
+	}
+
+	return true;
+}
+
+
+//
+// Private functions
+//
+
+// opens the cooked file if it was cooked from the current image with these settings
+bool VirtualTextureFile::read(const string& imagePath, bool flipVertically, ImageContent content)
+{
+	file.open(cachePath(imagePath), ios::binary);
+	if (!file)
+	{
+		file.clear();
+		return false;
+	}
+
+	VirtualTextureHeader header;
+	bool valid = (bool)file.read((char*)&header, sizeof(header)) && memcmp(header.magic, VTEX_MAGIC, sizeof(VTEX_MAGIC)) == 0 &&
+		header.version == VTEX_VERSION && header.settings == cookSettings(flipVertically, content);
+
+	unsigned long long sourceSize, sourceTime;
+	if (valid && fileInfo(imagePath, sourceSize, sourceTime))
+		valid = header.sourceSize[0] == (unsigned int)sourceSize && header.sourceSize[1] == (unsigned int)(sourceSize >> 32) &&
+			header.sourceTime[0] == (unsigned int)sourceTime && header.sourceTime[1] == (unsigned int)(sourceTime >> 32);
+
+	VirtualTextureInfo info;
+	if (valid)
+	{
+		info.width = header.width;
+		info.height = header.height;
+		info.tileSize = header.tileSize;
+		info.border = header.border;
+		info.levels = header.levels;
+		info.format = (BlockFormat)header.format;
+
+		valid = isPowerOfTwo(info.tileSize) && info.width >= info.tileSize && info.height >= info.tileSize &&
+			info.width / info.tileSize < MAX_TILES_ACROSS && info.height / info.tileSize < MAX_TILES_ACROSS &&
+			info.levels > 0 && info.levels <= MAX_LEVELS && header.format <= BLOCK_BC5 && info.paddedTileSize() % 4 == 0;
+	}
+
+	// the file must hold every tile
+	if (valid)
+	{
+		file.seekg(0, ios::end);
+		valid = (unsigned long long)file.tellg() >= sizeof(header) + (unsigned long long)info.numTiles() * info.tileBytes();
+	}
+
+	if (!valid)
+	{
+		file.close();
+		file.clear();
+		return false;
+	}
+
+	info_ = info;
+	return true;
+}
@@ -0,0 +1,78 @@
+//  VirtualTextureFile.h - Images too large to keep in video memory, cooked into block compressed tiles read on demand
+#ifndef VIRTUAL_TEXTURE_FILE_H
+#define VIRTUAL_TEXTURE_FILE_H
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "MipBuilder.h"
+
+// A tile is named by one key: its mip level in the top 4 bits, then its row and column in 14 bits each
+inline unsigned int tileKey(int level, int x, int y) { return ((unsigned int)level << 28) | ((unsigned int)y << 14) | (unsigned int)x; }
+inline int tileLevel(unsigned int key) { return (int)(key >> 28); }
+inline int tileX(unsigned int key) { return (int)(key & 0x3FFF); }
+inline int tileY(unsigned int key) { return (int)((key >> 14) & 0x3FFF); }
+
+// The shape of a cooked image.  Every level is cut into tileSize x tileSize tiles, each stored with a border of
+// neighbouring pixels on every side, so a tile can be filtered on its own wherever it lands in the tile cache.  Levels
+// stop at the first one that is a single tile across or down, which is always kept resident
+struct VirtualTextureInfo {
+
+	int				width = 0;
+	int				height = 0;
+	int				tileSize = 0;
+	int				border = 0;
+	int				levels = 0;
+	BlockFormat		format = BLOCK_BC1;
+
+	int paddedTileSize() const { return tileSize + 2 * border; }
+	int tilesX(int level) const { int n = (width / tileSize) >> level; return n > 0 ? n : 1; }
+	int tilesY(int level) const { int n = (height / tileSize) >> level; return n > 0 ? n : 1; }
+	size_t tileBytes() const { return BlockCompressor::compressedSize(format, paddedTileSize(), paddedTileSize()); }
+
+	// tiles in the whole pyramid, and the position of a tile among them (level 0 first, each level in rows)
+	unsigned int numTiles() const;
+	unsigned int tileIndex(unsigned int key) const;
+};
+
+// Cooking reads the image, builds its mips with MipBuilder and block compresses each tile of each level in turn into
+// <image>.vtex.  The header records the source image's size and modification time, as TextureCooker's DDS files do, so
+// a changed image is cooked again when it's opened.  A cooked file whose image is missing is used as it is, so a huge
+// source needn't ship with it.
+//
+// Nothing here touches OpenGL.  readTile() can be called from any number of threads at once.
+class VirtualTextureFile {
+
+public:
+	static const int DEFAULT_TILE_SIZE = 128;
+	// wide enough for bilinear and a little anisotropic filtering, and keeps padded tiles a whole number of blocks
+	static const int DEFAULT_BORDER = 4;
+
+	static std::string cachePath(const std::string& imagePath);
+
+	// false if the image can't be decoded or its sides aren't powers of two of at least one tile
+	static bool cook(const std::string& imagePath, bool flipVertically, ImageContent content,
+		int tileSize = DEFAULT_TILE_SIZE, int border = DEFAULT_BORDER);
+
+	// opens the cooked image, cooking it first if there isn't an up to date one
+	bool open(const std::string& imagePath, bool flipVertically, ImageContent content);
+	void close();
+
+	bool isOpen() const { return info_.levels > 0; }
+	const VirtualTextureInfo& info() const { return info_; }
+
+	// reads a tile's blocks, info().tileBytes() of them.  False if the key is outside the pyramid or the read fails
+	bool readTile(unsigned int key, std::vector<unsigned char>& blocks);
+
+private:
+	VirtualTextureInfo	info_;
+	std::ifstream		file;
+	std::mutex			fileMutex;
+
+	bool read(const std::string& imagePath, bool flipVertically, ImageContent content);
+};
+
+#endif
@@ -28,6 +28,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
 
 	// glfw window creation
@@ -59,6 +60,7 @@ int main()
 	glfwSwapInterval(1);		// glfw enable swap interval to match screen v-sync
 	glEnable(GL_DEPTH_TEST);	//Enables depth testing
 	glEnable(GL_CULL_FACE);		//Enables face culling
+	glEnable(GL_FRAMEBUFFER_SRGB);	//Shaders work in linear light; writes to the window are encoded as sRGB
 	glFrontFace(GL_CCW);		//Specifies which winding order if front facing
 
 	////	Shaders - Textures - Models	////
@@ -86,7 +88,7 @@ int main()
 		timer.tick();
 
 		// render
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClearColor(0.01f, 0.01f, 0.01f, 1.0f);	// 0.1 once encoded as sRGB
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		glm::mat4 model = glm::mat4(1.0);
@@ -102,7 +104,7 @@ int main()
 		GLint lightDirectionLoc = glGetUniformLocation(perVertex, "lightDirection");
 		GLint lightDiffuseLoc = glGetUniformLocation(perVertex, "lightDiffuseColour");
 		glUniform4f(lightDirectionLoc, 1.0f, 1.0f, 0.5f, 0.0f);
-		glUniform4f(lightDiffuseLoc, 1.0f, 0.2f, 0.2f, 1.0f);
+		glUniform4f(lightDiffuseLoc, 1.0f, 0.2f, 0.2f, 1.0f);	// linear light
 
 		spaceship.draw(perVertex); //Render the model
 
@@ -29,6 +29,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
 
 	// glfw window creation
@@ -61,6 +62,7 @@ int main()
 	glfwSwapInterval(1);		// glfw enable swap interval to match screen v-sync
 	glEnable(GL_DEPTH_TEST);	//Enables depth testing
 	glEnable(GL_CULL_FACE);		//Enables face culling
+	glEnable(GL_FRAMEBUFFER_SRGB);	//Shaders work in linear light; writes to the window are encoded as sRGB
 	glFrontFace(GL_CCW);		//Specifies which winding order if front facing
 
 	////	Shaders - Textures - Models	////
@@ -90,7 +92,7 @@ int main()
 
 	//Light Data///////////////////////////////////////////////
 	// Lights
-	GLfloat light_ambient[] = { 0.1, 0.1, 0.1, 1.0 };	// Dim light 
+	GLfloat light_ambient[] = { 0.1, 0.1, 0.1, 1.0 };	// Dim light, in linear light
 	GLfloat light_diffuse[] = { 1.0, 1.0, 1.0, 1.0 };	// White main light 
 	GLfloat light_position[] = { 0.0, 3.0, 0.0, 1.0 };	// Point light (w=1.0)
 	GLfloat	attenuation[] = { 1.0, 0.10, 0.08 };
@@ -122,7 +124,7 @@ int main()
 		timer.tick();
 
 		// render
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClearColor(0.01f, 0.01f, 0.01f, 1.0f);	// 0.1 once encoded as sRGB
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		glm::mat4 sphereModel = glm::mat4(1.0);
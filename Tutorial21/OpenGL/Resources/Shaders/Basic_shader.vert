@@ -14,21 +14,34 @@ out vec2 TexCoord;
 out vec3 Normal; 
 out vec3 Vertex; 
 
-const int MAX_BONES = 150;
-uniform mat4 gBones[MAX_BONES];
+// Every character's skinning matrices for the frame, four RGBA32F texels each, filled by a BonePaletteBuffer.  This
+// character's start at paletteBase, so the number of bones isn't limited by the uniform space.  An instanced crowd's
+// palettes follow one another, paletteStride matrices apart, and each copy stands instanceOffset further along
+uniform samplerBuffer bonePalette;
+uniform int paletteBase;
+uniform int paletteStride;
+uniform vec3 instanceOffset;
+
+mat4 bone(int id)
+{
+	int texel = (paletteBase + gl_InstanceID * paletteStride + id) * 4;
+	return mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+		texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3));
+}
 
 void main()
 {
-    mat4 BoneTransform = gBones[BoneIDs[0]] * Weights[0];
-    BoneTransform += gBones[BoneIDs[1]] * Weights[1];
-    BoneTransform += gBones[BoneIDs[2]] * Weights[2];
-    BoneTransform += gBones[BoneIDs[3]] * Weights[3];
+    mat4 BoneTransform = bone(BoneIDs[0]) * Weights[0];
+    BoneTransform += bone(BoneIDs[1]) * Weights[1];
+    BoneTransform += bone(BoneIDs[2]) * Weights[2];
+    BoneTransform += bone(BoneIDs[3]) * Weights[3];
 
 	vec4 PosL = BoneTransform * vec4(vertexPos, 1.0);
 
 	TexCoord = texCoord;
 	Normal = vec3(BoneTransform * vec4(normal, 1.0));  // normal vector in eye coordinates
-	Vertex = vec3(model * vec4(vertexPos, 1.0)); // vertex in eye coordinates (map to vec3 since gl_Vertex is a vec4)
+	vec4 offset = vec4(instanceOffset * float(gl_InstanceID), 0.0);
+	Vertex = vec3(model * vec4(vertexPos, 1.0) + offset); // vertex in eye coordinates (map to vec3 since gl_Vertex is a vec4)
 
-	gl_Position = projection * view * model * PosL;
+	gl_Position = projection * view * (model * PosL + offset);
 }
\ No newline at end of file
@@ -21,7 +21,15 @@ Camera camera(camera_settings, glm::vec3(0.0, 30.0, 150.0));
 double lastX = camera_settings.screenWidth / 2.0f;
 double lastY = camera_settings.screenHeight / 2.0f;
 
-static float t;
+// set by the number keys: the dragon animation to cross-fade to next frame
+static int requestedAnimation = -1;
+
+// C toggles a row of dragons behind the first, all drawn by one instanced draw.  Each plays the first animation a
+// little behind the one before, from its own palette
+static bool showCrowd = false;
+static const unsigned int crowdSize = 8;
+static const float crowdSpacing = 60.0f;
+static const float crowdStagger = 0.2f;		// seconds between neighbours
 
 int main()
 {
@@ -31,6 +39,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
 
 	// glfw window creation
@@ -63,6 +72,7 @@ int main()
 	glfwSwapInterval(1);		// glfw enable swap interval to match screen v-sync
 	glEnable(GL_DEPTH_TEST);	//Enables depth testing
 	glEnable(GL_CULL_FACE);		//Enables face culling
+	glEnable(GL_FRAMEBUFFER_SRGB);	//Shaders work in linear light; writes to the window are encoded as sRGB
 	glFrontFace(GL_CCW);		//Specifies which winding order if front facing
 
 	////	Shaders - Textures - Models	////
@@ -84,11 +94,21 @@ int main()
 		getchar();
 		return 0;
 	}
-	const int numberOfBones = dragonModel.NumBones();
 
-	vector<glm::mat4> Transforms;
+	// the dragon's bone matrices are written straight into a texture buffer each frame, rather than set one uniform at
+	// a time.  Unit 15 is clear of the model's own textures
+	const GLuint paletteUnit = 15;
+	BonePaletteBuffer bonePalettes;
+
+	glUseProgram(basicShader);
+	glUniform1i(glGetUniformLocation(basicShader, "bonePalette"), paletteUnit);
+	glUniform1i(glGetUniformLocation(basicShader, "paletteStride"), dragonModel.NumBones());
+	GLint paletteBaseLocation = glGetUniformLocation(basicShader, "paletteBase");
+	GLint instanceOffsetLocation = glGetUniformLocation(basicShader, "instanceOffset");
+
+	float crowdTime = 0.0f;
+	float crowdTimes[crowdSize];
 
-	
 
 	// render loop
 	while (!glfwWindowShouldClose(window))
@@ -98,7 +118,7 @@ int main()
 		timer.tick();
 
 		// render
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClearColor(0.01f, 0.01f, 0.01f, 1.0f);	// 0.1 once encoded as sRGB
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		glm::mat4 model = glm::mat4(1.0);
@@ -113,25 +133,51 @@ int main()
 		glUniformMatrix4fv(glGetUniformLocation(basicShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 		glUniformMatrix4fv(glGetUniformLocation(basicShader, "model"), 1, GL_FALSE, glm::value_ptr(rotation * scale * model));
 
-		//Static time
+		if (requestedAnimation >= 0)
+		{
+			dragonModel.PlayAnimation(requestedAnimation, 0.3f);
+			requestedAnimation = -1;
+		}
+
+		bonePalettes.beginFrame();
+		GLint paletteBase = dragonModel.UpdateAnimation(timer.getDeltaTimeSeconds(), bonePalettes);
 
-		t += timer.getDeltaTimeSeconds();
-		dragonModel.BoneTransform(t, Transforms, 0);
-		
-		for (int i = 0; i < numberOfBones; i++)
+		// the crowd's palettes, one after another in the same region
+		GLint crowdBase = -1;
+		if (showCrowd)
 		{
-			stringstream name;
-			name << "gBones[" << i << "]";
-			glUniformMatrix4fv(glGetUniformLocation(basicShader, name.str().c_str()), 1, GL_FALSE, glm::value_ptr(Transforms[i]));
+			crowdTime += timer.getDeltaTimeSeconds();
+			for (unsigned int i = 0; i < crowdSize; i++)
+				crowdTimes[i] = crowdTime + i * crowdStagger;
+			crowdBase = dragonModel.BoneTransforms(crowdTimes, crowdSize, bonePalettes, 0);
 		}
+		bonePalettes.submit();
+
+		bonePalettes.bind(paletteUnit);
+		glUniform1i(paletteBaseLocation, paletteBase);
+		glUniform3f(instanceOffsetLocation, 0.0f, 0.0f, 0.0f);
 
 		dragonModel.Render(basicShader);
 
+		if (crowdBase >= 0)
+		{
+			glm::mat4 crowdPlacement = glm::translate(glm::mat4(1.0), glm::vec3(-crowdSpacing * (crowdSize - 1) / 2.0f, 0.0f, -150.0f));
+			glUniformMatrix4fv(glGetUniformLocation(basicShader, "model"), 1, GL_FALSE, glm::value_ptr(crowdPlacement * rotation * scale * model));
+			glUniform1i(paletteBaseLocation, crowdBase);
+			glUniform3f(instanceOffsetLocation, crowdSpacing, 0.0f, 0.0f);
+
+			dragonModel.Render(basicShader, crowdSize);
+		}
+		bonePalettes.endFrame();
+
 		// glfw: swap buffers and poll events
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
+	// the palette buffer's GL objects have to go while the context is still current
+	bonePalettes.release();
+
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	glfwTerminate();
 	return 0;
@@ -157,7 +203,12 @@ void processInput(GLFWwindow *window)
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+	// 1 to 9 pick the dragon's animation
+	if (action == GLFW_PRESS && key >= GLFW_KEY_1 && key <= GLFW_KEY_9)
+		requestedAnimation = key - GLFW_KEY_1;
 
+	if (action == GLFW_PRESS && key == GLFW_KEY_C)
+		showCrowd = !showCrowd;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes